@@ -0,0 +1,178 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <math.h>
+#include "batchroot.h"
+
+#define BATCH_ROOT_MAX_ITER  1000
+
+BatchRootFinder::BatchRootFinder() {
+  capacity_ = 0;
+  xl_ = xh_ = rts_ = dx_ = dxold_ = 0;
+  ff_ = df_ = xx_ = 0;
+  active_ = 0;
+  allocations_ = 0;
+}
+
+void BatchRootFinder::reserve(int numRoots) {
+  if (numRoots <= capacity_) {
+    return;
+  }
+  freeArrays();
+  capacity_ = numRoots * 2;
+  xl_ = new double[capacity_];
+  xh_ = new double[capacity_];
+  rts_ = new double[capacity_];
+  dx_ = new double[capacity_];
+  dxold_ = new double[capacity_];
+  ff_ = new double[capacity_];
+  df_ = new double[capacity_];
+  xx_ = new double[capacity_];
+  active_ = new int[capacity_];
+  allocations_ += 9;
+}
+
+// Total number of heap allocations, so callers can check they've stopped.
+int BatchRootFinder::getAllocations() {
+  return allocations_;
+}
+
+// Finds a root of each of numRoots functions in [x0, x1]. For each root, status
+// is set to 1 if it converged, 0 if it ran out of iterations and -1 if the
+// function has the same sign at both ends, like the return value of
+// newtonBisect. If it didn't converge, out is the best guess so far. If the
+// bracket was bad, out is x0 if the function is already negative there, since
+// the root is behind us, or x1 if it's positive.
+void BatchRootFinder::solve(batchRootFun fun, int numRoots, double x0,
+    double x1, void *params, double *out, int *status, double epsRel,
+    double epsAbs) {
+  reserve(numRoots);
+  int numActive = 0;
+  for (int x = 0; x < numRoots; x++) {
+    active_[numActive++] = x;
+    xx_[x] = x0;
+  }
+  fun(xx_, active_, numActive, params, xl_, df_);
+  for (int x = 0; x < numRoots; x++) {
+    xx_[x] = x1;
+  }
+  fun(xx_, active_, numActive, params, xh_, df_);
+
+  // xl_ and xh_ hold the function values at x0 and x1 until we've sorted out
+  // which end is which.
+  numActive = 0;
+  for (int x = 0; x < numRoots; x++) {
+    double fl = xl_[x];
+    double fh = xh_[x];
+    if (fl*fh > 0.) {
+      out[x] = (fl < 0. ? x0 : x1);
+      status[x] = -1;
+    } else if (fl == 0.) {
+      out[x] = x0;
+      status[x] = 1;
+    } else if (fh == 0.) {
+      out[x] = x1;
+      status[x] = 1;
+    } else {
+      if (fl < 0.) {
+        xl_[x] = x0;
+        xh_[x] = x1;
+      } else {
+        xh_[x] = x0;
+        xl_[x] = x1;
+      }
+      rts_[x] = 0.5*(xl_[x] + xh_[x]);
+      dxold_[x] = fabs(xh_[x] - xl_[x]);
+      dx_[x] = dxold_[x];
+      active_[numActive++] = x;
+    }
+  }
+  fun(rts_, active_, numActive, params, ff_, df_);
+
+  for (int ii = 0; ii <= BATCH_ROOT_MAX_ITER && numActive > 0; ii++) {
+    int numStillActive = 0;
+    for (int y = 0; y < numActive; y++) {
+      int x = active_[y];
+      double rts = rts_[x];
+      double xl = xl_[x];
+      double xh = xh_[x];
+      double ff = ff_[x];
+      double df = df_[x];
+      bool done = false;
+      if ( (((rts-xh)*df-ff)*((rts-xl)*df-ff) > 0.0) or
+           (fabs(2.0*ff) > fabs(dxold_[x]*df)) ) {
+        dxold_[x] = dx_[x];
+        dx_[x] = 0.5*(xh-xl);
+        rts = xl+dx_[x];
+        done = (xl == rts);
+      } else {
+        dxold_[x] = dx_[x];
+        dx_[x] = ff/df;
+        double temp = rts;
+        rts -= dx_[x];
+        done = (temp == rts);
+      }
+      rts_[x] = rts;
+      if (done || fabs(dx_[x]) < epsAbs + epsRel*fabs(rts)) {
+        out[x] = rts;
+        status[x] = 1;
+      } else {
+        active_[numStillActive++] = x;
+      }
+    }
+    numActive = numStillActive;
+
+    fun(rts_, active_, numActive, params, ff_, df_);
+    for (int y = 0; y < numActive; y++) {
+      int x = active_[y];
+      if (ff_[x] < 0.0) {
+        xl_[x] = rts_[x];
+      } else {
+        xh_[x] = rts_[x];
+      }
+    }
+  }
+
+  for (int y = 0; y < numActive; y++) {
+    int x = active_[y];
+    out[x] = rts_[x];
+    status[x] = 0;
+  }
+}
+
+void BatchRootFinder::freeArrays() {
+  if (capacity_ > 0) {
+    delete[] xl_;
+    delete[] xh_;
+    delete[] rts_;
+    delete[] dx_;
+    delete[] dxold_;
+    delete[] ff_;
+    delete[] df_;
+    delete[] xx_;
+    delete[] active_;
+    capacity_ = 0;
+  }
+}
+
+BatchRootFinder::~BatchRootFinder() {
+  freeArrays();
+}
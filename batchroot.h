@@ -0,0 +1,55 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef BATCH_ROOT_H
+#define BATCH_ROOT_H
+
+// Evaluates the function and its derivative at xx[i] into ff[i] and df[i], for
+// each i in indices.
+typedef void (*batchRootFun)(double *xx, int *indices, int numIndices,
+                             void *params, double *ff, double *df);
+
+// Runs the same safe Newton's method as newtonBisect on many functions at once,
+// all bracketed by the same interval. The roots are batched, not vectorized:
+// each iteration evaluates every root that hasn't converged yet in a single
+// call, so the caller can set up work they share once per solve instead of once
+// per evaluation, but each root is still stepped on its own. Each root follows
+// exactly the steps newtonBisect would take for it on its own.
+class BatchRootFinder {
+  int capacity_;
+  double *xl_, *xh_, *rts_, *dx_, *dxold_;
+  double *ff_, *df_, *xx_;
+  int *active_;
+  int allocations_;
+
+  public:
+    BatchRootFinder();
+    ~BatchRootFinder();
+    int getAllocations();
+    void solve(batchRootFun fun, int numRoots, double x0, double x1,
+               void *params, double *out, int *status, double epsRel,
+               double epsAbs);
+  private:
+    void reserve(int numRoots);
+    void freeArrays();
+};
+
+#endif
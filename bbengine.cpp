@@ -25,8 +25,8 @@
 #include <algorithm>
 #include <pthread.h>
 #include <limits.h>
+#include <stdlib.h>
 #include <platformstl/performance/performance_counter.hpp>
-#include <platformstl/synch/sleep_functions.h>
 #include "bbconst.h"
 #include "bblua.h"
 #include "printhandler.h"
@@ -36,8 +36,10 @@
 #include "bbengine.h"
 
 BerryBotsEngine::BerryBotsEngine(PrintHandler *printHandler,
-    FileManager *fileManager, const char *replayTemplateDir) {
-  stage_ = new Stage(DEFAULT_STAGE_WIDTH, DEFAULT_STAGE_HEIGHT);
+    FileManager *fileManager, const char *replayTemplateDir,
+    unsigned int randomSeed) {
+  random_ = new RandomGenerator(randomSeed);
+  stage_ = new Stage(DEFAULT_STAGE_WIDTH, DEFAULT_STAGE_HEIGHT, random_);
   consoleHandler_ = new ConsoleEventHandler(this);
   stage_->addEventHandler(consoleHandler_);
   printHandler_ = printHandler;
@@ -76,16 +78,16 @@ BerryBotsEngine::BerryBotsEngine(PrintHandler *printHandler,
   stageGfx_ = 0;
   teamVision_ = 0;
   sensorHandler_ = 0;
+  stageEventEncoder_ = new StageEventEncoder();
 
-  timerSettings_ = new TickTimerSettings;
-  timerSettings_->L = 0;
-  timerSettings_->timerTick = 0;
-  timerSettings_->timerExpiration = LONG_MAX;
-  timerSettings_->enabled = true;
-  pthread_create(&timerThread_, 0, BerryBotsEngine::timer,
-                 (void*) timerSettings_);
-  pthread_detach(timerThread_);
-  // TODO: how to handle failure to create thread
+  watchdogTimer_ = Watchdog::getInstance()->newTimer();
+  teamPool_ = 0;
+  teamPoolTimers_ = 0;
+  statePool_ = 0;
+  commandBuffers_ = 0;
+  teamRunFatal_ = 0;
+  laserReservations_ = torpedoReservations_ = 0;
+  bufferingCommands_ = false;
 
   replayHandler_ = 0;
   if (replayTemplateDir == 0) {
@@ -95,11 +97,22 @@ BerryBotsEngine::BerryBotsEngine(PrintHandler *printHandler,
     strcpy(replayTemplateDir_, replayTemplateDir);
   }
   replayBuilder_ = new ReplayBuilder(replayTemplateDir_);
+  replayBuilder_->spillToDisk();
   deleteReplayBuilder_ = true;
 }
 
 BerryBotsEngine::~BerryBotsEngine() {
-  timerSettings_->enabled = false;
+  Watchdog::getInstance()->deleteTimer(watchdogTimer_);
+  setTeamThreads(1);
+  if (commandBuffers_ != 0) {
+    for (int x = 0; x < numTeams_; x++) {
+      delete commandBuffers_[x];
+    }
+    delete[] commandBuffers_;
+    delete[] teamRunFatal_;
+    delete[] laserReservations_;
+    delete[] torpedoReservations_;
+  }
   if (stagesDir_ != 0) {
     delete stagesDir_;
   }
@@ -154,6 +167,14 @@ BerryBotsEngine::~BerryBotsEngine() {
     for (int y = 0; y < team->numTexts; y++) {
       delete team->gfxTexts[y];
     }
+    if (team->worldView.enemyShips.ships != 0) {
+      delete[] team->worldView.enemyShips.ships;
+    }
+    if (team->shipViews != 0) {
+      delete[] team->shipViews;
+    }
+    releaseStageEvents(team->stageEvents);
+    delete team->stageEvents;
     delete team;
   }
   delete teams_;
@@ -174,9 +195,11 @@ BerryBotsEngine::~BerryBotsEngine() {
     delete teamVision_;
   }
   delete stage_;
+  delete random_;
   if (sensorHandler_ != 0) {
     delete sensorHandler_;
   }
+  delete stageEventEncoder_;
   if (deleteReplayBuilder_) {
     delete replayBuilder_;
   }
@@ -223,6 +246,45 @@ int BerryBotsEngine::getTeamSize() {
   return teamSize_;
 }
 
+// The seed the engine was constructed with. Running the same stage and ships
+// with it again repeats the match.
+unsigned int BerryBotsEngine::getRandomSeed() {
+  return random_->getSeed();
+}
+
+// With more than one thread, the teams' run() functions are called in
+// parallel each tick. Anything they do that touches shared state (firing,
+// printing, renaming) is buffered and applied in team order once they're all
+// done, so the results don't depend on thread timing.
+void BerryBotsEngine::setTeamThreads(int numThreads) {
+  if (teamPool_ != 0) {
+    for (int x = 0; x < teamPool_->getNumThreads(); x++) {
+      Watchdog::getInstance()->deleteTimer(teamPoolTimers_[x]);
+    }
+    delete[] teamPoolTimers_;
+    delete teamPool_;
+    teamPool_ = 0;
+    teamPoolTimers_ = 0;
+  }
+  if (numThreads > 1) {
+    teamPool_ = new WorkerPool(numThreads);
+    teamPoolTimers_ = new WatchdogTimer*[numThreads];
+    for (int x = 0; x < numThreads; x++) {
+      teamPoolTimers_[x] = Watchdog::getInstance()->newTimer();
+    }
+  }
+}
+
+int BerryBotsEngine::getTeamThreads() {
+  return (teamPool_ == 0) ? 1 : teamPool_->getNumThreads();
+}
+
+// Stage and ship Lua states come from this pool, when set, instead of being
+// built from scratch for each match. The pool must outlive the engine.
+void BerryBotsEngine::setStatePool(LuaStatePool *statePool) {
+  statePool_ = statePool;
+}
+
 bool BerryBotsEngine::isStageConfigureComplete() {
   return stageConfigureComplete_;
 }
@@ -432,14 +494,10 @@ Team* BerryBotsEngine::getTeam(int teamIndex) {
   return teams_[teamIndex];
 }
 
+// Each ship state knows its own team once the team is initialized, so this is
+// safe to call from any binding, even with lots of teams.
 Team* BerryBotsEngine::getTeam(lua_State *L) {
-  for (int x = 0; x < numInitializedTeams_; x++) {
-    Team *team = teams_[x];
-    if (team->state == L) {
-      return team;
-    }
-  }
-  return 0;
+  return (Team *) lua_getowner(L);
 }
 
 Team** BerryBotsEngine::getRankedTeams() {
@@ -482,17 +540,20 @@ static int traceback(lua_State *L) {
 
 int BerryBotsEngine::callUserLuaCode(lua_State *L, int nargs,
     const char *errorMsg, int callStyle) throw (EngineException*) {
+  return callUserLuaCode(L, nargs, errorMsg, callStyle, watchdogTimer_);
+}
+
+int BerryBotsEngine::callUserLuaCode(lua_State *L, int nargs,
+    const char *errorMsg, int callStyle, WatchdogTimer *timer)
+    throw (EngineException*) {
   int base = lua_gettop(L) - nargs;
   lua_pushcfunction(L, traceback);
   lua_insert(L, base);
 
-  // TODO: I'm not completely convinced we're safe without a mutex here. Do
-  //       more tests and maybe add one.
-  timerSettings_->timerExpiration = timerSettings_->timerTick + 2;
-  timerSettings_->L = L;
+  Watchdog *watchdog = Watchdog::getInstance();
+  watchdog->arm(timer, L);
   int pcallValue = lua_pcall(L, nargs, 0, base);
-  timerSettings_->L = 0;
-  timerSettings_->timerExpiration = LONG_MAX;
+  watchdog->disarm(timer);
 
   lua_remove(L, base);
 
@@ -509,20 +570,28 @@ int BerryBotsEngine::callUserLuaCode(lua_State *L, int nargs,
   return pcallValue;
 }
 
-void *BerryBotsEngine::timer(void *vargs) {
-  TickTimerSettings *settings = (TickTimerSettings *) vargs;
-  while (settings->enabled) {
-    platformstl::micro_sleep(PCALL_TIME_LIMIT);
-    if (settings->timerExpiration <= ++(settings->timerTick)) {
-      if (settings->L != 0) {
-        lua_State *killState = settings->L;
-        settings->L = 0;
-        lua_sethook(killState, killHook, LUA_MASKCOUNT, 1);
-      }
+// Sets up a new stage or ship Lua state in dir, loads the program in filename
+// and leaves it on top of the stack, returning the load result. A state from
+// the pool is seeded the same way as a new one, so it makes no difference to
+// the match which one we get.
+int BerryBotsEngine::initUserState(lua_State **state, int type,
+    const char *dir, const char *filename, const char *cacheDir) {
+  int randomSeed = random_->next();
+  int loadResult;
+  if (statePool_ == 0) {
+    if (type == POOL_STAGE_STATE) {
+      initStageState(state, dir, randomSeed);
+    } else {
+      initShipState(state, dir, randomSeed);
     }
+    loadResult = fileManager_->loadLuaFile(*state, filename, cacheDir);
+  } else {
+    loadResult =
+        statePool_->acquireState(type, dir, filename, cacheDir, state);
+    luaSrand(*state, randomSeed);
   }
-  delete settings;
-  return 0;
+  lua_setprinter(*state, this);
+  return loadResult;
 }
 
 // Loads the stage in the file stageName, which may include a relative path,
@@ -552,10 +621,8 @@ void BerryBotsEngine::initStage(const char *stagesBaseDir,
     delete pse;
     throw eie;
   }
-  initStageState(&stageState_, stagesDir_);
-  lua_setprinter(stageState_, this);
-
-  if (luaL_loadfile(stageState_, stageFilename_)) {
+  if (initUserState(&stageState_, POOL_STAGE_STATE, stagesDir_,
+                    stageFilename_, cacheDir)) {
     throwForLuaError(stageState_, "Cannot load stage file: %s");
   }
   callUserLuaCode(stageState_, 0, "Cannot load stage file", PCALL_STAGE);
@@ -692,8 +759,8 @@ void BerryBotsEngine::initShips(const char *shipsBaseDir, char **teamNames,
       delete pse;
       throw eie;
     }
-    initShipState(&teamState, shipDir);
-    lua_setprinter(teamState, this);
+    int loadResult = initUserState(
+        &teamState, POOL_SHIP_STATE, shipDir, shipFilename, cacheDir);
 
     Team *team = new Team;
     team->index = x;
@@ -703,6 +770,7 @@ void BerryBotsEngine::initShips(const char *shipsBaseDir, char **teamNames,
     team->gfxEnabled = false;
     team->tooManyRectangles = team->tooManyLines = false;
     team->tooManyCircles = team->tooManyTexts = false;
+    team->userGfxOverflows = 0;
     if (printHandler_ != 0) {
       printHandler_->registerTeam(team, filename);
     }
@@ -710,7 +778,7 @@ void BerryBotsEngine::initShips(const char *shipsBaseDir, char **teamNames,
     int numStateShips = (stageShip ? 1 : teamSize_);
     Ship **stateShips = new Ship*[numStateShips];
     bool disabled;
-    if (luaL_loadfile(teamState, shipFilename)) {
+    if (loadResult != 0) {
       printLuaErrorToShipConsole(teamState, "Error loading file: %s");
       disabled = true;
       team->ownedByLua = false;
@@ -731,7 +799,12 @@ void BerryBotsEngine::initShips(const char *shipsBaseDir, char **teamNames,
 
     team->numShips = numStateShips;
     team->shipsAlive = 0;
-    team->stageEventRef = 0;
+    team->stageEvents = new EventArena(sizeof(StageEvent *));
+    team->enemyShipsRef = 0;
+    team->worldView.enemyShips.numShips = 0;
+    team->worldView.enemyShips.ships = 0;
+    team->shipViews = (disabled ? 0 : new ShipView[numStateShips]);
+    team->viewsRequested = false;
     for (int y = 0; y < CPU_TIME_TICKS; y++) {
       team->cpuTime[y] = 0;
     }
@@ -813,6 +886,8 @@ void BerryBotsEngine::initShips(const char *shipsBaseDir, char **teamNames,
       properties->thrusterG = properties->thrusterB = 0;
       properties->thrusterR = 255;
       properties->engine = this;
+      properties->teamName = team->name;
+      properties->view = (disabled ? 0 : &(team->shipViews[y]));
   
       strncpy(properties->name, defaultShipName, defaultNameLength);
       properties->name[defaultNameLength] = '\0';
@@ -821,6 +896,7 @@ void BerryBotsEngine::initShips(const char *shipsBaseDir, char **teamNames,
     delete defaultShipName;
 
     teams_[x] = team;
+    lua_setowner(teamState, team);
     numInitializedTeams_++;
     for (int y = 0; y < numStateShips; y++) {
       Ship *ship = stateShips[y];
@@ -832,7 +908,8 @@ void BerryBotsEngine::initShips(const char *shipsBaseDir, char **teamNames,
     }
 
     if (!disabled) {
-      worlds_[x] = pushWorld(teamState, stage_, numShips_, teamSize_);
+      worlds_[x] = pushWorld(teamState, stage_, numShips_, teamSize_,
+                             &(team->worldView));
       worlds_[x]->engine = this;
       shipGfxs_[x] = pushShipGfx(teamState);
       shipGfxs_[x]->team = team;
@@ -879,7 +956,7 @@ void BerryBotsEngine::initShips(const char *shipsBaseDir, char **teamNames,
   pushCopyOfShips(stageState_, ships_, stageShips_, numShips_);
   stage_->setTeamsAndShips(teams_, numTeams_, stageShips_, numShips_);
   if (strcmp(luaL_typename(stageState_, -2), "nil") != 0) {
-    stageWorld_ = pushWorld(stageState_, stage_, numShips_, teamSize_);
+    stageWorld_ = pushWorld(stageState_, stage_, numShips_, teamSize_, 0);
     stageWorld_->engine = this;
     Admin *admin = pushAdmin(stageState_);
     admin->engine = this;
@@ -965,10 +1042,76 @@ void BerryBotsEngine::stagePrint(const char *text) {
 }
 
 void BerryBotsEngine::shipPrint(lua_State *L, const char *text) {
+  Team *team = getTeam(L);
+  if (bufferingCommands_ && team != 0) {
+    commandBuffers_[team->index]->addText(COMMAND_PRINT, 0, text);
+    return;
+  }
   if (printHandler_ != 0) {
     printHandler_->shipPrint(L, text);
   }
-  replayBuilder_->addLogEntry(this->getTeam(L), gameTime_, text);
+  replayBuilder_->addLogEntry(team, gameTime_, text);
+}
+
+void BerryBotsEngine::shipError(lua_State *L, const char *text) {
+  Team *team = getTeam(L);
+  if (bufferingCommands_ && team != 0) {
+    commandBuffers_[team->index]->addText(COMMAND_PRINT_ERROR, 0, text);
+    return;
+  }
+  if (printHandler_ != 0) {
+    printHandler_->shipError(L, text);
+  }
+  replayBuilder_->addLogEntry(team, gameTime_, text);
+}
+
+bool BerryBotsEngine::fireLaser(Ship *ship, double heading) {
+  if (!bufferingCommands_) {
+    return stage_->fireLaser(ship, heading, gameTime_);
+  } else if (!stage_->canFireLaser(ship)
+             || laserReservations_[ship->teamIndex] == 0) {
+    return false;
+  } else {
+    if (stage_->prepareLaser(ship, heading, true)) {
+      laserReservations_[ship->teamIndex]--;
+      commandBuffers_[ship->teamIndex]->addFireLaser(ship, heading);
+    }
+    return true;
+  }
+}
+
+bool BerryBotsEngine::fireTorpedo(
+    Ship *ship, double heading, double distance) {
+  if (!bufferingCommands_) {
+    return stage_->fireTorpedo(ship, heading, distance, gameTime_);
+  } else if (!stage_->canFireTorpedo(ship)
+             || torpedoReservations_[ship->teamIndex] == 0) {
+    return false;
+  } else {
+    stage_->prepareTorpedo(ship);
+    torpedoReservations_[ship->teamIndex]--;
+    commandBuffers_[ship->teamIndex]->addFireTorpedo(ship, heading, distance);
+    return true;
+  }
+}
+
+void BerryBotsEngine::setShipName(Ship *ship, const char *name) {
+  if (bufferingCommands_) {
+    commandBuffers_[ship->teamIndex]->addText(
+        COMMAND_SET_SHIP_NAME, ship, name);
+  } else {
+    strncpy(ship->properties->name, name, MAX_NAME_LENGTH);
+    ship->properties->name[MAX_NAME_LENGTH] = '\0';
+  }
+}
+
+void BerryBotsEngine::setTeamName(Team *team, const char *name) {
+  if (bufferingCommands_) {
+    commandBuffers_[team->index]->addText(COMMAND_SET_TEAM_NAME, 0, name);
+  } else {
+    strncpy(team->name, name, MAX_NAME_LENGTH);
+    team->name[MAX_NAME_LENGTH] = '\0';
+  }
 }
 
 void BerryBotsEngine::processTick() throw (EngineException*) {
@@ -979,30 +1122,28 @@ void BerryBotsEngine::processTick() throw (EngineException*) {
   stage_->clearStaleUserGfxs(gameTime_);
   copyShips(oldShips_, prevShips_, numShips_);
   copyShips(ships_, oldShips_, numShips_);
-  for (int x = 0; x < numTeams_; x++) {
-    Team *team = teams_[x];
-    if (team->shipsAlive > 0 && !team->disabled) {
-      worlds_[x]->time = gameTime_;
-      for (int y = 0; y < team->numShips; y++) {
-        int shipIndex = y + team->firstShipIndex;
-        Ship *ship = ships_[shipIndex];
-        ship->thrusterForce = 0;
-        ship->laserGunHeat = std::max(0, ship->laserGunHeat - 1);
-        ship->torpedoGunHeat = std::max(0, ship->torpedoGunHeat - 1);
-        ship->power = std::min(DEFAULT_POWER, ship->power+POWER_REGEN);
-        ship->shields *= SHIELDS_DECAY;
+  if (teamPool_ != 0) {
+    processTeamRunsInParallel();
+  } else {
+    for (int x = 0; x < numTeams_; x++) {
+      Team *team = teams_[x];
+      if (team->shipsAlive > 0 && !team->disabled) {
+        prepareTeamRun(team);
+        lua_getglobal(team->state, "run");
+        pushVisibleEnemyShips(team, teamVision_[x], oldShips_, numShips_);
+        Sensors *sensors = pushSensors(team, sensorHandler_, shipProperties_);
+        team->counter.start();
+        int r = callUserLuaCode(team->state, 2,
+            "Error calling ship function: 'run'", PCALL_SHIP);
+        monitorCpuTimer(team, (r != 0 && lua_gethookcount(team->state) > 0));
+        cleanupSensorsTables(team->state, sensors);
+        releaseStageEvents(team->stageEvents);
+        lua_settop(team->state, 0);
+      } else {
+        // Nobody will read these, so don't let them pile up.
+        sensorHandler_->clearTeamEvents(x);
+        releaseStageEvents(team->stageEvents);
       }
-
-      lua_getglobal(team->state, "run");
-      pushVisibleEnemyShips(
-          team->state, teamVision_[x], x, oldShips_, numShips_);
-      Sensors *sensors = pushSensors(team, sensorHandler_, shipProperties_);
-      team->counter.start();
-      int r = callUserLuaCode(team->state, 2,
-                              "Error calling ship function: 'run'", PCALL_SHIP);
-      monitorCpuTimer(team, (r != 0 && lua_gethookcount(team->state) > 0));
-      cleanupSensorsTables(team->state, sensors);
-      lua_settop(team->state, 0);
     }
   }
   stage_->moveAndCheckCollisions(oldShips_, ships_, numShips_, gameTime_);
@@ -1013,9 +1154,222 @@ void BerryBotsEngine::processTick() throw (EngineException*) {
     this->setRoundOver(false);
     this->setGameOver(false);
     processStageRun();
+  } else {
+    sensorHandler_->clearStageEvents();
+  }
+}
+
+void BerryBotsEngine::prepareTeamRun(Team *team) {
+  worlds_[team->index]->time = gameTime_;
+  for (int y = 0; y < team->numShips; y++) {
+    int shipIndex = y + team->firstShipIndex;
+    Ship *ship = ships_[shipIndex];
+    ship->thrusterForce = 0;
+    ship->laserGunHeat = std::max(0, ship->laserGunHeat - 1);
+    ship->torpedoGunHeat = std::max(0, ship->torpedoGunHeat - 1);
+    ship->power = std::min(DEFAULT_POWER, ship->power+POWER_REGEN);
+    ship->shields *= SHIELDS_DECAY;
+  }
+  if (team->viewsRequested) {
+    updateShipViews(team);
+    updateEnemyShipViews(team);
+  }
+}
+
+// Most ship programs never ask for a view, so we only keep a team's views up
+// to date once it has. The first request fills them in on the spot, and from
+// then on they're refreshed at the start of each tick, in prepareTeamRun.
+// Called from the team's own ship program, so it may be on a worker thread,
+// but it only writes the team's own views.
+void BerryBotsEngine::requestViews(Team *team) {
+  if (!team->viewsRequested) {
+    team->viewsRequested = true;
+    updateShipViews(team);
+    if (shipInitComplete_) {
+      updateEnemyShipViews(team);
+    }
   }
 }
 
+// Copies the game time and the team's own ships into the views its ship
+// program reads through the FFI.
+void BerryBotsEngine::updateShipViews(Team *team) {
+  team->worldView.time = gameTime_;
+  for (int y = 0; y < team->numShips; y++) {
+    Ship *ship = ships_[team->firstShipIndex + y];
+    ShipView *view = &(team->shipViews[y]);
+    view->index = ship->index;
+    view->teamIndex = ship->teamIndex;
+    view->thrusterAngle = ship->thrusterAngle;
+    view->thrusterForce = ship->thrusterForce;
+    view->x = ship->x;
+    view->y = ship->y;
+    view->heading = ship->heading;
+    view->speed = ship->speed;
+    view->momentum = ship->momentum;
+    view->energy = ship->energy;
+    view->power = ship->power;
+    view->shields = ship->shields;
+    view->torpedoAmmo = ship->torpedoAmmo;
+    view->laserGunHeat = ship->laserGunHeat;
+    view->torpedoGunHeat = ship->torpedoGunHeat;
+    view->hitWall = ship->hitWall;
+    view->hitShip = ship->hitShip;
+    view->alive = ship->alive;
+    view->laserEnabled = ship->laserEnabled;
+    view->torpedoEnabled = ship->torpedoEnabled;
+    view->thrusterEnabled = ship->thrusterEnabled;
+    view->energyEnabled = ship->energyEnabled;
+    view->powerEnabled = ship->powerEnabled;
+    view->shieldsEnabled = ship->shieldsEnabled;
+    view->showName = ship->showName;
+    view->newColors = ship->newColors;
+    view->kills = ship->kills;
+    view->friendlyKills = ship->friendlyKills;
+    view->damage = ship->damage;
+    view->friendlyDamage = ship->friendlyDamage;
+    view->shieldedDamage = ship->shieldedDamage;
+  }
+}
+
+// Copies the enemy ships the team could see at the start of the tick, the same
+// ones pushVisibleEnemyShips hands to run, into the team's WorldView.
+void BerryBotsEngine::updateEnemyShipViews(Team *team) {
+  EnemyShipsView *enemyShipsView = &(team->worldView.enemyShips);
+  if (enemyShipsView->ships == 0) {
+    enemyShipsView->ships = new EnemyShipView[numShips_];
+  }
+  enemyShipsView->numShips = 0;
+  bool *teamVision = teamVision_[team->index];
+  for (int x = 0; x < numShips_; x++) {
+    Ship *ship = oldShips_[x];
+    if (ship->teamIndex != team->index && teamVision[x]) {
+      EnemyShipView *shipView =
+          &(enemyShipsView->ships[enemyShipsView->numShips++]);
+      shipView->index = ship->index;
+      shipView->teamIndex = ship->teamIndex;
+      shipView->x = ship->x;
+      shipView->y = ship->y;
+      shipView->heading = ship->heading;
+      shipView->speed = ship->speed;
+      shipView->momentum = ship->momentum;
+      shipView->energy = ship->energy;
+      shipView->power = ship->power;
+      shipView->shields = ship->shields;
+      shipView->torpedoAmmo = ship->torpedoAmmo;
+      shipView->isStageShip = ship->properties->stageShip;
+      strcpy(shipView->name, ship->properties->name);
+      strcpy(shipView->teamName, ship->properties->teamName);
+    }
+  }
+}
+
+void BerryBotsEngine::runTeamJob(void *context, int teamIndex,
+                                 int workerIndex) {
+  ((BerryBotsEngine *) context)->runTeam(teamIndex, workerIndex);
+}
+
+// Each team only touches its own Lua state, ships, world and sensor events
+// here, so teams can run side by side. Whatever would reach past that goes
+// through the team's command buffer instead.
+void BerryBotsEngine::runTeam(int teamIndex, int workerIndex) {
+  Team *team = teams_[teamIndex];
+  teamRunFatal_[teamIndex] = false;
+  if (team->shipsAlive > 0 && !team->disabled) {
+    prepareTeamRun(team);
+    lua_getglobal(team->state, "run");
+    pushVisibleEnemyShips(team, teamVision_[teamIndex], oldShips_, numShips_);
+    Sensors *sensors = pushSensors(team, sensorHandler_, shipProperties_);
+    team->counter.start();
+    int r = callUserLuaCode(team->state, 2,
+        "Error calling ship function: 'run'", PCALL_SHIP,
+        teamPoolTimers_[workerIndex]);
+    recordCpuTime(team);
+    teamRunFatal_[teamIndex] =
+        (r != 0 && lua_gethookcount(team->state) > 0);
+    cleanupSensorsTables(team->state, sensors);
+    lua_settop(team->state, 0);
+  } else {
+    sensorHandler_->clearTeamEvents(teamIndex);
+  }
+}
+
+void BerryBotsEngine::processTeamRunsInParallel() {
+  if (commandBuffers_ == 0) {
+    commandBuffers_ = new CommandBuffer*[numTeams_];
+    for (int x = 0; x < numTeams_; x++) {
+      commandBuffers_[x] = new CommandBuffer();
+    }
+    teamRunFatal_ = new bool[numTeams_];
+    laserReservations_ = new int[numTeams_];
+    torpedoReservations_ = new int[numTeams_];
+  }
+
+  // The stage's laser and torpedo counts don't change until the commands are
+  // applied, so set aside room for them up front, in team order. Gun heat
+  // keeps each ship to one of each per tick. That way a shot the ship was
+  // charged for is never dropped for being over the limit.
+  int freeLasers = MAX_LASERS - stage_->getLaserCount();
+  int freeTorpedos = MAX_TORPEDOS - stage_->getTorpedoCount();
+  for (int x = 0; x < numTeams_; x++) {
+    Team *team = teams_[x];
+    int shipsAlive = (team->disabled ? 0 : team->shipsAlive);
+    laserReservations_[x] = std::min(freeLasers, shipsAlive);
+    torpedoReservations_[x] = std::min(freeTorpedos, shipsAlive);
+    freeLasers -= laserReservations_[x];
+    freeTorpedos -= torpedoReservations_[x];
+  }
+
+  bufferingCommands_ = true;
+  stage_->setDeferUserGfxOverflows(true);
+  teamPool_->run(runTeamJob, this, numTeams_);
+  stage_->setDeferUserGfxOverflows(false);
+  bufferingCommands_ = false;
+
+  for (int x = 0; x < numTeams_; x++) {
+    Team *team = teams_[x];
+    applyCommands(team);
+    // Teams may share stage events, so this isn't safe on the workers. Teams
+    // that didn't run won't read theirs either.
+    releaseStageEvents(team->stageEvents);
+    if (teamRunFatal_[x]) {
+      disableTeam(team);
+    }
+  }
+}
+
+void BerryBotsEngine::applyCommands(Team *team) {
+  stage_->reportUserGfxOverflows(team);
+  CommandBuffer *commandBuffer = commandBuffers_[team->index];
+  TeamCommand *commands = commandBuffer->getCommands();
+  int numCommands = commandBuffer->getNumCommands();
+  for (int x = 0; x < numCommands; x++) {
+    TeamCommand *command = &(commands[x]);
+    switch (command->type) {
+      case COMMAND_FIRE_LASER:
+        stage_->addLaser(command->ship, command->heading, gameTime_);
+        break;
+      case COMMAND_FIRE_TORPEDO:
+        stage_->addTorpedo(command->ship, command->heading, command->distance,
+                           gameTime_);
+        break;
+      case COMMAND_PRINT:
+        shipPrint(team->state, command->text);
+        break;
+      case COMMAND_PRINT_ERROR:
+        shipError(team->state, command->text);
+        break;
+      case COMMAND_SET_SHIP_NAME:
+        setShipName(command->ship, command->text);
+        break;
+      case COMMAND_SET_TEAM_NAME:
+        setTeamName(team, command->text);
+        break;
+    }
+  }
+  commandBuffer->clear();
+}
+
 void BerryBotsEngine::processStageRun() throw (EngineException*) {
   copyShips(ships_, stageShips_, numShips_);
   if (stageWorld_ != 0) {
@@ -1069,19 +1423,29 @@ void BerryBotsEngine::processGameOver() {
 }
 
 void BerryBotsEngine::monitorCpuTimer(Team *team, bool fatal) {
-  unsigned int cpuTimeSlot = team->totalCpuTicks % CPU_TIME_TICKS;
+  recordCpuTime(team);
+  if (fatal) {
+    disableTeam(team);
+  }
+}
+
+// Only touches the team's own fields, so it's safe to call from a team's
+// worker thread.
+void BerryBotsEngine::recordCpuTime(Team *team) {
   team->counter.stop();
+  unsigned int cpuTimeSlot = team->totalCpuTicks % CPU_TIME_TICKS;
   team->totalCpuTime +=
   (team->cpuTime[cpuTimeSlot] = team->counter.get_microseconds());
   team->totalCpuTicks++;
+}
 
-  if (fatal) {
-    team->disabled = true;
-    for (int x = 0; x < team->numShips; x++) {
-      Ship *ship = ships_[x + team->firstShipIndex];
-      destroyShip(ship);
-      ship->properties->disabled = true;
-    }
+// Destroys the team's ships, so this has to run on the main engine thread.
+void BerryBotsEngine::disableTeam(Team *team) {
+  team->disabled = true;
+  for (int x = 0; x < team->numShips; x++) {
+    Ship *ship = ships_[x + team->firstShipIndex];
+    destroyShip(ship);
+    ship->properties->disabled = true;
   }
 }
 
@@ -1152,6 +1516,10 @@ ReplayBuilder* BerryBotsEngine::getReplayBuilder() {
   return replayBuilder_;
 }
 
+StageEventEncoder* BerryBotsEngine::getStageEventEncoder() {
+  return stageEventEncoder_;
+}
+
 // Note: We don't have to log stage errors to the output console because they
 //       are considered fatal. We throw exceptions from the engine and the
 //       GUI or CLI displays them appropriately.
@@ -1159,17 +1527,12 @@ void BerryBotsEngine::printLuaErrorToShipConsole(lua_State *L,
                                                  const char *formatString) {
   if (printHandler_ != 0) {
     char *errorMessage = formatLuaError(L, formatString);
-    if (printHandler_ != 0) {
-      printHandler_->shipError(L, errorMessage);
-    }
-    replayBuilder_->addLogEntry(this->getTeam(L), gameTime_, errorMessage);
+    shipError(L, errorMessage);
     delete errorMessage;
   }
-  for (int x = 0; x < numInitializedTeams_; x++) {
-    Team *team = teams_[x];
-    if (team->state == L) {
-      team->errored = true;
-    }
+  Team *team = getTeam(L);
+  if (team != 0) {
+    team->errored = true;
   }
 }
 
@@ -31,6 +31,12 @@
 #include "sensorhandler.h"
 #include "replaybuilder.h"
 #include "printhandler.h"
+#include "randomgen.h"
+#include "watchdog.h"
+#include "workerpool.h"
+#include "commandbuffer.h"
+#include "luastatepool.h"
+#include "stageevents.h"
 
 #define PCALL_STAGE     1
 #define PCALL_SHIP      2
@@ -58,17 +64,11 @@ class EngineException : public std::exception {
     virtual const char* what() const throw();
 };
 
-typedef struct {
-  lua_State *L;
-  volatile unsigned long timerTick;
-  volatile unsigned long timerExpiration;
-  volatile bool enabled;
-} TickTimerSettings;
-
 class ConsoleEventHandler;
 
 class BerryBotsEngine {
   Stage *stage_;
+  RandomGenerator *random_;
   PrintHandler *printHandler_;
   FileManager *fileManager_;
   lua_State *stageState_;
@@ -94,11 +94,19 @@ class BerryBotsEngine {
   ShipGfx **shipGfxs_;
   StageGfx *stageGfx_;
   bool** teamVision_;
-  pthread_t timerThread_;
-  TickTimerSettings *timerSettings_;
+  WatchdogTimer *watchdogTimer_;
+  WorkerPool *teamPool_;
+  LuaStatePool *statePool_;
+  WatchdogTimer **teamPoolTimers_;
+  CommandBuffer **commandBuffers_;
+  bool *teamRunFatal_;
+  int *laserReservations_;
+  int *torpedoReservations_;
+  bool bufferingCommands_;
 
   int gameTime_;
   SensorHandler *sensorHandler_;
+  StageEventEncoder *stageEventEncoder_;
   bool stageRun_;
   bool stageConfigureComplete_;
   bool shipInitComplete_;
@@ -120,9 +128,13 @@ class BerryBotsEngine {
 
   public:
     BerryBotsEngine(PrintHandler *printHandler, FileManager *manager,
-                    const char *replayTemplateDir);
+                    const char *replayTemplateDir, unsigned int randomSeed);
     ~BerryBotsEngine();
 
+    unsigned int getRandomSeed();
+    void setTeamThreads(int numThreads);
+    int getTeamThreads();
+    void setStatePool(LuaStatePool *statePool);
     bool isStageConfigureComplete();
     bool isShipInitComplete();
     void setBattleMode(bool battleMode);
@@ -154,6 +166,10 @@ class BerryBotsEngine {
                    const char *cacheDir) throw (EngineException*);
     void stagePrint(const char *text);
     void shipPrint(lua_State *L, const char *text);
+    bool fireLaser(Ship *ship, double heading);
+    bool fireTorpedo(Ship *ship, double heading, double distance);
+    void setShipName(Ship *ship, const char *name);
+    void setTeamName(Team *team, const char *name);
     void processTick() throw (EngineException*);
     void processRoundOver();
     void processGameOver();
@@ -175,11 +191,26 @@ class BerryBotsEngine {
     bool touchedZone(Ship *ship, const char *zoneTag);
     bool touchedAnyZone(Ship *ship);
     void destroyShip(Ship *ship);
-    static void* timer(void *vargs);
     int callUserLuaCode(lua_State *L,int nargs, const char *errorMsg,
                         int callStyle) throw (EngineException*);
     ReplayBuilder* getReplayBuilder();
+    StageEventEncoder* getStageEventEncoder();
+    void requestViews(Team *team);
+    static void runTeamJob(void *context, int teamIndex, int workerIndex);
   private:
+    int callUserLuaCode(lua_State *L,int nargs, const char *errorMsg,
+        int callStyle, WatchdogTimer *timer) throw (EngineException*);
+    int initUserState(lua_State **state, int type, const char *dir,
+        const char *filename, const char *cacheDir);
+    void prepareTeamRun(Team *team);
+    void updateShipViews(Team *team);
+    void updateEnemyShipViews(Team *team);
+    void runTeam(int teamIndex, int workerIndex);
+    void processTeamRunsInParallel();
+    void applyCommands(Team *team);
+    void recordCpuTime(Team *team);
+    void disableTeam(Team *team);
+    void shipError(lua_State *L, const char *text);
     void setTeamRanksByScore();
     void initShipRound(Ship *ship);
     void updateTeamShipsAlive();
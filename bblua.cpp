@@ -20,17 +20,24 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <algorithm>
 #include <sstream>
 #include <stdio.h>
 #include <time.h>
+#include <math.h>
+#include <limits.h>
 #include "basedir.h"
 #include "bbutil.h"
 #include "filemanager.h"
 #include "stage.h"
 #include "sensorhandler.h"
+#include "stageevents.h"
 #include "bbengine.h"
 #include "replaybuilder.h"
+#include "replayformat.h"
+#include "replaysaver.h"
+#include "replayreader.h"
 #include "printhandler.h"
 #include "gamerunner.h"
 #include "bbrunner.h"
@@ -43,9 +50,9 @@
 //       by Lua (C -> Lua -> C). They are not fatal to the host app and are
 //       handled appropriately (CLI vs GUI) by the original C caller.
 
-void luaSrand(lua_State *L) {
+void luaSrand(lua_State *L, int randomSeed) {
   char *luaSrand = new char[100];
-  sprintf(luaSrand, "math.randomseed(%d)", rand());
+  sprintf(luaSrand, "math.randomseed(%d)", randomSeed);
   luaL_dostring(L, luaSrand);
   delete luaSrand;
 }
@@ -58,11 +65,12 @@ void abortHook(lua_State *L, lua_Debug *ar) {
   luaL_error(L, "Game Runner aborted.");
 }
 
-void initStageState(lua_State **stageState, const char *stageCwd) {
+void initStageState(lua_State **stageState, const char *stageCwd,
+    int randomSeed) {
   *stageState = luaL_newstate();
   lua_setcwd(*stageState, stageCwd);
   luaL_openlibs(*stageState);
-  luaSrand(*stageState);
+  luaSrand(*stageState, randomSeed);
   registerStageBuilder(*stageState);
   registerShip(*stageState);
   registerWorld(*stageState);
@@ -72,26 +80,30 @@ void initStageState(lua_State **stageState, const char *stageCwd) {
   registerStageGlobals(*stageState);
 }
 
-void initShipState(lua_State **shipState, const char *shipCwd) {
+void initShipState(lua_State **shipState, const char *shipCwd,
+    int randomSeed) {
   *shipState = luaL_newstate();
   lua_setcwd(*shipState, shipCwd);
   luaL_openlibs(*shipState);
-  luaSrand(*shipState);
+  luaSrand(*shipState, randomSeed);
   registerShip(*shipState);
   registerSensors(*shipState);
   registerWorld(*shipState);
+  registerShipViews(*shipState);
   registerShipGfx(*shipState);
   registerShipGlobals(*shipState);
 }
 
-void initRunnerState(lua_State **runnerState, const char *runnerCwd) {
+void initRunnerState(lua_State **runnerState, const char *runnerCwd,
+    int randomSeed) {
   *runnerState = luaL_newstate();
   lua_setcwd(*runnerState, runnerCwd);
   luaL_openlibs(*runnerState);
-  luaSrand(*runnerState);
+  luaSrand(*runnerState, randomSeed);
   registerRunnerForm(*runnerState);
   registerGameRunner(*runnerState);
   registerRunnerFiles(*runnerState);
+  registerReplayReader(*runnerState);
   registerRunnerGlobals(*runnerState);
 }
 
@@ -205,9 +217,8 @@ int Ship_chargeShields(lua_State *L) {
 int Ship_fireLaser(lua_State *L) {
   Ship *ship = checkShip(L, 1);
   if (ship->alive && ship->laserEnabled
-      && ship->properties->engine->getStage()->fireLaser(
-          ship, luaL_checknumber(L, 2),
-          ship->properties->engine->getGameTime())) {
+      && ship->properties->engine->fireLaser(
+          ship, luaL_checknumber(L, 2))) {
     ship->laserGunHeat = LASER_HEAT;
     lua_pushboolean(L, true);
   } else {
@@ -219,10 +230,9 @@ int Ship_fireLaser(lua_State *L) {
 int Ship_fireTorpedo(lua_State *L) {
   Ship *ship = checkShip(L, 1);
   if (ship->alive && ship->torpedoEnabled
-      && ship->properties->engine->getStage()->fireTorpedo(
+      && ship->properties->engine->fireTorpedo(
           ship, luaL_checknumber(L, 2),
-          std::max(0.0, (double) luaL_checknumber(L, 3)),
-          ship->properties->engine->getGameTime())) {
+          std::max(0.0, (double) luaL_checknumber(L, 3)))) {
     ship->torpedoGunHeat = TORPEDO_HEAT;
     lua_pushboolean(L, true);
   } else {
@@ -321,21 +331,15 @@ int Ship_isStageShip(lua_State *L) {
   return 1;
 }
 
-void setTeamName(Team *team, const char *name) {
-  strncpy(team->name, name, MAX_NAME_LENGTH);
-  team->name[MAX_NAME_LENGTH] = '\0';
-}
-
 int Ship_setName(lua_State *L) {
   Ship *ship = checkShip(L, 1);
   const char *shipName = luaL_checkstring(L, 2);
   BerryBotsEngine *engine = ship->properties->engine;
   Team *team = engine->getTeam(ship->teamIndex);
   if (!engine->isShipInitComplete() || team->gfxEnabled) {
-    strncpy(ship->properties->name, shipName, MAX_NAME_LENGTH);
-    ship->properties->name[MAX_NAME_LENGTH] = '\0';
+    engine->setShipName(ship, shipName);
     if (team->numShips == 1) {
-      setTeamName(team, shipName);
+      engine->setTeamName(team, shipName);
     }
 
     std::stringstream ss;
@@ -357,7 +361,7 @@ int Ship_setTeamName(lua_State *L) {
   BerryBotsEngine *engine = ship->properties->engine;
   Team *team = engine->getTeam(ship->teamIndex);
   if (!engine->isShipInitComplete() || team->gfxEnabled) {
-    setTeamName(team, teamName);
+    engine->setTeamName(team, teamName);
 
     std::stringstream ss;
     ss << "== Set team name: " << teamName;
@@ -479,7 +483,7 @@ int Ship_name(lua_State *L) {
 
 int Ship_teamName(lua_State *L) {
   Ship *ship = checkShip(L, 1);
-  lua_pushstring(L, ship->properties->engine->getTeam(ship->teamIndex)->name);
+  lua_pushstring(L, ship->properties->teamName);
   return 1;
 }
 
@@ -518,14 +522,31 @@ int registerShip(lua_State *L) {
   return registerClass(L, SHIP, Ship_methods);
 }
 
+// Each team keeps one table per enemy ship and updates it in place whenever
+// that ship is visible, instead of creating new tables for every visible ship
+// on every tick.
 void pushVisibleEnemyShips(
-    lua_State *L, bool *teamVision, int teamIndex, Ship **ships, int numShips) {
+    Team *team, bool *teamVision, Ship **ships, int numShips) {
+  lua_State *L = team->state;
+  if (team->enemyShipsRef == 0) {
+    lua_createtable(L, numShips, 0);
+    team->enemyShipsRef = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+  lua_rawgeti(L, LUA_REGISTRYINDEX, team->enemyShipsRef);
+  int enemyShipsIndex = lua_gettop(L);
+
   lua_newtable(L);
   int visibleIndex = 1;
   for (int x = 0; x < numShips; x++) {
     Ship *ship = ships[x];
-    if (ship->teamIndex != teamIndex && teamVision[x]) {
-      lua_newtable(L);
+    if (ship->teamIndex != team->index && teamVision[x]) {
+      lua_rawgeti(L, enemyShipsIndex, x + 1);
+      if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_createtable(L, 0, 12);
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, enemyShipsIndex, x + 1);
+      }
       setField(L, "x", ship->x);
       setField(L, "y", ship->y);
       setField(L, "heading", ship->heading);
@@ -537,11 +558,11 @@ void pushVisibleEnemyShips(
       setField(L, "energy", ship->energy);
       setField(L, "isStageShip", ship->properties->stageShip);
       setField(L, "name", ship->properties->name);
-      setField(L, "teamName",
-               ship->properties->engine->getTeam(ship->teamIndex)->name);
+      setField(L, "teamName", ship->properties->teamName);
       lua_rawseti(L, -2, visibleIndex++);
     }
   }
+  lua_remove(L, enemyShipsIndex);
 }
 
 Sensors* checkSensors(lua_State *L, int index) {
@@ -557,14 +578,56 @@ Sensors* pushSensors(
   Sensors *sensors = (Sensors *) lua_newuserdata(L, sizeof(Sensors));
   luaL_getmetatable(L, SENSORS);
   lua_setmetatable(L, -2);
-  int teamIndex = team->index;
+  sensors->sensorHandler = sensorHandler;
+  sensors->properties = properties;
+  sensors->teamIndex = team->index;
+  sensors->hitByShipRef = sensors->hitByLaserRef = sensors->hitByTorpedoRef =
+      sensors->hitWallRef = sensors->shipDestroyedRef =
+      sensors->shipFiredLaserRef = sensors->shipFiredTorpedoRef =
+      sensors->laserHitShipRef = LUA_NOREF;
 
-  lua_newtable(L);
-  int numHitByShips = sensorHandler->numHitByShips(teamIndex);
-  HitByShip** hitByShipEvents = sensorHandler->getHitByShips(teamIndex);
+  sensors->stageEventRef = 0;
+  sensors->stageEvents = team->stageEvents;
+
+  return sensors;
+}
+
+// Clears this tick's events, whether or not the ship program looked at them.
+// The Sensors object may outlive the tick, so after this its accessors just
+// return empty tables.
+void cleanupSensorsTables(lua_State *L, Sensors *sensors) {
+  luaL_unref(L, LUA_REGISTRYINDEX, sensors->hitByShipRef);
+  luaL_unref(L, LUA_REGISTRYINDEX, sensors->hitByLaserRef);
+  luaL_unref(L, LUA_REGISTRYINDEX, sensors->hitByTorpedoRef);
+  luaL_unref(L, LUA_REGISTRYINDEX, sensors->hitWallRef);
+  luaL_unref(L, LUA_REGISTRYINDEX, sensors->shipDestroyedRef);
+  luaL_unref(L, LUA_REGISTRYINDEX, sensors->shipFiredLaserRef);
+  luaL_unref(L, LUA_REGISTRYINDEX, sensors->shipFiredTorpedoRef);
+  luaL_unref(L, LUA_REGISTRYINDEX, sensors->laserHitShipRef);
+  if (sensors->stageEventRef != 0) {
+    luaL_unref(L, LUA_REGISTRYINDEX, sensors->stageEventRef);
+  }
+  sensors->hitByShipRef = sensors->hitByLaserRef = sensors->hitByTorpedoRef =
+      sensors->hitWallRef = sensors->shipDestroyedRef =
+      sensors->shipFiredLaserRef = sensors->shipFiredTorpedoRef =
+      sensors->laserHitShipRef = LUA_NOREF;
+  sensors->stageEventRef = 0;
+  sensors->stageEvents = 0;
+
+  sensors->sensorHandler->clearTeamEvents(sensors->teamIndex);
+  sensors->sensorHandler = 0;
+}
+
+void pushHitByShipEvents(lua_State *L, Sensors *sensors) {
+  SensorHandler *sensorHandler = sensors->sensorHandler;
+  ShipProperties **properties = sensors->properties;
+  int numHitByShips = sensorHandler->numHitByShips(sensors->teamIndex);
+  HitByShip* hitByShipEvents =
+      sensorHandler->getHitByShips(sensors->teamIndex);
+  lua_createtable(L, numHitByShips, 0);
   for (int x = 0; x < numHitByShips; x++) {
-    HitByShip* hitByShip = hitByShipEvents[x];
-    lua_newtable(L);
+    HitByShip* hitByShip = &(hitByShipEvents[x]);
+    lua_createtable(L, 0, 11);
     setField(L, "time", hitByShip->time);
     setField(L, "targetName", properties[hitByShip->targetShipIndex]->name);
     setField(L, "targetX", hitByShip->targetX);
@@ -578,15 +641,18 @@ Sensors* pushSensors(
     setField(L, "outForce", hitByShip->outForce);
     lua_rawseti(L, -2, x + 1);
   }
-  sensors->hitByShipRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  sensorHandler->clearHitByShips(teamIndex);
+}
 
-  lua_newtable(L);
-  int numHitByLasers = sensorHandler->numHitByLasers(teamIndex);
-  HitByLaser** hitByLaserEvents = sensorHandler->getHitByLasers(teamIndex);
+void pushHitByLaserEvents(lua_State *L, Sensors *sensors) {
+  SensorHandler *sensorHandler = sensors->sensorHandler;
+  ShipProperties **properties = sensors->properties;
+  int numHitByLasers = sensorHandler->numHitByLasers(sensors->teamIndex);
+  HitByLaser* hitByLaserEvents =
+      sensorHandler->getHitByLasers(sensors->teamIndex);
+  lua_createtable(L, numHitByLasers, 0);
   for (int x = 0; x < numHitByLasers; x++) {
-    HitByLaser* hitByLaser = hitByLaserEvents[x];
-    lua_newtable(L);
+    HitByLaser* hitByLaser = &(hitByLaserEvents[x]);
+    lua_createtable(L, 0, 5);
     setField(L, "time", hitByLaser->time);
     setField(L, "targetName", properties[hitByLaser->targetShipIndex]->name);
     setField(L, "laserX", hitByLaser->laserX);
@@ -594,15 +660,18 @@ Sensors* pushSensors(
     setField(L, "laserHeading", hitByLaser->laserHeading);
     lua_rawseti(L, -2, x + 1);
   }
-  sensors->hitByLaserRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  sensorHandler->clearHitByLasers(teamIndex);
+}
 
-  lua_newtable(L);
-  int numHitByTorpedos = sensorHandler->numHitByTorpedos(teamIndex);
-  HitByTorpedo** hitByTorpedoEvents = sensorHandler->getHitByTorpedos(teamIndex);
+void pushHitByTorpedoEvents(lua_State *L, Sensors *sensors) {
+  SensorHandler *sensorHandler = sensors->sensorHandler;
+  ShipProperties **properties = sensors->properties;
+  int numHitByTorpedos = sensorHandler->numHitByTorpedos(sensors->teamIndex);
+  HitByTorpedo* hitByTorpedoEvents =
+      sensorHandler->getHitByTorpedos(sensors->teamIndex);
+  lua_createtable(L, numHitByTorpedos, 0);
   for (int x = 0; x < numHitByTorpedos; x++) {
-    HitByTorpedo* hitByTorpedo = hitByTorpedoEvents[x];
-    lua_newtable(L);
+    HitByTorpedo* hitByTorpedo = &(hitByTorpedoEvents[x]);
+    lua_createtable(L, 0, 5);
     setField(L, "time", hitByTorpedo->time);
     setField(L, "targetName", properties[hitByTorpedo->targetShipIndex]->name);
     setField(L, "hitAngle", hitByTorpedo->hitAngle);
@@ -610,15 +679,17 @@ Sensors* pushSensors(
     setField(L, "hitDamage", hitByTorpedo->hitDamage);
     lua_rawseti(L, -2, x + 1);
   }
-  sensors->hitByTorpedoRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  sensorHandler->clearHitByTorpedos(teamIndex);
+}
 
-  lua_newtable(L);
-  int numHitWalls = sensorHandler->numHitWalls(teamIndex);
-  ShipHitWall** hitWallEvents = sensorHandler->getHitWalls(teamIndex);
+void pushHitWallEvents(lua_State *L, Sensors *sensors) {
+  SensorHandler *sensorHandler = sensors->sensorHandler;
+  ShipProperties **properties = sensors->properties;
+  int numHitWalls = sensorHandler->numHitWalls(sensors->teamIndex);
+  ShipHitWall* hitWallEvents = sensorHandler->getHitWalls(sensors->teamIndex);
+  lua_createtable(L, numHitWalls, 0);
   for (int x = 0; x < numHitWalls; x++) {
-    ShipHitWall* hitWall = hitWallEvents[x];
-    lua_newtable(L);
+    ShipHitWall* hitWall = &(hitWallEvents[x]);
+    lua_createtable(L, 0, 6);
     setField(L, "time", hitWall->time);
     setField(L, "shipName", properties[hitWall->shipIndex]->name);
     setField(L, "shipX", hitWall->shipX);
@@ -627,146 +698,165 @@ Sensors* pushSensors(
     setField(L, "bounceForce", hitWall->bounceForce);
     lua_rawseti(L, -2, x + 1);
   }
-  sensors->hitWallRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  sensorHandler->clearHitWalls(teamIndex);
+}
 
-  lua_newtable(L);
-  int numShipDestroyeds = sensorHandler->numShipDestroyeds(teamIndex);
-  ShipDestroyed** shipDestroyedEvents =
-      sensorHandler->getShipDestroyeds(teamIndex);
+void pushShipDestroyedEvents(lua_State *L, Sensors *sensors) {
+  SensorHandler *sensorHandler = sensors->sensorHandler;
+  ShipProperties **properties = sensors->properties;
+  int numShipDestroyeds =
+      sensorHandler->numShipDestroyeds(sensors->teamIndex);
+  ShipDestroyed* shipDestroyedEvents =
+      sensorHandler->getShipDestroyeds(sensors->teamIndex);
+  lua_createtable(L, numShipDestroyeds, 0);
   for (int x = 0; x < numShipDestroyeds; x++) {
-    ShipDestroyed* shipDestroyed = shipDestroyedEvents[x];
-    lua_newtable(L);
+    ShipDestroyed* shipDestroyed = &(shipDestroyedEvents[x]);
+    lua_createtable(L, 0, 2);
     setField(L, "time", shipDestroyed->time);
     setField(L, "shipName", properties[shipDestroyed->shipIndex]->name);
     lua_rawseti(L, -2, x + 1);
   }
-  sensors->shipDestroyedRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  sensorHandler->clearShipDestroyeds(teamIndex);
+}
 
-  lua_newtable(L);
-  int numShipFiredLasers = sensorHandler->numShipFiredLasers(teamIndex);
-  ShipFiredLaser** shipFiredLaserEvents =
-      sensorHandler->getShipFiredLasers(teamIndex);
+void pushShipFiredLaserEvents(lua_State *L, Sensors *sensors) {
+  SensorHandler *sensorHandler = sensors->sensorHandler;
+  ShipProperties **properties = sensors->properties;
+  int numShipFiredLasers =
+      sensorHandler->numShipFiredLasers(sensors->teamIndex);
+  ShipFiredLaser* shipFiredLaserEvents =
+      sensorHandler->getShipFiredLasers(sensors->teamIndex);
+  lua_createtable(L, numShipFiredLasers, 0);
   for (int x = 0; x < numShipFiredLasers; x++) {
-    ShipFiredLaser* shipFiredLaser = shipFiredLaserEvents[x];
-    lua_newtable(L);
+    ShipFiredLaser* shipFiredLaser = &(shipFiredLaserEvents[x]);
+    lua_createtable(L, 0, 4);
     setField(L, "time", shipFiredLaser->time);
     setField(L, "shipName", properties[shipFiredLaser->shipIndex]->name);
     setField(L, "shipX", shipFiredLaser->shipX);
     setField(L, "shipY", shipFiredLaser->shipY);
     lua_rawseti(L, -2, x + 1);
   }
-  sensors->shipFiredLaserRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  sensorHandler->clearShipFiredLasers(teamIndex);
+}
 
-  lua_newtable(L);
-  int numShipFiredTorpedos = sensorHandler->numShipFiredTorpedos(teamIndex);
-  ShipFiredTorpedo** shipFiredTorpedoEvents =
-      sensorHandler->getShipFiredTorpedos(teamIndex);
+void pushShipFiredTorpedoEvents(lua_State *L, Sensors *sensors) {
+  SensorHandler *sensorHandler = sensors->sensorHandler;
+  ShipProperties **properties = sensors->properties;
+  int numShipFiredTorpedos =
+      sensorHandler->numShipFiredTorpedos(sensors->teamIndex);
+  ShipFiredTorpedo* shipFiredTorpedoEvents =
+      sensorHandler->getShipFiredTorpedos(sensors->teamIndex);
+  lua_createtable(L, numShipFiredTorpedos, 0);
   for (int x = 0; x < numShipFiredTorpedos; x++) {
-    ShipFiredTorpedo* shipFiredTorpedo = shipFiredTorpedoEvents[x];
-    lua_newtable(L);
+    ShipFiredTorpedo* shipFiredTorpedo = &(shipFiredTorpedoEvents[x]);
+    lua_createtable(L, 0, 4);
     setField(L, "time", shipFiredTorpedo->time);
     setField(L, "shipName", properties[shipFiredTorpedo->shipIndex]->name);
     setField(L, "shipX", shipFiredTorpedo->shipX);
     setField(L, "shipY", shipFiredTorpedo->shipY);
     lua_rawseti(L, -2, x + 1);
   }
-  sensors->shipFiredTorpedoRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  sensorHandler->clearShipFiredTorpedos(teamIndex);
+}
 
-  lua_newtable(L);
-  int numLaserHitShips = sensorHandler->numLaserHitShips(teamIndex);
-  LaserHitShip** laserHitShipEvents =
-      sensorHandler->getLaserHitShips(teamIndex);
+void pushLaserHitShipEvents(lua_State *L, Sensors *sensors) {
+  SensorHandler *sensorHandler = sensors->sensorHandler;
+  ShipProperties **properties = sensors->properties;
+  int numLaserHitShips = sensorHandler->numLaserHitShips(sensors->teamIndex);
+  LaserHitShip* laserHitShipEvents =
+      sensorHandler->getLaserHitShips(sensors->teamIndex);
+  lua_createtable(L, numLaserHitShips, 0);
   for (int x = 0; x < numLaserHitShips; x++) {
-    LaserHitShip* laserHitShip = laserHitShipEvents[x];
-    lua_newtable(L);
+    LaserHitShip* laserHitShip = &(laserHitShipEvents[x]);
+    lua_createtable(L, 0, 4);
     setField(L, "time", laserHitShip->time);
     setField(L, "targetName", properties[laserHitShip->targetShipIndex]->name);
     setField(L, "targetX", laserHitShip->shipX);
     setField(L, "targetY", laserHitShip->shipY);
     lua_rawseti(L, -2, x + 1);
   }
-  sensors->laserHitShipRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  sensorHandler->clearLaserHitShips(teamIndex);
+}
 
-  if (team->stageEventRef == 0) {
+// Pushes the table for one category of events, building it from the
+// SensorHandler the first time it's asked for this tick.
+int pushSensorEvents(lua_State *L, Sensors *sensors, int *ref,
+                     void (*pushEvents)(lua_State*, Sensors*)) {
+  if (*ref != LUA_NOREF) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, *ref);
+  } else if (sensors->sensorHandler == 0) {
     lua_newtable(L);
-    sensors->stageEventRef = luaL_ref(L, LUA_REGISTRYINDEX);
   } else {
-    sensors->stageEventRef = team->stageEventRef;
+    pushEvents(L, sensors);
+    lua_pushvalue(L, -1);
+    *ref = luaL_ref(L, LUA_REGISTRYINDEX);
   }
-  team->stageEventRef = 0;
-
-  return sensors;
-}
-
-void cleanupSensorsTables(lua_State *L, Sensors *sensors) {
-  luaL_unref(L, LUA_REGISTRYINDEX, sensors->hitByShipRef);
-  luaL_unref(L, LUA_REGISTRYINDEX, sensors->hitByLaserRef);
-  luaL_unref(L, LUA_REGISTRYINDEX, sensors->hitByTorpedoRef);
-  luaL_unref(L, LUA_REGISTRYINDEX, sensors->hitWallRef);
-  luaL_unref(L, LUA_REGISTRYINDEX, sensors->shipDestroyedRef);
-  luaL_unref(L, LUA_REGISTRYINDEX, sensors->shipFiredLaserRef);
-  luaL_unref(L, LUA_REGISTRYINDEX, sensors->shipFiredTorpedoRef);
-  luaL_unref(L, LUA_REGISTRYINDEX, sensors->laserHitShipRef);
-  luaL_unref(L, LUA_REGISTRYINDEX, sensors->stageEventRef);
-  sensors->stageEventRef = 0;
+  return 1;
 }
 
 int Sensors_hitByShipEvents(lua_State *L) {
   Sensors *sensors = checkSensors(L, 1);
-  lua_rawgeti(L, LUA_REGISTRYINDEX, sensors->hitByShipRef);
-  return 1;
+  return pushSensorEvents(
+      L, sensors, &(sensors->hitByShipRef), pushHitByShipEvents);
 }
 
 int Sensors_hitByLaserEvents(lua_State *L) {
   Sensors *sensors = checkSensors(L, 1);
-  lua_rawgeti(L, LUA_REGISTRYINDEX, sensors->hitByLaserRef);
-  return 1;
+  return pushSensorEvents(
+      L, sensors, &(sensors->hitByLaserRef), pushHitByLaserEvents);
 }
 
 int Sensors_hitByTorpedoEvents(lua_State *L) {
   Sensors *sensors = checkSensors(L, 1);
-  lua_rawgeti(L, LUA_REGISTRYINDEX, sensors->hitByTorpedoRef);
-  return 1;
+  return pushSensorEvents(
+      L, sensors, &(sensors->hitByTorpedoRef), pushHitByTorpedoEvents);
 }
 
 int Sensors_hitWallEvents(lua_State *L) {
   Sensors *sensors = checkSensors(L, 1);
-  lua_rawgeti(L, LUA_REGISTRYINDEX, sensors->hitWallRef);
-  return 1;
+  return pushSensorEvents(
+      L, sensors, &(sensors->hitWallRef), pushHitWallEvents);
 }
 
 int Sensors_shipDestroyedEvents(lua_State *L) {
   Sensors *sensors = checkSensors(L, 1);
-  lua_rawgeti(L, LUA_REGISTRYINDEX, sensors->shipDestroyedRef);
-  return 1;
+  return pushSensorEvents(
+      L, sensors, &(sensors->shipDestroyedRef), pushShipDestroyedEvents);
 }
 
 int Sensors_shipFiredLaserEvents(lua_State *L) {
   Sensors *sensors = checkSensors(L, 1);
-  lua_rawgeti(L, LUA_REGISTRYINDEX, sensors->shipFiredLaserRef);
-  return 1;
+  return pushSensorEvents(
+      L, sensors, &(sensors->shipFiredLaserRef), pushShipFiredLaserEvents);
 }
 
 int Sensors_shipFiredTorpedoEvents(lua_State *L) {
   Sensors *sensors = checkSensors(L, 1);
-  lua_rawgeti(L, LUA_REGISTRYINDEX, sensors->shipFiredTorpedoRef);
-  return 1;
+  return pushSensorEvents(L, sensors, &(sensors->shipFiredTorpedoRef),
+                          pushShipFiredTorpedoEvents);
 }
 
 int Sensors_laserHitShipEvents(lua_State *L) {
   Sensors *sensors = checkSensors(L, 1);
-  lua_rawgeti(L, LUA_REGISTRYINDEX, sensors->laserHitShipRef);
-  return 1;
+  return pushSensorEvents(
+      L, sensors, &(sensors->laserHitShipRef), pushLaserHitShipEvents);
 }
 
+// Stage events are decoded into this ship's Lua state the first time it asks
+// for them each tick.
 int Sensors_stageEvents(lua_State *L) {
   Sensors *sensors = checkSensors(L, 1);
-  lua_rawgeti(L, LUA_REGISTRYINDEX, sensors->stageEventRef);
+  if (sensors->stageEventRef != 0) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, sensors->stageEventRef);
+  } else {
+    lua_newtable(L);
+    if (sensors->sensorHandler != 0) {
+      StageEvent **stageEvents =
+          (StageEvent **) sensors->stageEvents->getEvents();
+      int numStageEvents = sensors->stageEvents->getNumEvents();
+      for (int x = 0; x < numStageEvents; x++) {
+        pushStageEvent(L, stageEvents[x]);
+        lua_rawseti(L, -2, x + 1);
+      }
+      lua_pushvalue(L, -1);
+      sensors->stageEventRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+  }
   return 1;
 }
 
@@ -804,9 +894,9 @@ StageSensors* pushStageSensors(lua_State *L, SensorHandler *sensorHandler,
 
   lua_newtable(L);
   int numShipHitShips = sensorHandler->numStageShipHitShips();
-  ShipHitShip** shipHitShipEvents = sensorHandler->getStageShipHitShips();
+  ShipHitShip* shipHitShipEvents = sensorHandler->getStageShipHitShips();
   for (int x = 0; x < numShipHitShips; x++) {
-    ShipHitShip* shipHitShip = shipHitShipEvents[x];
+    ShipHitShip* shipHitShip = &(shipHitShipEvents[x]);
     lua_newtable(L);
     setField(L, "time", shipHitShip->time);
     setField(L, "targetName",
@@ -824,14 +914,13 @@ StageSensors* pushStageSensors(lua_State *L, SensorHandler *sensorHandler,
     lua_rawseti(L, -2, x + 1);
   }
   stageSensors->shipHitShipRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  sensorHandler->clearStageShipHitShips();
 
   lua_newtable(L);
   int numLaserHitShips = sensorHandler->numStageLaserHitShips();
-  StageLaserHitShip** laserHitShipEvents =
+  StageLaserHitShip* laserHitShipEvents =
       sensorHandler->getStageLaserHitShips();
   for (int x = 0; x < numLaserHitShips; x++) {
-    StageLaserHitShip* laserHitShip = laserHitShipEvents[x];
+    StageLaserHitShip* laserHitShip = &(laserHitShipEvents[x]);
     lua_newtable(L);
     setField(L, "time", laserHitShip->time);
     setField(L, "srcName", properties[laserHitShip->srcShipIndex]->name);
@@ -842,14 +931,13 @@ StageSensors* pushStageSensors(lua_State *L, SensorHandler *sensorHandler,
     lua_rawseti(L, -2, x + 1);
   }
   stageSensors->laserHitShipRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  sensorHandler->clearStageLaserHitShips();
 
   lua_newtable(L);
   int numTorpedoHitShips = sensorHandler->numStageTorpedoHitShips();
-  StageTorpedoHitShip** torpedoHitShipEvents =
+  StageTorpedoHitShip* torpedoHitShipEvents =
       sensorHandler->getStageTorpedoHitShips();
   for (int x = 0; x < numTorpedoHitShips; x++) {
-    StageTorpedoHitShip* torpedoHitShip = torpedoHitShipEvents[x];
+    StageTorpedoHitShip* torpedoHitShip = &(torpedoHitShipEvents[x]);
     lua_newtable(L);
     setField(L, "time", torpedoHitShip->time);
     setField(L, "srcName", properties[torpedoHitShip->srcShipIndex]->name);
@@ -861,13 +949,12 @@ StageSensors* pushStageSensors(lua_State *L, SensorHandler *sensorHandler,
     lua_rawseti(L, -2, x + 1);
   }
   stageSensors->torpedoHitShipRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  sensorHandler->clearStageTorpedoHitShips();
 
   lua_newtable(L);
   int numShipHitWalls = sensorHandler->numStageShipHitWalls();
-  ShipHitWall** shipHitWallEvents = sensorHandler->getStageShipHitWalls();
+  ShipHitWall* shipHitWallEvents = sensorHandler->getStageShipHitWalls();
   for (int x = 0; x < numShipHitWalls; x++) {
-    ShipHitWall* shipHitWall = shipHitWallEvents[x];
+    ShipHitWall* shipHitWall = &(shipHitWallEvents[x]);
     lua_newtable(L);
     setField(L, "time", shipHitWall->time);
     setField(L, "shipName", properties[shipHitWall->shipIndex]->name);
@@ -878,13 +965,12 @@ StageSensors* pushStageSensors(lua_State *L, SensorHandler *sensorHandler,
     lua_rawseti(L, -2, x + 1);
   }
   stageSensors->shipHitWallRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  sensorHandler->clearStageShipHitWalls();
 
   lua_newtable(L);
   int numShipDestroyeds = sensorHandler->numStageShipDestroyeds();
-  ShipDestroyed** shipDestroyedEvents = sensorHandler->getStageShipDestroyeds();
+  ShipDestroyed* shipDestroyedEvents = sensorHandler->getStageShipDestroyeds();
   for (int x = 0; x < numShipDestroyeds; x++) {
-    ShipDestroyed* shipDestroyed = shipDestroyedEvents[x];
+    ShipDestroyed* shipDestroyed = &(shipDestroyedEvents[x]);
     BerryBotsEngine *engine = properties[shipDestroyed->shipIndex]->engine;
     if (shipDestroyed->time == engine->getGameTime()) {
       // TODO: doesn't seem like we should need this check - do we?
@@ -895,14 +981,13 @@ StageSensors* pushStageSensors(lua_State *L, SensorHandler *sensorHandler,
     }
   }
   stageSensors->shipDestroyedRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  sensorHandler->clearStageShipDestroyeds();
 
   lua_newtable(L);
   int numShipFiredLasers = sensorHandler->numStageShipFiredLasers();
-  StageShipFiredLaser** shipFiredLaserEvents =
+  StageShipFiredLaser* shipFiredLaserEvents =
       sensorHandler->getStageShipFiredLasers();
   for (int x = 0; x < numShipFiredLasers; x++) {
-    StageShipFiredLaser* shipFiredLaser = shipFiredLaserEvents[x];
+    StageShipFiredLaser* shipFiredLaser = &(shipFiredLaserEvents[x]);
     lua_newtable(L);
     setField(L, "time", shipFiredLaser->time);
     setField(L, "shipName", properties[shipFiredLaser->shipIndex]->name);
@@ -912,14 +997,13 @@ StageSensors* pushStageSensors(lua_State *L, SensorHandler *sensorHandler,
     lua_rawseti(L, -2, x + 1);
   }
   stageSensors->shipFiredLaserRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  sensorHandler->clearStageShipFiredLasers();
 
   lua_newtable(L);
   int numShipFiredTorpedos = sensorHandler->numStageShipFiredTorpedos();
-  StageShipFiredTorpedo** shipFiredTorpedoEvents =
+  StageShipFiredTorpedo* shipFiredTorpedoEvents =
       sensorHandler->getStageShipFiredTorpedos();
   for (int x = 0; x < numShipFiredTorpedos; x++) {
-    StageShipFiredTorpedo* shipFiredTorpedo = shipFiredTorpedoEvents[x];
+    StageShipFiredTorpedo* shipFiredTorpedo = &(shipFiredTorpedoEvents[x]);
     lua_newtable(L);
     setField(L, "time", shipFiredTorpedo->time);
     setField(L, "shipName", properties[shipFiredTorpedo->shipIndex]->name);
@@ -930,7 +1014,7 @@ StageSensors* pushStageSensors(lua_State *L, SensorHandler *sensorHandler,
     lua_rawseti(L, -2, x + 1);
   }
   stageSensors->shipFiredTorpedoRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  sensorHandler->clearStageShipFiredTorpedos();
+  sensorHandler->clearStageEvents();
 
   return stageSensors;
 }
@@ -1256,7 +1340,10 @@ World* checkWorld(lua_State *L, int index) {
   return world;
 }
 
-World* pushWorld(lua_State *L, Stage *stage, int numShips, int teamSize) {
+// If view is given, it's filled in with everything that doesn't change from tick
+// to tick.
+World* pushWorld(lua_State *L, Stage *stage, int numShips, int teamSize,
+                 WorldView *view) {
   World *world = (World *) lua_newuserdata(L, sizeof(World));
   luaL_getmetatable(L, WORLD);
   lua_setmetatable(L, -2);
@@ -1289,6 +1376,28 @@ World* pushWorld(lua_State *L, Stage *stage, int numShips, int teamSize) {
   setField(L, "WALL_BOUNCE", WALL_BOUNCE);
   world->constantsRef = luaL_ref(L, LUA_REGISTRYINDEX);
 
+  world->view = view;
+  if (view != 0) {
+    view->width = world->width;
+    view->height = world->height;
+    view->numShips = world->numShips;
+    view->teamSize = world->teamSize;
+    view->time = world->time;
+    WorldConstants *constants = &(view->constants);
+    constants->shipRadius = SHIP_RADIUS;
+    constants->laserSpeed = LASER_SPEED;
+    constants->laserHeat = LASER_HEAT;
+    constants->laserDamage = LASER_DAMAGE;
+    constants->torpedoSpeed = TORPEDO_SPEED;
+    constants->torpedoHeat = TORPEDO_HEAT;
+    constants->torpedoBlastRadius = TORPEDO_BLAST_RADIUS;
+    constants->torpedoBlastForce = TORPEDO_BLAST_FORCE;
+    constants->torpedoBlastDamage = TORPEDO_BLAST_DAMAGE;
+    constants->defaultEnergy = DEFAULT_ENERGY;
+    constants->maxThrusterForce = MAX_THRUSTER_FORCE;
+    constants->wallBounce = WALL_BOUNCE;
+  }
+
   return world;
 }
 
@@ -1400,6 +1509,110 @@ int registerWorld(lua_State *L) {
   return registerClass(L, WORLD, World_methods);
 }
 
+// Ship:view() and World:view() return const FFI pointers to the team's copies
+// of its ships and world, so JIT compiled ship code can read them without
+// calling back into C. The copies are refreshed before each call into the ship
+// program. The C declarations below must match the views in bbutil.h; the
+// sizes and offsets are checked at load time and the view methods are left
+// undefined if they don't match or the FFI isn't available.
+const char *SHIP_VIEWS_CHUNK =
+  "local ok, ffi = pcall(require, 'ffi')\n"
+  "if not ok then return end\n"
+  "local nameSize, shipSize, worldSize, enemyShipsOffset, enemyShipSize,\n"
+  "    teamNameOffset, shipPointer, worldPointer = ...\n"
+  "ffi.cdef(string.format([[\n"
+  "typedef struct {\n"
+  "  short index, teamIndex;\n"
+  "  double thrusterAngle, thrusterForce, x, y, heading, speed, momentum,\n"
+  "      energy, power, shields;\n"
+  "  short torpedoAmmo, laserGunHeat, torpedoGunHeat;\n"
+  "  bool hitWall, hitShip, alive, laserEnabled, torpedoEnabled,\n"
+  "      thrusterEnabled, energyEnabled, powerEnabled, shieldsEnabled,\n"
+  "      showName, newColors;\n"
+  "  double kills, friendlyKills, damage, friendlyDamage, shieldedDamage;\n"
+  "} bb_ship_t;\n"
+  "typedef struct {\n"
+  "  short index, teamIndex;\n"
+  "  double x, y, heading, speed, momentum, energy, power, shields;\n"
+  "  short torpedoAmmo;\n"
+  "  bool isStageShip;\n"
+  "  char name[%d], teamName[%d];\n"
+  "} bb_enemy_ship_t;\n"
+  "typedef struct {\n"
+  "  int numShips;\n"
+  "  const bb_enemy_ship_t *ships;\n"
+  "} bb_enemy_ships_t;\n"
+  "typedef struct {\n"
+  "  int width, height;\n"
+  "  short numShips, teamSize;\n"
+  "  int time;\n"
+  "  struct {\n"
+  "    double SHIP_RADIUS, LASER_SPEED, LASER_HEAT, LASER_DAMAGE,\n"
+  "        TORPEDO_SPEED, TORPEDO_HEAT, TORPEDO_BLAST_RADIUS,\n"
+  "        TORPEDO_BLAST_FORCE, TORPEDO_BLAST_DAMAGE, DEFAULT_ENERGY,\n"
+  "        MAX_THRUSTER_FORCE, WALL_BOUNCE;\n"
+  "  } constants;\n"
+  "  bb_enemy_ships_t enemyShips;\n"
+  "} bb_world_t;\n"
+  "]], nameSize, nameSize))\n"
+  "if ffi.sizeof('bb_ship_t') ~= shipSize\n"
+  "    or ffi.sizeof('bb_world_t') ~= worldSize\n"
+  "    or ffi.offsetof('bb_world_t', 'enemyShips') ~= enemyShipsOffset\n"
+  "    or ffi.sizeof('bb_enemy_ship_t') ~= enemyShipSize\n"
+  "    or ffi.offsetof('bb_enemy_ship_t', 'teamName') ~= teamNameOffset then\n"
+  "  return\n"
+  "end\n"
+  "local shipView = ffi.typeof('const bb_ship_t *')\n"
+  "local worldView = ffi.typeof('const bb_world_t *')\n"
+  "Ship.view = function(ship)\n"
+  "  return ffi.cast(shipView, shipPointer(ship))\n"
+  "end\n"
+  "World.view = function(world)\n"
+  "  return ffi.cast(worldView, worldPointer(world))\n"
+  "end\n";
+
+int ShipViews_shipPointer(lua_State *L) {
+  Ship *ship = checkShip(L, 1);
+  if (ship->properties->view == 0) {
+    luaL_error(L, "This ship has no view.");
+  }
+  BerryBotsEngine *engine = ship->properties->engine;
+  engine->requestViews(engine->getTeam(ship->teamIndex));
+  lua_pushlightuserdata(L, ship->properties->view);
+  return 1;
+}
+
+int ShipViews_worldPointer(lua_State *L) {
+  World *world = checkWorld(L, 1);
+  if (world->view == 0) {
+    luaL_error(L, "This world has no view.");
+  }
+  world->engine->requestViews(world->engine->getTeam(L));
+  lua_pushlightuserdata(L, world->view);
+  return 1;
+}
+
+int registerShipViews(lua_State *L) {
+  if (luaL_loadbuffer(L, SHIP_VIEWS_CHUNK, strlen(SHIP_VIEWS_CHUNK),
+                      "=shipviews") != 0) {
+    lua_pop(L, 1);
+    return 0;
+  }
+  lua_pushinteger(L, MAX_NAME_LENGTH + 1);
+  lua_pushinteger(L, sizeof(ShipView));
+  lua_pushinteger(L, sizeof(WorldView));
+  lua_pushinteger(L, offsetof(WorldView, enemyShips));
+  lua_pushinteger(L, sizeof(EnemyShipView));
+  lua_pushinteger(L, offsetof(EnemyShipView, teamName));
+  lua_pushcfunction(L, ShipViews_shipPointer);
+  lua_pushcfunction(L, ShipViews_worldPointer);
+  if (lua_pcall(L, 8, 0, 0) != 0) {
+    lua_pop(L, 1);
+    return 0;
+  }
+  return 1;
+}
+
 ShipGfx* checkShipGfx(lua_State *L, int index) {
   luaL_checktype(L, index, LUA_TUSERDATA);
   ShipGfx *shipGfx = (ShipGfx *) luaL_checkudata(L, index, SHIP_GFX);
@@ -1735,51 +1948,38 @@ int Admin_setShipShowName(lua_State *L) {
   return 1;
 }
 
-void copyValueAtIndex(lua_State *L1, lua_State *L2, int index) {
-  if (lua_isnumber(L1, index)) {
-    lua_pushnumber(L2, lua_tonumber(L1, index));
-  } else if (lua_isboolean(L1, index)) {
-    lua_pushboolean(L2, lua_toboolean(L1, index));
-  } else if (lua_isnil(L1, index)) {
-    lua_pushnil(L2);
-  } else if (lua_isstring(L1, index)) {
-    lua_pushstring(L2, lua_tostring(L1, index));
-  } else if (lua_istable(L1, index)) {
-    lua_newtable(L2);
-    lua_pushnil(L1);
-    while (lua_next(L1, index - (index < 0 ? 1 : 0)) != 0) {
-      copyValueAtIndex(L1, L2, -2);
-      copyValueAtIndex(L1, L2, -1);
-      lua_settable(L2, -3);
-      lua_pop(L1, 1);
-    }
-  } else {
-    luaL_error(L1, "Can't copy type '%s' to send as stage event. %s",
-               luaL_typename(L1, index),
-               "Valid stage event types: nil, number, string, table, boolean.");
-  }
-}
-
-void copyValue(lua_State *L1, lua_State *L2) {
-  copyValueAtIndex(L1, L2, -1);
-}
-
+// The event is encoded once, however many ships it goes to, and each team
+// decodes its own copy only if it looks at its stage events. Pass a table of
+// ships to send the same event to all of them.
 int Admin_sendEvent(lua_State *L) {
   Admin *admin = checkAdmin(L, 1);
-  Ship *ship = getShip(L, 2, admin->engine);
-  if (ship != 0) {
-    Team *team = ship->properties->engine->getTeam(ship->teamIndex);
-    lua_State *teamState = team->state;
+  BerryBotsEngine *engine = admin->engine;
+  if (lua_isnoneornil(L, 3)) {
+    return 1;
+  }
 
-    if (team->stageEventRef == 0) {
-      lua_newtable(teamState);
-      team->stageEventRef = luaL_ref(teamState, LUA_REGISTRYINDEX);
+  StageEvent *stageEvent = 0;
+  if (lua_istable(L, 2)) {
+    int numShips = (int) lua_objlen(L, 2);
+    for (int x = 1; x <= numShips; x++) {
+      lua_rawgeti(L, 2, x);
+      Ship *ship = getShip(L, -1, engine);
+      lua_pop(L, 1);
+      if (ship != 0) {
+        if (stageEvent == 0) {
+          stageEvent = engine->getStageEventEncoder()->encode(L, 3);
+        }
+        addStageEvent(engine->getTeam(ship->teamIndex)->stageEvents,
+                      stageEvent);
+      }
+    }
+  } else {
+    Ship *ship = getShip(L, 2, engine);
+    if (ship != 0) {
+      stageEvent = engine->getStageEventEncoder()->encode(L, 3);
+      addStageEvent(engine->getTeam(ship->teamIndex)->stageEvents,
+                    stageEvent);
     }
-    lua_rawgeti(teamState, LUA_REGISTRYINDEX, team->stageEventRef);
-    int newIndex = (int) lua_objlen(L, -1) + 1;
-
-    copyValue(L, teamState);
-    lua_rawseti(teamState, -2, newIndex);
   }
   return 1;
 }
@@ -1834,7 +2034,7 @@ const char* getTeamName(lua_State *L, int index) {
     return luaL_checkstring(L, index);
   } else if (lua_isuserdata(L, index)) {
     Ship *ship = checkShip(L, index);
-    return ship->properties->engine->getTeam(ship->teamIndex)->name;
+    return ship->properties->teamName;
   } else {
     return 0;
   }
@@ -2252,9 +2452,51 @@ MatchRunner* pushGameRunner(lua_State *L, GameRunner *gameRunner) {
   lua_rawgeti(L, LUA_REGISTRYINDEX, runnerRef);
   luaRunner->gameRunner = gameRunner;
   luaRunner->replayBuilder = 0;
+  luaRunner->replaySaver = 0;
   return luaRunner;
 }
 
+// Waits for any replays that are still saving once the runner's run() has
+// returned. Their callbacks aren't called.
+void finishGameRunner(MatchRunner *runner) {
+  if (runner->replaySaver != 0) {
+    runner->replaySaver->waitForAll();
+    ReplaySave *replaySave;
+    while ((replaySave = runner->replaySaver->nextDone()) != 0) {
+      if (replaySave->releaseReplayBuilder) {
+        runner->gameRunner->deleteReplayBuilder(replaySave->replayBuilder);
+      }
+      ReplaySaver::deleteSave(replaySave);
+    }
+    runner->replaySaver = 0;
+  }
+}
+
+// Calls the callbacks for replays that have finished saving, and deletes the
+// ReplayBuilders that nextResult already moved on from while they were saving.
+void dispatchSavedReplays(lua_State *L, MatchRunner *runner) {
+  if (runner->replaySaver == 0) {
+    return;
+  }
+  ReplaySave *replaySave;
+  while ((replaySave = runner->replaySaver->nextDone()) != 0) {
+    if (replaySave->releaseReplayBuilder) {
+      runner->gameRunner->deleteReplayBuilder(replaySave->replayBuilder);
+    }
+    int callbackRef = replaySave->callbackRef;
+    if (callbackRef == LUA_NOREF) {
+      ReplaySaver::deleteSave(replaySave);
+    } else {
+      lua_rawgeti(L, LUA_REGISTRYINDEX, callbackRef);
+      luaL_unref(L, LUA_REGISTRYINDEX, callbackRef);
+      lua_pushstring(L, replaySave->filename);
+      lua_pushboolean(L, replaySave->saved);
+      ReplaySaver::deleteSave(replaySave);
+      lua_call(L, 2, 0);
+    }
+  }
+}
+
 int GameRunner_setThreadCount(lua_State *L) {
   MatchRunner *runner = checkGameRunner(L, 1);
   if (runner->gameRunner->started()) {
@@ -2266,16 +2508,42 @@ int GameRunner_setThreadCount(lua_State *L) {
   return 1;
 }
 
+int GameRunner_setIsolateMatches(lua_State *L) {
+  MatchRunner *runner = checkGameRunner(L, 1);
+  if (runner->gameRunner->started()) {
+    luaL_error(L, "Can't isolate matches after starting the first match.");
+  } else {
+    luaL_checktype(L, 2, LUA_TBOOLEAN);
+    runner->gameRunner->setIsolateMatches(lua_toboolean(L, 2));
+  }
+  return 1;
+}
+
 int GameRunner_queueMatch(lua_State *L) {
   MatchRunner *runner = checkGameRunner(L, 1);
   if (lua_gettop(L) < 3) {
     luaL_error(L, "Need at least one stage and one ship to queue a match.");
   } else {
     const char *stageName = luaL_checkstring(L, 2);
+    bool hasSeed = (lua_istable(L, 3) && lua_gettop(L) >= 4);
+    unsigned int seed = 0;
+    if (hasSeed) {
+      lua_Number seedNumber = luaL_checknumber(L, 4);
+      if (!(seedNumber >= 0 && seedNumber <= UINT_MAX
+            && seedNumber == floor(seedNumber))) {
+        luaL_error(L, "Random seed must be a whole number from 0 to %s.",
+                   "4294967295");
+      }
+      seed = (unsigned int) seedNumber;
+    }
     int numShips;
     char **ships;
     getStringArgs(L, 3, ships, numShips);
-    runner->gameRunner->queueMatch(stageName, ships, numShips);
+    if (hasSeed) {
+      runner->gameRunner->queueMatch(stageName, ships, numShips, seed);
+    } else {
+      runner->gameRunner->queueMatch(stageName, ships, numShips);
+    }
     for (int x = 0; x < numShips; x++) {
       delete ships[x];
     }
@@ -2286,15 +2554,20 @@ int GameRunner_queueMatch(lua_State *L) {
 
 int GameRunner_empty(lua_State *L) {
   MatchRunner *runner = checkGameRunner(L, 1);
+  dispatchSavedReplays(L, runner);
   lua_pushboolean(L, runner->gameRunner->empty());
   return 1;
 }
 
 int GameRunner_nextResult(lua_State *L) {
   MatchRunner *runner = checkGameRunner(L, 1);
+  dispatchSavedReplays(L, runner);
   MatchResult *result = runner->gameRunner->nextResult();
   if (runner->replayBuilder != 0) {
-    runner->gameRunner->deleteReplayBuilder(runner->replayBuilder);
+    if (runner->replaySaver == 0
+        || !runner->replaySaver->release(runner->replayBuilder)) {
+      runner->gameRunner->deleteReplayBuilder(runner->replayBuilder);
+    }
     runner->replayBuilder = 0;
   }
   if (result == 0) {
@@ -2304,6 +2577,7 @@ int GameRunner_nextResult(lua_State *L) {
     bool hasScores = result->hasScores();
     lua_newtable(L);
     setField(L, "stage", result->getStageName());
+    setField(L, "seed", (double) result->getRandomSeed());
     if (result->errored()) {
       setField(L, "errored", true);
       setField(L, "errorMessage", result->getErrorMessage());
@@ -2354,12 +2628,13 @@ int GameRunner_nextResult(lua_State *L) {
   return 1;
 }
 
-char* newFilename(const char *stageName, const char *timestamp) {
+char* newFilename(const char *stageName, const char *timestamp,
+                  const char *extension) {
   std::stringstream nameStream;
   nameStream << ((stageName == 0) ? "unknown" : stageName) << "-" << timestamp
              << "-";
   nameStream << std::hex << (rand() % 4096);
-  nameStream << ".html";
+  nameStream << extension;
 
   std::string filename = nameStream.str();
   char *newFilename = new char[filename.length() + 1];
@@ -2368,41 +2643,177 @@ char* newFilename(const char *stageName, const char *timestamp) {
   return newFilename;
 }
 
-int GameRunner_saveReplay(lua_State *L) {
+// The file is created right away to claim the name, since the replay itself
+// is written later. The timestamp is only set once, since an earlier save of
+// the same replay might still be in progress.
+char* newReplayFilename(ReplayBuilder *replayBuilder, const char *extension) {
+  if (replayBuilder->getTimestamp() == 0) {
+    char *timestamp = getTimestamp();
+    replayBuilder->setTimestamp(timestamp);
+    delete[] timestamp;
+  }
+
+  FileManager *fileManager = new FileManager();
+  std::string replaysDir = getReplaysDir();
+  fileManager->createDirectoryIfNecessary(replaysDir.c_str());
+  char *absFilename = 0;
+  do {
+    if (absFilename != 0) {
+      delete[] absFilename;
+    }
+    char *filename = newFilename(replayBuilder->getStageName(),
+        replayBuilder->getTimestamp(), extension);
+    absFilename = fileManager->getFilePath(replaysDir.c_str(), filename);
+    delete[] filename;
+  } while (fileManager->fileExists(absFilename));
+  delete fileManager;
+
+  FILE *f = fopen(absFilename, "wb");
+  if (f != 0) {
+    fclose(f);
+  }
+  return absFilename;
+}
+
+// Queues the replay from the previous result to be saved in the background,
+// with an optional callback for when it's done.
+int saveReplay(lua_State *L, bool binary) {
   MatchRunner *runner = checkGameRunner(L, 1);
+  dispatchSavedReplays(L, runner);
   if (runner->replayBuilder == 0) {
     lua_pushnil(L);
   } else {
-    FileManager *fileManager = new FileManager();
-    char *absFilename = 0;
-    do {
-      if (absFilename != 0) {
-        delete absFilename;
-      }
-      char *timestamp = getTimestamp();
-      const char *filename =
-          newFilename(runner->replayBuilder->getStageName(), timestamp);
-      absFilename = fileManager->getFilePath(getReplaysDir().c_str(), filename);
-      runner->replayBuilder->setTimestamp(timestamp);
-      delete timestamp;
-    } while (fileManager->fileExists(absFilename));
+    int callbackRef = LUA_NOREF;
+    if (lua_gettop(L) >= 2 && !lua_isnil(L, 2)) {
+      luaL_checktype(L, 2, LUA_TFUNCTION);
+      lua_pushvalue(L, 2);
+      callbackRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+    char *absFilename = newReplayFilename(runner->replayBuilder,
+        binary ? BINARY_REPLAY_EXTENSION : ".html");
+    if (runner->replaySaver == 0) {
+      runner->replaySaver = runner->gameRunner->getReplaySaver();
+    }
+    runner->replaySaver->save(
+        runner->replayBuilder, absFilename, binary, callbackRef);
+    lua_pushstring(L, absFilename);
+    delete[] absFilename;
+  }
+  return 1;
+}
+
+int GameRunner_saveReplay(lua_State *L) {
+  return saveReplay(L, false);
+}
+
+int GameRunner_saveBinaryReplay(lua_State *L) {
+  return saveReplay(L, true);
+}
+
+int GameRunner_waitForReplays(lua_State *L) {
+  MatchRunner *runner = checkGameRunner(L, 1);
+  if (runner->replaySaver != 0) {
+    runner->replaySaver->waitForAll();
+    dispatchSavedReplays(L, runner);
+  }
+  return 0;
+}
 
+// Takes a filename under the replays directory, or the full path returned by
+// saveBinaryReplay, and returns its full path. Like the RunnerFiles functions,
+// this won't go outside that directory.
+char* checkReplayFilename(lua_State *L, int index) {
+  const char *rawFilename = luaL_checkstring(L, index);
+  std::string replaysDir = getReplaysDir();
+  std::string replaysPrefix(replaysDir);
+  replaysPrefix.append(BB_DIRSEP);
+  if (strncmp(rawFilename, replaysPrefix.c_str(), replaysPrefix.size()) == 0) {
+    rawFilename = &(rawFilename[replaysPrefix.size()]);
+  }
+
+  char *filename = new char[strlen(rawFilename) + 1];
+  strcpy(filename, rawFilename);
+  FileManager *fileManager = new FileManager();
+  fileManager->fixSlashes(filename);
+  bool absPath = fileManager->isAbsPath(filename);
+  char *absFilename = 0;
+  if (!absPath) {
+    absFilename = fileManager->getFilePath(replaysDir.c_str(), filename);
+  }
+  delete[] filename;
+  delete fileManager;
+  if (absPath || strncmp(absFilename, replaysPrefix.c_str(),
+                         replaysPrefix.size()) != 0) {
     if (absFilename != 0) {
-      runner->replayBuilder->saveReplay(absFilename);
-      lua_pushstring(L, absFilename);
-      delete absFilename;
+      delete[] absFilename;
     }
-    delete fileManager;
+    luaL_error(L, "Can only read replays from the replays directory.");
+    return 0;
   }
+  return absFilename;
+}
+
+// Saves an HTML replay next to a binary one, with the same name but an .html
+// extension, and returns its filename. Unlike saveReplay, this finishes the
+// save before returning.
+int GameRunner_convertReplay(lua_State *L) {
+  MatchRunner *runner = checkGameRunner(L, 1);
+  char *absFilename = checkReplayFilename(L, 2);
+  FileManager *fileManager = new FileManager();
+  char *dir = fileManager->parseDir(absFilename);
+  char *filename = fileManager->parseFilename(absFilename);
+  char *htmlFilename = htmlReplayFilename(filename);
+
+  ReplayBuilder *replayBuilder =
+      new ReplayBuilder(runner->gameRunner->getReplayTemplateDir());
+  if (replayBuilder->loadBinaryReplay(dir, filename)
+      && replayBuilder->saveReplay(dir, htmlFilename)) {
+    char *htmlPath = fileManager->getFilePath(dir, htmlFilename);
+    lua_pushstring(L, htmlPath);
+    delete[] htmlPath;
+  } else {
+    lua_pushnil(L);
+  }
+  delete replayBuilder;
+  delete[] absFilename;
+  delete[] dir;
+  delete[] filename;
+  delete[] htmlFilename;
+  delete fileManager;
+  return 1;
+}
+
+int GameRunner_openReplay(lua_State *L) {
+  checkGameRunner(L, 1);
+  char *absFilename = checkReplayFilename(L, 2);
+  ReplayReader *reader = new ReplayReader();
+  bool opened = reader->open(absFilename);
+  delete[] absFilename;
+  if (!opened) {
+    delete reader;
+    lua_pushnil(L);
+    return 1;
+  }
+
+  RunnerReplay *replay =
+      (RunnerReplay *) lua_newuserdata(L, sizeof(RunnerReplay));
+  luaL_getmetatable(L, REPLAY_READER);
+  lua_setmetatable(L, -2);
+  replay->reader = reader;
   return 1;
 }
 
 const luaL_Reg GameRunner_methods[] = {
-  {"setThreadCount",  GameRunner_setThreadCount},
-  {"queueMatch",      GameRunner_queueMatch},
-  {"empty",           GameRunner_empty},
-  {"nextResult",      GameRunner_nextResult},
-  {"saveReplay",      GameRunner_saveReplay},
+  {"setThreadCount",    GameRunner_setThreadCount},
+  {"setIsolateMatches", GameRunner_setIsolateMatches},
+  {"queueMatch",        GameRunner_queueMatch},
+  {"empty",             GameRunner_empty},
+  {"nextResult",        GameRunner_nextResult},
+  {"saveReplay",        GameRunner_saveReplay},
+  {"saveBinaryReplay",  GameRunner_saveBinaryReplay},
+  {"waitForReplays",    GameRunner_waitForReplays},
+  {"convertReplay",     GameRunner_convertReplay},
+  {"openReplay",        GameRunner_openReplay},
   {0, 0}
 };
 
@@ -2410,6 +2821,130 @@ int registerGameRunner(lua_State *L) {
   return registerClass(L, MATCH_RUNNER, GameRunner_methods);
 }
 
+RunnerReplay* checkRunnerReplay(lua_State *L, int index) {
+  luaL_checktype(L, index, LUA_TUSERDATA);
+  RunnerReplay *replay =
+      (RunnerReplay *) luaL_checkudata(L, index, REPLAY_READER);
+  if (replay == NULL) luaL_error(L, "error in checkRunnerReplay");
+  return replay;
+}
+
+ReplayReader* checkReplayReader(lua_State *L, int index) {
+  RunnerReplay *replay = checkRunnerReplay(L, index);
+  if (replay->reader == 0) {
+    luaL_error(L, "Replay is closed.");
+  }
+  return replay->reader;
+}
+
+int ReplayReader_stageName(lua_State *L) {
+  lua_pushstring(L, checkReplayReader(L, 1)->getStageName());
+  return 1;
+}
+
+int ReplayReader_timestamp(lua_State *L) {
+  lua_pushstring(L, checkReplayReader(L, 1)->getTimestamp());
+  return 1;
+}
+
+int ReplayReader_numTeams(lua_State *L) {
+  lua_pushinteger(L, checkReplayReader(L, 1)->getNumTeams());
+  return 1;
+}
+
+int ReplayReader_teamName(lua_State *L) {
+  ReplayReader *reader = checkReplayReader(L, 1);
+  const char *teamName = reader->getTeamName(luaL_checkint(L, 2) - 1);
+  if (teamName == 0) {
+    lua_pushnil(L);
+  } else {
+    lua_pushstring(L, teamName);
+  }
+  return 1;
+}
+
+int ReplayReader_numShips(lua_State *L) {
+  lua_pushinteger(L, checkReplayReader(L, 1)->getNumShips());
+  return 1;
+}
+
+int ReplayReader_seek(lua_State *L) {
+  ReplayReader *reader = checkReplayReader(L, 1);
+  lua_pushboolean(L, reader->seek(luaL_checkint(L, 2)));
+  return 1;
+}
+
+int ReplayReader_nextTick(lua_State *L) {
+  lua_pushboolean(L, checkReplayReader(L, 1)->nextTick());
+  return 1;
+}
+
+int ReplayReader_time(lua_State *L) {
+  int time = checkReplayReader(L, 1)->getTime();
+  if (time < 0) {
+    lua_pushnil(L);
+  } else {
+    lua_pushinteger(L, time);
+  }
+  return 1;
+}
+
+int ReplayReader_shipAlive(lua_State *L) {
+  ReplayReader *reader = checkReplayReader(L, 1);
+  lua_pushboolean(L, reader->isShipAlive(luaL_checkint(L, 2) - 1));
+  return 1;
+}
+
+int ReplayReader_shipState(lua_State *L) {
+  ReplayReader *reader = checkReplayReader(L, 1);
+  ReplayShipState state;
+  if (!reader->getShipState(luaL_checkint(L, 2) - 1, &state)) {
+    lua_pushnil(L);
+    return 1;
+  }
+  lua_pushnumber(L, state.x);
+  lua_pushnumber(L, state.y);
+  lua_pushnumber(L, state.thrusterAngle);
+  lua_pushnumber(L, state.thrusterForce);
+  lua_pushnumber(L, state.energy);
+  return 5;
+}
+
+int ReplayReader_close(lua_State *L) {
+  RunnerReplay *replay = checkRunnerReplay(L, 1);
+  if (replay->reader != 0) {
+    delete replay->reader;
+    replay->reader = 0;
+  }
+  return 0;
+}
+
+const luaL_Reg ReplayReader_methods[] = {
+  {"stageName",  ReplayReader_stageName},
+  {"timestamp",  ReplayReader_timestamp},
+  {"numTeams",   ReplayReader_numTeams},
+  {"teamName",   ReplayReader_teamName},
+  {"numShips",   ReplayReader_numShips},
+  {"seek",       ReplayReader_seek},
+  {"nextTick",   ReplayReader_nextTick},
+  {"time",       ReplayReader_time},
+  {"shipAlive",  ReplayReader_shipAlive},
+  {"shipState",  ReplayReader_shipState},
+  {"close",      ReplayReader_close},
+  {0, 0}
+};
+
+// Replays a runner doesn't close are closed when they're garbage collected.
+int registerReplayReader(lua_State *L) {
+  registerClass(L, REPLAY_READER, ReplayReader_methods);
+  luaL_getmetatable(L, REPLAY_READER);
+  lua_pushliteral(L, "__gc");
+  lua_pushcfunction(L, ReplayReader_close);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);
+  return 1;
+}
+
 RunnerFiles* checkRunnerFiles(lua_State *L, int index) {
   luaL_checktype(L, index, LUA_TUSERDATA);
   RunnerFiles *files = (RunnerFiles *) luaL_checkudata(L, index, RUNNER_FILES);
@@ -2434,7 +2969,7 @@ char* checkFilename(lua_State *L, int index, const char *dir) {
   FileManager *fileManager = new FileManager();
   fileManager->fixSlashes(filename);
   if (fileManager->isAbsPath(filename)) {
-    delete filename;
+    delete[] filename;
     delete fileManager;
     luaL_error(L, "Can't read from absolute paths.");
     return 0;
@@ -2444,9 +2979,9 @@ char* checkFilename(lua_State *L, int index, const char *dir) {
     if (strncmp(dir, absFilename, strlen(dir))) {
       error = true;
     }
-    delete filename;
+    delete[] filename;
     if (error) {
-      delete absFilename;
+      delete[] absFilename;
       delete fileManager;
       luaL_error(L, "Can only read from below runners directory.");
       return 0;
@@ -56,6 +56,7 @@ extern int registerStageBuilder(lua_State *L);
 extern int registerWall(lua_State *L);
 extern int registerZone(lua_State *L);
 extern int registerWorld(lua_State *L);
+extern int registerShipViews(lua_State *L);
 extern int registerShipGfx(lua_State *L);
 extern int registerAdmin(lua_State *L);
 extern int registerStageGfx(lua_State *L);
@@ -64,16 +65,21 @@ extern int registerStageGlobals(lua_State *L);
 extern int registerRunnerForm(lua_State *L);
 extern int registerGameRunner(lua_State *L);
 extern int registerRunnerFiles(lua_State *L);
+extern int registerReplayReader(lua_State *L);
 extern int registerRunnerGlobals(lua_State *L);
 
+extern void luaSrand(lua_State *L, int randomSeed);
 extern void killHook(lua_State *L, lua_Debug *ar);
 extern void abortHook(lua_State *L, lua_Debug *ar);
-extern void initStageState(lua_State **stageState, const char *stageCwd);
-extern void initShipState(lua_State **shipState, const char *shipCwd);
-extern void initRunnerState(lua_State **runnerState, const char *runnerCwd);
+extern void initStageState(lua_State **stageState, const char *stageCwd,
+    int randomSeed);
+extern void initShipState(lua_State **shipState, const char *shipCwd,
+    int randomSeed);
+extern void initRunnerState(lua_State **runnerState, const char *runnerCwd,
+    int randomSeed);
 extern Ship* pushShip(lua_State *L);
 extern void pushVisibleEnemyShips(
-    lua_State *L, bool *teamVision, int teamIndex, Ship **ships, int numShips);
+    Team *team, bool *teamVision, Ship **ships, int numShips);
 extern Sensors* pushSensors(
     Team *team, SensorHandler *sensorHandler, ShipProperties **properties);
 extern void cleanupSensorsTables(lua_State *L, Sensors *sensors);
@@ -86,12 +92,14 @@ extern void pushWalls(lua_State *L, Wall** walls, int wallCount);
 extern void pushZones(lua_State *L, Zone** zones, int zoneCount);
 extern void pushCopyOfShips(
     lua_State *L, Ship** ships, Ship **shipsCopy, int numShips);
-extern World* pushWorld(lua_State *L, Stage *stage, int numShips, int teamSize);
+extern World* pushWorld(lua_State *L, Stage *stage, int numShips, int teamSize,
+                        WorldView *view);
 extern ShipGfx* pushShipGfx(lua_State *L);
 extern Admin* pushAdmin(lua_State *L);
 extern StageGfx* pushStageGfx(lua_State *L);
 extern LuaRunnerForm* pushRunnerForm(lua_State *L, GameRunner *gameRunner);
 extern MatchRunner* pushGameRunner(lua_State *L, GameRunner *gameRunner);
+extern void finishGameRunner(MatchRunner *runner);
 extern RunnerFiles* pushRunnerFiles(lua_State *L, GameRunner *gameRunner);
 extern void crawlFiles(lua_State *L, const char *startFile);
 
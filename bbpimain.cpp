@@ -20,6 +20,7 @@
 
 #include <iostream>
 #include <exception>
+#include <algorithm>
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
@@ -32,6 +33,7 @@
 #include "stage.h"
 #include "bbengine.h"
 #include "replaybuilder.h"
+#include "replayformat.h"
 #include "gfxeventhandler.h"
 #include "cliprinthandler.h"
 #include "clipackagereporter.h"
@@ -40,7 +42,7 @@
 
 void printUsage() {
   std::cout << "Usage:" << std::endl;
-  std::cout << "  ./berrybots [-nodisplay] [-savereplay]"
+  std::cout << "  ./berrybots [-nodisplay] [-savereplay] [-teamthreads <n>]"
             << " <stage.lua> <bot1.lua> [<bot2.lua> ...]" << std::endl;
   std::cout << "  OR" << std::endl;
   std::cout << "  ./berrybots -packstage <stage.lua> <version>"
@@ -48,6 +50,8 @@ void printUsage() {
   std::cout << "  OR" << std::endl;
   std::cout << "  ./berrybots -packbot <bot.lua> <version>"
             << std::endl;
+  std::cout << "  OR" << std::endl;
+  std::cout << "  ./berrybots -convertreplay <replay.bbr>" << std::endl;
   exit(0);
 }
 
@@ -134,9 +138,47 @@ int main(int argc, char *argv[]) {
     return 0;
   }
 
+  if (flagExists(argc, argv, "convertreplay")) {
+    char **replayInfo = parseFlag(argc, argv, "convertreplay", 1);
+    if (replayInfo == 0) {
+      printUsage();
+    } else {
+      char *replayAbsName = fileManager->getAbsFilePath(replayInfo[0]);
+      char *replayDir = fileManager->parseDir(replayAbsName);
+      char *replayName = fileManager->parseFilename(replayAbsName);
+      char *htmlName = htmlReplayFilename(replayName);
+      ReplayBuilder *replayBuilder =
+          new ReplayBuilder(resourcePath().c_str());
+      if (!replayBuilder->loadBinaryReplay(replayDir, replayName)) {
+        std::cout << "Couldn't read binary replay: " << replayInfo[0]
+                  << std::endl;
+      } else if (!replayBuilder->saveReplay(replayDir, htmlName)) {
+        std::cout << "Couldn't save replay: " << htmlName << std::endl;
+      } else {
+        char *htmlPath = fileManager->getFilePath(replayDir, htmlName);
+        std::cout << "Saved replay to: " << htmlPath << std::endl;
+        delete[] htmlPath;
+      }
+      delete replayBuilder;
+      delete[] replayAbsName;
+      delete[] replayDir;
+      delete[] replayName;
+      delete[] htmlName;
+      delete[] replayInfo;
+    }
+    return 0;
+  }
+
   bool nodisplay = flagExists(argc, argv, "nodisplay");
   bool saveReplay = flagExists(argc, argv, "savereplay");
-  int optArgsOffset = (nodisplay ? 1 : 0) + (saveReplay ? 1 : 0);
+  char **teamThreadsInfo = parseFlag(argc, argv, "teamthreads", 1);
+  int teamThreads = 1;
+  if (teamThreadsInfo != 0) {
+    teamThreads = std::max(1, atoi(teamThreadsInfo[0]));
+    delete[] teamThreadsInfo;
+  }
+  int optArgsOffset = (nodisplay ? 1 : 0) + (saveReplay ? 1 : 0)
+      + (teamThreadsInfo != 0 ? 2 : 0);
   if (argc < 3 + optArgsOffset) {
     printUsage();
   }
@@ -149,8 +191,10 @@ int main(int argc, char *argv[]) {
   CliPrintHandler *printHandler = new CliPrintHandler();
 
   BerryBotsEngine *engine =
-      new BerryBotsEngine(printHandler, fileManager, resourcePath().c_str());
+      new BerryBotsEngine(printHandler, fileManager, resourcePath().c_str(),
+                          rand());
   Stage *stage = engine->getStage();
+  engine->setTeamThreads(teamThreads);
   // TODO: Enable graphical debugging on Raspberry Pi. Main barrier is UI.
   stage->disableUserGfx();
 
@@ -18,19 +18,47 @@
   3. This notice may not be removed or altered from any source distribution.
 */
 
+#include <stdio.h>
 #include <string.h>
+#include <iostream>
 #include <pthread.h>
 #include <stdlib.h>
-#include <platformstl/synch/sleep_functions.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <algorithm>
+#ifndef __WIN32__
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#endif
 #include "basedir.h"
 #include "filemanager.h"
 #include "zipper.h"
 #include "bbengine.h"
 #include "replaybuilder.h"
+#include "watchdog.h"
 #include "bbrunner.h"
 
 BerryBotsRunner::BerryBotsRunner(int threadCount, Zipper *zipper,
                                  const char *replayTemplateDir) {
+  init(threadCount, zipper, replayTemplateDir, false);
+}
+
+// With isolateMatches, every match runs in a process of its own, so a bot that
+// leaks memory, crashes or hogs a global lock only takes down its own match.
+// Not supported on Windows, where matches always run on threads.
+BerryBotsRunner::BerryBotsRunner(int threadCount, Zipper *zipper,
+    const char *replayTemplateDir, bool isolateMatches) {
+  init(threadCount, zipper, replayTemplateDir, isolateMatches);
+}
+
+void BerryBotsRunner::init(int threadCount, Zipper *zipper,
+    const char *replayTemplateDir, bool isolateMatches) {
+#ifdef __WIN32__
+  isolateMatches = false;
+#endif
   stagesDir_ = new char[getStagesDir().length() + 1];
   strcpy(stagesDir_, getStagesDir().c_str());
   shipsDir_ = new char[getShipsDir().length() + 1];
@@ -44,17 +72,53 @@ BerryBotsRunner::BerryBotsRunner(int threadCount, Zipper *zipper,
     strcpy(replayTemplateDir_, replayTemplateDir);
   }
   listener_ = 0;
+  replaySaver_ = 0;
+  replaySaverCancelled_ = false;
+  pthread_mutex_init(&replaySaverLock_, 0);
 
   schedulerSettings_ = new SchedulerSettings;
+  schedulerSettings_->matches = 0;
   schedulerSettings_->numMatches = 0;
+  schedulerSettings_->matchesCapacity = 0;
+  schedulerSettings_->nextMatch = 0;
+  schedulerSettings_->finishedMatches = 0;
+  schedulerSettings_->numFinished = 0;
+  schedulerSettings_->numResultsProcessed = 0;
+  schedulerSettings_->replayBuilders = new ReplayBuilderMap();
   schedulerSettings_->numThreads = threadCount;
+  schedulerSettings_->threadsRunning = threadCount;
   schedulerSettings_->matchesRunning = 0;
   schedulerSettings_->zipper = zipper;
+  schedulerSettings_->statePool = 0;
+  schedulerSettings_->channels = 0;
+  schedulerSettings_->nextChannel = 0;
+  schedulerSettings_->launcherPid = 0;
+  schedulerSettings_->launcherFd = -1;
   schedulerSettings_->done = false;
-  schedulerSettings_->randomSeed = rand();
-  pthread_create(&schedulerThread_, 0, BerryBotsRunner::scheduler,
-                 (void*) schedulerSettings_);
-  pthread_detach(schedulerThread_);
+  pthread_mutex_init(&schedulerSettings_->launcherLock, 0);
+  pthread_mutex_init(&schedulerSettings_->lock, 0);
+  pthread_cond_init(&schedulerSettings_->matchQueued, 0);
+  pthread_cond_init(&schedulerSettings_->matchFinished, 0);
+#ifndef __WIN32__
+  // The launcher takes a copy of everything above, and has to be forked before
+  // any of our threads start.
+  if (isolateMatches && !startLauncher()) {
+    isolateMatches = false;
+  }
+#endif
+  schedulerSettings_->isolateMatches = isolateMatches;
+  // Matches on other threads may want the same programs at the same time. A
+  // match process can't use the pool, since its builder thread doesn't come
+  // along.
+  if (!isolateMatches) {
+    schedulerSettings_->statePool = new LuaStatePool(threadCount + 1);
+  }
+  for (int x = 0; x < threadCount; x++) {
+    pthread_t workerThread;
+    pthread_create(&workerThread, 0, BerryBotsRunner::worker,
+                   (void*) schedulerSettings_);
+    pthread_detach(workerThread);
+  }
 }
 
 BerryBotsRunner::~BerryBotsRunner() {
@@ -67,55 +131,128 @@ BerryBotsRunner::~BerryBotsRunner() {
   if (listener_ != 0) {
     delete listener_;
   }
+  if (replaySaver_ != 0) {
+    replaySaver_->cancel();
+    delete replaySaver_;
+  }
+  pthread_mutex_destroy(&replaySaverLock_);
 }
 
 void BerryBotsRunner::queueMatch(const char *stageName, char **teamNames,
                                  int numTeams) {
-  if (schedulerSettings_->numMatches < MAX_MATCHES) {
-    MatchConfig *matchConfig = new MatchConfig(stageName, teamNames, numTeams,
-        stagesDir_, shipsDir_, cacheDir_, replayTemplateDir_);
-    schedulerSettings_->matches[schedulerSettings_->numMatches++] = matchConfig;
-    // TODO: error handling for scheduling > max matches
+  queueMatch(stageName, teamNames, numTeams, rand());
+}
+
+// Each match gets its own random seed, reported back in its MatchResult, so a
+// match can be run again exactly by queueing it with the same seed.
+void BerryBotsRunner::queueMatch(const char *stageName, char **teamNames,
+                                 int numTeams, unsigned int randomSeed) {
+  MatchConfig *matchConfig = new MatchConfig(stageName, teamNames, numTeams,
+      randomSeed, stagesDir_, shipsDir_, cacheDir_, replayTemplateDir_);
+  pthread_mutex_lock(&schedulerSettings_->lock);
+  if (schedulerSettings_->numMatches == schedulerSettings_->matchesCapacity) {
+    growMatches();
   }
+  schedulerSettings_->matches[schedulerSettings_->numMatches++] = matchConfig;
+  pthread_cond_signal(&schedulerSettings_->matchQueued);
+  pthread_mutex_unlock(&schedulerSettings_->lock);
 }
 
+// Caller must hold the scheduler lock. Workers only hold on to the matches
+// themselves, not the array, so it's safe to replace it.
+void BerryBotsRunner::growMatches() {
+  SchedulerSettings *settings = schedulerSettings_;
+  int newCapacity = std::max(64, settings->matchesCapacity * 2);
+  MatchConfig **newMatches = new MatchConfig*[newCapacity];
+  int *newFinishedMatches = new int[newCapacity];
+  for (int x = 0; x < settings->numMatches; x++) {
+    newMatches[x] = settings->matches[x];
+  }
+  for (int x = 0; x < settings->numFinished; x++) {
+    newFinishedMatches[x] = settings->finishedMatches[x];
+  }
+  if (settings->matchesCapacity > 0) {
+    delete[] settings->matches;
+    delete[] settings->finishedMatches;
+  }
+  settings->matches = newMatches;
+  settings->finishedMatches = newFinishedMatches;
+  settings->matchesCapacity = newCapacity;
+}
+
+// Waits for a match to finish, waking up every SLEEP_INTERVAL to refresh the
+// listener in the meantime.
 MatchResult* BerryBotsRunner::nextResult() {
   if (allResultsProcessed()) {
     return 0;
-  } else {
-    while (!schedulerSettings_->done) {
-      for (int x = 0; x < schedulerSettings_->numMatches; x++) {
-        MatchConfig *config = schedulerSettings_->matches[x];
-        if (config->isFinished() && !config->hasProcessedResult()) {
-          MatchResult *nextResult = new MatchResult(config->getStageName(),
-              config->getTeamNames(), config->getNumTeams(),
-              config->getWinnerFilename(), config->getTeamResults(),
-              config->hasScores(), config->getReplayBuilder(),
-              config->getErrorMessage());
-          config->processedResult();
-          return nextResult;
-        }
-      }
-      if (listener_ != 0) {
-        listener_->refresh();
-      }
-      platformstl::micro_sleep(SLEEP_INTERVAL);
+  }
+
+  SchedulerSettings *settings = schedulerSettings_;
+  pthread_mutex_lock(&settings->lock);
+  while (!settings->done) {
+    MatchResult *nextResult = nextFinishedResult();
+    if (nextResult != 0) {
+      pthread_mutex_unlock(&settings->lock);
+      return nextResult;
+    }
+
+    struct timeval now;
+    gettimeofday(&now, 0);
+    long usecs = now.tv_usec + SLEEP_INTERVAL;
+    struct timespec timeout;
+    timeout.tv_sec = now.tv_sec + (usecs / 1000000);
+    timeout.tv_nsec = (usecs % 1000000) * 1000;
+    if (pthread_cond_timedwait(&settings->matchFinished, &settings->lock,
+                               &timeout) == ETIMEDOUT && listener_ != 0) {
+      pthread_mutex_unlock(&settings->lock);
+      listener_->refresh();
+      pthread_mutex_lock(&settings->lock);
     }
   }
+  pthread_mutex_unlock(&settings->lock);
   return 0;
 }
 
-bool BerryBotsRunner::allResultsProcessed() {
-  for (int x = 0; x < schedulerSettings_->numMatches; x++) {
-    if (!schedulerSettings_->matches[x]->hasProcessedResult()) {
-      return false;
-    }
+// Caller must hold the scheduler lock.
+MatchResult* BerryBotsRunner::nextFinishedResult() {
+  SchedulerSettings *settings = schedulerSettings_;
+  if (settings->numResultsProcessed == settings->numFinished) {
+    return 0;
   }
-  return true;
+  MatchConfig *config = settings->matches[
+      settings->finishedMatches[settings->numResultsProcessed++]];
+  MatchResult *nextResult = new MatchResult(config->getStageName(),
+      config->getTeamNames(), config->getNumTeams(), config->getRandomSeed(),
+      config->getWinnerFilename(), config->getTeamResults(),
+      config->hasScores(), config->getReplayBuilder(),
+      config->getErrorMessage());
+  config->processedResult();
+  return nextResult;
 }
 
+bool BerryBotsRunner::allResultsProcessed() {
+  pthread_mutex_lock(&schedulerSettings_->lock);
+  bool allProcessed = (schedulerSettings_->numResultsProcessed
+                       == schedulerSettings_->numMatches);
+  pthread_mutex_unlock(&schedulerSettings_->lock);
+  return allProcessed;
+}
+
+// The last worker to exit deletes every ReplayBuilder, so stop the replay
+// saver from touching them first.
 void BerryBotsRunner::quit() {
+  pthread_mutex_lock(&replaySaverLock_);
+  replaySaverCancelled_ = true;
+  if (replaySaver_ != 0) {
+    replaySaver_->cancel();
+  }
+  pthread_mutex_unlock(&replaySaverLock_);
+
+  pthread_mutex_lock(&schedulerSettings_->lock);
   schedulerSettings_->done = true;
+  pthread_cond_broadcast(&schedulerSettings_->matchQueued);
+  pthread_cond_broadcast(&schedulerSettings_->matchFinished);
+  pthread_mutex_unlock(&schedulerSettings_->lock);
 }
 
 void BerryBotsRunner::setListener(RefresherListener *listener) {
@@ -125,6 +262,20 @@ void BerryBotsRunner::setListener(RefresherListener *listener) {
   listener_ = listener;
 }
 
+// Saves replays from this runner's results in the background. The runner owns
+// it, so it can cancel any saves that are left when it quits.
+ReplaySaver* BerryBotsRunner::getReplaySaver() {
+  pthread_mutex_lock(&replaySaverLock_);
+  if (replaySaver_ == 0) {
+    replaySaver_ = new ReplaySaver(REPLAY_SAVER_MAX_PENDING);
+    if (replaySaverCancelled_) {
+      replaySaver_->cancel();
+    }
+  }
+  pthread_mutex_unlock(&replaySaverLock_);
+  return replaySaver_;
+}
+
 void BerryBotsRunner::deleteReplayBuilder(ReplayBuilder *replayBuilder) {
   if (schedulerSettings_->done) {
     // If we've already quit, BerryBotsRunner will delete any pending
@@ -133,76 +284,94 @@ void BerryBotsRunner::deleteReplayBuilder(ReplayBuilder *replayBuilder) {
     return;
   }
 
-  // TODO: is this too slow? a map would be nice.
-  for (int x = 0; x < schedulerSettings_->numMatches; x++) {
-    MatchConfig *config = schedulerSettings_->matches[x];
-    if (config->getReplayBuilder() == replayBuilder) {
-      config->deleteReplayBuilder();
-      break;
-    }
+  pthread_mutex_lock(&schedulerSettings_->lock);
+  MatchConfig *config = schedulerSettings_->replayBuilders->get(replayBuilder);
+  if (config != 0) {
+    schedulerSettings_->replayBuilders->remove(replayBuilder);
+    config->deleteReplayBuilder();
   }
+  pthread_mutex_unlock(&schedulerSettings_->lock);
 }
 
-void *BerryBotsRunner::scheduler(void *vargs) {
+// Each worker thread runs queued matches one at a time until we quit. The last
+// worker to exit cleans up the matches and scheduler settings.
+void *BerryBotsRunner::worker(void *vargs) {
   SchedulerSettings *settings = (SchedulerSettings *) vargs;
-  srand(settings->randomSeed);
+  pthread_mutex_lock(&settings->lock);
+  int channelIndex = settings->nextChannel++;
   while (!settings->done) {
-    platformstl::micro_sleep(SLEEP_INTERVAL);
-    if (settings->matchesRunning < settings->numThreads) {
-      MatchConfig *nextMatch = 0;
-      for (int x = 0; x < settings->numMatches; x++) {
-        MatchConfig *config = settings->matches[x];
-        if (!config->isStarted()) {
-          config->started();
-          nextMatch = config;
-          break;
-        }
+    if (settings->nextMatch < settings->numMatches) {
+      int matchIndex = settings->nextMatch++;
+      MatchSettings matchSettings;
+      matchSettings.schedulerSettings = settings;
+      matchSettings.matchConfig = settings->matches[matchIndex];
+      matchSettings.channel = 0;
+      matchSettings.matchConfig->started();
+      settings->matchesRunning++;
+      pthread_mutex_unlock(&settings->lock);
+
+#ifndef __WIN32__
+      if (settings->isolateMatches) {
+        runIsolatedMatch(&matchSettings, channelIndex);
+      } else {
+        runMatch(&matchSettings);
       }
-      if (nextMatch != 0) {
-        settings->matchesRunning++;
-        pthread_t gameThread;
-        MatchSettings *matchSettings = new MatchSettings;
-        matchSettings->schedulerSettings = settings;
-        matchSettings->matchConfig = nextMatch;
-        matchSettings->randomSeed = rand();
-        pthread_create(&gameThread, 0, BerryBotsRunner::runMatch,
-                       (void*) matchSettings);
-        pthread_detach(gameThread);
+#else
+      runMatch(&matchSettings);
+#endif
+
+      pthread_mutex_lock(&settings->lock);
+      MatchConfig *config = matchSettings.matchConfig;
+      config->finished();
+      if (config->getReplayBuilder() != 0) {
+        settings->replayBuilders->put(config->getReplayBuilder(), config);
       }
+      settings->finishedMatches[settings->numFinished++] = matchIndex;
+      settings->matchesRunning--;
+      pthread_cond_broadcast(&settings->matchFinished);
+    } else {
+      pthread_cond_wait(&settings->matchQueued, &settings->lock);
     }
   }
 
-  bool pendingMatches = false;
-  do {
+  bool lastThread = (--settings->threadsRunning == 0);
+  pthread_mutex_unlock(&settings->lock);
+
+  if (lastThread) {
+#ifndef __WIN32__
+    if (settings->isolateMatches) {
+      stopLauncher(settings);
+    }
+#endif
     for (int x = 0; x < settings->numMatches; x++) {
-      MatchConfig *config = settings->matches[x];
-      if (config->isStarted() && !config->isFinished()) {
-        pendingMatches = true;
-        break;
-      }
-      if (pendingMatches) {
-        platformstl::micro_sleep(SLEEP_INTERVAL);
-      }
+      delete settings->matches[x];
     }
-  } while (pendingMatches);
-
-  for (int x = 0; x < settings->numMatches; x++) {
-    delete settings->matches[x];
+    if (settings->matchesCapacity > 0) {
+      delete[] settings->matches;
+      delete[] settings->finishedMatches;
+    }
+    delete settings->replayBuilders;
+    if (settings->statePool != 0) {
+      delete settings->statePool;
+    }
+    pthread_mutex_destroy(&settings->launcherLock);
+    pthread_mutex_destroy(&settings->lock);
+    pthread_cond_destroy(&settings->matchQueued);
+    pthread_cond_destroy(&settings->matchFinished);
+    delete settings;
   }
-
-  delete settings;
   return 0;
 }
 
-void* BerryBotsRunner::runMatch(void *vargs) {
-  MatchSettings *settings = (MatchSettings *) vargs;
-  srand(settings->randomSeed);
+void BerryBotsRunner::runMatch(MatchSettings *settings) {
   MatchConfig *config = settings->matchConfig;
   SchedulerSettings *schedulerSettings = settings->schedulerSettings;
 
   FileManager *fileManager = new FileManager(schedulerSettings->zipper);
   BerryBotsEngine *engine =
-      new BerryBotsEngine(0, fileManager, config->getReplayTemplateDir());
+      new BerryBotsEngine(0, fileManager, config->getReplayTemplateDir(),
+                          config->getRandomSeed());
+  engine->setStatePool(schedulerSettings->statePool);
   bool aborted = false;
   try {
     engine->initStage(config->getStagesDir(), config->getStageName(),
@@ -218,6 +387,11 @@ void* BerryBotsRunner::runMatch(void *vargs) {
   try {
     while (!aborted && !schedulerSettings->done && !engine->isGameOver()) {
       engine->processTick();
+#ifndef __WIN32__
+      if (settings->channel != 0) {
+        settings->channel->tick();
+      }
+#endif
     }
   } catch (EngineException *e) {
     config->setErrorMessage(e->what());
@@ -239,18 +413,488 @@ void* BerryBotsRunner::runMatch(void *vargs) {
   }
   config->setHasScores(engine->hasScores());
   config->setReplayBuilder(engine->getReplayBuilder());
-  config->finished();
   delete engine;
   delete fileManager;
+}
 
-  schedulerSettings->matchesRunning--;
-  delete settings;
-  return 0;
+#ifndef __WIN32__
+#ifdef MSG_NOSIGNAL
+#define LAUNCHER_SEND_FLAGS  MSG_NOSIGNAL
+#else
+#define LAUNCHER_SEND_FLAGS  0 // SO_NOSIGPIPE is set on the socket instead
+#endif
+#define LAUNCHER_MAX_STRING  (64 * 1024)
+
+// Forks the launcher, a helper process that forks every match process. A
+// child forked from a process with other threads running inherits whatever
+// locks those threads held at the time (in malloc, iostreams, the watchdog),
+// with no one left to release them, so it's only safe to do a few simple
+// things before exec'ing. A match does everything, so the launcher is forked
+// before the runner starts any threads, and never starts any of its own.
+// Returns false if we can't isolate matches, so we fall back to threads.
+bool BerryBotsRunner::startLauncher() {
+  SchedulerSettings *settings = schedulerSettings_;
+  int numChannels = settings->numThreads;
+  settings->channels = new ResultChannel*[numChannels];
+  bool channelsValid = true;
+  for (int x = 0; x < numChannels; x++) {
+    settings->channels[x] = new ResultChannel(RESULT_CHANNEL_CAPACITY);
+    channelsValid = channelsValid && settings->channels[x]->isValid();
+  }
+
+  int launcherFds[2];
+  if (channelsValid
+      && socketpair(AF_UNIX, SOCK_STREAM, 0, launcherFds) == 0) {
+#ifdef SO_NOSIGPIPE
+    int noSigpipe = 1;
+    setsockopt(launcherFds[0], SOL_SOCKET, SO_NOSIGPIPE, &noSigpipe,
+               sizeof(int));
+#endif
+    // Flush before forking so the launcher doesn't repeat buffered output.
+    std::cout.flush();
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(launcherFds[0]);
+      runLauncher(launcherFds[1]);
+      _exit(0);
+    } else if (pid > 0) {
+      close(launcherFds[1]);
+      settings->launcherPid = pid;
+      settings->launcherFd = launcherFds[0];
+      return true;
+    }
+    close(launcherFds[0]);
+    close(launcherFds[1]);
+  }
+
+  for (int x = 0; x < numChannels; x++) {
+    delete settings->channels[x];
+  }
+  delete[] settings->channels;
+  settings->channels = 0;
+  return false;
+}
+
+// The launcher forks a match process for each match a worker sends it, then
+// reports on it through the worker's channel until it's reaped. Once the
+// runner hangs up, or dies, it kills whatever's left and exits.
+void BerryBotsRunner::runLauncher(int launcherFd) {
+  SchedulerSettings *settings = schedulerSettings_;
+  int numChannels = settings->numThreads;
+  pid_t runnerPid = getppid();
+  pid_t *matchPids = new pid_t[numChannels];
+  for (int x = 0; x < numChannels; x++) {
+    matchPids[x] = 0;
+  }
+  int numRunning = 0;
+  bool listening = true;
+  Watchdog::resetAfterFork();
+
+  while (listening || numRunning > 0) {
+    struct pollfd pollFd;
+    pollFd.fd = launcherFd;
+    pollFd.events = POLLIN;
+    pollFd.revents = 0;
+    poll(&pollFd, (listening ? 1 : 0), RESULT_CHANNEL_POLL);
+    if (listening && pollFd.revents != 0) {
+      int channelIndex;
+      MatchConfig *config = receiveMatch(launcherFd, &channelIndex);
+      if (config == 0 || matchPids[channelIndex] != 0) {
+        listening = false;
+      } else {
+        ResultChannel *channel = settings->channels[channelIndex];
+        pid_t pid = fork();
+        if (pid == 0) {
+          close(launcherFd);
+          MatchSettings matchSettings;
+          matchSettings.schedulerSettings = settings;
+          matchSettings.matchConfig = config;
+          matchSettings.channel = channel;
+          channel->startWriter();
+          runMatch(&matchSettings);
+          writeMatchResult(channel, config);
+          channel->flush();
+          // Flush before exiting, since _exit won't.
+          std::cout.flush();
+          fflush(stdout);
+          _exit(0);
+        }
+        channel->launched(pid);
+        if (pid > 0) {
+          matchPids[channelIndex] = pid;
+          numRunning++;
+        }
+      }
+      if (config != 0) {
+        delete config;
+      }
+    }
+    if (getppid() != runnerPid) {
+      listening = false;
+    }
+
+    if (!listening) {
+      for (int x = 0; x < numChannels; x++) {
+        if (matchPids[x] != 0) {
+          kill(matchPids[x], SIGKILL);
+        }
+      }
+    }
+    pid_t pid;
+    while (numRunning > 0 && (pid = waitpid(-1, 0, WNOHANG)) > 0) {
+      for (int x = 0; x < numChannels; x++) {
+        if (matchPids[x] == pid) {
+          matchPids[x] = 0;
+          numRunning--;
+          settings->channels[x]->exited();
+        }
+      }
+    }
+  }
+  delete[] matchPids;
+  close(launcherFd);
+}
+
+static bool sendAll(int fd, const void *data, int length) {
+  const char *bytes = (const char *) data;
+  while (length > 0) {
+    ssize_t sent = send(fd, bytes, length, LAUNCHER_SEND_FLAGS);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    } else if (sent <= 0) {
+      return false;
+    }
+    bytes += sent;
+    length -= (int) sent;
+  }
+  return true;
+}
+
+static bool sendString(int fd, const char *s) {
+  int length = (int) strlen(s);
+  return (sendAll(fd, &length, sizeof(int)) && sendAll(fd, s, length));
+}
+
+static bool receiveAll(int fd, void *data, int length) {
+  char *bytes = (char *) data;
+  while (length > 0) {
+    ssize_t received = recv(fd, bytes, length, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    } else if (received <= 0) {
+      return false;
+    }
+    bytes += received;
+    length -= (int) received;
+  }
+  return true;
+}
+
+// Returns a new string, or null if the runner hung up.
+static char* receiveString(int fd) {
+  int length;
+  if (!receiveAll(fd, &length, sizeof(int)) || length < 0
+      || length > LAUNCHER_MAX_STRING) {
+    return 0;
+  }
+  char *s = new char[length + 1];
+  if (!receiveAll(fd, s, length)) {
+    delete[] s;
+    return 0;
+  }
+  s[length] = '\0';
+  return s;
+}
+
+// Match request format:
+// channel index | random seed | num teams | stage name | team name*
+// Workers send their matches under the launcher lock so they don't interleave.
+bool BerryBotsRunner::sendMatch(SchedulerSettings *settings, int channelIndex,
+                                MatchConfig *config) {
+  int fd = settings->launcherFd;
+  unsigned int randomSeed = config->getRandomSeed();
+  int numTeams = config->getNumTeams();
+  char **teamNames = config->getTeamNames();
+  pthread_mutex_lock(&settings->launcherLock);
+  bool sent = sendAll(fd, &channelIndex, sizeof(int))
+      && sendAll(fd, &randomSeed, sizeof(unsigned int))
+      && sendAll(fd, &numTeams, sizeof(int))
+      && sendString(fd, config->getStageName());
+  for (int x = 0; x < numTeams && sent; x++) {
+    sent = sendString(fd, teamNames[x]);
+  }
+  pthread_mutex_unlock(&settings->launcherLock);
+  return sent;
+}
+
+// Returns a new MatchConfig, or null if the runner hung up.
+MatchConfig* BerryBotsRunner::receiveMatch(int launcherFd, int *channelIndex) {
+  unsigned int randomSeed;
+  int numTeams;
+  if (!receiveAll(launcherFd, channelIndex, sizeof(int))
+      || *channelIndex < 0 || *channelIndex >= schedulerSettings_->numThreads
+      || !receiveAll(launcherFd, &randomSeed, sizeof(unsigned int))
+      || !receiveAll(launcherFd, &numTeams, sizeof(int)) || numTeams < 0
+      || numTeams > LAUNCHER_MAX_STRING) {
+    return 0;
+  }
+  char *stageName = receiveString(launcherFd);
+  if (stageName == 0) {
+    return 0;
+  }
+  char **teamNames = new char*[numTeams];
+  int numReceived = 0;
+  while (numReceived < numTeams
+         && (teamNames[numReceived] = receiveString(launcherFd)) != 0) {
+    numReceived++;
+  }
+  MatchConfig *config = 0;
+  if (numReceived == numTeams) {
+    config = new MatchConfig(stageName, teamNames, numTeams, randomSeed,
+        stagesDir_, shipsDir_, cacheDir_, replayTemplateDir_);
+  }
+  for (int x = 0; x < numReceived; x++) {
+    delete[] teamNames[x];
+  }
+  delete[] teamNames;
+  delete[] stageName;
+  return config;
+}
+
+// Called by the last worker to exit. Hanging up tells the launcher to exit,
+// even if a process forked since has a copy of our end of the socket.
+void BerryBotsRunner::stopLauncher(SchedulerSettings *settings) {
+  shutdown(settings->launcherFd, SHUT_RDWR);
+  close(settings->launcherFd);
+  waitpid(settings->launcherPid, 0, 0);
+  for (int x = 0; x < settings->numThreads; x++) {
+    delete settings->channels[x];
+  }
+  delete[] settings->channels;
+}
+
+// Has the launcher run the match in a process of its own and reads back the
+// results. If the match process dies, or we quit, the match ends with an error
+// instead.
+void BerryBotsRunner::runIsolatedMatch(MatchSettings *settings,
+                                       int channelIndex) {
+  SchedulerSettings *schedulerSettings = settings->schedulerSettings;
+  MatchConfig *config = settings->matchConfig;
+  ResultChannel *channel = schedulerSettings->channels[channelIndex];
+  channel->reset();
+  if (!sendMatch(schedulerSettings, channelIndex, config)) {
+    config->setErrorMessage("Failed to start a process for the match.");
+    return;
+  }
+
+  channel->setLauncher(schedulerSettings->launcherFd,
+                       &(schedulerSettings->done));
+  readMatchResult(channel, config);
+  channel->finishWriter();
+}
+
+// Match result format:
+// error message | winner | has scores | has team results |
+//     (rank | score | show result | num stats | (key | value)*)* |
+//     has replay | replay
+void BerryBotsRunner::writeMatchResult(ResultChannel *channel,
+                                       MatchConfig *config) {
+  channel->writeString(config->getErrorMessage());
+  channel->writeString(config->getWinnerFilename());
+  channel->writeInt(config->hasScores() ? 1 : 0);
+  TeamResult **teamResults = config->getTeamResults();
+  channel->writeInt(teamResults == 0 ? 0 : 1);
+  if (teamResults != 0) {
+    for (int x = 0; x < config->getNumTeams(); x++) {
+      TeamResult *result = teamResults[x];
+      channel->writeInt(result->rank);
+      channel->writeDouble(result->score);
+      channel->writeInt(result->showResult ? 1 : 0);
+      channel->writeInt(result->numStats);
+      for (int y = 0; y < result->numStats; y++) {
+        channel->writeString(result->stats[y]->key);
+        channel->writeDouble(result->stats[y]->value);
+      }
+    }
+  }
+  ReplayBuilder *replayBuilder = config->getReplayBuilder();
+  channel->writeInt(replayBuilder == 0 ? 0 : 1);
+  if (replayBuilder != 0) {
+    replayBuilder->writeTo(channel);
+  }
+}
+
+// Nothing is set on the match until the whole result has arrived.
+void BerryBotsRunner::readMatchResult(ResultChannel *channel,
+                                      MatchConfig *config) {
+  int numTeams = config->getNumTeams();
+  char *errorMessage = channel->readString();
+  char *winner = channel->readString();
+  bool hasScores = (channel->readInt() != 0);
+  TeamResult **teamResults = 0;
+  if (channel->readInt() != 0) {
+    teamResults = new TeamResult*[numTeams];
+    for (int x = 0; x < numTeams; x++) {
+      TeamResult *result = teamResults[x] = new TeamResult;
+      result->rank = channel->readInt();
+      result->score = channel->readDouble();
+      result->showResult = (channel->readInt() != 0);
+      result->numStats =
+          std::max(0, std::min(channel->readInt(), MAX_SCORE_STATS));
+      for (int y = 0; y < result->numStats; y++) {
+        ScoreStat *stat = result->stats[y] = new ScoreStat;
+        stat->key = channel->readString();
+        stat->value = channel->readDouble();
+        if (stat->key == 0) {
+          stat->key = new char[1];
+          stat->key[0] = '\0';
+        }
+      }
+    }
+  }
+  ReplayBuilder *replayBuilder = 0;
+  if (channel->readInt() != 0) {
+    replayBuilder = new ReplayBuilder(config->getReplayTemplateDir());
+    replayBuilder->spillToDisk();
+    replayBuilder->readFrom(channel);
+  }
+
+  if (channel->failed()) {
+    if (channel->launchFailed()) {
+      config->setErrorMessage("Failed to start a process for the match.");
+    } else if (channel->stalled()) {
+      config->setErrorMessage("Match process stopped responding.");
+    } else {
+      config->setErrorMessage("Match process exited unexpectedly.");
+    }
+    if (teamResults != 0) {
+      for (int x = 0; x < numTeams; x++) {
+        TeamResult *result = teamResults[x];
+        for (int y = 0; y < result->numStats; y++) {
+          delete[] result->stats[y]->key;
+          delete result->stats[y];
+        }
+        delete result;
+      }
+      delete[] teamResults;
+    }
+    if (replayBuilder != 0) {
+      delete replayBuilder;
+    }
+  } else {
+    if (errorMessage != 0) {
+      config->setErrorMessage(errorMessage);
+    }
+    if (winner != 0) {
+      config->setWinnerFilename(winner);
+    }
+    config->setHasScores(hasScores);
+    config->setTeamResults(teamResults);
+    config->setReplayBuilder(replayBuilder);
+  }
+  if (errorMessage != 0) {
+    delete[] errorMessage;
+  }
+  if (winner != 0) {
+    delete[] winner;
+  }
+}
+#endif
+
+ReplayBuilderMap::ReplayBuilderMap() {
+  keys_ = 0;
+  values_ = 0;
+  capacity_ = 0;
+  size_ = 0;
+  resize(64);
+}
+
+void ReplayBuilderMap::put(ReplayBuilder *replayBuilder,
+                           MatchConfig *matchConfig) {
+  if ((size_ + 1) * 2 > capacity_) {
+    resize(capacity_ * 2);
+  }
+  int slot = getSlot(replayBuilder);
+  if (keys_[slot] == 0) {
+    size_++;
+  }
+  keys_[slot] = replayBuilder;
+  values_[slot] = matchConfig;
+}
+
+MatchConfig* ReplayBuilderMap::get(ReplayBuilder *replayBuilder) {
+  int slot = getSlot(replayBuilder);
+  return (keys_[slot] == 0) ? 0 : values_[slot];
+}
+
+// Linear probing, so after removing an entry we move up any later entries in
+// the same run that would no longer be found.
+void ReplayBuilderMap::remove(ReplayBuilder *replayBuilder) {
+  int slot = getSlot(replayBuilder);
+  if (keys_[slot] == 0) {
+    return;
+  }
+  keys_[slot] = 0;
+  size_--;
+  int mask = capacity_ - 1;
+  int next = (slot + 1) & mask;
+  while (keys_[next] != 0) {
+    ReplayBuilder *key = keys_[next];
+    MatchConfig *value = values_[next];
+    keys_[next] = 0;
+    int newSlot = getSlot(key);
+    keys_[newSlot] = key;
+    values_[newSlot] = value;
+    next = (next + 1) & mask;
+  }
+}
+
+// The slot holding replayBuilder, or the empty slot where it would go.
+int ReplayBuilderMap::getSlot(ReplayBuilder *replayBuilder) {
+  size_t hash = (size_t) replayBuilder;
+  hash ^= (hash >> 16);
+  hash *= 0x45d9f3b;
+  hash ^= (hash >> 16);
+  int mask = capacity_ - 1;
+  int slot = (int) (hash & mask);
+  while (keys_[slot] != 0 && keys_[slot] != replayBuilder) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+void ReplayBuilderMap::resize(int capacity) {
+  ReplayBuilder **oldKeys = keys_;
+  MatchConfig **oldValues = values_;
+  int oldCapacity = capacity_;
+  keys_ = new ReplayBuilder*[capacity];
+  values_ = new MatchConfig*[capacity];
+  capacity_ = capacity;
+  for (int x = 0; x < capacity; x++) {
+    keys_[x] = 0;
+  }
+  for (int x = 0; x < oldCapacity; x++) {
+    if (oldKeys[x] != 0) {
+      int slot = getSlot(oldKeys[x]);
+      keys_[slot] = oldKeys[x];
+      values_[slot] = oldValues[x];
+    }
+  }
+  if (oldCapacity > 0) {
+    delete[] oldKeys;
+    delete[] oldValues;
+  }
+}
+
+ReplayBuilderMap::~ReplayBuilderMap() {
+  delete[] keys_;
+  delete[] values_;
 }
 
 MatchConfig::MatchConfig(const char *stageName, char **teamNames,
-    int numTeams, const char *stagesDir, const char *shipsDir,
-    const char *cacheDir, const char *replayTemplateDir) {
+    int numTeams, unsigned int randomSeed, const char *stagesDir,
+    const char *shipsDir, const char *cacheDir, const char *replayTemplateDir) {
   stagesDir_ = new char[strlen(stagesDir) + 1];
   strcpy(stagesDir_, stagesDir);
   shipsDir_ = new char[strlen(shipsDir) + 1];
@@ -272,6 +916,7 @@ MatchConfig::MatchConfig(const char *stageName, char **teamNames,
     strcpy(teamNames_[x], teamNames[x]);
   }
   numTeams_ = numTeams;
+  randomSeed_ = randomSeed;
   winnerFilename_ = 0;
   started_ = finished_ = processedResult_ = hasScores_ = false;
   teamResults_ = 0;
@@ -341,6 +986,10 @@ int MatchConfig::getNumTeams() {
   return numTeams_;
 }
 
+unsigned int MatchConfig::getRandomSeed() {
+  return randomSeed_;
+}
+
 const char* MatchConfig::getWinnerFilename() {
   return winnerFilename_;
 }
@@ -416,7 +1065,7 @@ void MatchConfig::setErrorMessage(const char *errorMessage) {
 }
 
 MatchResult::MatchResult(const char *stageName, char **teamNames, int numTeams,
-    const char *winner, TeamResult **teamResults, bool hasScores,
+    unsigned int randomSeed, const char *winner, TeamResult **teamResults, bool hasScores,
     ReplayBuilder *replayBuilder, const char *errorMessage) {
   stageName_ = new char[strlen(stageName) + 1];
   strcpy(stageName_, stageName);
@@ -426,6 +1075,7 @@ MatchResult::MatchResult(const char *stageName, char **teamNames, int numTeams,
     strcpy(teamNames_[x], teamNames[x]);
   }
   numTeams_ = numTeams;
+  randomSeed_ = randomSeed;
   if (winner == 0) {
     winner_ = 0;
   } else {
@@ -469,6 +1119,10 @@ int MatchResult::getNumTeams() {
   return numTeams_;
 }
 
+unsigned int MatchResult::getRandomSeed() {
+  return randomSeed_;
+}
+
 const char* MatchResult::getWinner() {
   return winner_;
 }
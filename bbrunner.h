@@ -21,13 +21,15 @@
 #ifndef BERRYBOTS_RUNNER
 #define BERRYBOTS_RUNNER
 
-#define MAX_MATCHES    100000
-#define SLEEP_INTERVAL  50000 // 0.05s
+#define SLEEP_INTERVAL  50000 // 0.05s, how often nextResult refreshes listener
 
 #include <pthread.h>
 #include "bbutil.h"
 #include "zipper.h"
 #include "replaybuilder.h"
+#include "luastatepool.h"
+#include "resultchannel.h"
+#include "replaysaver.h"
 
 class RefresherListener {
   public:
@@ -43,6 +45,7 @@ class MatchConfig {
   char *stageName_;
   char **teamNames_;
   int numTeams_;
+  unsigned int randomSeed_;
   char *winnerFilename_;
   bool started_;
   bool finished_;
@@ -54,8 +57,8 @@ class MatchConfig {
 
   public:
     MatchConfig(const char *stageName, char **teamNames, int numTeams,
-        const char *stagesDir, const char *shipsDir, const char *cacheDir,
-        const char *replayTemplateDir);
+        unsigned int randomSeed, const char *stagesDir, const char *shipsDir,
+        const char *cacheDir, const char *replayTemplateDir);
     ~MatchConfig();
     const char *getStagesDir();
     const char *getShipsDir();
@@ -64,6 +67,7 @@ class MatchConfig {
     const char *getStageName();
     char **getTeamNames();
     int getNumTeams();
+    unsigned int getRandomSeed();
     const char *getWinnerFilename();
     void setWinnerFilename(const char *name);
     TeamResult** getTeamResults();
@@ -87,6 +91,7 @@ class MatchResult {
   char *stageName_;
   char **teamNames_;
   int numTeams_;
+  unsigned int randomSeed_;
   char *winner_;
   TeamResult **teamResults_;
   bool hasScores_;
@@ -95,12 +100,13 @@ class MatchResult {
 
   public:
     MatchResult(const char *stageName, char **teamNames, int numTeams,
-                const char *winner, TeamResult **teamResults, bool hasScores,
+                unsigned int randomSeed, const char *winner, TeamResult **teamResults, bool hasScores,
                 ReplayBuilder *replayBuilder, const char *errorMessage);
     ~MatchResult();
     const char* getStageName();
     char** getTeamNames();
     int getNumTeams();
+    unsigned int getRandomSeed();
     const char* getWinner();
     TeamResult** getTeamResults();
     bool hasScores();
@@ -109,20 +115,61 @@ class MatchResult {
     const char *getErrorMessage();
 };
 
+// Hash map from each ReplayBuilder to the match that created it, so we can
+// find the match when the ReplayBuilder is deleted.
+class ReplayBuilderMap {
+  ReplayBuilder **keys_;
+  MatchConfig **values_;
+  int capacity_;
+  int size_;
+
+  public:
+    ReplayBuilderMap();
+    ~ReplayBuilderMap();
+    void put(ReplayBuilder *replayBuilder, MatchConfig *matchConfig);
+    MatchConfig* get(ReplayBuilder *replayBuilder);
+    void remove(ReplayBuilder *replayBuilder);
+  private:
+    int getSlot(ReplayBuilder *replayBuilder);
+    void resize(int capacity);
+};
+
+// Shared by the runner and its worker threads. Everything but done is guarded
+// by lock. Matches are started in the order they're queued: workers wait on
+// matchQueued for the next one, and signal matchFinished when they're done.
+// Results are handed out in the order the matches finish. With isolateMatches,
+// each worker thread runs its matches in processes forked by the launcher
+// instead of itself, and reads the results from a channel of its own.
 typedef struct {
-  MatchConfig* matches[MAX_MATCHES];
+  MatchConfig **matches;
   int numMatches;
+  int matchesCapacity;
+  int nextMatch;
+  int *finishedMatches; // indices into matches, in the order they finished
+  int numFinished;
+  int numResultsProcessed;
+  ReplayBuilderMap *replayBuilders;
   int numThreads;
-  volatile int matchesRunning;
+  int threadsRunning;
+  int matchesRunning;
+  bool isolateMatches;
   volatile bool done;
   Zipper *zipper;
-  int randomSeed;
+  LuaStatePool *statePool;
+  ResultChannel **channels; // one per worker thread, with isolateMatches
+  int nextChannel;
+  pid_t launcherPid;
+  int launcherFd;           // where workers send the launcher their matches
+  pthread_mutex_t launcherLock;
+  pthread_mutex_t lock;
+  pthread_cond_t matchQueued;
+  pthread_cond_t matchFinished;
 } SchedulerSettings;
 
 typedef struct {
   SchedulerSettings *schedulerSettings;
   MatchConfig *matchConfig;
-  int randomSeed;
+  ResultChannel *channel; // in a match process, where to report progress
 } MatchSettings;
 
 class BerryBotsRunner {
@@ -130,22 +177,45 @@ class BerryBotsRunner {
   char *shipsDir_;
   char *cacheDir_;
   char *replayTemplateDir_;
-  pthread_t schedulerThread_;
   SchedulerSettings *schedulerSettings_;
   RefresherListener *listener_;
+  ReplaySaver *replaySaver_;
+  pthread_mutex_t replaySaverLock_;
+  bool replaySaverCancelled_;
 
   public:
     BerryBotsRunner(int threadCount, Zipper *zipper,
                     const char *replayTemplateDir);
+    BerryBotsRunner(int threadCount, Zipper *zipper,
+                    const char *replayTemplateDir, bool isolateMatches);
     ~BerryBotsRunner();
     void queueMatch(const char *stageName, char **teamNames, int numTeams);
+    void queueMatch(const char *stageName, char **teamNames, int numTeams,
+                    unsigned int randomSeed);
     MatchResult* nextResult();
     bool allResultsProcessed();
     void quit();
     void setListener(RefresherListener *listener);
     void deleteReplayBuilder(ReplayBuilder *replayBuilder);
-    static void* scheduler(void *vargs);
-    static void* runMatch(void *vargs);
+    ReplaySaver* getReplaySaver();
+    static void* worker(void *vargs);
+    static void runMatch(MatchSettings *settings);
+  private:
+    void init(int threadCount, Zipper *zipper, const char *replayTemplateDir,
+              bool isolateMatches);
+#ifndef __WIN32__
+    bool startLauncher();
+    void runLauncher(int launcherFd);
+    MatchConfig* receiveMatch(int launcherFd, int *channelIndex);
+    static bool sendMatch(SchedulerSettings *settings, int channelIndex,
+                          MatchConfig *config);
+    static void stopLauncher(SchedulerSettings *settings);
+    static void runIsolatedMatch(MatchSettings *settings, int channelIndex);
+    static void writeMatchResult(ResultChannel *channel, MatchConfig *config);
+    static void readMatchResult(ResultChannel *channel, MatchConfig *config);
+#endif
+    MatchResult* nextFinishedResult();
+    void growMatches();
 };
 
 #endif
@@ -42,10 +42,15 @@ extern "C" {
 #define RUNNER_FORM    "RunnerForm"
 #define MATCH_RUNNER   "MatchRunner"
 #define RUNNER_FILES   "RunnerFiles"
+#define REPLAY_READER  "ReplayReader"
 
 class BerryBotsEngine;
 class GameRunner;
 class ReplayBuilder;
+class ReplaySaver;
+class ReplayReader;
+class SensorHandler;
+class EventArena;
 
 // Graphic definition structs
 
@@ -153,6 +158,98 @@ typedef struct {
   bool showResult;
 } TeamResult;
 
+// The views below are copies of engine state, made for ship programs reading
+// it through LuaJIT's FFI. They're refreshed before each call into the ship
+// program, and never point back into the engine, so a ship program can't
+// reach anything it couldn't through the usual functions.
+
+// Copy of one of the team's own ships. The layout must match bb_ship_t in
+// bblua.cpp.
+typedef struct {
+  short index;
+  short teamIndex;
+  double thrusterAngle;
+  double thrusterForce;
+  double x;
+  double y;
+  double heading;
+  double speed;
+  double momentum;
+  double energy;
+  double power;
+  double shields;
+  short torpedoAmmo;
+  short laserGunHeat;
+  short torpedoGunHeat;
+  bool hitWall;
+  bool hitShip;
+  bool alive;
+  bool laserEnabled;
+  bool torpedoEnabled;
+  bool thrusterEnabled;
+  bool energyEnabled;
+  bool powerEnabled;
+  bool shieldsEnabled;
+  bool showName;
+  bool newColors;
+  double kills;
+  double friendlyKills;
+  double damage;
+  double friendlyDamage;
+  double shieldedDamage;
+} ShipView;
+
+// Copy of a visible enemy ship. The layout must match bb_enemy_ship_t in
+// bblua.cpp.
+typedef struct {
+  short index;
+  short teamIndex;
+  double x;
+  double y;
+  double heading;
+  double speed;
+  double momentum;
+  double energy;
+  double power;
+  double shields;
+  short torpedoAmmo;
+  bool isStageShip;
+  char name[MAX_NAME_LENGTH + 1];
+  char teamName[MAX_NAME_LENGTH + 1];
+} EnemyShipView;
+
+typedef struct {
+  int numShips;
+  EnemyShipView *ships;
+} EnemyShipsView;
+
+typedef struct {
+  double shipRadius;
+  double laserSpeed;
+  double laserHeat;
+  double laserDamage;
+  double torpedoSpeed;
+  double torpedoHeat;
+  double torpedoBlastRadius;
+  double torpedoBlastForce;
+  double torpedoBlastDamage;
+  double defaultEnergy;
+  double maxThrusterForce;
+  double wallBounce;
+} WorldConstants;
+
+// Copy of the world, along with the enemy ships the team can see. The layout
+// must match bb_world_t in bblua.cpp.
+typedef struct {
+  int width;
+  int height;
+  short numShips;
+  short teamSize;
+  int time;
+  WorldConstants constants;
+  EnemyShipsView enemyShips;
+} WorldView;
+
 typedef struct {
   short index;
   short firstShipIndex;
@@ -160,7 +257,11 @@ typedef struct {
   short shipsAlive;
   bool hasRoundOver;
   bool hasGameOver;
-  int stageEventRef;
+  EventArena *stageEvents; // StageEvent pointers, until the ship runs
+  int enemyShipsRef; // one EnemyShip table per ship, reused every tick
+  WorldView worldView;
+  ShipView *shipViews; // one per ship, in the same order
+  bool viewsRequested; // views are only kept up to date once this is set
   lua_State *state;
   char name[MAX_NAME_LENGTH + 1];
   char filename[MAX_NAME_LENGTH + 1];
@@ -185,6 +286,7 @@ typedef struct {
   UserGfxText* gfxTexts[MAX_USER_TEXTS];
   int numTexts;
   bool tooManyTexts;
+  int userGfxOverflows; // USER_GFX_* bits, see Stage::reportUserGfxOverflows
   TeamResult result;
 } Team;
 
@@ -207,6 +309,8 @@ typedef struct {
   bool disabled;
   bool ownedByLua;
   BerryBotsEngine *engine;
+  const char *teamName; // points at the team's name, so follows renames
+  ShipView *view; // the ship's copy in its team's views, if it has one
 } ShipProperties;
 
 typedef struct {
@@ -244,7 +348,12 @@ typedef struct {
   ShipProperties *properties;
 } Ship;
 
+// Event tables are only built when a ship program asks for them, so the refs
+// are LUA_NOREF until then.
 typedef struct {
+  SensorHandler *sensorHandler;
+  ShipProperties **properties;
+  int teamIndex;
   int hitByShipRef;
   int hitByLaserRef;
   int hitByTorpedoRef;
@@ -254,6 +363,7 @@ typedef struct {
   int shipFiredTorpedoRef;
   int laserHitShipRef;
   int stageEventRef;
+  EventArena *stageEvents;
 } Sensors;
 
 typedef struct {
@@ -298,6 +408,7 @@ typedef struct {
   int wallsRef;
   int zonesRef;
   int constantsRef;
+  WorldView *view; // the team's, or null for the stage
   BerryBotsEngine *engine;
 } World;
 
@@ -331,12 +442,17 @@ typedef struct {
 typedef struct {
   GameRunner *gameRunner;
   ReplayBuilder *replayBuilder;
+  ReplaySaver *replaySaver;
 } MatchRunner;
 
 typedef struct {
   GameRunner *gameRunner;
 } RunnerFiles;
 
+typedef struct {
+  ReplayReader *reader; // 0 once it's closed
+} RunnerReplay;
+
 extern double limit(double p, double q, double r);
 extern int signum(double x);
 extern double square(double x);
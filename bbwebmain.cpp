@@ -73,7 +73,8 @@ int main(int argc, char *argv[]) {
   srand(time(NULL));
   CliPrintHandler *printHandler = new CliPrintHandler(true);
   BerryBotsEngine *engine =
-      new BerryBotsEngine(printHandler, fileManager, resourcePath().c_str());
+      new BerryBotsEngine(printHandler, fileManager, resourcePath().c_str(),
+                          rand());
   Stage *stage = engine->getStage();
 
   char *stageAbsName = fileManager->getAbsFilePath(argv[1]);
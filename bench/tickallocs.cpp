@@ -0,0 +1,159 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+// Checks Stage::getTickAllocations against the heap. Replaces operator new
+// with one that counts calls, runs moveAndCheckCollisions on a crowded stage
+// with a few different numbers of ships, and compares what the stage reports
+// for each tick with what it actually allocated. Also prints how many ticks
+// allocated anything, which should only be the few where a scratch buffer had
+// to grow.
+//
+// Build with "make benchtickallocs", then run ./tickallocs [ticks].
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <new>
+#include "bbconst.h"
+#include "bbutil.h"
+#include "randomgen.h"
+#include "point2d.h"
+#include "stage.h"
+
+#define BENCH_WIDTH   2000
+#define BENCH_HEIGHT  2000
+#define BENCH_WALLS   60
+#define BENCH_TICKS   400
+
+int numNews = 0;
+
+void* operator new(size_t size) throw(std::bad_alloc) {
+  numNews++;
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == 0) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) throw() {
+  free(p);
+}
+
+double randomBetween(double low, double high) {
+  return low + (high - low)*(rand() / (double) RAND_MAX);
+}
+
+// Runs numShips ships around the stage for numTicks ticks, thrusting in random
+// directions. Returns how many ticks the stage's count was wrong.
+int runShips(Stage *stage, int numShips, int numTicks) {
+  Ship *shipStates = new Ship[numShips];
+  Ship *oldShipStates = new Ship[numShips];
+  Ship **ships = new Ship*[numShips];
+  Ship **oldShips = new Ship*[numShips];
+  for (int x = 0; x < numShips; x++) {
+    Ship *ship = ships[x] = &(shipStates[x]);
+    oldShips[x] = &(oldShipStates[x]);
+    memset(ship, 0, sizeof(Ship));
+    ship->index = x;
+    ship->teamIndex = x;
+    ship->alive = true;
+    ship->thrusterEnabled = true;
+    ship->energy = 1000000;
+    ship->heading = randomBetween(0, 2*M_PI);
+    ship->momentum = randomBetween(0, SPEED_OF_LIGHT);
+    bool safeStart;
+    do {
+      Point2D *start = stage->getStart();
+      ship->x = start->getX();
+      ship->y = start->getY();
+      delete start;
+      safeStart = true;
+      for (int y = 0; y < x; y++) {
+        if (square(ship->x - ships[y]->x) + square(ship->y - ships[y]->y)
+            < square(SHIP_SIZE)) {
+          safeStart = false;
+        }
+      }
+    } while (!safeStart);
+  }
+
+  int numMismatches = 0;
+  int reportedTotal = 0;
+  int actualTotal = 0;
+  int allocatingTicks = 0;
+  for (int t = 0; t < numTicks; t++) {
+    for (int x = 0; x < numShips; x++) {
+      ships[x]->thrusterAngle = randomBetween(0, 2*M_PI);
+      ships[x]->thrusterForce = MAX_THRUSTER_FORCE;
+      *(oldShips[x]) = *(ships[x]);
+    }
+    int newsBefore = numNews;
+    stage->moveAndCheckCollisions(oldShips, ships, numShips, t);
+    int actual = numNews - newsBefore;
+    int reported = stage->getTickAllocations();
+    if (reported != actual) {
+      numMismatches++;
+    }
+    if (actual > 0) {
+      allocatingTicks++;
+    }
+    reportedTotal += reported;
+    actualTotal += actual;
+  }
+
+  printf("%4d ships: %5d allocations reported, %5d counted, in %d of %d "
+         "ticks, %d ticks wrong\n", numShips, reportedTotal, actualTotal,
+         allocatingTicks, numTicks, numMismatches);
+
+  delete[] shipStates;
+  delete[] oldShipStates;
+  delete[] ships;
+  delete[] oldShips;
+  return numMismatches;
+}
+
+int main(int argc, char **argv) {
+  int numTicks = (argc > 1 ? atoi(argv[1]) : BENCH_TICKS);
+  srand(1);
+
+  RandomGenerator *random = new RandomGenerator(1);
+  Stage *stage = new Stage(BENCH_WIDTH, BENCH_HEIGHT, random);
+  stage->setRelativistic(true);
+  for (int x = 0; x < BENCH_WALLS; x++) {
+    stage->addWall((int) randomBetween(0, BENCH_WIDTH - 100),
+        (int) randomBetween(0, BENCH_HEIGHT - 100),
+        (int) randomBetween(10, 100), (int) randomBetween(10, 100), true);
+  }
+  stage->buildBaseWalls();
+
+  // Same stage throughout, so each run starts with the last one's buffers.
+  int numMismatches = 0;
+  numMismatches += runShips(stage, 8, numTicks);
+  numMismatches += runShips(stage, 64, numTicks);
+  numMismatches += runShips(stage, 32, numTicks);
+  numMismatches += runShips(stage, 256, numTicks);
+
+  delete stage;
+  delete random;
+  return (numMismatches == 0 ? 0 : 1);
+}
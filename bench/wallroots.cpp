@@ -0,0 +1,305 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+// Times the ways we've solved for relativistic ship-wall collision times:
+// newtonBisect on one candidate at a time, the way the stage used to;
+// BatchRootFinder doing a full relPushFun for every evaluation; and
+// BatchRootFinder pushing from each ship's RelPushStart, the way the stage
+// does now. Checks that all three give the same times, then prints how long
+// each one took.
+//
+// Then does the same for non-relativistic ships, comparing newtonBisect on
+// nonRelPushFun, the way the stage used to, with the closed form solvers it
+// uses now. Those only agree to within rounding, so it prints the largest
+// difference instead of requiring an exact match.
+//
+// Build with "make benchwallroots", then run ./wallroots [rounds].
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/time.h>
+#include "bbconst.h"
+#include "bbutil.h"
+#include "line2d.h"
+#include "batchroot.h"
+#include "stage.h"
+
+#define BENCH_SHIPS       64
+#define BENCH_WALLS_EACH  8   // walls near each ship, 3 candidates apiece
+#define BENCH_ROUNDS      200
+#define NON_REL_MAX_DIFF  1e-9
+
+typedef struct {
+  WallCandidate *candidate;
+  void (*pushFun)(double, double*, double*);
+} SequentialRootStruct;
+
+// The old wallRootFun and wallEndpointRootFun, as one function.
+int sequentialWallRootFun(double* tt, void* params, double* out) {
+  SequentialRootStruct *srs = static_cast<SequentialRootStruct*>(params);
+  WallCandidate *candidate = srs->candidate;
+  double coordsT[6];
+  srs->pushFun((*tt), candidate->smd->coords, coordsT);
+  if (candidate->wallEndpoint == 0) {
+    Line2D *wall = candidate->wall;
+    out[0] = wall->signedDistance(coordsT[0], coordsT[1]) - SHIP_RADIUS;
+    out[1] = wall->nx()*coordsT[2] + wall->ny()*coordsT[3];
+  } else {
+    double dx = coordsT[0] - candidate->xp;
+    double dy = coordsT[1] - candidate->yp;
+    out[0] = square(dx) + square(dy) - square(SHIP_RADIUS);
+    out[1] = 2.*(dx*coordsT[2] + dy*coordsT[3]);
+  }
+  return 0;
+}
+
+// relWallBatchRootFun as it was before RelPushStart.
+void fullPushBatchRootFun(double *xx, int *indices, int numIndices,
+                          void *params, double *ff, double *df) {
+  WallCandidate *candidates = static_cast<WallCandidate*>(params);
+  double coordsT[6];
+  for (int x = 0; x < numIndices; x++) {
+    int index = indices[x];
+    WallCandidate *candidate = &(candidates[index]);
+    relPushFun(xx[index], candidate->smd->coords, coordsT);
+    if (candidate->wallEndpoint == 0) {
+      Line2D *wall = candidate->wall;
+      ff[index] = wall->signedDistance(coordsT[0], coordsT[1]) - SHIP_RADIUS;
+      df[index] = wall->nx()*coordsT[2] + wall->ny()*coordsT[3];
+    } else {
+      double dx = coordsT[0] - candidate->xp;
+      double dy = coordsT[1] - candidate->yp;
+      ff[index] = square(dx) + square(dy) - square(SHIP_RADIUS);
+      df[index] = 2.*(dx*coordsT[2] + dy*coordsT[3]);
+    }
+  }
+}
+
+double randomBetween(double low, double high) {
+  return low + (high - low)*(rand() / (double) RAND_MAX);
+}
+
+long long currentTimeMicros() {
+  struct timeval now;
+  gettimeofday(&now, 0);
+  return (((long long) now.tv_sec) * 1000000) + now.tv_usec;
+}
+
+// Ships moving at high speeds under full thrust, each with a few walls close
+// enough that some of them get hit within the tick. Without relativity, the
+// same momentum is also the velocity.
+void initShips(ShipMoveData *shipData, WallCandidate *candidates,
+               Line2D **walls, bool relativistic) {
+  srand(1);
+  int numWalls = 0;
+  int numCandidatesSet = 0;
+  for (int ii = 0; ii < BENCH_SHIPS; ii++) {
+    double *c = shipData[ii].coords;
+    double momentumAngle = randomBetween(0, 2*M_PI);
+    double momentum = randomBetween(0, 3*SPEED_OF_LIGHT);
+    double forceAngle = randomBetween(0, 2*M_PI);
+    c[0] = randomBetween(100, 900);
+    c[1] = randomBetween(100, 900);
+    c[4] = momentum*cos(momentumAngle);
+    c[5] = momentum*sin(momentumAngle);
+    double gamma = (relativistic
+        ? sqrt(1 + square(momentum)/square(SPEED_OF_LIGHT)) : 1.);
+    c[2] = c[4]/gamma;
+    c[3] = c[5]/gamma;
+    c[6] = MAX_THRUSTER_FORCE*cos(forceAngle);
+    c[7] = MAX_THRUSTER_FORCE*sin(forceAngle);
+    for (int jj = 0; jj < BENCH_WALLS_EACH; jj++) {
+      double angle = randomBetween(0, 2*M_PI);
+      double distance = randomBetween(SHIP_RADIUS, SHIP_RADIUS + 60);
+      double cx = c[0] + distance*cos(angle);
+      double cy = c[1] + distance*sin(angle);
+      double wallAngle = angle + M_PI/2 + randomBetween(-0.5, 0.5);
+      double halfLength = randomBetween(5, 40);
+      Line2D *wall = walls[numWalls++] = new Line2D(
+          cx - halfLength*cos(wallAngle), cy - halfLength*sin(wallAngle),
+          cx + halfLength*cos(wallAngle), cy + halfLength*sin(wallAngle));
+      for (int endpoint = 0; endpoint < 3; endpoint++) {
+        WallCandidate *candidate = &(candidates[numCandidatesSet++]);
+        candidate->smd = &(shipData[ii]);
+        candidate->wall = wall;
+        candidate->shipIndex = ii;
+        candidate->wallIndex = jj;
+        candidate->wallEndpoint = endpoint;
+        candidate->xp = (endpoint == 2 ? wall->x2() : wall->x1());
+        candidate->yp = (endpoint == 2 ? wall->y2() : wall->y1());
+      }
+    }
+  }
+}
+
+void deleteWalls(Line2D **walls) {
+  for (int x = 0; x < BENCH_SHIPS * BENCH_WALLS_EACH; x++) {
+    delete walls[x];
+  }
+}
+
+int main(int argc, char **argv) {
+  int rounds = (argc > 1 ? atoi(argv[1]) : BENCH_ROUNDS);
+
+  ShipMoveData *shipData = new ShipMoveData[BENCH_SHIPS];
+  int numCandidates = BENCH_SHIPS * BENCH_WALLS_EACH * 3;
+  WallCandidate *candidates = new WallCandidate[numCandidates];
+  Line2D **walls = new Line2D*[BENCH_SHIPS * BENCH_WALLS_EACH];
+  initShips(shipData, candidates, walls, true);
+
+  double *sequentialTimes = new double[numCandidates];
+  int *sequentialStatus = new int[numCandidates];
+  double *fullPushTimes = new double[numCandidates];
+  int *fullPushStatus = new int[numCandidates];
+  double *batchTimes = new double[numCandidates];
+  int *batchStatus = new int[numCandidates];
+  BatchRootFinder *rootFinder = new BatchRootFinder();
+  double tMax = 1.;
+
+  long long start = currentTimeMicros();
+  for (int r = 0; r < rounds; r++) {
+    for (int x = 0; x < numCandidates; x++) {
+      SequentialRootStruct srs;
+      srs.candidate = &(candidates[x]);
+      srs.pushFun = relPushFun;
+      double tStart[2] = {0., tMax};
+      sequentialStatus[x] = newtonBisect(sequentialWallRootFun, tStart, &srs,
+          &(sequentialTimes[x]), DEFAULT_EPS, DEFAULT_EPS);
+    }
+  }
+  long long sequentialMicros = currentTimeMicros() - start;
+
+  start = currentTimeMicros();
+  for (int r = 0; r < rounds; r++) {
+    rootFinder->solve(fullPushBatchRootFun, numCandidates, 0., tMax,
+        candidates, fullPushTimes, fullPushStatus, DEFAULT_EPS, DEFAULT_EPS);
+  }
+  long long fullPushMicros = currentTimeMicros() - start;
+
+  start = currentTimeMicros();
+  for (int r = 0; r < rounds; r++) {
+    for (int ii = 0; ii < BENCH_SHIPS; ii++) {
+      relPushStart(shipData[ii].coords, &(shipData[ii].relStart));
+    }
+    rootFinder->solve(relWallBatchRootFun, numCandidates, 0., tMax,
+        candidates, batchTimes, batchStatus, DEFAULT_EPS, DEFAULT_EPS);
+  }
+  long long batchMicros = currentTimeMicros() - start;
+
+  // newtonBisect leaves the result alone if the bracket is bad, so only
+  // compare candidates it actually solved.
+  int numCollisions = 0;
+  int numMismatches = 0;
+  double maxDiff = 0;
+  for (int x = 0; x < numCandidates; x++) {
+    if (sequentialStatus[x] == 1) {
+      numCollisions++;
+    }
+    if (sequentialStatus[x] != fullPushStatus[x]
+        || sequentialStatus[x] != batchStatus[x]) {
+      numMismatches++;
+    } else if (sequentialStatus[x] != -1) {
+      maxDiff = fmax(maxDiff, fabs(sequentialTimes[x] - fullPushTimes[x]));
+      maxDiff = fmax(maxDiff, fabs(sequentialTimes[x] - batchTimes[x]));
+    }
+  }
+
+  printf("%d candidates (%d with a root in the tick), %d rounds\n",
+         numCandidates, numCollisions, rounds);
+  printf("status mismatches: %d, max time difference: %g\n", numMismatches,
+         maxDiff);
+  printf("newtonBisect, one at a time:    %8.1f ms\n",
+         sequentialMicros / 1000.);
+  printf("BatchRootFinder, full push:     %8.1f ms\n", fullPushMicros / 1000.);
+  printf("BatchRootFinder, RelPushStart:  %8.1f ms\n", batchMicros / 1000.);
+  deleteWalls(walls);
+
+  // Non-relativistic ships through the same walls, reusing the output arrays:
+  // the sequential times for newtonBisect and the batch ones for the closed
+  // forms.
+  initShips(shipData, candidates, walls, false);
+  start = currentTimeMicros();
+  for (int r = 0; r < rounds; r++) {
+    for (int x = 0; x < numCandidates; x++) {
+      SequentialRootStruct srs;
+      srs.candidate = &(candidates[x]);
+      srs.pushFun = nonRelPushFun;
+      double tStart[2] = {0., tMax};
+      sequentialStatus[x] = newtonBisect(sequentialWallRootFun, tStart, &srs,
+          &(sequentialTimes[x]), DEFAULT_EPS, DEFAULT_EPS);
+    }
+  }
+  long long nonRelSequentialMicros = currentTimeMicros() - start;
+
+  start = currentTimeMicros();
+  for (int r = 0; r < rounds; r++) {
+    for (int x = 0; x < numCandidates; x++) {
+      WallCandidate *candidate = &(candidates[x]);
+      if (candidate->wallEndpoint == 0) {
+        batchStatus[x] = nonRelWallCollisionTime(candidate->smd,
+            candidate->wall, tMax, &(batchTimes[x]));
+      } else {
+        batchStatus[x] = nonRelWallEndpointCollisionTime(candidate->smd,
+            candidate->xp, candidate->yp, tMax, &(batchTimes[x]));
+      }
+    }
+  }
+  long long closedFormMicros = currentTimeMicros() - start;
+
+  int numNonRelCollisions = 0;
+  int numNonRelMismatches = 0;
+  double nonRelMaxDiff = 0;
+  for (int x = 0; x < numCandidates; x++) {
+    if (sequentialStatus[x] == 1) {
+      numNonRelCollisions++;
+    }
+    if (sequentialStatus[x] != batchStatus[x]) {
+      numNonRelMismatches++;
+    } else if (sequentialStatus[x] != -1) {
+      nonRelMaxDiff = fmax(nonRelMaxDiff,
+                           fabs(sequentialTimes[x] - batchTimes[x]));
+    }
+  }
+
+  printf("\nnon-relativistic: %d with a root in the tick\n",
+         numNonRelCollisions);
+  printf("status mismatches: %d, max time difference: %g\n",
+         numNonRelMismatches, nonRelMaxDiff);
+  printf("newtonBisect on nonRelPushFun:  %8.1f ms\n",
+         nonRelSequentialMicros / 1000.);
+  printf("closed forms:                   %8.1f ms\n",
+         closedFormMicros / 1000.);
+  deleteWalls(walls);
+
+  delete[] walls;
+  delete[] candidates;
+  delete[] shipData;
+  delete[] sequentialTimes;
+  delete[] sequentialStatus;
+  delete[] fullPushTimes;
+  delete[] fullPushStatus;
+  delete[] batchTimes;
+  delete[] batchStatus;
+  delete rootFinder;
+  return (numMismatches == 0 && maxDiff == 0 && numNonRelMismatches == 0
+          && nonRelMaxDiff < NON_REL_MAX_DIFF ? 0 : 1);
+}
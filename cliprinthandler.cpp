@@ -62,13 +62,12 @@ void CliPrintHandler::shipError(lua_State *L, const char *text) {
 }
 
 void CliPrintHandler::doPrint(lua_State *L, const char *text, bool isError) {
-  for (int x = 0; x < numTeams_; x++) {
-    Team *team = teams_[x];
-    if (team->state == L) {
-      if (!onlyPlayer1Errors_ || (x == 0 && isError)) {
-        std::cout << "Ship: " << teamNames_[x] << ": " << text << std::endl;
-      }
-      break;
+  Team *team = (Team *) lua_getowner(L);
+  if (team != 0 && team->index < nextTeamIndex_
+      && teams_[team->index] == team) {
+    int x = team->index;
+    if (!onlyPlayer1Errors_ || (x == 0 && isError)) {
+      std::cout << "Ship: " << teamNames_[x] << ": " << text << std::endl;
     }
   }
 }
@@ -0,0 +1,77 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <string.h>
+#include "commandbuffer.h"
+
+CommandBuffer::CommandBuffer() {
+  commands_ = new EventArena(sizeof(TeamCommand));
+}
+
+CommandBuffer::~CommandBuffer() {
+  clear();
+  delete commands_;
+}
+
+void CommandBuffer::addFireLaser(Ship *ship, double heading) {
+  TeamCommand *command = (TeamCommand *) commands_->allocate();
+  command->type = COMMAND_FIRE_LASER;
+  command->ship = ship;
+  command->heading = heading;
+  command->text = 0;
+}
+
+void CommandBuffer::addFireTorpedo(Ship *ship, double heading,
+                                   double distance) {
+  TeamCommand *command = (TeamCommand *) commands_->allocate();
+  command->type = COMMAND_FIRE_TORPEDO;
+  command->ship = ship;
+  command->heading = heading;
+  command->distance = distance;
+  command->text = 0;
+}
+
+void CommandBuffer::addText(int type, Ship *ship, const char *text) {
+  TeamCommand *command = (TeamCommand *) commands_->allocate();
+  command->type = type;
+  command->ship = ship;
+  command->text = new char[strlen(text) + 1];
+  strcpy(command->text, text);
+}
+
+TeamCommand* CommandBuffer::getCommands() {
+  return (TeamCommand *) commands_->getEvents();
+}
+
+int CommandBuffer::getNumCommands() {
+  return commands_->getNumEvents();
+}
+
+void CommandBuffer::clear() {
+  TeamCommand *commands = getCommands();
+  int numCommands = getNumCommands();
+  for (int x = 0; x < numCommands; x++) {
+    if (commands[x].text != 0) {
+      delete[] commands[x].text;
+    }
+  }
+  commands_->reset();
+}
@@ -0,0 +1,60 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+#include "bbutil.h"
+#include "eventarena.h"
+
+#define COMMAND_FIRE_LASER     1
+#define COMMAND_FIRE_TORPEDO   2
+#define COMMAND_PRINT          3
+#define COMMAND_PRINT_ERROR    4
+#define COMMAND_SET_SHIP_NAME  5
+#define COMMAND_SET_TEAM_NAME  6
+
+typedef struct {
+  int type;
+  Ship *ship;
+  double heading;
+  double distance;
+  char *text;
+} TeamCommand;
+
+// Records the calls a ship program makes that would change shared engine state
+// while teams are running in parallel, so they can be applied afterwards in a
+// fixed order.
+class CommandBuffer {
+  EventArena *commands_;
+
+  public:
+    CommandBuffer();
+    ~CommandBuffer();
+    void addFireLaser(Ship *ship, double heading);
+    void addFireTorpedo(Ship *ship, double heading, double distance);
+    void addText(int type, Ship *ship, const char *text);
+    TeamCommand* getCommands();
+    int getNumCommands();
+    void clear();
+};
+
+#endif
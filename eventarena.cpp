@@ -0,0 +1,57 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <string.h>
+#include "eventarena.h"
+
+EventArena::EventArena(int eventSize) {
+  eventSize_ = eventSize;
+  numEvents_ = 0;
+  capacity_ = EVENT_ARENA_INITIAL_CAPACITY;
+  events_ = new char[eventSize_ * capacity_];
+}
+
+EventArena::~EventArena() {
+  delete[] events_;
+}
+
+void* EventArena::allocate() {
+  if (numEvents_ == capacity_) {
+    char *newEvents = new char[eventSize_ * capacity_ * 2];
+    memcpy(newEvents, events_, eventSize_ * numEvents_);
+    delete[] events_;
+    events_ = newEvents;
+    capacity_ *= 2;
+  }
+  return &(events_[eventSize_ * numEvents_++]);
+}
+
+void* EventArena::getEvents() {
+  return events_;
+}
+
+int EventArena::getNumEvents() {
+  return numEvents_;
+}
+
+void EventArena::reset() {
+  numEvents_ = 0;
+}
@@ -0,0 +1,47 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef EVENT_ARENA_H
+#define EVENT_ARENA_H
+
+#define EVENT_ARENA_INITIAL_CAPACITY  16
+
+// Holds one tick's worth of same-sized event structs by value. New events are
+// bump allocated from one contiguous block, so they can be read back as a
+// plain array, and reset() throws them all away without freeing anything. The
+// block doubles when it's full instead of dropping events. Pointers returned by
+// allocate() are only good until the next allocate().
+class EventArena {
+  char *events_;
+  int eventSize_;
+  int numEvents_;
+  int capacity_;
+
+  public:
+    EventArena(int eventSize);
+    ~EventArena();
+    void* allocate();
+    void* getEvents();
+    int getNumEvents();
+    void reset();
+};
+
+#endif
@@ -37,6 +37,34 @@ extern "C" {
   #include "lua.h"
   #include "lualib.h"
   #include "lauxlib.h"
+  #include "luajit.h"
+}
+
+#define BYTECODE_MAGIC  "BBBC"
+
+// Written at the start of each file in the bytecode cache. The filename
+// already covers the source, but we check it again before trusting the
+// bytecode, along with its length in case the file was cut short.
+typedef struct {
+  char magic[4];
+  int luajitVersion;
+  int sourceLength;
+  unsigned int sourceHash;
+  int bytecodeLength;
+} BytecodeHeader;
+
+static unsigned int fnvHash(unsigned int hash, const char *s, int length) {
+  for (int x = 0; x < length; x++) {
+    hash = (hash ^ (unsigned char) s[x]) * 16777619u;
+  }
+  return hash;
+}
+
+static unsigned int djbHash(unsigned int hash, const char *s, int length) {
+  for (int x = 0; x < length; x++) {
+    hash = ((hash << 5) + hash) + (unsigned char) s[x];
+  }
+  return hash;
 }
 
 FileManager::FileManager() {
@@ -602,9 +630,9 @@ void FileManager::packageStage(const char *stagesBaseDir, const char *stageName,
   checkLuaFilename(stageName);
   char *stageAbsBaseDir = getAbsFilePath(stagesBaseDir);
   lua_State *stageState;
-  initStageState(&stageState, stageAbsBaseDir);
+  initStageState(&stageState, stageAbsBaseDir, rand());
   
-  BerryBotsEngine engine(0, this, 0);
+  BerryBotsEngine engine(0, this, 0, rand());
   Stage *stage = engine.getStage();
   if (luaL_loadfile(stageState, stageName)
       || engine.callUserLuaCode(stageState, 0, "", PCALL_VALIDATE)) {
@@ -732,8 +760,8 @@ void FileManager::packageShip(const char *shipBaseDir, const char *shipName,
   checkLuaFilename(shipName);
   char *shipAbsBaseDir = getAbsFilePath(shipBaseDir);
   lua_State *shipState;
-  initShipState(&shipState, shipAbsBaseDir);
-  BerryBotsEngine engine(0, this, 0);
+  initShipState(&shipState, shipAbsBaseDir, rand());
+  BerryBotsEngine engine(0, this, 0, rand());
   crawlFiles(shipState, shipName, &engine);
 
   lua_getfield(shipState, LUA_REGISTRYINDEX, "__FILES");
@@ -833,6 +861,49 @@ char* FileManager::readFile(const char *filename)
   return contents;
 }
 
+// Reads the whole file as is, returning 0 if it can't be read.
+char* FileManager::readBinaryFile(const char *filename, int *length) {
+  if (isDirectory(filename)) {
+    return 0;
+  }
+  FILE *f = fopen(filename, "rb");
+  if (f == 0) {
+    return 0;
+  }
+
+  fseek(f, 0, SEEK_END);
+  long fileLength = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (fileLength < 0) {
+    fclose(f);
+    return 0;
+  }
+  char *contents = new char[fileLength + 1];
+  if (fread(contents, 1, fileLength, f) != (size_t) fileLength) {
+    fclose(f);
+    delete[] contents;
+    return 0;
+  }
+  fclose(f);
+  contents[fileLength] = '\0';
+  *length = (int) fileLength;
+  return contents;
+}
+
+// A cheap check for whether a file has changed, without reading it: its size
+// and last modified time. Edits within the same second that keep the size
+// won't show up here.
+bool FileManager::stampFile(const char *filename, long long *size,
+                            long long *modified) {
+  struct stat st;
+  if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode)) {
+    return false;
+  }
+  *size = (long long) st.st_size;
+  *modified = (long long) st.st_mtime;
+  return true;
+}
+
 void FileManager::writeFile(const char *filename, const char *contents) {
   char *dir = parseDir(filename);
   createDirectoryIfNecessary(dir);
@@ -973,6 +1044,131 @@ void FileManager::saveBytecode(const char *srcFile, const char *outputFile,
   fclose(D);
 }
 
+static int bufferWriter(lua_State* L, const void* p, size_t size, void* u) {
+  ((std::string *) u)->append((const char *) p, size);
+  return 0;
+}
+
+// Like luaL_loadfile, but keeps the compiled bytecode under cacheDir so the
+// same file isn't parsed again for every match. Cache entries are named by a
+// hash of the chunk name and source contents, so editing a file just leads
+// to a new entry. If anything about the cache is off, we compile from source.
+int FileManager::loadLuaFile(lua_State *L, const char *filename,
+                             const char *cacheDir) {
+  unsigned int sourceHash;
+  return loadLuaFile(L, filename, cacheDir, &sourceHash);
+}
+
+// Same as above, and also sets sourceHash to the hash of the source we loaded,
+// as used for the cache entry, or 0 if we handed off to luaL_loadfile.
+int FileManager::loadLuaFile(lua_State *L, const char *filename,
+    const char *cacheDir, unsigned int *sourceHash) {
+  *sourceHash = 0;
+  // luaL_loadfile would name the chunk by its normalized path, so just let it
+  // handle anything that isn't already a plain relative path.
+  const char *luaCwd = lua_getcwd(L);
+  std::string dotSlash(".");
+  dotSlash.append(BB_DIRSEP);
+  if (cacheDir == 0 || luaCwd == 0 || isAbsPath(filename)
+      || strstr(filename, dotSlash.c_str()) != 0) {
+    return luaL_loadfile(L, filename);
+  }
+
+  char *srcPath = getFilePath(luaCwd, filename);
+  int sourceLength;
+  char *source = readBinaryFile(srcPath, &sourceLength);
+  delete[] srcPath;
+  if (source == 0) {
+    return luaL_loadfile(L, filename);
+  }
+
+  std::string chunkname("@");
+  chunkname.append(filename);
+  unsigned int keyHash = fnvHash(2166136261u, chunkname.c_str(),
+                                 (int) chunkname.size() + 1);
+  keyHash = fnvHash(keyHash, source, sourceLength);
+  *sourceHash = djbHash(5381, source, sourceLength);
+  char cacheFilename[64];
+  sprintf(cacheFilename, "%08x%08x-%d.bc", keyHash, *sourceHash,
+          LUAJIT_VERSION_NUM);
+  char *bytecodeDir = getFilePath(cacheDir, BYTECODE_CACHE_SUBDIR);
+  char *cachePath = getFilePath(bytecodeDir, cacheFilename);
+
+  int result = loadCachedBytecode(
+      L, cachePath, chunkname.c_str(), sourceLength, *sourceHash);
+  if (result != 0) {
+    result = luaL_loadbuffer(L, source, sourceLength, chunkname.c_str());
+    if (result == 0) {
+      saveCachedBytecode(L, bytecodeDir, cachePath, sourceLength,
+                         *sourceHash);
+    }
+  }
+
+  delete[] source;
+  delete[] bytecodeDir;
+  delete[] cachePath;
+  return result;
+}
+
+int FileManager::loadCachedBytecode(lua_State *L, const char *cachePath,
+    const char *chunkname, int sourceLength, unsigned int sourceHash) {
+  int fileLength;
+  char *contents = readBinaryFile(cachePath, &fileLength);
+  if (contents == 0) {
+    return 1;
+  }
+
+  int result = 1;
+  BytecodeHeader *header = (BytecodeHeader *) contents;
+  if (fileLength >= (int) sizeof(BytecodeHeader)
+      && strncmp(header->magic, BYTECODE_MAGIC, 4) == 0
+      && header->luajitVersion == LUAJIT_VERSION_NUM
+      && header->sourceLength == sourceLength
+      && header->sourceHash == sourceHash
+      && header->bytecodeLength
+          == fileLength - (int) sizeof(BytecodeHeader)) {
+    result = luaL_loadbuffer(L, &(contents[sizeof(BytecodeHeader)]),
+                             header->bytecodeLength, chunkname);
+    if (result != 0) {
+      lua_pop(L, 1);
+    }
+  }
+  delete[] contents;
+  return result;
+}
+
+// Expects the freshly compiled chunk on top of the stack. Writes to a
+// temporary file first and renames it into place, so other threads or
+// processes loading the same file never see a partial entry.
+void FileManager::saveCachedBytecode(lua_State *L, const char *bytecodeDir,
+    const char *cachePath, int sourceLength, unsigned int sourceHash) {
+  std::string bytecode;
+  if (lua_dump(L, bufferWriter, &bytecode) != 0) {
+    return;
+  }
+
+  BytecodeHeader header;
+  memcpy(header.magic, BYTECODE_MAGIC, 4);
+  header.luajitVersion = LUAJIT_VERSION_NUM;
+  header.sourceLength = sourceLength;
+  header.sourceHash = sourceHash;
+  header.bytecodeLength = (int) bytecode.size();
+
+  createDirectoryIfNecessary(bytecodeDir);
+  char *tmpPath = new char[strlen(cachePath) + 64];
+  sprintf(tmpPath, "%s.%d.%p.tmp", cachePath, (int) getpid(), (void *) L);
+  FILE *f = fopen(tmpPath, "wb");
+  if (f != 0) {
+    bool written = (fwrite(&header, sizeof(BytecodeHeader), 1, f) == 1)
+        && (fwrite(bytecode.data(), 1, bytecode.size(), f) == bytecode.size());
+    written = (fclose(f) == 0) && written;
+    if (!written || rename(tmpPath, cachePath) != 0) {
+      remove(tmpPath);
+    }
+  }
+  delete[] tmpPath;
+}
+
 void FileManager::deleteFromCache(const char *cacheDir, const char *filename) {
   char *cacheFilePath = getFilePath(cacheDir, filename);
   recursiveDelete(cacheFilePath);
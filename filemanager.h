@@ -25,6 +25,7 @@
 #include "zipper.h"
 
 #define MAX_LINE_LENGTH  16384
+#define BYTECODE_CACHE_SUBDIR  "bytecode"
 
 extern "C" {
   #include "lua.h"
@@ -137,6 +138,9 @@ class FileManager {
     void saveBytecode(const char *srcFile, const char *outputFile,
                       const char *luaCwd)
         throw (LuaException*);
+    int loadLuaFile(lua_State *L, const char *filename, const char *cacheDir);
+    int loadLuaFile(lua_State *L, const char *filename, const char *cacheDir,
+                    unsigned int *sourceHash);
     void deleteFromCache(const char *cacheDir, const char *filename);
     bool isAbsPath(const char *filename);
     char* getFilePath(const char *dir, const char *filename);
@@ -152,6 +156,9 @@ class FileManager {
     bool fileExists(const char *filename);
     void fixSlashes(char *filename);
     char* readFile(const char *filename) throw (FileNotFoundException*);
+    char* readBinaryFile(const char *filename, int *length);
+    bool stampFile(const char *filename, long long *size,
+                   long long *modified);
     void writeFile(const char *filename, const char *contents);
     void createDirectory(const char *filename);
     void createDirectoryIfNecessary(const char *dir);
@@ -166,6 +173,10 @@ class FileManager {
         const char *cacheDir) throw (FileNotFoundException*, ZipperException*,
                                      PackagedSymlinkException*);
     bool hasSymlinks(const char *userDir);
+    int loadCachedBytecode(lua_State *L, const char *cachePath,
+        const char *chunkname, int sourceLength, unsigned int sourceHash);
+    void saveCachedBytecode(lua_State *L, const char *bytecodeDir,
+        const char *cachePath, int sourceLength, unsigned int sourceHash);
     bool hasExtension(const char *filename, const char *extension);
     void packageCommon(lua_State *userState, const char *userAbsBaseDir,
         const char *userFilename, const char *version, const char *metaFilename,
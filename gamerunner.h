@@ -53,12 +53,17 @@ class GameRunner {
     virtual int getIntegerValue(const char *name) = 0;
     virtual bool getBooleanValue(const char *name) = 0;
     virtual void setThreadCount(int threadCount) = 0;
+    virtual void setIsolateMatches(bool isolateMatches) = 0;
     virtual void queueMatch(const char *stageName, char **teamNames,
                             int numTeams) = 0;
+    virtual void queueMatch(const char *stageName, char **teamNames,
+                            int numTeams, unsigned int randomSeed) = 0;
     virtual bool started() = 0;
     virtual bool empty() = 0;
     virtual MatchResult* nextResult() = 0;
     virtual void deleteReplayBuilder(ReplayBuilder *replayBuilder) = 0;
+    virtual ReplaySaver* getReplaySaver() = 0;
+    virtual const char* getReplayTemplateDir() = 0;
     virtual void run(const char *runnerName) = 0;
     virtual ~GameRunner() {};
 };
@@ -47,6 +47,7 @@ GuiGameRunner::GuiGameRunner(PrintHandler *printHandler, char **stageNames,
   numTeams_ = numTeams;
   zipper_ = zipper;
   threadCount_ = 1;
+  isolateMatches_ = false;
   started_ = false;
   quitting_ = false;
   runnerState_ = 0;
@@ -265,14 +266,26 @@ void GuiGameRunner::setThreadCount(int threadCount) {
   }
 }
 
+void GuiGameRunner::setIsolateMatches(bool isolateMatches) {
+  if (!started_) {
+    isolateMatches_ = isolateMatches;
+  }
+}
+
 void GuiGameRunner::queueMatch(const char *stageName, char **teamNames,
                                int numTeams) {
+  queueMatch(stageName, teamNames, numTeams, rand());
+}
+
+void GuiGameRunner::queueMatch(const char *stageName, char **teamNames,
+                               int numTeams, unsigned int randomSeed) {
   if (!started_) {
-    bbRunner_ = new BerryBotsRunner(threadCount_, zipper_, replayTemplateDir_);
+    bbRunner_ = new BerryBotsRunner(threadCount_, zipper_, replayTemplateDir_,
+                                    isolateMatches_);
     bbRunner_->setListener(new GuiRefresherListener());
     started_ = true;
   }
-  bbRunner_->queueMatch(stageName, teamNames, numTeams);
+  bbRunner_->queueMatch(stageName, teamNames, numTeams, randomSeed);
 }
 
 bool GuiGameRunner::started() {
@@ -308,6 +321,14 @@ void GuiGameRunner::deleteReplayBuilder(ReplayBuilder *replayBuilder) {
   bbRunner_->deleteReplayBuilder(replayBuilder);
 }
 
+ReplaySaver* GuiGameRunner::getReplaySaver() {
+  return bbRunner_->getReplaySaver();
+}
+
+const char* GuiGameRunner::getReplayTemplateDir() {
+  return replayTemplateDir_;
+}
+
 void GuiGameRunner::run(const char *runnerName) {
   if (runnerName_ != 0) {
     delete runnerName_;
@@ -316,7 +337,7 @@ void GuiGameRunner::run(const char *runnerName) {
   strcpy(runnerName_, runnerName);
 
   std::string runnersDir = getRunnersDir();
-  initRunnerState(&runnerState_, runnersDir.c_str());
+  initRunnerState(&runnerState_, runnersDir.c_str(), rand());
   lua_setprinter(runnerState_, printHandler_);
 
   bool error = false;
@@ -345,12 +366,13 @@ void GuiGameRunner::run(const char *runnerName) {
     lua_pushcfunction(runnerState_, traceback);
     int errfunc = lua_gettop(runnerState_);
     lua_getglobal(runnerState_, "run");
-    pushGameRunner(runnerState_, this);
+    MatchRunner *matchRunner = pushGameRunner(runnerState_, this);
     pushRunnerForm(runnerState_, this);
     pushRunnerFiles(runnerState_, this);
 
     int pcallValue = lua_pcall(runnerState_, 3, 0, errfunc);
     lua_remove(runnerState_, errfunc);
+    finishGameRunner(matchRunner);
     if (pcallValue != 0) {
       const char *luaMessage = lua_tostring(runnerState_, -1);
       printHandler_->runnerPrint(luaMessage);
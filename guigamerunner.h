@@ -40,6 +40,7 @@ class GuiGameRunner : public GameRunner {
   int numTeams_;
   PrintHandler *printHandler_;
   int threadCount_;
+  bool isolateMatches_;
   bool started_;
   bool quitting_;
   lua_State *runnerState_;
@@ -70,12 +71,17 @@ class GuiGameRunner : public GameRunner {
     virtual int getIntegerValue(const char *name);
     virtual bool getBooleanValue(const char *name);
     virtual void setThreadCount(int threadCount);
+    virtual void setIsolateMatches(bool isolateMatches);
     virtual void queueMatch(const char *stageName, char **teamNames,
                             int numTeams);
+    virtual void queueMatch(const char *stageName, char **teamNames,
+                            int numTeams, unsigned int randomSeed);
     virtual bool started();
     virtual bool empty();
     virtual MatchResult* nextResult();
     virtual void deleteReplayBuilder(ReplayBuilder *replayBuilder);
+    virtual ReplaySaver* getReplaySaver();
+    virtual const char* getReplayTemplateDir();
     virtual void run(const char *runnerName);
     void quit();
   private:
@@ -230,9 +230,10 @@ bool GuiManager::isValidStageFile(const char *srcFilename,
       return false;
     }
     lua_State *stageState;
-    initStageState(&stageState, stagesDir);
+    initStageState(&stageState, stagesDir, rand());
 
-    if (luaL_loadfile(stageState, stageFilename)
+    if (fileManager_->loadLuaFile(stageState, stageFilename,
+                                  getCacheDir().c_str())
         || engine->callUserLuaCode(stageState, 0, "", PCALL_VALIDATE)) {
       logErrorMessage(stageState, "Problem loading stage: %s");
       lua_close(stageState);
@@ -321,9 +322,10 @@ bool GuiManager::isValidShipFile(const char *srcFilename,
       return false;
     }
     lua_State *shipState;
-    initShipState(&shipState, shipDir);
+    initShipState(&shipState, shipDir, rand());
 
-    if (luaL_loadfile(shipState, shipFilename)
+    if (fileManager_->loadLuaFile(shipState, shipFilename,
+                                  getCacheDir().c_str())
         || engine->callUserLuaCode(shipState, 0, "", PCALL_VALIDATE)) {
       logErrorMessage(shipState, "Problem loading ship: %s");
       lua_close(shipState);
@@ -365,7 +367,7 @@ bool GuiManager::isValidRunnerFile(const char *srcFilename,
     char *runnersDir = new char[strlen(getRunnersDir().c_str()) + 1];
     strcpy(runnersDir, getRunnersDir().c_str());
     lua_State *runnerState;
-    initRunnerState(&runnerState, runnersDir);
+    initRunnerState(&runnerState, runnersDir, rand());
 
     if (luaL_loadfile(runnerState, srcFilename)
         || engine->callUserLuaCode(runnerState, 0, "", PCALL_VALIDATE)) {
@@ -544,7 +546,7 @@ void GuiManager::runNewMatch(const char *stageName, char **teamNames,
   }
 
   engine_ = new BerryBotsEngine(guiPrintHandler_, fileManager_,
-                                resourcePath().c_str());
+                                resourcePath().c_str(), rand());
 
   Stage *stage = engine_->getStage();
   if (restarting_) {
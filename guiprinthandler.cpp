@@ -55,11 +55,9 @@ void GuiPrintHandler::shipError(lua_State *L, const char *text) {
 }
 
 void GuiPrintHandler::doPrint(lua_State *L, const char *text) {
-  for (int x = 0; x < numTeams_; x++) {
-    if (teams_[x]->state == L) {
-      teamConsoles_[x]->println(text);
-      break;
-    }
+  Team *team = (Team *) lua_getowner(L);
+  if (team != 0 && team->index < numTeams_ && teams_[team->index] == team) {
+    teamConsoles_[team->index]->println(text);
   }
 }
 
@@ -0,0 +1,201 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <math.h>
+#include <limits.h>
+#include <algorithm>
+#include "line2d.h"
+#include "linegrid.h"
+
+LineGrid::LineGrid(double left, double bottom, double width, double height,
+                   int maxLines) {
+  left_ = left;
+  bottom_ = bottom;
+  cellSize_ = std::max((double) LINE_GRID_CELL_SIZE,
+      std::max(width, height) / LINE_GRID_MAX_CELLS);
+  numCols_ = std::max(1, (int) ceil(width / cellSize_));
+  numRows_ = std::max(1, (int) ceil(height / cellSize_));
+
+  int numCells = numCols_ * numRows_;
+  cells_ = new int*[numCells];
+  cellCounts_ = new int[numCells];
+  cellCapacities_ = new int[numCells];
+  for (int x = 0; x < numCells; x++) {
+    cells_[x] = 0;
+    cellCounts_[x] = cellCapacities_[x] = 0;
+  }
+
+  maxLines_ = maxLines;
+  lines_ = new Line2D*[maxLines_];
+  queryMarks_ = new int[maxLines_];
+  for (int x = 0; x < maxLines_; x++) {
+    lines_[x] = 0;
+    queryMarks_[x] = 0;
+  }
+  queryId_ = 0;
+}
+
+int LineGrid::getCol(double x) {
+  int col = (int) floor((x - left_) / cellSize_);
+  return std::min(numCols_ - 1, std::max(0, col));
+}
+
+int LineGrid::getRow(double y) {
+  int row = (int) floor((y - bottom_) / cellSize_);
+  return std::min(numRows_ - 1, std::max(0, row));
+}
+
+// Adds the line to every cell its bounding box touches. Cells of stage walls
+// stay small, so we just grow them as needed.
+void LineGrid::addLine(int index, Line2D *line) {
+  if (index < 0 || index >= maxLines_) {
+    return;
+  }
+  lines_[index] = line;
+  int colMin = getCol(line->xMin());
+  int colMax = getCol(line->xMax());
+  int rowMin = getRow(line->yMin());
+  int rowMax = getRow(line->yMax());
+  for (int row = rowMin; row <= rowMax; row++) {
+    for (int col = colMin; col <= colMax; col++) {
+      addToCell((row * numCols_) + col, index);
+    }
+  }
+}
+
+void LineGrid::addToCell(int cell, int index) {
+  if (cellCounts_[cell] >= cellCapacities_[cell]) {
+    int newCapacity = std::max(4, cellCapacities_[cell] * 2);
+    int *newCell = new int[newCapacity];
+    for (int x = 0; x < cellCounts_[cell]; x++) {
+      newCell[x] = cells_[cell][x];
+    }
+    if (cells_[cell] != 0) {
+      delete[] cells_[cell];
+    }
+    cells_[cell] = newCell;
+    cellCapacities_[cell] = newCapacity;
+  }
+  cells_[cell][cellCounts_[cell]++] = index;
+}
+
+// Fills indices with the index of each line whose bounding box overlaps the
+// given box, in ascending order and without duplicates, and returns how many
+// there are. So callers iterating the result see lines in the same order as a
+// full scan of all the lines would.
+int LineGrid::getLines(double left, double bottom, double right, double top,
+                       int *indices) {
+  nextQuery();
+  int numIndices = 0;
+  int colMin = getCol(left);
+  int colMax = getCol(right);
+  int rowMin = getRow(bottom);
+  int rowMax = getRow(top);
+  for (int row = rowMin; row <= rowMax; row++) {
+    for (int col = colMin; col <= colMax; col++) {
+      numIndices = addCellLines((row * numCols_) + col, left, bottom, right,
+                                top, indices, numIndices);
+    }
+  }
+  std::sort(indices, indices + numIndices);
+  return numIndices;
+}
+
+// Like getLines, but only looks in the cells the line segment passes through,
+// and the indices are not sorted. Any line that intersects the segment is
+// included.
+int LineGrid::getLinesAlong(double x1, double y1, double x2, double y2,
+                            int *indices) {
+  nextQuery();
+  int numIndices = 0;
+  double left = std::min(x1, x2);
+  double right = std::max(x1, x2);
+  double bottom = std::min(y1, y2);
+  double top = std::max(y1, y2);
+  double dy = y2 - y1;
+  double dxdy = (dy == 0 ? 0 : (x2 - x1) / dy);
+  double fudge = cellSize_ * 0.001;
+  int rowMin = getRow(bottom);
+  int rowMax = getRow(top);
+  for (int row = rowMin; row <= rowMax; row++) {
+    // The part of the segment within this row, widened a little so rounding
+    // can't make us skip a cell the segment grazes.
+    double segLeft = left;
+    double segRight = right;
+    if (dy != 0) {
+      double rowBottom = (row == 0 ? bottom : std::max(bottom,
+          bottom_ + (row * cellSize_) - fudge));
+      double rowTop = (row == numRows_ - 1 ? top : std::min(top,
+          bottom_ + ((row + 1) * cellSize_) + fudge));
+      double xBottom = x1 + ((rowBottom - y1) * dxdy);
+      double xTop = x1 + ((rowTop - y1) * dxdy);
+      segLeft = std::max(left, std::min(xBottom, xTop) - fudge);
+      segRight = std::min(right, std::max(xBottom, xTop) + fudge);
+    }
+    int colMin = getCol(segLeft);
+    int colMax = getCol(segRight);
+    for (int col = colMin; col <= colMax; col++) {
+      numIndices = addCellLines((row * numCols_) + col, left, bottom, right,
+                                top, indices, numIndices);
+    }
+  }
+  return numIndices;
+}
+
+void LineGrid::nextQuery() {
+  if (queryId_ == INT_MAX) {
+    for (int x = 0; x < maxLines_; x++) {
+      queryMarks_[x] = 0;
+    }
+    queryId_ = 0;
+  }
+  queryId_++;
+}
+
+int LineGrid::addCellLines(int cell, double left, double bottom, double right,
+                           double top, int *indices, int numIndices) {
+  int *cellLines = cells_[cell];
+  for (int x = 0; x < cellCounts_[cell]; x++) {
+    int index = cellLines[x];
+    if (queryMarks_[index] != queryId_) {
+      queryMarks_[index] = queryId_;
+      Line2D *line = lines_[index];
+      if (line->xMax() >= left && line->xMin() <= right
+          && line->yMax() >= bottom && line->yMin() <= top) {
+        indices[numIndices++] = index;
+      }
+    }
+  }
+  return numIndices;
+}
+
+LineGrid::~LineGrid() {
+  int numCells = numCols_ * numRows_;
+  for (int x = 0; x < numCells; x++) {
+    if (cells_[x] != 0) {
+      delete[] cells_[x];
+    }
+  }
+  delete[] cells_;
+  delete[] cellCounts_;
+  delete[] cellCapacities_;
+  delete[] lines_;
+  delete[] queryMarks_;
+}
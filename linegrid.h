@@ -0,0 +1,61 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef LINE_GRID_H
+#define LINE_GRID_H
+
+#include "line2d.h"
+
+#define LINE_GRID_CELL_SIZE  64
+#define LINE_GRID_MAX_CELLS  128  // per side
+
+// A uniform grid over a static set of lines, used as a broadphase so we only
+// have to do the expensive checks for lines near a point of interest. Lines are
+// referenced by the index they were added with, and are not owned by the grid.
+class LineGrid {
+  double left_, bottom_, cellSize_;
+  int numCols_, numRows_;
+  int **cells_;
+  int *cellCounts_;
+  int *cellCapacities_;
+  Line2D **lines_;
+  int maxLines_;
+  int *queryMarks_;
+  int queryId_;
+
+  public:
+    LineGrid(double left, double bottom, double width, double height,
+             int maxLines);
+    ~LineGrid();
+    void addLine(int index, Line2D *line);
+    int getLines(double left, double bottom, double right, double top,
+                 int *indices);
+    int getLinesAlong(double x1, double y1, double x2, double y2,
+                      int *indices);
+  private:
+    int getCol(double x);
+    int getRow(double y);
+    void addToCell(int cell, int index);
+    void nextQuery();
+    int addCellLines(int cell, double left, double bottom, double right,
+                     double top, int *indices, int numIndices);
+};
+
+#endif
@@ -141,6 +141,21 @@ LUA_API void *lua_getprinter (lua_State *L)
   return g->printer;
 }
 
+// @Voidious: Set an owner so BerryBots can find the object (like a team) that
+//            a Lua state belongs to without searching for it.
+LUA_API void lua_setowner (lua_State *L, void *owner)
+{
+  global_State *g = G(L);
+  g->owner = owner;
+}
+
+// @Voidious: Get owner.
+LUA_API void *lua_getowner (lua_State *L)
+{
+  global_State *g = G(L);
+  return g->owner;
+}
+
 /* -- Stack manipulation -------------------------------------------------- */
 
 LUA_API int lua_gettop(lua_State *L)
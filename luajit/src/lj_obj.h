@@ -542,6 +542,7 @@ typedef struct global_State {
   const char *cwd; /* @Voidious: Working directory, for BerryBots security. */
   void *printer; /* @Voidious: BerryBots overrides print so it can redirect
                                each Lua state's output to the right place. */
+  void *owner; /* @Voidious: BerryBots object that owns this Lua state. */
 } global_State;
 
 #define mainthread(g)	(&gcref(g->mainthref)->th)
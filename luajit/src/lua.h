@@ -248,6 +248,8 @@ LUA_API void        (lua_setcwd) (lua_State *L, const char *cwd);
 LUA_API const char *(lua_getcwd) (lua_State *L);
 LUA_API void        (lua_setprinter) (lua_State *L, void *printer);
 LUA_API void       *(lua_getprinter) (lua_State *L);
+LUA_API void        (lua_setowner) (lua_State *L, void *owner);
+LUA_API void       *(lua_getowner) (lua_State *L);
 
 
 
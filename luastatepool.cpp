@@ -0,0 +1,291 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+
+#include <string.h>
+#include <pthread.h>
+#include <algorithm>
+#include "bblua.h"
+#include "filemanager.h"
+#include "luastatepool.h"
+
+extern "C" {
+  #include "lua.h"
+}
+
+LuaStatePool::LuaStatePool(int statesPerFile) {
+  fileManager_ = new FileManager();
+  pooledStates_ = new PooledStates*[POOL_MAX_PROGRAMS];
+  numPooledStates_ = 0;
+  statesPerFile_ = std::max(1, statesPerFile);
+  useCount_ = 0;
+  quitting_ = false;
+  pthread_mutex_init(&lock_, 0);
+  pthread_cond_init(&statesWanted_, 0);
+  pthread_create(&thread_, 0, LuaStatePool::builder, (void*) this);
+}
+
+LuaStatePool::~LuaStatePool() {
+  pthread_mutex_lock(&lock_);
+  quitting_ = true;
+  pthread_cond_signal(&statesWanted_);
+  pthread_mutex_unlock(&lock_);
+  pthread_join(thread_, 0);
+
+  for (int x = 0; x < numPooledStates_; x++) {
+    deletePooledStates(pooledStates_[x]);
+  }
+  delete[] pooledStates_;
+  pthread_cond_destroy(&statesWanted_);
+  pthread_mutex_destroy(&lock_);
+  delete fileManager_;
+}
+
+// Gives the caller a new Lua state for the program filename in dir, with the
+// program loaded and left on top of the stack, and returns the load result,
+// just like luaL_loadfile. The caller owns the state and is expected to seed
+// math.random before running anything in it. We build the state on the spot
+// if there isn't a warm one for the current source.
+//
+// Checking for a warm state only stats the source file. The builder reads and
+// hashes it, through the bytecode cache, as part of building each state.
+int LuaStatePool::acquireState(int type, const char *dir,
+    const char *filename, const char *cacheDir, lua_State **state) {
+  long long sourceSize;
+  long long sourceModified;
+  unsigned int sourceHash;
+  if (!stampSource(dir, filename, &sourceSize, &sourceModified)) {
+    return buildState(type, dir, filename, cacheDir, state, &sourceHash);
+  }
+
+  lua_State *pooledState = 0;
+  int loadResult = 0;
+  pthread_mutex_lock(&lock_);
+  PooledStates *pooledStates = getPooledStates(
+      type, dir, filename, cacheDir, sourceSize, sourceModified);
+  if (pooledStates->numStates > 0) {
+    int x = --pooledStates->numStates;
+    pooledState = pooledStates->states[x];
+    loadResult = pooledStates->loadResults[x];
+  }
+  pthread_cond_signal(&statesWanted_);
+  pthread_mutex_unlock(&lock_);
+
+  if (pooledState == 0) {
+    return buildState(type, dir, filename, cacheDir, state, &sourceHash);
+  }
+  *state = pooledState;
+  return loadResult;
+}
+
+// Keeps every program we've handed out states for topped up to statesPerFile
+// warm states.
+void* LuaStatePool::builder(void *vargs) {
+  LuaStatePool *pool = (LuaStatePool *) vargs;
+  pthread_mutex_lock(&pool->lock_);
+  while (!pool->quitting_) {
+    PooledStates *pooledStates = pool->nextWanted();
+    if (pooledStates == 0) {
+      pthread_cond_wait(&pool->statesWanted_, &pool->lock_);
+      continue;
+    }
+
+    // Entries aren't evicted while we're building for them, so it's safe to
+    // use this one without the lock.
+    pooledStates->building = true;
+    long long sourceSize = pooledStates->sourceSize;
+    long long sourceModified = pooledStates->sourceModified;
+    pthread_mutex_unlock(&pool->lock_);
+
+    lua_State *state = 0;
+    int loadResult = 0;
+    unsigned int sourceHash = 0;
+    long long currentSize;
+    long long currentModified;
+    bool stamped = pool->stampSource(pooledStates->dir,
+        pooledStates->filename, &currentSize, &currentModified);
+    bool unchanged = stamped && currentSize == sourceSize
+        && currentModified == sourceModified;
+    if (unchanged) {
+      loadResult = pool->buildState(pooledStates->type, pooledStates->dir,
+          pooledStates->filename, pooledStates->cacheDir, &state,
+          &sourceHash);
+    }
+
+    pthread_mutex_lock(&pool->lock_);
+    pooledStates->building = false;
+    bool sameEntry = pooledStates->sourceSize == sourceSize
+        && pooledStates->sourceModified == sourceModified;
+    if (!stamped) {
+      // Can't read the file anymore. Stop building until it's asked for again.
+      pooledStates->valid = false;
+      pool->clearStates(pooledStates);
+    } else if (sameEntry && !unchanged) {
+      pooledStates->sourceSize = currentSize;
+      pooledStates->sourceModified = currentModified;
+      pooledStates->sourceHash = 0;
+      pool->clearStates(pooledStates);
+    } else if (sameEntry && sourceHash != 0
+               && sourceHash != pooledStates->sourceHash) {
+      // The file changed without changing its stamp, so anything we built
+      // before this state is stale.
+      if (pooledStates->sourceHash != 0) {
+        pool->clearStates(pooledStates);
+      }
+      pooledStates->sourceHash = sourceHash;
+    }
+    if (state != 0) {
+      if (pooledStates->valid && sameEntry
+          && pooledStates->numStates < pool->statesPerFile_) {
+        int x = pooledStates->numStates++;
+        pooledStates->states[x] = state;
+        pooledStates->loadResults[x] = loadResult;
+      } else {
+        lua_close(state);
+      }
+    }
+  }
+  pthread_mutex_unlock(&pool->lock_);
+  return 0;
+}
+
+int LuaStatePool::buildState(int type, const char *dir, const char *filename,
+    const char *cacheDir, lua_State **state, unsigned int *sourceHash) {
+  if (type == POOL_STAGE_STATE) {
+    initStageState(state, dir, 0);
+  } else {
+    initShipState(state, dir, 0);
+  }
+  return fileManager_->loadLuaFile(*state, filename, cacheDir, sourceHash);
+}
+
+bool LuaStatePool::stampSource(const char *dir, const char *filename,
+                               long long *size, long long *modified) {
+  char *srcPath = fileManager_->getFilePath(dir, filename);
+  bool stamped = fileManager_->stampFile(srcPath, size, modified);
+  delete[] srcPath;
+  return stamped;
+}
+
+static bool sameString(const char *s1, const char *s2) {
+  return (s1 == 0 || s2 == 0) ? (s1 == s2) : (strcmp(s1, s2) == 0);
+}
+
+static char* copyString(const char *s) {
+  if (s == 0) {
+    return 0;
+  }
+  char *newString = new char[strlen(s) + 1];
+  strcpy(newString, s);
+  return newString;
+}
+
+// Caller must hold lock_. Finds or adds the entry for this program, throwing
+// out any warm states that were built from an older version of the file.
+PooledStates* LuaStatePool::getPooledStates(int type, const char *dir,
+    const char *filename, const char *cacheDir, long long sourceSize,
+    long long sourceModified) {
+  for (int x = 0; x < numPooledStates_; x++) {
+    PooledStates *pooledStates = pooledStates_[x];
+    if (pooledStates->type == type && sameString(pooledStates->dir, dir)
+        && sameString(pooledStates->filename, filename)
+        && sameString(pooledStates->cacheDir, cacheDir)) {
+      if (pooledStates->sourceSize != sourceSize
+          || pooledStates->sourceModified != sourceModified) {
+        clearStates(pooledStates);
+        pooledStates->sourceSize = sourceSize;
+        pooledStates->sourceModified = sourceModified;
+        pooledStates->sourceHash = 0;
+      }
+      pooledStates->valid = true;
+      pooledStates->lastUsed = ++useCount_;
+      return pooledStates;
+    }
+  }
+
+  if (numPooledStates_ == POOL_MAX_PROGRAMS) {
+    evictLeastRecentlyUsed();
+  }
+
+  PooledStates *pooledStates = new PooledStates;
+  pooledStates->type = type;
+  pooledStates->dir = copyString(dir);
+  pooledStates->filename = copyString(filename);
+  pooledStates->cacheDir = copyString(cacheDir);
+  pooledStates->sourceSize = sourceSize;
+  pooledStates->sourceModified = sourceModified;
+  pooledStates->sourceHash = 0;
+  pooledStates->valid = true;
+  pooledStates->building = false;
+  pooledStates->lastUsed = ++useCount_;
+  pooledStates->states = new lua_State*[statesPerFile_];
+  pooledStates->loadResults = new int[statesPerFile_];
+  pooledStates->numStates = 0;
+  pooledStates_[numPooledStates_++] = pooledStates;
+  return pooledStates;
+}
+
+// Caller must hold lock_. The builder only works on one entry at a time, so
+// there's always another one we can drop.
+void LuaStatePool::evictLeastRecentlyUsed() {
+  int evictIndex = -1;
+  for (int x = 0; x < numPooledStates_; x++) {
+    PooledStates *pooledStates = pooledStates_[x];
+    if (!pooledStates->building && (evictIndex == -1
+        || pooledStates->lastUsed < pooledStates_[evictIndex]->lastUsed)) {
+      evictIndex = x;
+    }
+  }
+  deletePooledStates(pooledStates_[evictIndex]);
+  pooledStates_[evictIndex] = pooledStates_[--numPooledStates_];
+}
+
+// Caller must hold lock_.
+PooledStates* LuaStatePool::nextWanted() {
+  for (int x = 0; x < numPooledStates_; x++) {
+    PooledStates *pooledStates = pooledStates_[x];
+    if (pooledStates->valid && pooledStates->numStates < statesPerFile_) {
+      return pooledStates;
+    }
+  }
+  return 0;
+}
+
+// Caller must hold lock_, or be the destructor.
+void LuaStatePool::clearStates(PooledStates *pooledStates) {
+  for (int x = 0; x < pooledStates->numStates; x++) {
+    lua_close(pooledStates->states[x]);
+  }
+  pooledStates->numStates = 0;
+}
+
+// Caller must hold lock_, or be the destructor.
+void LuaStatePool::deletePooledStates(PooledStates *pooledStates) {
+  clearStates(pooledStates);
+  delete[] pooledStates->dir;
+  delete[] pooledStates->filename;
+  if (pooledStates->cacheDir != 0) {
+    delete[] pooledStates->cacheDir;
+  }
+  delete[] pooledStates->states;
+  delete[] pooledStates->loadResults;
+  delete pooledStates;
+}
@@ -0,0 +1,101 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef LUA_STATE_POOL_H
+#define LUA_STATE_POOL_H
+
+#include <pthread.h>
+#include "filemanager.h"
+
+extern "C" {
+  #include "lua.h"
+}
+
+#define POOL_STAGE_STATE  1
+#define POOL_SHIP_STATE   2
+
+#define POOL_MAX_PROGRAMS  32
+
+// The warm states for one program file. They were all loaded from the source
+// file as it was when it had size sourceSize and modified time sourceModified.
+// sourceHash is the bytecode cache's hash of that source, or 0 if we don't
+// know it yet. Each state is ready to be handed out exactly once.
+typedef struct {
+  int type;
+  char *dir;
+  char *filename;
+  char *cacheDir;
+  long long sourceSize;
+  long long sourceModified;
+  unsigned int sourceHash;
+  bool valid;
+  bool building;
+  unsigned int lastUsed;
+  lua_State **states;
+  int *loadResults;
+  int numStates;
+} PooledStates;
+
+// Keeps Lua states for the stage and ship programs we've seen, built ahead of
+// time on a background thread: libraries opened, BerryBots API registered and
+// the program file loaded, but not run. Handing one out takes the state setup
+// and compile off the critical path of starting a match.
+//
+// A Lua state can't be copied, so each one is only handed out once and the
+// pool builds another to replace it. We stop short of running the program's
+// top level code and leave seeding math.random to the engine, so a warm state
+// behaves exactly like a freshly built one.
+//
+// We keep states for up to POOL_MAX_PROGRAMS programs, dropping the least
+// recently used one to make room for another.
+class LuaStatePool {
+  FileManager *fileManager_;
+  PooledStates **pooledStates_;
+  int numPooledStates_;
+  int statesPerFile_;
+  unsigned int useCount_;
+  pthread_t thread_;
+  pthread_mutex_t lock_;
+  pthread_cond_t statesWanted_;
+  bool quitting_;
+
+  public:
+    LuaStatePool(int statesPerFile);
+    ~LuaStatePool();
+    int acquireState(int type, const char *dir, const char *filename,
+                     const char *cacheDir, lua_State **state);
+    static void* builder(void *vargs);
+  private:
+    int buildState(int type, const char *dir, const char *filename,
+                   const char *cacheDir, lua_State **state,
+                   unsigned int *sourceHash);
+    bool stampSource(const char *dir, const char *filename, long long *size,
+                     long long *modified);
+    PooledStates* getPooledStates(int type, const char *dir,
+        const char *filename, const char *cacheDir, long long sourceSize,
+        long long sourceModified);
+    void evictLeastRecentlyUsed();
+    PooledStates* nextWanted();
+    void clearStates(PooledStates *pooledStates);
+    void deletePooledStates(PooledStates *pooledStates);
+};
+
+#endif
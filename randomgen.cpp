@@ -0,0 +1,60 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include "randomgen.h"
+
+RandomGenerator::RandomGenerator(unsigned int seed) {
+  setSeed(seed);
+}
+
+// Spreads the seed over the whole state, so similar seeds still give unrelated
+// sequences.
+void RandomGenerator::setSeed(unsigned int seed) {
+  seed_ = seed;
+  unsigned int z = seed;
+  for (int x = 0; x < 4; x++) {
+    z += 0x9e3779b9;
+    unsigned int t = z;
+    t = (t ^ (t >> 16)) * 0x85ebca6b;
+    t = (t ^ (t >> 13)) * 0xc2b2ae35;
+    state_[x] = t ^ (t >> 16);
+  }
+  if (state_[0] == 0 && state_[1] == 0 && state_[2] == 0 && state_[3] == 0) {
+    state_[0] = 1;
+  }
+}
+
+unsigned int RandomGenerator::getSeed() {
+  return seed_;
+}
+
+// Returns a non-negative int, like rand() with a RAND_MAX of 2^31 - 1.
+int RandomGenerator::next() {
+  unsigned int t = state_[3];
+  unsigned int s = state_[0];
+  state_[3] = state_[2];
+  state_[2] = state_[1];
+  state_[1] = s;
+  t ^= t << 11;
+  t ^= t >> 8;
+  state_[0] = t ^ s ^ (s >> 19);
+  return (int) (state_[0] >> 1);
+}
@@ -0,0 +1,39 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef RANDOM_GENERATOR_H
+#define RANDOM_GENERATOR_H
+
+// A small pseudo random number generator (xorshift128) that each engine owns,
+// so matches running on different threads don't share the global rand() state
+// and a match can be run again with the same seed.
+class RandomGenerator {
+  unsigned int seed_;
+  unsigned int state_[4];
+
+  public:
+    RandomGenerator(unsigned int seed);
+    void setSeed(unsigned int seed);
+    unsigned int getSeed();
+    int next();
+};
+
+#endif
@@ -18,6 +18,7 @@
   3. This notice may not be removed or altered from any source distribution.
 */
 
+#include <limits.h>
 #include <math.h>
 #include <algorithm>
 #include <stdio.h>
@@ -27,6 +28,8 @@
 #include "bbutil.h"
 #include "basedir.h"
 #include "replaybuilder.h"
+#include "replayformat.h"
+#include "resultchannel.h"
 
 ReplayBuilder::ReplayBuilder(const char *templateDir) {
   numTeams_ = numTeamsAdded_ = 0;
@@ -58,8 +61,11 @@ ReplayBuilder::ReplayBuilder(const char *templateDir) {
   logData_ = new ReplayData(MAX_TEXT_CHUNKS);
   numLogEntries_ = 0;
   resultsData_ = new ReplayData(MAX_MISC_CHUNKS);
+  keyframeData_ = new ReplayData(MAX_MISC_CHUNKS);
+  nextKeyframeTime_ = REPLAY_KEYFRAME_INTERVAL;
   stageName_ = 0;
   timestamp_ = 0;
+  spillFile_ = 0;
   if (templateDir == 0) {
     templateDir_ = 0;
   } else {
@@ -107,7 +113,12 @@ ReplayBuilder::~ReplayBuilder() {
   delete torpedoDebrisData_;
   delete shipDestroyData_;
   delete textData_;
+  delete logData_;
   delete resultsData_;
+  delete keyframeData_;
+  if (spillFile_ != 0) {
+    delete spillFile_;
+  }
   if (timestamp_ != 0) {
     delete timestamp_;
   }
@@ -119,6 +130,27 @@ ReplayBuilder::~ReplayBuilder() {
   }
 }
 
+// Moves full chunks out to a temporary file as the replay grows, so only the
+// last chunk of each stream stays in memory and long matches don't hit the
+// caps. Call before anything is added. If we can't create the file, the
+// replay just stays in memory.
+void ReplayBuilder::spillToDisk() {
+  if (spillFile_ != 0) {
+    return;
+  }
+  ReplaySpillFile *spillFile = new ReplaySpillFile();
+  if (!spillFile->isOpen()) {
+    delete spillFile;
+    return;
+  }
+  spillFile_ = spillFile;
+  ReplayData *replayDatas[NUM_REPLAY_DATAS];
+  getReplayDatas(replayDatas);
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    replayDatas[x]->setSpillFile(spillFile_);
+  }
+}
+
 void ReplayBuilder::initShips(int numTeams, int numShips) {
   numTeams_ = numTeams;
   numShips_ = numShips;
@@ -276,6 +308,40 @@ void ReplayBuilder::addShipStates(Ship **ships, int time) {
       shipTickData_->addInt(round(std::max(0., ship->energy) * 10));
     }
   }
+
+  if (time + 1 >= nextKeyframeTime_) {
+    addKeyframe(time + 1);
+    nextKeyframeTime_ = time + 1 + REPLAY_KEYFRAME_INTERVAL;
+  }
+}
+
+// Keyframe format:  (variable)
+// time | <size of each other stream> | num alive | <alive ship indices>
+//
+// Marks where everything from this tick on starts in each stream, and which
+// ships are alive going into it. Events are recorded as they happen, so any
+// from this tick on come after those offsets.
+void ReplayBuilder::addKeyframe(int time) {
+  ReplayData *replayDatas[NUM_REPLAY_DATAS];
+  getReplayDatas(replayDatas);
+  keyframeData_->addInt(time);
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    if (x != REPLAY_STREAM_KEYFRAMES) {
+      keyframeData_->addInt(replayDatas[x]->getSize());
+    }
+  }
+  int numAlive = 0;
+  for (int x = 0; x < numShips_; x++) {
+    if (shipsAlive_[x]) {
+      numAlive++;
+    }
+  }
+  keyframeData_->addInt(numAlive);
+  for (int x = 0; x < numShips_; x++) {
+    if (shipsAlive_[x]) {
+      keyframeData_->addInt(x);
+    }
+  }
 }
 
 // Laser start format:  (6)
@@ -444,6 +510,10 @@ const char* ReplayBuilder::getStageName() {
   return stageName_;
 }
 
+const char* ReplayBuilder::getTimestamp() {
+  return timestamp_;
+}
+
 void ReplayBuilder::setTimestamp(const char *timestamp) {
   if (timestamp_ != 0) {
     delete timestamp_;
@@ -457,8 +527,92 @@ void ReplayBuilder::setTimestamp(const char *timestamp) {
   }
 }
 
-void ReplayBuilder::saveReplay(const char *filename) {
-  saveReplay(getReplaysDir().c_str(), filename);
+#ifndef __WIN32__
+// Sends a finished replay from a match process back to the runner, which
+// reads it into a new ReplayBuilder with readFrom.
+void ReplayBuilder::writeTo(ResultChannel *channel) {
+  channel->writeInt(numTeams_);
+  channel->writeInt(numShips_);
+  channel->writeInt(numTeamsAdded_);
+  for (int x = 0; x < numTeams_; x++) {
+    channel->writeString(teamNames_[x]);
+  }
+  channel->writeString(stageName_);
+  channel->writeString(timestamp_);
+  channel->writeInt(numTexts_);
+  channel->writeInt(numLogEntries_);
+  ReplayData *replayDatas[NUM_REPLAY_DATAS];
+  getReplayDatas(replayDatas);
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    replayDatas[x]->writeChunks(channel);
+  }
+}
+
+// Only for a new ReplayBuilder. If the channel fails partway through, this
+// leaves a replay that's safe to delete but not to save.
+void ReplayBuilder::readFrom(ResultChannel *channel) {
+  int numTeams = std::max(0, channel->readInt());
+  int numShips = std::max(0, channel->readInt());
+  initShips(numTeams, numShips);
+  numTeamsAdded_ = channel->readInt();
+  for (int x = 0; x < numTeams; x++) {
+    teamNames_[x] = channel->readString();
+  }
+  stageName_ = channel->readString();
+  timestamp_ = channel->readString();
+  numTexts_ = channel->readInt();
+  numLogEntries_ = channel->readInt();
+  ReplayData *replayDatas[NUM_REPLAY_DATAS];
+  getReplayDatas(replayDatas);
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    replayDatas[x]->readChunks(channel);
+  }
+}
+#endif
+
+// True if any stream lost data it had spilled to disk, in which case the
+// replay we just wrote has holes in it.
+bool ReplayBuilder::replayDataFailed() {
+  ReplayData *replayDatas[NUM_REPLAY_DATAS];
+  getReplayDatas(replayDatas);
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    if (replayDatas[x]->failed()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ReplayBuilder::getReplayDatas(ReplayData **replayDatas) {
+  int x = 0;
+  replayDatas[x++] = stagePropertiesData_;
+  replayDatas[x++] = wallsData_;
+  replayDatas[x++] = zonesData_;
+  replayDatas[x++] = teamPropertiesData_;
+  replayDatas[x++] = shipPropertiesData_;
+  replayDatas[x++] = shipAddData_;
+  replayDatas[x++] = shipRemoveData_;
+  replayDatas[x++] = shipShowNameData_;
+  replayDatas[x++] = shipHideNameData_;
+  replayDatas[x++] = shipShowEnergyData_;
+  replayDatas[x++] = shipHideEnergyData_;
+  replayDatas[x++] = shipTickData_;
+  replayDatas[x++] = laserStartData_;
+  replayDatas[x++] = laserEndData_;
+  replayDatas[x++] = laserSparkData_;
+  replayDatas[x++] = torpedoStartData_;
+  replayDatas[x++] = torpedoEndData_;
+  replayDatas[x++] = torpedoBlastData_;
+  replayDatas[x++] = torpedoDebrisData_;
+  replayDatas[x++] = shipDestroyData_;
+  replayDatas[x++] = textData_;
+  replayDatas[x++] = logData_;
+  replayDatas[x++] = resultsData_;
+  replayDatas[x++] = keyframeData_;
+}
+
+bool ReplayBuilder::saveReplay(const char *filename) {
+  return saveReplay(getReplaysDir().c_str(), filename);
 }
 
 // Format of saved replay file:
@@ -485,14 +639,47 @@ void ReplayBuilder::saveReplay(const char *filename) {
 // | num texts | <texts>
 // | num log entries | <log entries>
 // | num results | <results>
-void ReplayBuilder::saveReplay(const char *dir, const char *filename) {
+bool ReplayBuilder::saveReplay(const char *dir, const char *filename) {
   // TODO: throw exceptions for failing to save replay, don't silently fail
 
+  char *replayTemplate = readReplayTemplate();
+  if (replayTemplate == 0) {
+    return false;
+  }
+
+  copyReplayResource(KINETIC_JS, dir);
+  copyReplayResource(BBREPLAY_JS, dir);
+
   FileManager fileManager;
+  char *filePath = fileManager.getFilePath(dir, filename);
+  char *absFilename = fileManager.getAbsFilePath(filePath);
+  delete[] filePath;
+  char *absDir = fileManager.parseDir(absFilename);
+  fileManager.createDirectoryIfNecessary(absDir);
+  delete[] absDir;
+  FILE *f = fopen(absFilename, "wb");
+  delete[] absFilename;
+  bool saved = false;
+  if (f != 0) {
+    ReplayFileWriter *writer = new ReplayFileWriter(f);
+    writeReplayHtml(writer, replayTemplate);
+    writer->flush();
+    saved = !writer->failed() && !replayDataFailed();
+    delete writer;
+    if (fclose(f) != 0) {
+      saved = false;
+    }
+  }
+  delete[] replayTemplate;
+  return saved;
+}
+
+char* ReplayBuilder::readReplayTemplate() {
   std::string templateSubPath = std::string("resources/") + REPLAY_TEMPLATE;
   char *templatePath = getResourcePath(templateSubPath.c_str());
   char *replayTemplate = 0;
   if (templatePath != 0) {
+    FileManager fileManager;
     try {
       replayTemplate = fileManager.readFile(templatePath);
     } catch (FileNotFoundException *e) {
@@ -500,42 +687,393 @@ void ReplayBuilder::saveReplay(const char *dir, const char *filename) {
     }
     delete templatePath;
   }
+  return replayTemplate;
+}
+
+// Writes the template straight through to the replay file, filling in the
+// first occurrence of each placeholder as we come to it. The replay data is
+// written out a stream at a time instead of being built up as one big string,
+// so saving a replay needs little more memory than the replay itself.
+void ReplayBuilder::writeReplayHtml(ReplayFileWriter *writer,
+                                    const char *replayTemplate) {
+  const char *placeholders[4] = {REPLAY_TITLE_PLACEHOLDER,
+      REPLAY_DATA_PLACEHOLDER, KINETIC_JS_PLACEHOLDER, BBREPLAY_JS_PLACEHOLDER};
+  bool replaced[4] = {false, false, false, false};
+  const char *s = replayTemplate;
+  while (true) {
+    const char *next = 0;
+    int nextIndex = -1;
+    for (int x = 0; x < 4; x++) {
+      if (!replaced[x]) {
+        const char *found = strstr(s, placeholders[x]);
+        if (found != 0 && (next == 0 || found < next)) {
+          next = found;
+          nextIndex = x;
+        }
+      }
+    }
+    if (next == 0) {
+      break;
+    }
+
+    writer->writeBytes(s, (int) (next - s));
+    switch (nextIndex) {
+      case 0:
+        writer->writeText(htmlTitle().c_str());
+        break;
+      case 1:
+        writeReplayData(writer);
+        break;
+      case 2:
+        writer->writeText(KINETIC_JS);
+        break;
+      case 3:
+        writer->writeText(BBREPLAY_JS);
+        break;
+    }
+    replaced[nextIndex] = true;
+    s = next + strlen(placeholders[nextIndex]);
+  }
+  writer->writeText(s);
+}
+
+// Encoding and record size of each stream, in getReplayDatas order. The
+// variable format streams are stored as they are, except for stage texts. The
+// fixed size ones are stored as deltas from the previous record, or for ship
+// ticks, from the same ship's previous tick.
+void ReplayBuilder::getStreamFormats(int *encodings, int *recordSizes) {
+  int sizes[NUM_REPLAY_DATAS] =
+      {0, 4, 4, 0, 0, 2, 2, 2, 2, 2, 2, 5, 6, 2, 6, 6, 2, 3, 7, 4, 0, 0, 0, 0};
+  ReplayData *replayDatas[NUM_REPLAY_DATAS];
+  getReplayDatas(replayDatas);
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    recordSizes[x] = sizes[x];
+    if (replayDatas[x] == shipTickData_) {
+      encodings[x] = STREAM_ENCODING_SHIP_DELTA;
+    } else if (replayDatas[x] == textData_) {
+      encodings[x] = STREAM_ENCODING_TEXT;
+    } else if (sizes[x] > 0) {
+      encodings[x] = STREAM_ENCODING_COLUMN_DELTA;
+    } else {
+      encodings[x] = STREAM_ENCODING_PLAIN;
+    }
+  }
+}
+
+bool ReplayBuilder::saveBinaryReplay(const char *filename) {
+  return saveBinaryReplay(getReplaysDir().c_str(), filename);
+}
+
+// Format of binary replay file:
+// | "BBRP" | format version
+// | num teams | num ships | num teams added | num texts | num log entries
+// | stage name | timestamp | <team names>
+// | <stream index> | seek table offset | seek table length
+// | <streams>
+// | <seek table>
+//
+// Stream index, one entry per stream, in getReplayDatas order:
+// | encoding (1 byte) | record size (1 byte) | num ints | offset | length
+// where num ints, offset and length (in bytes) are 4 byte ints, so the index
+// can be filled in after the streams are written, like the seek table offset
+// and length. Everything else is a varint, and each stream is a varint per int,
+// zigzag encoded.
+//
+// Seek table format:
+// | num keyframes | <keyframe offsets>
+// with an offset for each stream but the keyframes, for each keyframe: where
+// in the stream that keyframe's ints start, in bytes, as a delta from the
+// same stream's offset in the previous keyframe.
+bool ReplayBuilder::saveBinaryReplay(const char *dir, const char *filename) {
+  FileManager fileManager;
+  char *filePath = fileManager.getFilePath(dir, filename);
+  char *absFilename = fileManager.getAbsFilePath(filePath);
+  delete[] filePath;
+  FILE *f = fopen(absFilename, "wb");
+  delete[] absFilename;
+  if (f == 0) {
+    return false;
+  }
 
-  if (replayTemplate != 0) {
-    copyReplayResource(KINETIC_JS, dir);
-    copyReplayResource(BBREPLAY_JS, dir);
+  ReplayFileWriter *writer = new ReplayFileWriter(f);
+  for (int x = 0; x < 4; x++) {
+    writer->writeByte(BINARY_REPLAY_MAGIC[x]);
+  }
+  writer->writeVarint(BINARY_REPLAY_VERSION);
+  writer->writeVarint(numTeams_);
+  writer->writeVarint(numShips_);
+  writer->writeVarint(numTeamsAdded_);
+  writer->writeVarint(numTexts_);
+  writer->writeVarint(numLogEntries_);
+  writer->writeString(stageName_);
+  writer->writeString(timestamp_);
+  for (int x = 0; x < numTeams_; x++) {
+    writer->writeString(teamNames_[x]);
+  }
 
-    std::string replayHtml(replayTemplate);
-    std::string title = htmlTitle();
-    size_t i;
-    i = replayHtml.find(REPLAY_TITLE_PLACEHOLDER, 0);
-    if (i != std::string::npos) {
-      replayHtml.replace(i, strlen(REPLAY_TITLE_PLACEHOLDER), htmlTitle());
+  ReplayData *replayDatas[NUM_REPLAY_DATAS];
+  int encodings[NUM_REPLAY_DATAS];
+  int recordSizes[NUM_REPLAY_DATAS];
+  long indexPositions[NUM_REPLAY_DATAS];
+  getReplayDatas(replayDatas);
+  getStreamFormats(encodings, recordSizes);
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    writer->writeByte(encodings[x]);
+    writer->writeByte(recordSizes[x]);
+    writer->writeFixed(replayDatas[x]->getSize());
+    indexPositions[x] = writer->getPosition();
+    writer->writeFixed(0);
+    writer->writeFixed(0);
+  }
+  long seekTablePosition = writer->getPosition();
+  writer->writeFixed(0);
+  writer->writeFixed(0);
+
+  ReplayKeyframes *keyframes = new ReplayKeyframes(keyframeData_, numShips_);
+  int numKeyframes = keyframes->getNumKeyframes();
+  unsigned int *seekOffsets =
+      new unsigned int[numKeyframes * (NUM_REPLAY_DATAS - 1)];
+  long offsets[NUM_REPLAY_DATAS];
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    offsets[x] = writer->getPosition();
+    writeStream(writer, replayDatas[x], encodings[x], recordSizes[x],
+        (x == REPLAY_STREAM_KEYFRAMES ? 0 : keyframes), x, seekOffsets);
+  }
+
+  long seekTableOffset = writer->getPosition();
+  writer->writeVarint(numKeyframes);
+  for (int x = 0; x < numKeyframes * (NUM_REPLAY_DATAS - 1); x++) {
+    writer->writeVarint(seekOffsets[x] - (x < NUM_REPLAY_DATAS - 1
+        ? 0 : seekOffsets[x - NUM_REPLAY_DATAS + 1]));
+  }
+  long end = writer->getPosition();
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    long length = (x + 1 < NUM_REPLAY_DATAS ? offsets[x + 1] : seekTableOffset)
+        - offsets[x];
+    writer->patchFixed(indexPositions[x], (unsigned int) offsets[x]);
+    writer->patchFixed(indexPositions[x] + 4, (unsigned int) length);
+  }
+  writer->patchFixed(seekTablePosition, (unsigned int) seekTableOffset);
+  writer->patchFixed(seekTablePosition + 4,
+                     (unsigned int) (end - seekTableOffset));
+  writer->flush();
+  bool saved = !writer->failed() && !replayDataFailed();
+  delete[] seekOffsets;
+  delete keyframes;
+  delete writer;
+  if (fclose(f) != 0) {
+    saved = false;
+  }
+  return saved;
+}
+
+// The delta encodings keep the last record of each ship (or just the last
+// record, for column deltas) and store each int as the difference from the
+// same int in it. The differences wrap around instead of overflowing. At each
+// keyframe, the deltas start over from zero, and we note where we are in the
+// stream for the seek table.
+void ReplayBuilder::writeStream(ReplayFileWriter *writer, ReplayData *data,
+    int encoding, int recordSize, ReplayKeyframes *keyframes, int stream,
+    unsigned int *seekOffsets) {
+  if (encoding == STREAM_ENCODING_TEXT) {
+    writeTextStream(writer, keyframes, stream, seekOffsets);
+    return;
+  }
+
+  ShipTickSlots *slots = 0;
+  int numSlots = 1;
+  if (encoding == STREAM_ENCODING_SHIP_DELTA) {
+    slots = new ShipTickSlots(numShips_, shipAddData_, shipRemoveData_);
+    numSlots = std::max(1, numShips_);
+  }
+  int *lastRecords = 0;
+  if (encoding != STREAM_ENCODING_PLAIN) {
+    lastRecords = new int[numSlots * recordSize];
+    memset(lastRecords, 0, sizeof(int) * numSlots * recordSize);
+  }
+  int *lastRecord = lastRecords;
+  long start = writer->getPosition();
+  int numKeyframes = (keyframes == 0 ? 0 : keyframes->getNumKeyframes());
+  int k = 0;
+  int size = data->getSize();
+  for (int x = 0; x < size; x++) {
+    while (k < numKeyframes && keyframes->getOffset(k, stream) <= x) {
+      seekOffsets[k * (NUM_REPLAY_DATAS - 1) + stream] =
+          (unsigned int) (writer->getPosition() - start);
+      if (lastRecords != 0) {
+        memset(lastRecords, 0, sizeof(int) * numSlots * recordSize);
+      }
+      k++;
     }
+    int value = data->getInt(x);
+    if (lastRecords == 0) {
+      writer->writeSignedVarint(value);
+    } else {
+      int column = x % recordSize;
+      if (column == 0) {
+        lastRecord = &(lastRecords[
+            (slots == 0 ? 0 : slots->nextSlot()) * recordSize]);
+      }
+      writer->writeSignedVarint(
+          (int) ((unsigned int) value - (unsigned int) lastRecord[column]));
+      lastRecord[column] = value;
+    }
+  }
+  for (; k < numKeyframes; k++) {
+    seekOffsets[k * (NUM_REPLAY_DATAS - 1) + stream] =
+        (unsigned int) (writer->getPosition() - start);
+  }
+  if (lastRecords != 0) {
+    delete[] lastRecords;
+  }
+  if (slots != 0) {
+    delete slots;
+  }
+}
 
-    i = replayHtml.find(REPLAY_DATA_PLACEHOLDER, 0);
-    if (i != std::string::npos) {
-      replayHtml.replace(i, strlen(REPLAY_DATA_PLACEHOLDER),
-                         buildReplayDataString());
+// See ReplayStreamDecoder::readTextItem for the format. The text history and
+// time deltas start over at each keyframe, and a record with a keyframe in the
+// middle of it (which only happens if the stream hit its cap) is stored as
+// leftover ints.
+void ReplayBuilder::writeTextStream(ReplayFileWriter *writer,
+    ReplayKeyframes *keyframes, int stream, unsigned int *seekOffsets) {
+  ReplayTextHistory *history = new ReplayTextHistory();
+  int textCapacity = 64;
+  int *text = new int[textCapacity];
+  int fields[TEXT_RECORD_FIELDS];
+  int lastTime = 0;
+  long start = writer->getPosition();
+  int numKeyframes = (keyframes == 0 ? 0 : keyframes->getNumKeyframes());
+  int k = 0;
+  int size = textData_->getSize();
+  int i = 0;
+  while (i < size) {
+    while (k < numKeyframes && keyframes->getOffset(k, stream) <= i) {
+      seekOffsets[k * (NUM_REPLAY_DATAS - 1) + stream] =
+          (unsigned int) (writer->getPosition() - start);
+      history->clear();
+      lastTime = 0;
+      k++;
+    }
+    int recordEnd = -1;
+    if (i + 2 <= size) {
+      int textLength = textData_->getInt(i + 1);
+      if (textLength >= 0
+          && textLength <= size - i - 2 - TEXT_RECORD_FIELDS) {
+        recordEnd = i + 2 + textLength + TEXT_RECORD_FIELDS;
+      }
+    }
+    if (recordEnd < 0
+        || (k < numKeyframes && keyframes->getOffset(k, stream) < recordEnd)) {
+      writer->writeVarint(TEXT_LEFTOVER_MARKER);
+      writer->writeSignedVarint(textData_->getInt(i++));
+      continue;
     }
 
-    i = replayHtml.find(KINETIC_JS_PLACEHOLDER, 0);
-    if (i != std::string::npos) {
-      replayHtml.replace(i, strlen(KINETIC_JS_PLACEHOLDER), KINETIC_JS);
+    int time = textData_->getInt(i++);
+    int textLength = textData_->getInt(i++);
+    if (textLength > textCapacity) {
+      delete[] text;
+      textCapacity = textLength;
+      text = new int[textCapacity];
+    }
+    for (int y = 0; y < textLength; y++) {
+      text[y] = textData_->getInt(i++);
+    }
+    for (int y = 0; y < TEXT_RECORD_FIELDS; y++) {
+      fields[y] = textData_->getInt(i++);
     }
 
-    i = replayHtml.find(BBREPLAY_JS_PLACEHOLDER, 0);
-    if (i != std::string::npos) {
-      replayHtml.replace(i, strlen(BBREPLAY_JS_PLACEHOLDER), BBREPLAY_JS);
+    int shared;
+    int baseSlot = history->findBase(text, textLength, &shared);
+    writer->writeVarint(baseSlot + 1);
+    writer->writeVarint(shared);
+    writer->writeVarint(textLength - shared);
+    for (int y = shared; y < textLength; y++) {
+      writer->writeVarint((unsigned int) text[y]);
+    }
+    writer->writeSignedVarint(
+        (int) ((unsigned int) time - (unsigned int) lastTime));
+    lastTime = time;
+    const int *baseFields = (baseSlot < 0 ? 0 : history->getFields(baseSlot));
+    for (int y = 0; y < TEXT_RECORD_FIELDS; y++) {
+      unsigned int baseField = (baseFields == 0 ? 0 : baseFields[y]);
+      writer->writeSignedVarint((int) ((unsigned int) fields[y] - baseField));
     }
+    history->store(baseSlot, text, textLength, fields);
+  }
+  for (; k < numKeyframes; k++) {
+    seekOffsets[k * (NUM_REPLAY_DATAS - 1) + stream] =
+        (unsigned int) (writer->getPosition() - start);
+  }
+  delete[] text;
+  delete history;
+}
+
+bool ReplayBuilder::loadBinaryReplay(const char *filename) {
+  return loadBinaryReplay(getReplaysDir().c_str(), filename);
+}
 
-    char *filePath = fileManager.getFilePath(dir, filename);
-    char *absFilename = fileManager.getAbsFilePath(filePath);
-    delete filePath;
-    fileManager.writeFile(absFilename, replayHtml.c_str());
-    delete absFilename;
-    delete replayTemplate;
+// Only for a new ReplayBuilder. Loading a binary replay and then saving it with
+// saveReplay gives the same HTML replay as saving the original. If the file is
+// malformed, this leaves a replay that's safe to delete but not to save.
+bool ReplayBuilder::loadBinaryReplay(const char *dir, const char *filename) {
+  FileManager fileManager;
+  char *filePath = fileManager.getFilePath(dir, filename);
+  char *absFilename = fileManager.getAbsFilePath(filePath);
+  delete[] filePath;
+  FILE *f = fopen(absFilename, "rb");
+  delete[] absFilename;
+  if (f == 0) {
+    return false;
+  }
+
+  spillToDisk();
+  ReplayFileReader *reader =
+      new ReplayFileReader(f, BINARY_REPLAY_BUFFER_SIZE);
+  bool loaded = readBinaryReplay(reader);
+  delete reader;
+  fclose(f);
+  return loaded;
+}
+
+bool ReplayBuilder::readBinaryReplay(ReplayFileReader *reader) {
+  BinaryReplayHeader *header = readBinaryReplayHeader(reader);
+  if (header == 0) {
+    return false;
+  }
+  initShips(header->numTeams, header->numShips);
+  numTeamsAdded_ = header->numTeamsAdded;
+  numTexts_ = header->numTexts;
+  numLogEntries_ = header->numLogEntries;
+  stageName_ = header->stageName;
+  timestamp_ = header->timestamp;
+  header->stageName = header->timestamp = 0;
+  for (int x = 0; x < numTeams_; x++) {
+    teamNames_[x] = header->teamNames[x];
+    header->teamNames[x] = 0;
+  }
+
+  // The keyframes say where the other streams start over, so they go first.
+  bool loaded = readReplayStream(
+      reader, header, REPLAY_STREAM_KEYFRAMES, 0, 0, keyframeData_);
+  ReplayKeyframes *keyframes = new ReplayKeyframes(keyframeData_, numShips_);
+  ReplayData *replayDatas[NUM_REPLAY_DATAS];
+  getReplayDatas(replayDatas);
+  for (int x = 0; x < NUM_REPLAY_DATAS && loaded; x++) {
+    if (x != REPLAY_STREAM_KEYFRAMES) {
+      ShipTickSlots *slots = (x == REPLAY_STREAM_SHIP_TICK
+          ? new ShipTickSlots(numShips_, shipAddData_, shipRemoveData_) : 0);
+      loaded = readReplayStream(
+          reader, header, x, keyframes, slots, replayDatas[x]);
+      if (slots != 0) {
+        delete slots;
+      }
+    }
   }
+  delete keyframes;
+  deleteBinaryReplayHeader(header);
+  return loaded;
 }
 
 void ReplayBuilder::copyReplayResource(const char *resource,
@@ -564,65 +1102,60 @@ void ReplayBuilder::copyReplayResource(const char *resource,
   delete targetPath;
 }
 
-std::string ReplayBuilder::buildReplayDataString() {
-  std::stringstream dataStream;
-
-  dataStream << std::hex << REPLAY_VERSION;
-  dataStream << ':' << stagePropertiesDataString()
-             << ':' << wallsData_->toHexString(4)
-             << ':' << zonesData_->toHexString(4)
-             << ':' << teamPropertiesDataString()
-             << ':' << shipPropertiesDataString()
-             << ':' << shipAddData_->toHexString(2)
-             << ':' << shipRemoveData_->toHexString(2)
-             << ':' << shipShowNameData_->toHexString(2)
-             << ':' << shipHideNameData_->toHexString(2)
-             << ':' << shipShowEnergyData_->toHexString(2)
-             << ':' << shipHideEnergyData_->toHexString(2)
-             << ':' << shipTickData_->toHexString(5)
-             << ':' << laserStartData_->toHexString(6)
-             << ':' << laserEndData_->toHexString(2)
-             << ':' << laserSparkData_->toHexString(6)
-             << ':' << torpedoStartData_->toHexString(6)
-             << ':' << torpedoEndData_->toHexString(2)
-             << ':' << torpedoBlastData_->toHexString(3)
-             << ':' << torpedoDebrisData_->toHexString(7)
-             << ':' << shipDestroyData_->toHexString(4)
-             << ':' << textDataString()
-             << ':' << logDataString()
-             << ':' << resultsDataString();
-
-  return dataStream.str();
-}
-
-std::string ReplayBuilder::stagePropertiesDataString() {
-  std::stringstream out;
+void ReplayBuilder::writeReplayData(ReplayFileWriter *out) {
+  out->writeHex(REPLAY_VERSION);
+  out->writeByte(':');
+  writeStageProperties(out);
+  appendHexData(out, wallsData_, 4);
+  appendHexData(out, zonesData_, 4);
+  out->writeByte(':');
+  writeTeamProperties(out);
+  out->writeByte(':');
+  writeShipProperties(out);
+  appendHexData(out, shipAddData_, 2);
+  appendHexData(out, shipRemoveData_, 2);
+  appendHexData(out, shipShowNameData_, 2);
+  appendHexData(out, shipHideNameData_, 2);
+  appendHexData(out, shipShowEnergyData_, 2);
+  appendHexData(out, shipHideEnergyData_, 2);
+  appendHexData(out, shipTickData_, 5);
+  appendHexData(out, laserStartData_, 6);
+  appendHexData(out, laserEndData_, 2);
+  appendHexData(out, laserSparkData_, 6);
+  appendHexData(out, torpedoStartData_, 6);
+  appendHexData(out, torpedoEndData_, 2);
+  appendHexData(out, torpedoBlastData_, 3);
+  appendHexData(out, torpedoDebrisData_, 7);
+  appendHexData(out, shipDestroyData_, 4);
+  out->writeByte(':');
+  writeTexts(out);
+  out->writeByte(':');
+  writeLogEntries(out);
+  out->writeByte(':');
+  writeResults(out);
+}
+
+void ReplayBuilder::writeStageProperties(ReplayFileWriter *out) {
   int i = 0;
 
   appendString(out, stagePropertiesData_, i);
   for (int x = 0; x < 2; x++) {
     appendInt(out, stagePropertiesData_->getInt(i++));
   }
-  
-  return out.str();
 }
 
-std::string ReplayBuilder::teamPropertiesDataString() {
-  std::stringstream out;
-  out << std::hex << numTeams_;
+void ReplayBuilder::writeTeamProperties(ReplayFileWriter *out) {
+  out->writeHex(numTeams_);
 
   int i = 0;
   for (int x = 0; x < numTeams_; x++) {
     appendInt(out, teamPropertiesData_->getInt(i++));
     appendColonString(out, teamPropertiesData_, i);
   }
-
-  return out.str();
 }
 
-std::string ReplayBuilder::shipPropertiesDataString() {
-  std::stringstream out;
-  out << std::hex << numShips_;
+void ReplayBuilder::writeShipProperties(ReplayFileWriter *out) {
+  out->writeHex(numShips_);
 
   int i = 0;
   char *rgbString = new char[8]; // "#RRGGBB\0"
@@ -633,19 +1166,17 @@ std::string ReplayBuilder::shipPropertiesDataString() {
       int g = shipPropertiesData_->getInt(i++);
       int b = shipPropertiesData_->getInt(i++);
       sprintf(rgbString, "#%02x%02x%02x", r, g, b);
-      out << ':' << rgbString;
+      out->writeByte(':');
+      out->writeText(rgbString);
     }
 
     appendColonString(out, shipPropertiesData_, i);
   }
   delete rgbString;
-
-  return out.str();
 }
 
-std::string ReplayBuilder::textDataString() {
-  std::stringstream out;
-  out << std::hex << numTexts_;
+void ReplayBuilder::writeTexts(ReplayFileWriter *out) {
+  out->writeHex(numTexts_);
 
   int i = 0;
   char *rgbString = new char[8]; // "#RRGGBB\0"
@@ -660,20 +1191,18 @@ std::string ReplayBuilder::textDataString() {
     int g = textData_->getInt(i++);
     int b = textData_->getInt(i++);
     sprintf(rgbString, "#%02x%02x%02x", r, g, b);
-    out << ':' << rgbString;
+    out->writeByte(':');
+    out->writeText(rgbString);
 
     for (int y = 0; y < 2; y++) {
       appendInt(out, textData_->getInt(i++));
     }
   }
   delete rgbString;
-
-  return out.str();
 }
 
-std::string ReplayBuilder::logDataString() {
-  std::stringstream out;
-  out << std::hex << numLogEntries_;
+void ReplayBuilder::writeLogEntries(ReplayFileWriter *out) {
+  out->writeHex(numLogEntries_);
   
   int i = 0;
   for (int x = 0; x < numLogEntries_; x++) {
@@ -683,8 +1212,6 @@ std::string ReplayBuilder::logDataString() {
 
     appendColonString(out, logData_, i);
   }
-  
-  return out.str();
 }
 
 // Expanded results format:
@@ -696,12 +1223,11 @@ std::string ReplayBuilder::logDataString() {
 // num results : <results>
 //   Team result: team index : rank : score * 100 : num stats : stats
 //     Stat: key : value * 100
-std::string ReplayBuilder::resultsDataString() {
-  std::stringstream out;
+void ReplayBuilder::writeResults(ReplayFileWriter *out) {
   int i = 0;
   int numResults =
       (resultsData_->getSize() > 0) ? resultsData_->getInt(i++) : 0;
-  out << std::hex << numResults;
+  out->writeHex(numResults);
   
   for (int x = 0; x < numResults; x++) {
     for (int y = 0; y < 3; y++) {
@@ -715,8 +1241,6 @@ std::string ReplayBuilder::resultsDataString() {
       appendInt(out, resultsData_->getInt(i++));
     }
   }
-  
-  return out.str();
 }
 
 std::string ReplayBuilder::htmlTitle() {
@@ -739,15 +1263,6 @@ std::string ReplayBuilder::htmlTitle() {
   return titleStream.str();
 }
 
-std::string ReplayBuilder::escapeString(std::string s) {
-  findReplace(s, ':', "\\:");
-  findReplace(s, '\\', "\\\\");
-  findReplace(s, '\'', "\\'");
-  findReplace(s, '\n', "\\n");
-  findReplace(s, '\r', "\\n");
-  return s;
-}
-
 std::string ReplayBuilder::escapeHtml(std::string s) {
   findReplace(s, '&', "&amp;");
   findReplace(s, '<', "&lt;");
@@ -767,30 +1282,49 @@ void ReplayBuilder::findReplace(std::string &s, char find, const char *replace)
   }
 }
 
-void ReplayBuilder::appendInt(std::stringstream &out, int i) {
-  out << ':';
-  int sign = 1;
-  if (i < 0) {
-    out << '-';
-    sign = -1;
-  }
-  out << std::hex << (sign * i);
+void ReplayBuilder::appendInt(ReplayFileWriter *out, int i) {
+  out->writeByte(':');
+  out->writeHex(i);
 }
 
-void ReplayBuilder::appendColonString(std::stringstream &out, ReplayData *data,
-                                int &i) {
-  out << ':';
+void ReplayBuilder::appendColonString(ReplayFileWriter *out, ReplayData *data,
+                                      int &i) {
+  out->writeByte(':');
   appendString(out, data, i);
 }
 
-void ReplayBuilder::appendString(std::stringstream &out, ReplayData *data,
-                                int &i) {
+// Escapes each char as it's written: a backslash becomes two backslashes, a
+// quote or newline gets one backslash in front of it, and a colon gets two,
+// which is what the replay viewer expects.
+void ReplayBuilder::appendString(ReplayFileWriter *out, ReplayData *data,
+                                 int &i) {
   int len = data->getInt(i++);
-  std::stringstream stringStream;
   for (int x = 0; x < len; x++) {
-    stringStream << (char) data->getInt(i++);
+    char c = (char) data->getInt(i++);
+    switch (c) {
+      case ':':
+        out->writeText("\\\\:");
+        break;
+      case '\\':
+        out->writeText("\\\\");
+        break;
+      case '\'':
+        out->writeText("\\'");
+        break;
+      case '\n':
+      case '\r':
+        out->writeText("\\n");
+        break;
+      default:
+        out->writeByte(c);
+    }
   }
-  out << escapeString(stringStream.str());
+}
+
+void ReplayBuilder::appendHexData(ReplayFileWriter *out, ReplayData *data,
+                                  int blockSize) {
+  out->writeByte(':');
+  data->writeHex(out, blockSize);
 }
 
 char* ReplayBuilder::getResourcePath(const char *resourcePath) {
@@ -807,6 +1341,12 @@ ReplayData::ReplayData(int maxChunks) {
   chunks_[0] = new ReplayChunk;
   chunks_[0]->size = 0;
   numChunks_ = 1;
+  spillFile_ = 0;
+  spilledOffsets_ = 0;
+  numSpilled_ = spilledCapacity_ = 0;
+  spillCache_ = 0;
+  spillCacheIndex_ = -1;
+  failed_ = false;
 }
 
 ReplayData::~ReplayData() {
@@ -814,19 +1354,94 @@ ReplayData::~ReplayData() {
     delete chunks_[x];
   }
   delete chunks_;
+  if (spilledOffsets_ != 0) {
+    delete[] spilledOffsets_;
+  }
+  if (spillCache_ != 0) {
+    delete spillCache_;
+  }
+}
+
+void ReplayData::setSpillFile(ReplaySpillFile *spillFile) {
+  spillFile_ = spillFile;
+}
+
+// True if a spilled chunk couldn't be read back, so anything written from
+// this stream has zeroes where that chunk should be.
+bool ReplayData::failed() {
+  return failed_;
 }
 
 void ReplayData::addInt(int x) {
+  ReplayChunk *chunk = writableChunk();
+  if (chunk != 0) {
+    chunk->data[chunk->size++] = x;
+  }
+}
+
+// The last chunk, after making room in it if it's full. With a spill file, a
+// full chunk is written out and reused. Otherwise we start a new chunk, or
+// return 0 once we're at the cap. If spilling ever fails, we keep everything
+// in memory from then on, so the spilled chunks stay in front.
+ReplayChunk* ReplayData::writableChunk() {
   ReplayChunk *chunk = chunks_[numChunks_ - 1];
   if (chunk->size == CHUNK_SIZE) {
-    if (numChunks_ == maxChunks_) {
-      return;
+    if (spillFile_ != 0 && numChunks_ == 1 && spillChunk(chunk)) {
+      chunk->size = 0;
+    } else if (numChunks_ == maxChunks_) {
+      return 0;
+    } else {
+      chunk = chunks_[numChunks_++] = new ReplayChunk;
+      chunk->size = 0;
+    }
+  }
+  return chunk;
+}
+
+bool ReplayData::spillChunk(ReplayChunk *chunk) {
+  long offset = spillFile_->append(chunk);
+  if (offset < 0) {
+    return false;
+  }
+  if (numSpilled_ == spilledCapacity_) {
+    int newCapacity = std::max(64, spilledCapacity_ * 2);
+    long *newOffsets = new long[newCapacity];
+    for (int x = 0; x < numSpilled_; x++) {
+      newOffsets[x] = spilledOffsets_[x];
     }
+    if (spilledOffsets_ != 0) {
+      delete[] spilledOffsets_;
+    }
+    spilledOffsets_ = newOffsets;
+    spilledCapacity_ = newCapacity;
+  }
+  spilledOffsets_[numSpilled_++] = offset;
+  return true;
+}
+
+int ReplayData::getNumChunks() {
+  return numSpilled_ + numChunks_;
+}
 
-    chunk = chunks_[numChunks_++] = new ReplayChunk;
-    chunk->size = 0;
+// Spilled chunks are read back into a one chunk cache, so reading through the
+// stream in order reads each of them from disk once. If one can't be read, we
+// hand back zeroes in its place and mark the stream failed.
+ReplayChunk* ReplayData::getChunk(int index) {
+  if (index >= numSpilled_) {
+    return chunks_[index - numSpilled_];
+  }
+  if (spillCacheIndex_ != index) {
+    if (spillCache_ == 0) {
+      spillCache_ = new ReplayChunk;
+    }
+    if (!spillFile_->read(spilledOffsets_[index], spillCache_)) {
+      memset(spillCache_->data, 0, sizeof(int) * CHUNK_SIZE);
+      spillCache_->size = CHUNK_SIZE;
+      failed_ = true;
+    }
+    spillCacheIndex_ = index;
   }
-  chunk->data[chunk->size++] = x;
+  return spillCache_;
 }
 
 void ReplayData::addString(const char *s) {
@@ -838,43 +1453,109 @@ void ReplayData::addString(const char *s) {
 }
 
 int ReplayData::getSize() {
-  return ((numChunks_ - 1) * CHUNK_SIZE) + chunks_[numChunks_ - 1]->size;
+  return ((getNumChunks() - 1) * CHUNK_SIZE) + chunks_[numChunks_ - 1]->size;
 }
 
 int ReplayData::getInt(int index) {
   int chunk = index / CHUNK_SIZE;
   int i = index % CHUNK_SIZE;
-  return chunks_[chunk]->data[i];
+  return getChunk(chunk)->data[i];
 }
 
 void ReplayData::writeChunks(FILE *f) {
-  for (int x = 0; x < numChunks_; x++) {
-    fwrite(chunks_[x]->data, sizeof(int), chunks_[x]->size, f);
+  int numChunks = getNumChunks();
+  for (int x = 0; x < numChunks; x++) {
+    ReplayChunk *chunk = getChunk(x);
+    fwrite(chunk->data, sizeof(int), chunk->size, f);
   }
 }
 
-std::string ReplayData::toHexString(int blockSize) {
-  std::stringstream out;
-  if (blockSize > 0) {
-    int numElements = getSize() / blockSize;
-    out << ':';
-    out << std::hex << numElements;
+#ifndef __WIN32__
+// Format: num chunks | (chunk size | chunk ints)* | failed
+void ReplayData::writeChunks(ResultChannel *channel) {
+  int numChunks = getNumChunks();
+  channel->writeInt(numChunks);
+  for (int x = 0; x < numChunks; x++) {
+    ReplayChunk *chunk = getChunk(x);
+    channel->writeInt(chunk->size);
+    channel->write(chunk->data, chunk->size * sizeof(int));
   }
-  for (int x = 0; x < numChunks_; x++) {
-    int chunkSize = chunks_[x]->size;
-    ReplayChunk *chunk = chunks_[x];
-    for (int y = 0; y < chunkSize; y++) {
-      out << ':';
-      int d = chunk->data[y];
-      int sign = 1;
-      if (d < 0) {
-        out << '-';
-        sign = -1;
+  channel->writeInt(failed_ ? 1 : 0);
+}
+
+// Only for empty ReplayData. Every chunk but the last arrives full. Any that
+// don't fit under the cap are dropped, like they would be by addInt.
+void ReplayData::readChunks(ResultChannel *channel) {
+  int numChunks = channel->readInt();
+  ReplayChunk *dropped = 0;
+  for (int x = 0; x < numChunks && !channel->failed(); x++) {
+    ReplayChunk *chunk = (x == 0 ? chunks_[0] : writableChunk());
+    if (chunk == 0 || chunk->size != 0) {
+      if (dropped == 0) {
+        dropped = new ReplayChunk;
       }
-      out << std::hex << (sign * d);
+      chunk = dropped;
     }
+    chunk->size = std::max(0, std::min(channel->readInt(), CHUNK_SIZE));
+    channel->read(chunk->data, chunk->size * sizeof(int));
+  }
+  if (channel->readInt() != 0) {
+    failed_ = true;
+  }
+  if (dropped != 0) {
+    delete dropped;
+  }
+}
+#endif
+
+// Format: num blocks | ints, colon separated, in hex.
+void ReplayData::writeHex(ReplayFileWriter *out, int blockSize) {
+  out->writeHex(getSize() / blockSize);
+  int numChunks = getNumChunks();
+  for (int x = 0; x < numChunks; x++) {
+    ReplayChunk *chunk = getChunk(x);
+    int chunkSize = chunk->size;
+    for (int y = 0; y < chunkSize; y++) {
+      out->writeByte(':');
+      out->writeHex(chunk->data[y]);
+    }
+  }
+}
+
+ReplaySpillFile::ReplaySpillFile() {
+  file_ = tmpfile();
+  size_ = 0;
+}
+
+ReplaySpillFile::~ReplaySpillFile() {
+  if (file_ != 0) {
+    fclose(file_);
+  }
+}
+
+bool ReplaySpillFile::isOpen() {
+  return (file_ != 0);
+}
+
+// Writes a full chunk to the end of the file. Returns its offset, or -1 if it
+// couldn't be written.
+long ReplaySpillFile::append(ReplayChunk *chunk) {
+  if (fseek(file_, size_, SEEK_SET) != 0
+      || fwrite(chunk->data, sizeof(int), CHUNK_SIZE, file_) != CHUNK_SIZE) {
+    return -1;
+  }
+  long offset = size_;
+  size_ += sizeof(int) * CHUNK_SIZE;
+  return offset;
+}
+
+bool ReplaySpillFile::read(long offset, ReplayChunk *chunk) {
+  if (fseek(file_, offset, SEEK_SET) != 0
+      || fread(chunk->data, sizeof(int), CHUNK_SIZE, file_) != CHUNK_SIZE) {
+    return false;
   }
-  return out.str().substr(1);
+  chunk->size = CHUNK_SIZE;
+  return true;
 }
 
 ReplayEventHandler::ReplayEventHandler(ReplayBuilder *replayBuilder) {
@@ -36,31 +36,102 @@
 #define BBREPLAY_JS_PLACEHOLDER   "{$bbreplayJs}"
 
 #define CHUNK_SIZE            (1024 * 32 / 4)  // 32 kb of ints
+// Caps on chunks kept in memory. Streams that spill to disk have no cap.
 #define MAX_SHIP_TICK_CHUNKS  640              // 20 megs
 #define MAX_LASER_CHUNKS      640              // 20 megs lasers/sparks
 #define MAX_TEXT_CHUNKS       640              // 20 megs
 #define MAX_MISC_CHUNKS       32               // 1 meg each
 #define MAX_TORPEDO_SPARKS    30
+#define NUM_REPLAY_DATAS      24
+
+// Stream indices, in getReplayDatas order.
+#define REPLAY_STREAM_STAGE_PROPERTIES  0
+#define REPLAY_STREAM_WALLS             1
+#define REPLAY_STREAM_ZONES             2
+#define REPLAY_STREAM_TEAM_PROPERTIES   3
+#define REPLAY_STREAM_SHIP_PROPERTIES   4
+#define REPLAY_STREAM_SHIP_ADD          5
+#define REPLAY_STREAM_SHIP_REMOVE       6
+#define REPLAY_STREAM_SHIP_SHOW_NAME    7
+#define REPLAY_STREAM_SHIP_HIDE_NAME    8
+#define REPLAY_STREAM_SHIP_SHOW_ENERGY  9
+#define REPLAY_STREAM_SHIP_HIDE_ENERGY  10
+#define REPLAY_STREAM_SHIP_TICK         11
+#define REPLAY_STREAM_LASER_START       12
+#define REPLAY_STREAM_LASER_END         13
+#define REPLAY_STREAM_LASER_SPARK       14
+#define REPLAY_STREAM_TORPEDO_START     15
+#define REPLAY_STREAM_TORPEDO_END       16
+#define REPLAY_STREAM_TORPEDO_BLAST     17
+#define REPLAY_STREAM_TORPEDO_DEBRIS    18
+#define REPLAY_STREAM_SHIP_DESTROY      19
+#define REPLAY_STREAM_TEXT              20
+#define REPLAY_STREAM_LOG               21
+#define REPLAY_STREAM_RESULTS           22
+#define REPLAY_STREAM_KEYFRAMES         23
+
+// Ticks between keyframes. Reading a replay from any tick only has to decode
+// the ticks since the keyframe before it.
+#define REPLAY_KEYFRAME_INTERVAL  128
+
+class ResultChannel;
+class ReplayFileWriter;
+class ReplayFileReader;
+class ReplayKeyframes;
 
 typedef struct {
   int data[CHUNK_SIZE];
   int size;
 } ReplayChunk;
 
+// Full chunks moved out of memory by a replay's ReplayData streams, all
+// appended to one temporary file that's removed when it's closed.
+class ReplaySpillFile {
+  FILE *file_;
+  long size_;
+
+  public:
+    ReplaySpillFile();
+    ~ReplaySpillFile();
+    bool isOpen();
+    long append(ReplayChunk *chunk);
+    bool read(long offset, ReplayChunk *chunk);
+};
+
+// A stream of ints, in chunks. Chunks that have been spilled to disk always
+// come before the ones still in memory.
 class ReplayData {
   ReplayChunk **chunks_;
   int numChunks_;
   int maxChunks_;
+  ReplaySpillFile *spillFile_;
+  long *spilledOffsets_;
+  int numSpilled_;
+  int spilledCapacity_;
+  ReplayChunk *spillCache_;
+  int spillCacheIndex_;
+  bool failed_;
 
   public:
     ReplayData(int maxChunks);
     ~ReplayData();
+    void setSpillFile(ReplaySpillFile *spillFile);
+    bool failed();
     void addInt(int x);
     void addString(const char *s);
     int getSize();
     int getInt(int index);
     void writeChunks(FILE *f);
-    std::string toHexString(int blockSize);
+#ifndef __WIN32__
+    void writeChunks(ResultChannel *channel);
+    void readChunks(ResultChannel *channel);
+#endif
+    void writeHex(ReplayFileWriter *out, int blockSize);
+  private:
+    ReplayChunk* writableChunk();
+    bool spillChunk(ReplayChunk *chunk);
+    int getNumChunks();
+    ReplayChunk* getChunk(int index);
 };
 
 class ReplayBuilder {
@@ -95,14 +166,18 @@ class ReplayBuilder {
   ReplayData *textData_;
   ReplayData *logData_;
   ReplayData *resultsData_;
+  ReplayData *keyframeData_;
+  int nextKeyframeTime_;
   int numTexts_;
   int numLogEntries_;
   char *timestamp_;
   char *templateDir_;
+  ReplaySpillFile *spillFile_;
   
   public:
     ReplayBuilder(const char *templateDir);
     ~ReplayBuilder();
+    void spillToDisk();
     void initShips(int numTeams, int numShips);
     void addStageProperties(const char *name, int width, int height);
     void addWall(int left, int bottom, int width, int height);
@@ -126,8 +201,17 @@ class ReplayBuilder {
     void setResults(Team **rankedTeams, int numTeams);
     const char* getStageName();
     void setTimestamp(const char *timestamp);
-    void saveReplay(const char *filename);
-    void saveReplay(const char *dir, const char *filename);
+    const char* getTimestamp();
+    bool saveReplay(const char *filename);
+    bool saveReplay(const char *dir, const char *filename);
+    bool saveBinaryReplay(const char *filename);
+    bool saveBinaryReplay(const char *dir, const char *filename);
+    bool loadBinaryReplay(const char *filename);
+    bool loadBinaryReplay(const char *dir, const char *filename);
+#ifndef __WIN32__
+    void writeTo(ResultChannel *channel);
+    void readFrom(ResultChannel *channel);
+#endif
   private:
     void addShip(int shipIndex, int time);
     void removeShip(int shipIndex, int time);
@@ -135,28 +219,38 @@ class ReplayBuilder {
     void addShipHideName(int shipIndex, int time);
     void addShipShowEnergy(int shipIndex, int time);
     void addShipHideEnergy(int shipIndex, int time);
+    void addKeyframe(int time);
     void addResult(Team *team);
     void addStat(ScoreStat *stat);
     int round(double f);
     void copyReplayResource(const char *resource, const char *targetDir);
-    std::string buildReplayDataString();
     char* readReplayTemplate();
-    std::string stagePropertiesDataString();
-    std::string teamPropertiesDataString();
-    std::string shipPropertiesDataString();
-    std::string textDataString();
-    std::string logDataString();
-    std::string resultsDataString();
+    void writeReplayHtml(ReplayFileWriter *writer, const char *replayTemplate);
+    void writeReplayData(ReplayFileWriter *out);
+    void writeStageProperties(ReplayFileWriter *out);
+    void writeTeamProperties(ReplayFileWriter *out);
+    void writeShipProperties(ReplayFileWriter *out);
+    void writeTexts(ReplayFileWriter *out);
+    void writeLogEntries(ReplayFileWriter *out);
+    void writeResults(ReplayFileWriter *out);
     std::string htmlTitle();
-    std::string escapeString(std::string s);
     std::string escapeHtml(std::string s);
     void findReplace(std::string &s, char find, const char *replace);
-    void appendInt(std::stringstream &hexStream, int i);
-    void appendColonString(std::stringstream &hexStream, ReplayData *data,
-                          int &i);
-    void appendString(std::stringstream &hexStream, ReplayData *data, int &i);
+    void appendInt(ReplayFileWriter *out, int i);
+    void appendColonString(ReplayFileWriter *out, ReplayData *data, int &i);
+    void appendString(ReplayFileWriter *out, ReplayData *data, int &i);
+    void appendHexData(ReplayFileWriter *out, ReplayData *data, int blockSize);
 
     char* getResourcePath(const char *resourcePath);
+    void getReplayDatas(ReplayData **replayDatas);
+    bool replayDataFailed();
+    void getStreamFormats(int *encodings, int *recordSizes);
+    bool readBinaryReplay(ReplayFileReader *reader);
+    void writeStream(ReplayFileWriter *writer, ReplayData *data, int encoding,
+        int recordSize, ReplayKeyframes *keyframes, int stream,
+        unsigned int *seekOffsets);
+    void writeTextStream(ReplayFileWriter *writer, ReplayKeyframes *keyframes,
+                         int stream, unsigned int *seekOffsets);
 };
 
 class ReplayEventHandler : public EventHandler {
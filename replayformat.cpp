@@ -0,0 +1,824 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <algorithm>
+#include "replaybuilder.h"
+#include "replayformat.h"
+
+ReplayFileWriter::ReplayFileWriter(FILE *file) {
+  file_ = file;
+  buffer_ = new unsigned char[BINARY_REPLAY_BUFFER_SIZE];
+  bufferSize_ = 0;
+  position_ = 0;
+  failed_ = false;
+}
+
+ReplayFileWriter::~ReplayFileWriter() {
+  delete[] buffer_;
+}
+
+void ReplayFileWriter::writeByte(int b) {
+  if (bufferSize_ == BINARY_REPLAY_BUFFER_SIZE) {
+    flush();
+  }
+  buffer_[bufferSize_++] = (unsigned char) b;
+  position_++;
+}
+
+void ReplayFileWriter::writeBytes(const char *bytes, int length) {
+  while (length > 0) {
+    if (bufferSize_ == BINARY_REPLAY_BUFFER_SIZE) {
+      flush();
+    }
+    int n = std::min(length, BINARY_REPLAY_BUFFER_SIZE - bufferSize_);
+    memcpy(&(buffer_[bufferSize_]), bytes, n);
+    bufferSize_ += n;
+    position_ += n;
+    bytes += n;
+    length -= n;
+  }
+}
+
+void ReplayFileWriter::writeText(const char *s) {
+  writeBytes(s, (int) strlen(s));
+}
+
+// Lower case hex, with a '-' in front of negative numbers.
+void ReplayFileWriter::writeHex(int x) {
+  unsigned int u = (unsigned int) x;
+  if (x < 0) {
+    writeByte('-');
+    u = 0 - u;
+  }
+  char digits[8];
+  int numDigits = 0;
+  do {
+    digits[numDigits++] = "0123456789abcdef"[u & 0xf];
+    u >>= 4;
+  } while (u != 0);
+  while (numDigits > 0) {
+    writeByte(digits[--numDigits]);
+  }
+}
+
+// 7 bits at a time, low bits first, with the high bit set on all but the last
+// byte.
+void ReplayFileWriter::writeVarint(unsigned int x) {
+  while (x >= 0x80) {
+    writeByte((x & 0x7f) | 0x80);
+    x >>= 7;
+  }
+  writeByte(x);
+}
+
+// Zigzag encoded, so small negative numbers stay small: 0, -1, 1, -2, 2, ...
+// become 0, 1, 2, 3, 4, ...
+void ReplayFileWriter::writeSignedVarint(int x) {
+  writeVarint((((unsigned int) x) << 1) ^ ((unsigned int) (x >> 31)));
+}
+
+void ReplayFileWriter::writeFixed(unsigned int x) {
+  for (int y = 0; y < 4; y++) {
+    writeByte((x >> (y * 8)) & 0xff);
+  }
+}
+
+// Format: length + 1 | chars, or just 0 for a null string.
+void ReplayFileWriter::writeString(const char *s) {
+  if (s == 0) {
+    writeVarint(0);
+  } else {
+    int len = (int) strlen(s);
+    writeVarint(len + 1);
+    for (int x = 0; x < len; x++) {
+      writeByte(s[x]);
+    }
+  }
+}
+
+long ReplayFileWriter::getPosition() {
+  return position_;
+}
+
+// Overwrites a fixed width int written earlier, e.g. to fill in an index
+// once we know what goes in it.
+void ReplayFileWriter::patchFixed(long position, unsigned int x) {
+  flush();
+  if (failed_ || fseek(file_, position, SEEK_SET) != 0) {
+    failed_ = true;
+    return;
+  }
+  unsigned char bytes[4];
+  for (int y = 0; y < 4; y++) {
+    bytes[y] = (x >> (y * 8)) & 0xff;
+  }
+  if (fwrite(bytes, 1, 4, file_) != 4 || fseek(file_, 0, SEEK_END) != 0) {
+    failed_ = true;
+  }
+}
+
+void ReplayFileWriter::flush() {
+  if (!failed_ && bufferSize_ > 0
+      && fwrite(buffer_, 1, bufferSize_, file_) != (size_t) bufferSize_) {
+    failed_ = true;
+  }
+  bufferSize_ = 0;
+}
+
+bool ReplayFileWriter::failed() {
+  return failed_;
+}
+
+ReplayFileReader::ReplayFileReader(FILE *file, int bufferCapacity) {
+  file_ = file;
+  bufferCapacity_ = bufferCapacity;
+  buffer_ = new unsigned char[bufferCapacity_];
+  bufferSize_ = bufferPosition_ = 0;
+  bufferOffset_ = 0;
+  failed_ = false;
+}
+
+ReplayFileReader::~ReplayFileReader() {
+  delete[] buffer_;
+}
+
+int ReplayFileReader::readByte() {
+  if (bufferPosition_ == bufferSize_ && !fillBuffer()) {
+    return 0;
+  }
+  return buffer_[bufferPosition_++];
+}
+
+unsigned int ReplayFileReader::readVarint() {
+  unsigned int x = 0;
+  for (int shift = 0; shift < 35 && !failed_; shift += 7) {
+    int b = readByte();
+    x |= ((unsigned int) (b & 0x7f)) << shift;
+    if ((b & 0x80) == 0) {
+      return x;
+    }
+  }
+  failed_ = true;
+  return 0;
+}
+
+int ReplayFileReader::readSignedVarint() {
+  unsigned int x = readVarint();
+  return (int) ((x >> 1) ^ (0 - (x & 1)));
+}
+
+unsigned int ReplayFileReader::readFixed() {
+  unsigned int x = 0;
+  for (int y = 0; y < 4; y++) {
+    x |= ((unsigned int) readByte()) << (y * 8);
+  }
+  return x;
+}
+
+char* ReplayFileReader::readString() {
+  unsigned int len = readVarint();
+  if (len == 0 || failed_) {
+    return 0;
+  }
+  len--;
+  if (len > BINARY_REPLAY_MAX_STRING) {
+    failed_ = true;
+    return 0;
+  }
+  char *s = new char[len + 1];
+  for (unsigned int x = 0; x < len; x++) {
+    s[x] = (char) readByte();
+  }
+  s[len] = '\0';
+  return s;
+}
+
+long ReplayFileReader::getPosition() {
+  return bufferOffset_ + bufferPosition_;
+}
+
+void ReplayFileReader::seek(long position) {
+  if (position >= bufferOffset_ && position <= bufferOffset_ + bufferSize_) {
+    bufferPosition_ = (int) (position - bufferOffset_);
+  } else {
+    bufferOffset_ = position;
+    bufferSize_ = bufferPosition_ = 0;
+  }
+}
+
+bool ReplayFileReader::failed() {
+  return failed_;
+}
+
+bool ReplayFileReader::fillBuffer() {
+  if (failed_) {
+    return false;
+  }
+  bufferOffset_ += bufferSize_;
+  bufferPosition_ = 0;
+  if (fseek(file_, bufferOffset_, SEEK_SET) != 0) {
+    bufferSize_ = 0;
+  } else {
+    bufferSize_ = (int) fread(buffer_, 1, bufferCapacity_, file_);
+  }
+  if (bufferSize_ == 0) {
+    failed_ = true;
+    return false;
+  }
+  return true;
+}
+
+ReplayTextHistory::ReplayTextHistory() {
+  for (int x = 0; x < TEXT_HISTORY_SIZE; x++) {
+    texts_[x] = 0;
+    textLengths_[x] = textCapacities_[x] = 0;
+  }
+  numTexts_ = nextSlot_ = 0;
+}
+
+ReplayTextHistory::~ReplayTextHistory() {
+  for (int x = 0; x < TEXT_HISTORY_SIZE; x++) {
+    if (texts_[x] != 0) {
+      delete[] texts_[x];
+    }
+  }
+}
+
+// Forgets all the texts, but keeps their memory for the next ones.
+void ReplayTextHistory::clear() {
+  numTexts_ = nextSlot_ = 0;
+}
+
+// The slot of the text that shares the longest start with this one, preferring
+// an exact match, or -1 if none of them share anything.
+int ReplayTextHistory::findBase(const int *text, int length, int *shared) {
+  int bestSlot = -1;
+  int bestShared = 0;
+  for (int x = 0; x < numTexts_; x++) {
+    int maxShared = std::min(length, textLengths_[x]);
+    int y = 0;
+    while (y < maxShared && texts_[x][y] == text[y]) {
+      y++;
+    }
+    if (y == length && textLengths_[x] == length) {
+      *shared = length;
+      return x;
+    }
+    if (y > bestShared) {
+      bestSlot = x;
+      bestShared = y;
+    }
+  }
+  *shared = bestShared;
+  return bestSlot;
+}
+
+bool ReplayTextHistory::hasSlot(int slot) {
+  return (slot >= 0 && slot < numTexts_);
+}
+
+int ReplayTextHistory::getLength(int slot) {
+  return textLengths_[slot];
+}
+
+const int* ReplayTextHistory::getText(int slot) {
+  return texts_[slot];
+}
+
+const int* ReplayTextHistory::getFields(int slot) {
+  return fields_[slot];
+}
+
+// A text that exactly matches its base replaces it, so a text that's redrawn
+// every tick keeps the same slot. Other texts take the oldest slot.
+void ReplayTextHistory::store(int baseSlot, const int *text, int length,
+                              const int *fields) {
+  int slot;
+  if (baseSlot >= 0 && textLengths_[baseSlot] == length
+      && memcmp(texts_[baseSlot], text, sizeof(int) * length) == 0) {
+    slot = baseSlot;
+  } else {
+    slot = nextSlot_;
+    nextSlot_ = (nextSlot_ + 1) % TEXT_HISTORY_SIZE;
+    if (slot == numTexts_) {
+      numTexts_++;
+    }
+    if (texts_[slot] == 0 || textCapacities_[slot] < length) {
+      if (texts_[slot] != 0) {
+        delete[] texts_[slot];
+      }
+      textCapacities_[slot] = std::max(length, 64);
+      texts_[slot] = new int[textCapacities_[slot]];
+    }
+    memcpy(texts_[slot], text, sizeof(int) * length);
+    textLengths_[slot] = length;
+  }
+  memcpy(fields_[slot], fields, sizeof(int) * TEXT_RECORD_FIELDS);
+}
+
+// Keyframe format:  (variable)
+// time | <size of each other stream> | num alive | <alive ship indices>
+ReplayKeyframes::ReplayKeyframes(ReplayData *keyframeData, int numShips) {
+  int size = keyframeData->getSize();
+  int maxKeyframes = size / (NUM_REPLAY_DATAS + 1);
+  times_ = new int[maxKeyframes];
+  offsets_ = new int[maxKeyframes * (NUM_REPLAY_DATAS - 1)];
+  aliveStarts_ = new int[maxKeyframes];
+  numAlive_ = new int[maxKeyframes];
+  aliveShips_ = new int[size];
+  numKeyframes_ = 0;
+
+  int numAliveShips = 0;
+  int i = 0;
+  while (i + NUM_REPLAY_DATAS + 1 <= size) {
+    int k = numKeyframes_;
+    int time = keyframeData->getInt(i);
+    bool valid = (k == 0 || time > times_[k - 1]);
+    int *offsets = &(offsets_[k * (NUM_REPLAY_DATAS - 1)]);
+    for (int x = 0; x < NUM_REPLAY_DATAS - 1 && valid; x++) {
+      offsets[x] = keyframeData->getInt(i + 1 + x);
+      valid = (offsets[x] >= (k == 0 ? 0 : offsets[x - NUM_REPLAY_DATAS + 1]));
+    }
+    int numAlive = keyframeData->getInt(i + NUM_REPLAY_DATAS);
+    if (!valid || numAlive < 0 || numAlive > numShips
+        || numAlive > size - i - NUM_REPLAY_DATAS - 1) {
+      break;
+    }
+    int lastShip = -1;
+    for (int x = 0; x < numAlive && valid; x++) {
+      int shipIndex = keyframeData->getInt(i + NUM_REPLAY_DATAS + 1 + x);
+      valid = (shipIndex > lastShip && shipIndex < numShips);
+      aliveShips_[numAliveShips + x] = lastShip = shipIndex;
+    }
+    if (!valid) {
+      break;
+    }
+    times_[k] = time;
+    aliveStarts_[k] = numAliveShips;
+    numAlive_[k] = numAlive;
+    numAliveShips += numAlive;
+    numKeyframes_++;
+    i += NUM_REPLAY_DATAS + 1 + numAlive;
+  }
+}
+
+ReplayKeyframes::~ReplayKeyframes() {
+  delete[] times_;
+  delete[] offsets_;
+  delete[] aliveStarts_;
+  delete[] numAlive_;
+  delete[] aliveShips_;
+}
+
+int ReplayKeyframes::getNumKeyframes() {
+  return numKeyframes_;
+}
+
+int ReplayKeyframes::getTime(int keyframe) {
+  return times_[keyframe];
+}
+
+int ReplayKeyframes::getOffset(int keyframe, int stream) {
+  return offsets_[keyframe * (NUM_REPLAY_DATAS - 1) + stream];
+}
+
+int ReplayKeyframes::getNumAlive(int keyframe) {
+  return numAlive_[keyframe];
+}
+
+int ReplayKeyframes::getAliveShip(int keyframe, int index) {
+  return aliveShips_[aliveStarts_[keyframe] + index];
+}
+
+// The last keyframe at or before this tick, or -1 if there isn't one.
+int ReplayKeyframes::find(int time) {
+  int low = 0;
+  int high = numKeyframes_;
+  while (low < high) {
+    int middle = (low + high) / 2;
+    if (times_[middle] <= time) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low - 1;
+}
+
+// Ship add/remove format:  (2)
+// ship index | time
+ShipTickSlots::ShipTickSlots(int numShips, ReplayData *shipAddData,
+                             ReplayData *shipRemoveData) {
+  shipAddData_ = shipAddData;
+  shipRemoveData_ = shipRemoveData;
+  numAdds_ = shipAddData->getSize() / 2;
+  numRemoves_ = shipRemoveData->getSize() / 2;
+  numShips_ = numShips;
+  alive_ = new bool[numShips];
+  seek(0, -1);
+}
+
+ShipTickSlots::~ShipTickSlots() {
+  delete[] alive_;
+}
+
+// Picks up at the first tick of a keyframe, or at the start for keyframe -1.
+// The ship ticks from there on get the same slots as they do when we walk
+// through the whole stream.
+void ShipTickSlots::seek(ReplayKeyframes *keyframes, int keyframe) {
+  for (int x = 0; x < numShips_; x++) {
+    alive_[x] = false;
+  }
+  numAlive_ = 0;
+  if (keyframe < 0) {
+    nextAdd_ = nextRemove_ = 0;
+    time_ = (eventsLeft() ? nextEventTime() : 0);
+  } else {
+    nextAdd_ = std::min(numAdds_,
+        keyframes->getOffset(keyframe, REPLAY_STREAM_SHIP_ADD) / 2);
+    nextRemove_ = std::min(numRemoves_,
+        keyframes->getOffset(keyframe, REPLAY_STREAM_SHIP_REMOVE) / 2);
+    int numAlive = keyframes->getNumAlive(keyframe);
+    for (int x = 0; x < numAlive; x++) {
+      setAlive(keyframes->getAliveShip(keyframe, x), true);
+    }
+    time_ = keyframes->getTime(keyframe);
+  }
+  applyEvents(time_);
+  cursor_ = 0;
+}
+
+int ShipTickSlots::nextSlot() {
+  return (advance() ? cursor_++ : 0);
+}
+
+// The tick the next slot is in, or -1 if there are no more live ships.
+int ShipTickSlots::getTickTime() {
+  return (advance() ? time_ : -1);
+}
+
+// Walks the live ships of each tick in order. When no ships are alive, we
+// skip ahead to the next add or remove instead of stepping through the ticks.
+bool ShipTickSlots::advance() {
+  while (true) {
+    while (cursor_ < numShips_ && !alive_[cursor_]) {
+      cursor_++;
+    }
+    if (cursor_ < numShips_) {
+      return true;
+    }
+    if (numAlive_ > 0) {
+      time_++;
+    } else if (eventsLeft()) {
+      time_ = nextEventTime();
+    } else {
+      return false;
+    }
+    applyEvents(time_);
+    cursor_ = 0;
+  }
+}
+
+bool ShipTickSlots::eventsLeft() {
+  return (nextAdd_ < numAdds_ || nextRemove_ < numRemoves_);
+}
+
+int ShipTickSlots::nextEventTime() {
+  if (nextAdd_ == numAdds_) {
+    return shipRemoveData_->getInt(nextRemove_ * 2 + 1);
+  } else if (nextRemove_ == numRemoves_) {
+    return shipAddData_->getInt(nextAdd_ * 2 + 1);
+  }
+  int addTime = shipAddData_->getInt(nextAdd_ * 2 + 1);
+  int removeTime = shipRemoveData_->getInt(nextRemove_ * 2 + 1);
+  return (addTime < removeTime ? addTime : removeTime);
+}
+
+void ShipTickSlots::applyEvents(int time) {
+  while (nextAdd_ < numAdds_
+         && shipAddData_->getInt(nextAdd_ * 2 + 1) <= time) {
+    setAlive(shipAddData_->getInt(nextAdd_ * 2), true);
+    nextAdd_++;
+  }
+  while (nextRemove_ < numRemoves_
+         && shipRemoveData_->getInt(nextRemove_ * 2 + 1) <= time) {
+    setAlive(shipRemoveData_->getInt(nextRemove_ * 2), false);
+    nextRemove_++;
+  }
+}
+
+void ShipTickSlots::setAlive(int shipIndex, bool alive) {
+  if (shipIndex >= 0 && shipIndex < numShips_
+      && alive_[shipIndex] != alive) {
+    alive_[shipIndex] = alive;
+    numAlive_ += (alive ? 1 : -1);
+  }
+}
+
+// Without keyframes, e.g. for the keyframe stream itself, we just decode the
+// stream from start to end.
+ReplayStreamDecoder::ReplayStreamDecoder(ReplayFileReader *reader,
+    ReplayKeyframes *keyframes, int stream, int encoding, int recordSize,
+    int numSlots, int numInts) {
+  reader_ = reader;
+  keyframes_ = keyframes;
+  stream_ = stream;
+  encoding_ = encoding;
+  recordSize_ = recordSize;
+  numSlots_ = (encoding == STREAM_ENCODING_SHIP_DELTA ? std::max(1, numSlots)
+                                                      : 1);
+  numInts_ = numInts;
+  lastRecords_ = lastRecord_ = 0;
+  history_ = 0;
+  textRecord_ = 0;
+  textRecordCapacity_ = 0;
+  failed_ = false;
+  if (encoding == STREAM_ENCODING_COLUMN_DELTA
+      || encoding == STREAM_ENCODING_SHIP_DELTA) {
+    if (recordSize < 1 || recordSize > BINARY_REPLAY_MAX_RECORD) {
+      failed_ = true;
+    } else {
+      lastRecords_ = new int[numSlots_ * recordSize];
+      lastRecord_ = lastRecords_;
+    }
+  } else if (encoding == STREAM_ENCODING_TEXT) {
+    history_ = new ReplayTextHistory();
+    textRecordCapacity_ = 64;
+    textRecord_ = new int[textRecordCapacity_];
+  } else if (encoding != STREAM_ENCODING_PLAIN) {
+    failed_ = true;
+  }
+  reset(-1);
+}
+
+ReplayStreamDecoder::~ReplayStreamDecoder() {
+  if (lastRecords_ != 0) {
+    delete[] lastRecords_;
+  }
+  if (history_ != 0) {
+    delete history_;
+  }
+  if (textRecord_ != 0) {
+    delete[] textRecord_;
+  }
+}
+
+// Starts over at a keyframe, or at the start of the stream for keyframe -1,
+// once the reader is at the matching spot in the file.
+void ReplayStreamDecoder::reset(int keyframe) {
+  position_ = (keyframe < 0 ? 0 : keyframes_->getOffset(keyframe, stream_));
+  nextKeyframe_ = keyframe + 1;
+  clearState();
+}
+
+void ReplayStreamDecoder::clearState() {
+  if (lastRecords_ != 0) {
+    memset(lastRecords_, 0, sizeof(int) * numSlots_ * recordSize_);
+  }
+  if (history_ != 0) {
+    history_->clear();
+  }
+  textRecordSize_ = textRecordPosition_ = 0;
+  lastTime_ = 0;
+}
+
+// The slot is the ship index of a ship tick record, and only matters for the
+// first int of each record.
+int ReplayStreamDecoder::next(int slot) {
+  if (failed_ || position_ >= numInts_) {
+    failed_ = true;
+    return 0;
+  }
+  int numKeyframes = (keyframes_ == 0 ? 0 : keyframes_->getNumKeyframes());
+  while (nextKeyframe_ < numKeyframes
+         && keyframes_->getOffset(nextKeyframe_, stream_) <= position_) {
+    clearState();
+    nextKeyframe_++;
+  }
+  int value;
+  if (encoding_ == STREAM_ENCODING_PLAIN) {
+    value = reader_->readSignedVarint();
+  } else if (encoding_ == STREAM_ENCODING_TEXT) {
+    if (textRecordPosition_ == textRecordSize_) {
+      readTextItem();
+    }
+    value = (failed_ ? 0 : textRecord_[textRecordPosition_++]);
+  } else {
+    int column = position_ % recordSize_;
+    if (column == 0) {
+      lastRecord_ = &(lastRecords_[
+          (slot >= 0 && slot < numSlots_ ? slot : 0) * recordSize_]);
+    }
+    lastRecord_[column] = (int) ((unsigned int) lastRecord_[column]
+        + (unsigned int) reader_->readSignedVarint());
+    value = lastRecord_[column];
+  }
+  if (reader_->failed()) {
+    failed_ = true;
+  }
+  position_++;
+  return value;
+}
+
+int ReplayStreamDecoder::getPosition() {
+  return position_;
+}
+
+bool ReplayStreamDecoder::failed() {
+  return failed_;
+}
+
+// Text stream format:
+// <items>, each one either a record or a leftover int
+//
+// Record format:
+// | base slot + 1 (0 for none) | num chars shared with base | num new chars
+// | <new chars> | time delta | <field deltas>
+//
+// Leftover int format:
+// | TEXT_LEFTOVER_MARKER | int
+//
+// The base is a recent text from ReplayTextHistory, and the field deltas are
+// from its fields. Leftover ints are for anything that isn't a whole record
+// between keyframes, like a partial record at the end of the stream.
+void ReplayStreamDecoder::readTextItem() {
+  textRecordSize_ = textRecordPosition_ = 0;
+  unsigned int marker = reader_->readVarint();
+  if (marker == TEXT_LEFTOVER_MARKER) {
+    textRecord_[textRecordSize_++] = reader_->readSignedVarint();
+    return;
+  }
+  int baseSlot = ((int) marker) - 1;
+  if (marker > TEXT_HISTORY_SIZE
+      || (baseSlot >= 0 && !history_->hasSlot(baseSlot))) {
+    failed_ = true;
+    return;
+  }
+  unsigned int shared = reader_->readVarint();
+  unsigned int numNew = reader_->readVarint();
+  int maxLength = numInts_ - position_ - 2 - TEXT_RECORD_FIELDS;
+  if (reader_->failed()
+      || shared > (unsigned int) (baseSlot < 0 ? 0
+                                      : history_->getLength(baseSlot))
+      || maxLength < (int) shared
+      || numNew > (unsigned int) (maxLength - (int) shared)) {
+    failed_ = true;
+    return;
+  }
+  int textLength = shared + numNew;
+  int recordSize = 2 + textLength + TEXT_RECORD_FIELDS;
+  if (recordSize > textRecordCapacity_) {
+    delete[] textRecord_;
+    textRecordCapacity_ = recordSize;
+    textRecord_ = new int[textRecordCapacity_];
+  }
+  int *text = &(textRecord_[2]);
+  int *fields = &(textRecord_[2 + textLength]);
+  if (shared > 0) {
+    memcpy(text, history_->getText(baseSlot), sizeof(int) * shared);
+  }
+  for (int x = shared; x < textLength; x++) {
+    text[x] = (int) reader_->readVarint();
+  }
+  lastTime_ = (int) ((unsigned int) lastTime_
+      + (unsigned int) reader_->readSignedVarint());
+  const int *baseFields = (baseSlot < 0 ? 0 : history_->getFields(baseSlot));
+  for (int x = 0; x < TEXT_RECORD_FIELDS; x++) {
+    unsigned int baseField = (baseFields == 0 ? 0 : baseFields[x]);
+    fields[x] = (int) (baseField + (unsigned int) reader_->readSignedVarint());
+  }
+  history_->store(baseSlot, text, textLength, fields);
+  textRecord_[0] = lastTime_;
+  textRecord_[1] = textLength;
+  textRecordSize_ = recordSize;
+}
+
+// Returns 0 if this isn't a binary replay in a format we can read.
+BinaryReplayHeader* readBinaryReplayHeader(ReplayFileReader *reader) {
+  for (int x = 0; x < 4; x++) {
+    if (reader->readByte() != BINARY_REPLAY_MAGIC[x]) {
+      return 0;
+    }
+  }
+  if (reader->readVarint() != BINARY_REPLAY_VERSION) {
+    return 0;
+  }
+  unsigned int numTeams = reader->readVarint();
+  unsigned int numShips = reader->readVarint();
+  if (reader->failed() || numTeams > BINARY_REPLAY_MAX_SHIPS
+      || numShips > BINARY_REPLAY_MAX_SHIPS) {
+    return 0;
+  }
+
+  BinaryReplayHeader *header = new BinaryReplayHeader;
+  header->numTeams = numTeams;
+  header->numShips = numShips;
+  header->numTeamsAdded = reader->readVarint();
+  header->numTexts = reader->readVarint();
+  header->numLogEntries = reader->readVarint();
+  header->stageName = reader->readString();
+  header->timestamp = reader->readString();
+  header->teamNames = new char*[numTeams];
+  for (unsigned int x = 0; x < numTeams; x++) {
+    header->teamNames[x] = reader->readString();
+  }
+  bool valid = true;
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    header->encodings[x] = reader->readByte();
+    header->recordSizes[x] = reader->readByte();
+    unsigned int numInts = reader->readFixed();
+    header->numInts[x] = (int) numInts;
+    header->offsets[x] = reader->readFixed();
+    header->lengths[x] = reader->readFixed();
+    if (numInts > INT_MAX) {
+      valid = false;
+    }
+  }
+  header->seekTableOffset = reader->readFixed();
+  header->seekTableLength = reader->readFixed();
+  if (!valid || reader->failed()) {
+    deleteBinaryReplayHeader(header);
+    return 0;
+  }
+  return header;
+}
+
+void deleteBinaryReplayHeader(BinaryReplayHeader *header) {
+  for (int x = 0; x < header->numTeams; x++) {
+    if (header->teamNames[x] != 0) {
+      delete[] header->teamNames[x];
+    }
+  }
+  delete[] header->teamNames;
+  if (header->stageName != 0) {
+    delete[] header->stageName;
+  }
+  if (header->timestamp != 0) {
+    delete[] header->timestamp;
+  }
+  delete header;
+}
+
+// Decodes a whole stream. Ship ticks need slots, and the keyframe stream
+// itself is read without keyframes.
+bool readReplayStream(ReplayFileReader *reader, BinaryReplayHeader *header,
+    int stream, ReplayKeyframes *keyframes, ShipTickSlots *slots,
+    ReplayData *data) {
+  int encoding = header->encodings[stream];
+  int recordSize = header->recordSizes[stream];
+  int numInts = header->numInts[stream];
+  if (encoding == STREAM_ENCODING_SHIP_DELTA && slots == 0) {
+    return false;
+  }
+
+  reader->seek(header->offsets[stream]);
+  ReplayStreamDecoder *decoder = new ReplayStreamDecoder(reader, keyframes,
+      stream, encoding, recordSize, header->numShips, numInts);
+  for (int x = 0; x < numInts && !decoder->failed(); x++) {
+    int slot = 0;
+    if (encoding == STREAM_ENCODING_SHIP_DELTA && x % recordSize == 0) {
+      slot = slots->nextSlot();
+    }
+    data->addInt(decoder->next(slot));
+  }
+  bool read = (!decoder->failed() && reader->getPosition()
+      == (long) header->offsets[stream] + (long) header->lengths[stream]);
+  delete decoder;
+  return read;
+}
+
+// The name to save the HTML version of a binary replay under: the same name,
+// with .html in place of the binary replay extension.
+char* htmlReplayFilename(const char *binaryFilename) {
+  int length = (int) strlen(binaryFilename);
+  int extensionLength = (int) strlen(BINARY_REPLAY_EXTENSION);
+  if (length > extensionLength && strcmp(&(binaryFilename[length
+          - extensionLength]), BINARY_REPLAY_EXTENSION) == 0) {
+    length -= extensionLength;
+  }
+  char *htmlFilename = new char[length + 6];
+  memcpy(htmlFilename, binaryFilename, length);
+  strcpy(&(htmlFilename[length]), ".html");
+  return htmlFilename;
+}
@@ -0,0 +1,249 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef REPLAY_FORMAT_H
+#define REPLAY_FORMAT_H
+
+#include <stdio.h>
+#include "replaybuilder.h"
+
+#define BINARY_REPLAY_MAGIC          "BBRP"
+#define BINARY_REPLAY_VERSION        2
+#define BINARY_REPLAY_EXTENSION      ".bbr"
+#define BINARY_REPLAY_BUFFER_SIZE    (64 * 1024)
+#define BINARY_REPLAY_MAX_STRING     (64 * 1024)
+#define BINARY_REPLAY_MAX_SHIPS      (16 * 1024)
+#define BINARY_REPLAY_MAX_RECORD     64
+
+// How each stream's ints are stored. Every int ends up as a zigzag varint.
+#define STREAM_ENCODING_PLAIN         0  // the ints as they are
+#define STREAM_ENCODING_COLUMN_DELTA  1  // fixed size records, each int stored
+                                         // as a delta from the same int in the
+                                         // previous record
+#define STREAM_ENCODING_SHIP_DELTA    2  // ship ticks, each stored as a delta
+                                         // from the same ship's last tick
+#define STREAM_ENCODING_TEXT          3  // stage texts, each stored against a
+                                         // recent text that starts the same
+
+#define TEXT_HISTORY_SIZE     32
+#define TEXT_RECORD_FIELDS    8  // x | y | size | R | G | B | A | duration
+#define TEXT_LEFTOVER_MARKER  (TEXT_HISTORY_SIZE + 1)
+
+// Buffered writes to a replay file: bytes, varints and fixed width ints for
+// binary replays, and text and hex ints for HTML replays. Once a write fails,
+// the rest are skipped and failed() returns true.
+class ReplayFileWriter {
+  FILE *file_;
+  unsigned char *buffer_;
+  int bufferSize_;
+  long position_;
+  bool failed_;
+
+  public:
+    ReplayFileWriter(FILE *file);
+    ~ReplayFileWriter();
+    void writeByte(int b);
+    void writeBytes(const char *bytes, int length);
+    void writeText(const char *s);
+    void writeHex(int x);
+    void writeVarint(unsigned int x);
+    void writeSignedVarint(int x);
+    void writeFixed(unsigned int x);
+    void writeString(const char *s);
+    long getPosition();
+    void patchFixed(long position, unsigned int x);
+    void flush();
+    bool failed();
+};
+
+// Buffered reads from a binary replay file. Reading past the end of the file
+// or a malformed value fails the reader, and it returns zeroes from then on,
+// so callers can read a whole section and check failed() once at the end.
+// Each reader keeps track of its own position, so several of them can read
+// different parts of the same file.
+class ReplayFileReader {
+  FILE *file_;
+  unsigned char *buffer_;
+  int bufferCapacity_;
+  int bufferSize_;
+  int bufferPosition_;
+  long bufferOffset_;
+  bool failed_;
+
+  public:
+    ReplayFileReader(FILE *file, int bufferCapacity);
+    ~ReplayFileReader();
+    int readByte();
+    unsigned int readVarint();
+    int readSignedVarint();
+    unsigned int readFixed();
+    char* readString();
+    long getPosition();
+    void seek(long position);
+    bool failed();
+  private:
+    bool fillBuffer();
+};
+
+// The last few distinct stage texts, so that a text that's drawn every tick,
+// or that only changes at the end (like a timer), can be stored as a reference
+// to an earlier one plus whatever's new. The encoder and decoder each keep one
+// and update it the same way after every record.
+class ReplayTextHistory {
+  int *texts_[TEXT_HISTORY_SIZE];
+  int textLengths_[TEXT_HISTORY_SIZE];
+  int textCapacities_[TEXT_HISTORY_SIZE];
+  int fields_[TEXT_HISTORY_SIZE][TEXT_RECORD_FIELDS];
+  int numTexts_;
+  int nextSlot_;
+
+  public:
+    ReplayTextHistory();
+    ~ReplayTextHistory();
+    void clear();
+    int findBase(const int *text, int length, int *shared);
+    bool hasSlot(int slot);
+    int getLength(int slot);
+    const int* getText(int slot);
+    const int* getFields(int slot);
+    void store(int baseSlot, const int *text, int length, const int *fields);
+};
+
+// The keyframes of a replay, parsed from its keyframe stream. Each one has the
+// tick it comes before, the size of every other stream at that point, and the
+// ships alive going into that tick. Parsing stops at the first keyframe that
+// doesn't make sense, so the encoder and decoder always agree on the rest.
+class ReplayKeyframes {
+  int numKeyframes_;
+  int *times_;
+  int *offsets_;
+  int *aliveStarts_;
+  int *numAlive_;
+  int *aliveShips_;
+
+  public:
+    ReplayKeyframes(ReplayData *keyframeData, int numShips);
+    ~ReplayKeyframes();
+    int getNumKeyframes();
+    int getTime(int keyframe);
+    int getOffset(int keyframe, int stream);
+    int getNumAlive(int keyframe);
+    int getAliveShip(int keyframe, int index);
+    int find(int time);
+};
+
+// Which ship each record in the ship tick stream belongs to. Each tick has one
+// record per live ship, in ship index order, and ships come and go with the
+// ship add and remove streams, so both sides of the encoding can work it out
+// without storing it. Records past the end of the add/remove data all go to
+// ship 0.
+class ShipTickSlots {
+  ReplayData *shipAddData_;
+  ReplayData *shipRemoveData_;
+  int numAdds_;
+  int numRemoves_;
+  int nextAdd_;
+  int nextRemove_;
+  bool *alive_;
+  int numShips_;
+  int numAlive_;
+  int time_;
+  int cursor_;
+
+  public:
+    ShipTickSlots(int numShips, ReplayData *shipAddData,
+                  ReplayData *shipRemoveData);
+    ~ShipTickSlots();
+    void seek(ReplayKeyframes *keyframes, int keyframe);
+    int nextSlot();
+    int getTickTime();
+  private:
+    bool advance();
+    bool eventsLeft();
+    int nextEventTime();
+    void applyEvents(int time);
+    void setAlive(int shipIndex, bool alive);
+};
+
+// Decodes one stream of a binary replay an int at a time, from the start of
+// the stream or from any keyframe. The encoder starts each delta and text
+// encoding over at every keyframe, so decoding can pick up there with nothing
+// but the keyframe's offsets.
+class ReplayStreamDecoder {
+  ReplayFileReader *reader_;
+  ReplayKeyframes *keyframes_;
+  int stream_;
+  int nextKeyframe_;
+  int encoding_;
+  int recordSize_;
+  int numSlots_;
+  int numInts_;
+  int *lastRecords_;
+  int *lastRecord_;
+  ReplayTextHistory *history_;
+  int *textRecord_;
+  int textRecordCapacity_;
+  int textRecordSize_;
+  int textRecordPosition_;
+  int lastTime_;
+  int position_;
+  bool failed_;
+
+  public:
+    ReplayStreamDecoder(ReplayFileReader *reader, ReplayKeyframes *keyframes,
+        int stream, int encoding, int recordSize, int numSlots, int numInts);
+    ~ReplayStreamDecoder();
+    void reset(int keyframe);
+    int next(int slot);
+    int getPosition();
+    bool failed();
+  private:
+    void clearState();
+    void readTextItem();
+};
+
+// Everything in a binary replay file before the streams.
+typedef struct {
+  int numTeams;
+  int numShips;
+  int numTeamsAdded;
+  int numTexts;
+  int numLogEntries;
+  char *stageName;
+  char *timestamp;
+  char **teamNames;
+  int encodings[NUM_REPLAY_DATAS];
+  int recordSizes[NUM_REPLAY_DATAS];
+  int numInts[NUM_REPLAY_DATAS];
+  unsigned int offsets[NUM_REPLAY_DATAS];
+  unsigned int lengths[NUM_REPLAY_DATAS];
+  unsigned int seekTableOffset;
+  unsigned int seekTableLength;
+} BinaryReplayHeader;
+
+BinaryReplayHeader* readBinaryReplayHeader(ReplayFileReader *reader);
+void deleteBinaryReplayHeader(BinaryReplayHeader *header);
+char* htmlReplayFilename(const char *binaryFilename);
+bool readReplayStream(ReplayFileReader *reader, BinaryReplayHeader *header,
+    int stream, ReplayKeyframes *keyframes, ShipTickSlots *slots,
+    ReplayData *data);
+
+#endif
@@ -0,0 +1,428 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include "replaybuilder.h"
+#include "replayformat.h"
+#include "replayreader.h"
+
+#define SHIP_TICK_RECORD_SIZE  5
+
+// The int in each stream's records that has the time, in getReplayDatas
+// order, or -1 for streams that aren't timed events.
+static const int EVENT_TIME_COLUMNS[NUM_REPLAY_DATAS] =
+    {-1, -1, -1, -1, -1, 1, 1, 1, 1, 1, 1, -1, 2, 1, 1, 2, 1, 0, 1, 1, 0, 1,
+     -1, -1};
+
+ReplayReader::ReplayReader() {
+  file_ = 0;
+  reader_ = 0;
+  header_ = 0;
+  keyframeData_ = shipAddData_ = shipRemoveData_ = 0;
+  keyframes_ = 0;
+  seekOffsets_ = 0;
+  slots_ = 0;
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    streamReaders_[x] = 0;
+    decoders_[x] = 0;
+    eventRecords_[x] = 0;
+    eventCapacities_[x] = eventSizes_[x] = 0;
+  }
+  shipStates_ = 0;
+  shipsInTick_ = 0;
+  time_ = -1;
+  lastEventStream_ = -1;
+  failed_ = false;
+}
+
+ReplayReader::~ReplayReader() {
+  close();
+}
+
+// Opens a binary replay saved with ReplayBuilder::saveBinaryReplay and seeks
+// to the start of it. The filename is used as it is, not relative to the
+// replays directory.
+bool ReplayReader::open(const char *filename) {
+  close();
+  file_ = fopen(filename, "rb");
+  if (file_ == 0) {
+    return false;
+  }
+  reader_ = new ReplayFileReader(file_, REPLAY_READER_BUFFER_SIZE);
+  header_ = readBinaryReplayHeader(reader_);
+  if (header_ == 0 || !checkStreamFormats()) {
+    close();
+    return false;
+  }
+
+  // The keyframes and the ship adds and removes are small, and we need all of
+  // them to find our way around the other streams, so we read them up front.
+  keyframeData_ = new ReplayData(MAX_MISC_CHUNKS);
+  shipAddData_ = new ReplayData(MAX_MISC_CHUNKS);
+  shipRemoveData_ = new ReplayData(MAX_MISC_CHUNKS);
+  if (!readReplayStream(
+          reader_, header_, REPLAY_STREAM_KEYFRAMES, 0, 0, keyframeData_)) {
+    close();
+    return false;
+  }
+  keyframes_ = new ReplayKeyframes(keyframeData_, header_->numShips);
+  if (!readSeekTable()
+      || !readReplayStream(reader_, header_, REPLAY_STREAM_SHIP_ADD,
+                           keyframes_, 0, shipAddData_)
+      || !readReplayStream(reader_, header_, REPLAY_STREAM_SHIP_REMOVE,
+                           keyframes_, 0, shipRemoveData_)) {
+    close();
+    return false;
+  }
+
+  int numShips = header_->numShips;
+  slots_ = new ShipTickSlots(numShips, shipAddData_, shipRemoveData_);
+  shipStates_ = new int[numShips * SHIP_TICK_RECORD_SIZE];
+  shipsInTick_ = new bool[numShips];
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    if (x == REPLAY_STREAM_SHIP_TICK || EVENT_TIME_COLUMNS[x] >= 0) {
+      streamReaders_[x] =
+          new ReplayFileReader(file_, REPLAY_READER_BUFFER_SIZE);
+      decoders_[x] = new ReplayStreamDecoder(streamReaders_[x], keyframes_, x,
+          header_->encodings[x], header_->recordSizes[x], numShips,
+          header_->numInts[x]);
+    }
+  }
+  seek(0);
+  if (failed_) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void ReplayReader::close() {
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    if (decoders_[x] != 0) {
+      delete decoders_[x];
+      decoders_[x] = 0;
+    }
+    if (streamReaders_[x] != 0) {
+      delete streamReaders_[x];
+      streamReaders_[x] = 0;
+    }
+    if (eventRecords_[x] != 0) {
+      delete[] eventRecords_[x];
+      eventRecords_[x] = 0;
+    }
+    eventCapacities_[x] = eventSizes_[x] = 0;
+  }
+  if (slots_ != 0) {
+    delete slots_;
+    slots_ = 0;
+  }
+  if (shipStates_ != 0) {
+    delete[] shipStates_;
+    shipStates_ = 0;
+  }
+  if (shipsInTick_ != 0) {
+    delete[] shipsInTick_;
+    shipsInTick_ = 0;
+  }
+  if (seekOffsets_ != 0) {
+    delete[] seekOffsets_;
+    seekOffsets_ = 0;
+  }
+  if (keyframes_ != 0) {
+    delete keyframes_;
+    keyframes_ = 0;
+  }
+  if (keyframeData_ != 0) {
+    delete keyframeData_;
+    delete shipAddData_;
+    delete shipRemoveData_;
+    keyframeData_ = shipAddData_ = shipRemoveData_ = 0;
+  }
+  if (header_ != 0) {
+    deleteBinaryReplayHeader(header_);
+    header_ = 0;
+  }
+  if (reader_ != 0) {
+    delete reader_;
+    reader_ = 0;
+  }
+  if (file_ != 0) {
+    fclose(file_);
+    file_ = 0;
+  }
+  time_ = -1;
+  lastEventStream_ = -1;
+  failed_ = false;
+}
+
+const char* ReplayReader::getStageName() {
+  return (header_ == 0 ? 0 : header_->stageName);
+}
+
+const char* ReplayReader::getTimestamp() {
+  return (header_ == 0 ? 0 : header_->timestamp);
+}
+
+int ReplayReader::getNumTeams() {
+  return (header_ == 0 ? 0 : header_->numTeams);
+}
+
+const char* ReplayReader::getTeamName(int teamIndex) {
+  if (header_ == 0 || teamIndex < 0 || teamIndex >= header_->numTeams) {
+    return 0;
+  }
+  return header_->teamNames[teamIndex];
+}
+
+int ReplayReader::getNumShips() {
+  return (header_ == 0 ? 0 : header_->numShips);
+}
+
+// Returns false if there are no ticks with live ships from here on, but the
+// events are still ready to go from this tick.
+bool ReplayReader::seek(int time) {
+  if (header_ == 0 || failed_) {
+    return false;
+  }
+  int keyframe = keyframes_->find(time);
+  seekStream(REPLAY_STREAM_SHIP_TICK, keyframe);
+  slots_->seek(keyframes_, keyframe);
+  bool found = false;
+  while (!found && readTick()) {
+    found = (time_ >= time);
+  }
+  if (!found) {
+    time_ = -1;
+  }
+
+  lastEventStream_ = -1;
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    int timeColumn = EVENT_TIME_COLUMNS[x];
+    if (timeColumn >= 0) {
+      seekStream(x, keyframe);
+      readEvent(x);
+      while (eventSizes_[x] > 0 && eventRecords_[x][timeColumn] < time) {
+        readEvent(x);
+      }
+    }
+  }
+  return (found && !failed_);
+}
+
+bool ReplayReader::nextTick() {
+  if (header_ == 0 || time_ < 0) {
+    return false;
+  }
+  if (!readTick()) {
+    time_ = -1;
+    return false;
+  }
+  return true;
+}
+
+// The current tick, or -1 if we're past the last one.
+int ReplayReader::getTime() {
+  return time_;
+}
+
+bool ReplayReader::isShipAlive(int shipIndex) {
+  return (time_ >= 0 && shipIndex >= 0 && shipIndex < header_->numShips
+          && shipsInTick_[shipIndex]);
+}
+
+bool ReplayReader::getShipState(int shipIndex, ReplayShipState *state) {
+  if (!isShipAlive(shipIndex)) {
+    return false;
+  }
+  int *shipState = &(shipStates_[shipIndex * SHIP_TICK_RECORD_SIZE]);
+  state->x = shipState[0] / 10.;
+  state->y = shipState[1] / 10.;
+  state->thrusterAngle = shipState[2] / 100.;
+  state->thrusterForce = shipState[3] / 100.;
+  state->energy = shipState[4] / 10.;
+  return true;
+}
+
+// Events at the same tick come in stream order, and in the order they were
+// recorded within a stream.
+bool ReplayReader::nextEvent(ReplayEvent *event) {
+  if (header_ == 0 || failed_) {
+    return false;
+  }
+  if (lastEventStream_ >= 0) {
+    readEvent(lastEventStream_);
+    lastEventStream_ = -1;
+  }
+  int nextStream = -1;
+  int nextTime = 0;
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    if (EVENT_TIME_COLUMNS[x] >= 0 && eventSizes_[x] > 0) {
+      int time = eventRecords_[x][EVENT_TIME_COLUMNS[x]];
+      if (nextStream < 0 || time < nextTime) {
+        nextStream = x;
+        nextTime = time;
+      }
+    }
+  }
+  if (nextStream < 0 || failed_) {
+    return false;
+  }
+  event->stream = nextStream;
+  event->time = nextTime;
+  event->record = eventRecords_[nextStream];
+  event->recordSize = eventSizes_[nextStream];
+  lastEventStream_ = nextStream;
+  return true;
+}
+
+bool ReplayReader::failed() {
+  return failed_;
+}
+
+// Keyframe byte offsets, checked against the lengths of their streams.
+bool ReplayReader::readSeekTable() {
+  int numKeyframes = keyframes_->getNumKeyframes();
+  reader_->seek(header_->seekTableOffset);
+  if (reader_->readVarint() != (unsigned int) numKeyframes) {
+    return false;
+  }
+  int numOffsets = numKeyframes * (NUM_REPLAY_DATAS - 1);
+  seekOffsets_ = new unsigned int[numOffsets];
+  for (int x = 0; x < numOffsets; x++) {
+    unsigned int lastOffset =
+        (x < NUM_REPLAY_DATAS - 1 ? 0 : seekOffsets_[x - NUM_REPLAY_DATAS + 1]);
+    seekOffsets_[x] = lastOffset + reader_->readVarint();
+    if (seekOffsets_[x] < lastOffset
+        || seekOffsets_[x] > header_->lengths[x % (NUM_REPLAY_DATAS - 1)]) {
+      return false;
+    }
+  }
+  return (!reader_->failed() && reader_->getPosition()
+      == (long) header_->seekTableOffset + (long) header_->seekTableLength);
+}
+
+// We only know how to find our way around ship ticks and events in the
+// formats ReplayBuilder records them in.
+bool ReplayReader::checkStreamFormats() {
+  if (header_->recordSizes[REPLAY_STREAM_SHIP_TICK] != SHIP_TICK_RECORD_SIZE
+      || header_->recordSizes[REPLAY_STREAM_SHIP_ADD] != 2
+      || header_->recordSizes[REPLAY_STREAM_SHIP_REMOVE] != 2) {
+    return false;
+  }
+  for (int x = 0; x < NUM_REPLAY_DATAS; x++) {
+    int recordSize = header_->recordSizes[x];
+    if (x == REPLAY_STREAM_TEXT || x == REPLAY_STREAM_LOG) {
+      if (recordSize != 0) {
+        return false;
+      }
+    } else if (EVENT_TIME_COLUMNS[x] >= 0 && (recordSize
+        <= EVENT_TIME_COLUMNS[x] || recordSize > BINARY_REPLAY_MAX_RECORD)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Moves a stream to a keyframe, or to the start for keyframe -1.
+void ReplayReader::seekStream(int stream, int keyframe) {
+  unsigned int offset = (keyframe < 0 ? 0
+      : seekOffsets_[keyframe * (NUM_REPLAY_DATAS - 1) + stream]);
+  streamReaders_[stream]->seek((long) header_->offsets[stream] + offset);
+  decoders_[stream]->reset(keyframe);
+}
+
+// Reads the ship states of the next tick with any live ships.
+bool ReplayReader::readTick() {
+  ReplayStreamDecoder *decoder = decoders_[REPLAY_STREAM_SHIP_TICK];
+  int numInts = header_->numInts[REPLAY_STREAM_SHIP_TICK];
+  int tickTime = slots_->getTickTime();
+  if (failed_ || tickTime < 0
+      || decoder->getPosition() + SHIP_TICK_RECORD_SIZE > numInts) {
+    return false;
+  }
+  for (int x = 0; x < header_->numShips; x++) {
+    shipsInTick_[x] = false;
+  }
+  while (decoder->getPosition() + SHIP_TICK_RECORD_SIZE <= numInts
+         && slots_->getTickTime() == tickTime) {
+    int slot = slots_->nextSlot();
+    for (int x = 0; x < SHIP_TICK_RECORD_SIZE; x++) {
+      shipStates_[slot * SHIP_TICK_RECORD_SIZE + x] = decoder->next(slot);
+    }
+    shipsInTick_[slot] = true;
+  }
+  if (decoder->failed()) {
+    failed_ = true;
+    return false;
+  }
+  time_ = tickTime;
+  return true;
+}
+
+// Reads the next record of an event stream, or leaves its size at 0 if
+// there aren't any more. Texts and logs have a length partway through that
+// tells us how long the rest of the record is.
+void ReplayReader::readEvent(int stream) {
+  ReplayStreamDecoder *decoder = decoders_[stream];
+  int remaining = header_->numInts[stream] - decoder->getPosition();
+  int lengthColumn = -1;
+  int numFields = 0;
+  if (stream == REPLAY_STREAM_TEXT) {
+    lengthColumn = 1;
+    numFields = TEXT_RECORD_FIELDS;
+  } else if (stream == REPLAY_STREAM_LOG) {
+    lengthColumn = 2;
+  }
+  int recordSize = (lengthColumn < 0 ? header_->recordSizes[stream]
+                                     : lengthColumn + 1);
+  eventSizes_[stream] = 0;
+  bool complete = true;
+  for (int x = 0; x < recordSize && complete; x++) {
+    if (x >= remaining) {
+      complete = false;
+      break;
+    }
+    if (recordSize > eventCapacities_[stream]) {
+      int *record = new int[recordSize];
+      if (eventRecords_[stream] != 0) {
+        memcpy(record, eventRecords_[stream], sizeof(int) * x);
+        delete[] eventRecords_[stream];
+      }
+      eventRecords_[stream] = record;
+      eventCapacities_[stream] = recordSize;
+    }
+    eventRecords_[stream][x] = decoder->next(0);
+    if (x == lengthColumn) {
+      int length = eventRecords_[stream][x];
+      if (length < 0 || length > remaining - x - 1 - numFields) {
+        complete = false;
+      } else {
+        recordSize += length + numFields;
+      }
+    }
+  }
+  if (decoder->failed()) {
+    failed_ = true;
+  } else if (complete) {
+    eventSizes_[stream] = recordSize;
+  }
+}
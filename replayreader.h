@@ -0,0 +1,107 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef REPLAY_READER_H
+#define REPLAY_READER_H
+
+#include <stdio.h>
+#include "replaybuilder.h"
+#include "replayformat.h"
+
+#define REPLAY_READER_BUFFER_SIZE  (4 * 1024)
+
+typedef struct {
+  double x;
+  double y;
+  double thrusterAngle;
+  double thrusterForce;
+  double energy;
+} ReplayShipState;
+
+// An event from one of the timed streams, like a laser firing or a stage text.
+// The stream is one of the REPLAY_STREAM_* indices, and the record is in that
+// stream's format (see replaybuilder.cpp). It's only good until the next call
+// to nextEvent.
+typedef struct {
+  int stream;
+  int time;
+  const int *record;
+  int recordSize;
+} ReplayEvent;
+
+// Reads a binary replay a little at a time, for tools that look at specific
+// moments in a lot of replays. Seeking to a tick starts from the keyframe
+// before it, so it only decodes up to REPLAY_KEYFRAME_INTERVAL ticks of ship
+// states, plus whatever events happened in those ticks. Everything else stays
+// on disk until it's asked for.
+//
+// After a seek, the ship states are for the first tick at or after the one we
+// asked for with any live ships, and nextTick steps through the ticks after
+// it. Separately, nextEvent goes through the events from the tick we asked for
+// to the end of the replay, in time order.
+class ReplayReader {
+  FILE *file_;
+  ReplayFileReader *reader_;
+  BinaryReplayHeader *header_;
+  ReplayData *keyframeData_;
+  ReplayKeyframes *keyframes_;
+  unsigned int *seekOffsets_;
+  ReplayData *shipAddData_;
+  ReplayData *shipRemoveData_;
+  ShipTickSlots *slots_;
+  ReplayFileReader *streamReaders_[NUM_REPLAY_DATAS];
+  ReplayStreamDecoder *decoders_[NUM_REPLAY_DATAS];
+  int *shipStates_;
+  bool *shipsInTick_;
+  int time_;
+  int *eventRecords_[NUM_REPLAY_DATAS];
+  int eventCapacities_[NUM_REPLAY_DATAS];
+  int eventSizes_[NUM_REPLAY_DATAS];
+  int lastEventStream_;
+  bool failed_;
+
+  public:
+    ReplayReader();
+    ~ReplayReader();
+    bool open(const char *filename);
+    void close();
+    const char* getStageName();
+    const char* getTimestamp();
+    int getNumTeams();
+    const char* getTeamName(int teamIndex);
+    int getNumShips();
+    bool seek(int time);
+    bool nextTick();
+    int getTime();
+    bool isShipAlive(int shipIndex);
+    bool getShipState(int shipIndex, ReplayShipState *state);
+    bool nextEvent(ReplayEvent *event);
+    bool failed();
+  private:
+    bool readSeekTable();
+    bool checkStreamFormats();
+    void seekStream(int stream, int keyframe);
+    bool readTick();
+    void readEvent(int stream);
+    int getEventSize(int stream, int position);
+};
+
+#endif
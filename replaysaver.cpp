@@ -0,0 +1,218 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "replaybuilder.h"
+#include "replaysaver.h"
+
+ReplaySaver::ReplaySaver(int maxPending) {
+  maxPending_ = (maxPending < 1) ? 1 : maxPending;
+  queue_ = new ReplaySave*[maxPending_];
+  queueStart_ = numQueued_ = 0;
+  saving_ = 0;
+  doneCapacity_ = maxPending_;
+  done_ = new ReplaySave*[doneCapacity_];
+  numDone_ = 0;
+  quitting_ = false;
+  cancelled_ = false;
+  pthread_mutex_init(&lock_, 0);
+  pthread_cond_init(&saveQueued_, 0);
+  pthread_cond_init(&saveDone_, 0);
+  pthread_create(&thread_, 0, ReplaySaver::saveThread, (void*) this);
+}
+
+// Finishes any saves that are still queued first.
+ReplaySaver::~ReplaySaver() {
+  pthread_mutex_lock(&lock_);
+  quitting_ = true;
+  pthread_cond_signal(&saveQueued_);
+  pthread_mutex_unlock(&lock_);
+  pthread_join(thread_, 0);
+  pthread_cond_destroy(&saveDone_);
+  pthread_cond_destroy(&saveQueued_);
+  pthread_mutex_destroy(&lock_);
+  for (int x = 0; x < numDone_; x++) {
+    deleteSave(done_[x]);
+  }
+  delete[] done_;
+  delete[] queue_;
+}
+
+// Saves an HTML replay, or a binary replay if binary is true, to an absolute
+// filename. Blocks while there are already maxPending saves in progress. Once
+// the saver is cancelled, the save comes straight back as not saved.
+void ReplaySaver::save(ReplayBuilder *replayBuilder, const char *filename,
+                       bool binary, int callbackRef) {
+  ReplaySave *replaySave = new ReplaySave;
+  replaySave->replayBuilder = replayBuilder;
+  replaySave->filename = new char[strlen(filename) + 1];
+  strcpy(replaySave->filename, filename);
+  replaySave->binary = binary;
+  replaySave->callbackRef = callbackRef;
+  replaySave->saved = false;
+  replaySave->releaseReplayBuilder = false;
+
+  pthread_mutex_lock(&lock_);
+  while (numPending() == maxPending_ && !cancelled_) {
+    pthread_cond_wait(&saveDone_, &lock_);
+  }
+  if (cancelled_) {
+    addDone(replaySave);
+  } else {
+    queue_[(queueStart_ + numQueued_) % maxPending_] = replaySave;
+    numQueued_++;
+    pthread_cond_signal(&saveQueued_);
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+// Returns false if the ReplayBuilder has no saves queued or in progress, so
+// the caller can delete it right away.
+bool ReplaySaver::release(ReplayBuilder *replayBuilder) {
+  pthread_mutex_lock(&lock_);
+  ReplaySave *replaySave = lastSave(replayBuilder);
+  if (replaySave != 0) {
+    replaySave->releaseReplayBuilder = true;
+  }
+  pthread_mutex_unlock(&lock_);
+  return (replaySave != 0);
+}
+
+// The oldest finished save, or 0 if there are none. The caller deletes it with
+// deleteSave.
+ReplaySave* ReplaySaver::nextDone() {
+  ReplaySave *replaySave = 0;
+  pthread_mutex_lock(&lock_);
+  if (numDone_ > 0) {
+    replaySave = done_[0];
+    numDone_--;
+    for (int x = 0; x < numDone_; x++) {
+      done_[x] = done_[x + 1];
+    }
+  }
+  pthread_mutex_unlock(&lock_);
+  return replaySave;
+}
+
+void ReplaySaver::waitForAll() {
+  pthread_mutex_lock(&lock_);
+  while (numPending() > 0) {
+    pthread_cond_wait(&saveDone_, &lock_);
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+// Drops the saves that haven't started and waits for the one in progress, if
+// any. The dropped saves come back from nextDone() as not saved. After this,
+// the saver won't touch any ReplayBuilder again.
+void ReplaySaver::cancel() {
+  pthread_mutex_lock(&lock_);
+  cancelled_ = true;
+  while (numQueued_ > 0) {
+    addDone(queue_[queueStart_]);
+    queueStart_ = (queueStart_ + 1) % maxPending_;
+    numQueued_--;
+  }
+  while (saving_ != 0) {
+    pthread_cond_wait(&saveDone_, &lock_);
+  }
+  pthread_cond_broadcast(&saveDone_);
+  pthread_mutex_unlock(&lock_);
+}
+
+void ReplaySaver::deleteSave(ReplaySave *replaySave) {
+  delete[] replaySave->filename;
+  delete replaySave;
+}
+
+// Called with lock_ held.
+int ReplaySaver::numPending() {
+  return numQueued_ + (saving_ == 0 ? 0 : 1);
+}
+
+// Called with lock_ held.
+void ReplaySaver::addDone(ReplaySave *replaySave) {
+  if (numDone_ == doneCapacity_) {
+    int newCapacity = doneCapacity_ * 2;
+    ReplaySave **newDone = new ReplaySave*[newCapacity];
+    for (int x = 0; x < numDone_; x++) {
+      newDone[x] = done_[x];
+    }
+    delete[] done_;
+    done_ = newDone;
+    doneCapacity_ = newCapacity;
+  }
+  done_[numDone_++] = replaySave;
+}
+
+// Called with lock_ held. Saves happen in order, so the last one queued for a
+// ReplayBuilder is the last to finish.
+ReplaySave* ReplaySaver::lastSave(ReplayBuilder *replayBuilder) {
+  for (int x = numQueued_ - 1; x >= 0; x--) {
+    ReplaySave *replaySave = queue_[(queueStart_ + x) % maxPending_];
+    if (replaySave->replayBuilder == replayBuilder) {
+      return replaySave;
+    }
+  }
+  if (saving_ != 0 && saving_->replayBuilder == replayBuilder) {
+    return saving_;
+  }
+  return 0;
+}
+
+void* ReplaySaver::saveThread(void *vargs) {
+  ReplaySaver *saver = (ReplaySaver *) vargs;
+  pthread_mutex_lock(&(saver->lock_));
+  while (true) {
+    while (saver->numQueued_ == 0 && !saver->quitting_) {
+      pthread_cond_wait(&(saver->saveQueued_), &(saver->lock_));
+    }
+    if (saver->numQueued_ == 0) {
+      break;
+    }
+    ReplaySave *replaySave = saver->queue_[saver->queueStart_];
+    saver->queueStart_ = (saver->queueStart_ + 1) % saver->maxPending_;
+    saver->numQueued_--;
+    saver->saving_ = replaySave;
+    pthread_mutex_unlock(&(saver->lock_));
+
+    ReplayBuilder *replayBuilder = replaySave->replayBuilder;
+    bool saved;
+    if (replaySave->binary) {
+      saved = replayBuilder->saveBinaryReplay(replaySave->filename);
+    } else {
+      saved = replayBuilder->saveReplay(replaySave->filename);
+    }
+    if (!saved) {
+      remove(replaySave->filename);
+    }
+
+    pthread_mutex_lock(&(saver->lock_));
+    replaySave->saved = saved;
+    saver->saving_ = 0;
+    saver->addDone(replaySave);
+    pthread_cond_broadcast(&(saver->saveDone_));
+  }
+  pthread_mutex_unlock(&(saver->lock_));
+  return 0;
+}
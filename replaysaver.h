@@ -0,0 +1,84 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef REPLAY_SAVER_H
+#define REPLAY_SAVER_H
+
+#include <pthread.h>
+
+#define REPLAY_SAVER_MAX_PENDING  4
+
+class ReplayBuilder;
+
+typedef struct {
+  ReplayBuilder *replayBuilder;
+  char *filename;
+  bool binary;
+  int callbackRef;  // for the caller, e.g. a Lua registry ref
+  bool saved;
+  bool releaseReplayBuilder;
+} ReplaySave;
+
+// Saves replays on a background thread, so the thread that's collecting match
+// results doesn't wait on the disk. At most maxPending saves are queued or in
+// progress at once, and save() blocks until there's room, so a slow disk
+// holds up the caller instead of piling up replays in memory.
+//
+// The caller keeps ownership of each ReplayBuilder. Finished saves are picked
+// up with nextDone() on the caller's thread. If the caller is done with a
+// ReplayBuilder before its saves are done, it can release() it, and the last
+// of its saves comes back with releaseReplayBuilder set, meaning it's the
+// caller's to delete then. If the ReplayBuilders are about to be deleted out
+// from under it, cancel() stops the saver from touching them again.
+class ReplaySaver {
+  pthread_t thread_;
+  pthread_mutex_t lock_;
+  pthread_cond_t saveQueued_;
+  pthread_cond_t saveDone_;
+  ReplaySave **queue_;
+  int maxPending_;
+  int queueStart_;
+  int numQueued_;
+  ReplaySave *saving_;
+  ReplaySave **done_;
+  int numDone_;
+  int doneCapacity_;
+  bool quitting_;
+  bool cancelled_;
+
+  public:
+    ReplaySaver(int maxPending);
+    ~ReplaySaver();
+    void save(ReplayBuilder *replayBuilder, const char *filename, bool binary,
+              int callbackRef);
+    bool release(ReplayBuilder *replayBuilder);
+    ReplaySave* nextDone();
+    void waitForAll();
+    void cancel();
+    static void deleteSave(ReplaySave *replaySave);
+    static void* saveThread(void *vargs);
+  private:
+    int numPending();
+    ReplaySave* lastSave(ReplayBuilder *replayBuilder);
+    void addDone(ReplaySave *replaySave);
+};
+
+#endif
@@ -0,0 +1,383 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef __WIN32__
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <algorithm>
+#include "resultchannel.h"
+
+ResultChannel::ResultChannel(int capacity) {
+  capacity_ = capacity;
+  void *shared = mmap(0, sizeof(ResultChannelHeader) + capacity,
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+  if (shared == MAP_FAILED) {
+    header_ = 0;
+    data_ = 0;
+  } else {
+    header_ = (ResultChannelHeader *) shared;
+    data_ = ((char *) shared) + sizeof(ResultChannelHeader);
+  }
+  if (pipe(dataPipe_) != 0) {
+    dataPipe_[0] = dataPipe_[1] = -1;
+  }
+  if (pipe(spacePipe_) != 0) {
+    spacePipe_[0] = spacePipe_[1] = -1;
+  }
+  for (int x = 0; x < 2; x++) {
+    if (dataPipe_[x] >= 0) {
+      fcntl(dataPipe_[x], F_SETFL, O_NONBLOCK);
+    }
+    if (spacePipe_[x] >= 0) {
+      fcntl(spacePipe_[x], F_SETFL, O_NONBLOCK);
+    }
+  }
+  readerPid_ = getpid();
+  launcherPid_ = 0;
+  launcherFd_ = -1;
+  launcherGone_ = false;
+  abort_ = 0;
+  readCount_ = writeCount_ = 0;
+  failed_ = stalled_ = false;
+  lastProgress_ = 0;
+  lastProgressTime_ = 0;
+}
+
+ResultChannel::~ResultChannel() {
+  if (header_ != 0) {
+    munmap(header_, sizeof(ResultChannelHeader) + capacity_);
+  }
+  for (int x = 0; x < 2; x++) {
+    if (dataPipe_[x] >= 0) {
+      close(dataPipe_[x]);
+    }
+    if (spacePipe_[x] >= 0) {
+      close(spacePipe_[x]);
+    }
+  }
+}
+
+bool ResultChannel::isValid() {
+  return (header_ != 0 && dataPipe_[0] >= 0 && spacePipe_[0] >= 0);
+}
+
+// Called by the reader before asking for each writer.
+void ResultChannel::reset() {
+  header_->readCount = header_->writeCount = header_->ticks = 0;
+  header_->writerPid = 0;
+  header_->writerExited = 0;
+  readCount_ = writeCount_ = 0;
+  drain(dataPipe_[0]);
+  drain(spacePipe_[0]);
+  launcherFd_ = -1;
+  launcherGone_ = false;
+  abort_ = 0;
+  failed_ = stalled_ = false;
+}
+
+static long long currentTimeMillis() {
+  struct timeval now;
+  gettimeofday(&now, 0);
+  return (((long long) now.tv_sec) * 1000) + (now.tv_usec / 1000);
+}
+
+// Called by the reader once it has asked the launcher for a writer. Reads fail
+// if the writer exits before writing what we need, as soon as abort is set, or
+// if the launcher hangs up its end of launcherFd.
+void ResultChannel::setLauncher(int launcherFd, volatile bool *abort) {
+  launcherFd_ = launcherFd;
+  abort_ = abort;
+  lastProgress_ = 0;
+  lastProgressTime_ = currentTimeMillis();
+}
+
+// Waits for the launcher to report that the writer has exited, first killing
+// it if we gave up on it. If the launcher is gone, the writer notices on its
+// own that it has lost its parent.
+void ResultChannel::finishWriter() {
+  bool killed = false;
+  while (!writerExited() && !launcherGone_) {
+    pid_t writerPid = header_->writerPid;
+    if (writerPid < 0) {
+      return;
+    }
+    if (failed_ && writerPid > 0 && !killed) {
+      kill(writerPid, SIGKILL);
+      killed = true;
+    }
+    pollFor(dataPipe_[0]);
+  }
+  if (launcherGone_ && failed_ && !killed && header_->writerPid > 0) {
+    kill(header_->writerPid, SIGKILL);
+  }
+}
+
+bool ResultChannel::failed() {
+  return failed_;
+}
+
+// Whether reads failed because the writer stopped making progress.
+bool ResultChannel::stalled() {
+  return stalled_;
+}
+
+// Whether the launcher couldn't fork a writer at all.
+bool ResultChannel::launchFailed() {
+  return (header_->writerPid < 0);
+}
+
+// Called by the launcher after forking the writer, or with -1 if it couldn't.
+void ResultChannel::launched(pid_t writerPid) {
+  header_->writerPid = writerPid;
+  if (writerPid < 0) {
+    exited();
+  }
+}
+
+// Called by the launcher once it has reaped the writer.
+void ResultChannel::exited() {
+  __sync_synchronize();
+  header_->writerExited = 1;
+  __sync_synchronize();
+  notify(dataPipe_[1]);
+}
+
+// Called by the writer before it writes anything.
+void ResultChannel::startWriter() {
+  launcherPid_ = getppid();
+}
+
+// Called by the writer as the match goes along, so the reader knows it's still
+// alive even when it has nothing to write yet.
+void ResultChannel::tick() {
+  header_->ticks++;
+}
+
+void ResultChannel::write(const void *data, int length) {
+  const char *bytes = (const char *) data;
+  while (length > 0 && !failed_) {
+    int space = capacity_ - (int) (writeCount_ - header_->readCount);
+    if (space == 0) {
+      publishWrites();
+      if (writeCount_ - header_->readCount == (unsigned int) capacity_
+          && !waitFor(spacePipe_[0])) {
+        failed_ = true;
+      }
+      continue;
+    }
+    int offset = (int) (writeCount_ & (capacity_ - 1));
+    int chunk = std::min(std::min(length, space), capacity_ - offset);
+    memcpy(&(data_[offset]), bytes, chunk);
+    writeCount_ += chunk;
+    bytes += chunk;
+    length -= chunk;
+    if (writeCount_ - header_->writeCount
+        >= (unsigned int) (capacity_ / RESULT_CHANNEL_BATCHES)) {
+      publishWrites();
+    }
+  }
+}
+
+void ResultChannel::writeInt(int i) {
+  write(&i, sizeof(int));
+}
+
+void ResultChannel::writeDouble(double d) {
+  write(&d, sizeof(double));
+}
+
+// Strings are written as length | chars, with a length of -1 for null.
+void ResultChannel::writeString(const char *s) {
+  if (s == 0) {
+    writeInt(-1);
+  } else {
+    int length = (int) strlen(s);
+    writeInt(length);
+    write(s, length);
+  }
+}
+
+// The writer must flush before it exits, or the reader may never see the last
+// of what it wrote.
+void ResultChannel::flush() {
+  publishWrites();
+}
+
+void ResultChannel::read(void *data, int length) {
+  char *bytes = (char *) data;
+  while (length > 0) {
+    if (failed_) {
+      memset(bytes, 0, length);
+      return;
+    }
+    int available = (int) (header_->writeCount - readCount_);
+    if (available == 0) {
+      publishReads();
+      if (header_->writeCount == readCount_ && !waitFor(dataPipe_[0])) {
+        failed_ = true;
+      }
+      continue;
+    }
+    __sync_synchronize();
+    int offset = (int) (readCount_ & (capacity_ - 1));
+    int chunk = std::min(std::min(length, available), capacity_ - offset);
+    memcpy(bytes, &(data_[offset]), chunk);
+    readCount_ += chunk;
+    bytes += chunk;
+    length -= chunk;
+    if (readCount_ - header_->readCount
+        >= (unsigned int) (capacity_ / RESULT_CHANNEL_BATCHES)) {
+      publishReads();
+    }
+  }
+}
+
+int ResultChannel::readInt() {
+  int i;
+  read(&i, sizeof(int));
+  return i;
+}
+
+double ResultChannel::readDouble() {
+  double d;
+  read(&d, sizeof(double));
+  return d;
+}
+
+// Returns a new string, or null if a null string was written.
+char* ResultChannel::readString() {
+  int length = readInt();
+  if (length < 0) {
+    if (length < -1) {
+      failed_ = true;
+    }
+    return 0;
+  }
+  char *s = new char[length + 1];
+  read(s, length);
+  s[length] = '\0';
+  return s;
+}
+
+// Each side publishes its progress and then checks whether the other side
+// might be waiting on it. A side only waits after publishing its own progress
+// and seeing no change from the other, so one of the two always notices.
+void ResultChannel::publishReads() {
+  unsigned int published = header_->readCount;
+  if (published == readCount_) {
+    return;
+  }
+  __sync_synchronize();
+  header_->readCount = readCount_;
+  __sync_synchronize();
+  if (header_->writeCount - published == (unsigned int) capacity_) {
+    notify(spacePipe_[1]);
+  }
+}
+
+void ResultChannel::publishWrites() {
+  unsigned int published = header_->writeCount;
+  if (published == writeCount_) {
+    return;
+  }
+  __sync_synchronize();
+  header_->writeCount = writeCount_;
+  __sync_synchronize();
+  if (header_->readCount == published) {
+    notify(dataPipe_[1]);
+  }
+}
+
+bool ResultChannel::writerExited() {
+  bool writerExited = (header_->writerExited != 0);
+  __sync_synchronize();
+  return writerExited;
+}
+
+bool ResultChannel::writerStalled() {
+  unsigned int progress = header_->ticks + header_->writeCount;
+  long long now = currentTimeMillis();
+  if (progress != lastProgress_) {
+    lastProgress_ = progress;
+    lastProgressTime_ = now;
+  } else if (now - lastProgressTime_ > RESULT_CHANNEL_STALL) {
+    stalled_ = true;
+  }
+  return stalled_;
+}
+
+void ResultChannel::notify(int fd) {
+  char wakeup = 0;
+  ssize_t written = ::write(fd, &wakeup, 1);
+  (void) written; // if the pipe is full, the other side has plenty to wake it
+}
+
+void ResultChannel::drain(int fd) {
+  char wakeups[64];
+  while (::read(fd, wakeups, sizeof(wakeups)) > 0);
+}
+
+// Waits up to RESULT_CHANNEL_POLL for a wakeup on fd. Returns false if the
+// other side is gone: the writer has exited with nothing left to read or has
+// stalled, or the launcher has died.
+bool ResultChannel::waitFor(int fd) {
+  pollFor(fd);
+  if (getpid() == readerPid_) {
+    if (abort_ != 0 && *abort_) {
+      return false;
+    }
+    if (writerExited()) {
+      return (header_->writeCount != readCount_);
+    }
+    if (launcherGone_ || writerStalled()) {
+      return false;
+    }
+  } else if (getppid() != launcherPid_) {
+    return false;
+  }
+  return true;
+}
+
+// The launcher never writes to launcherFd, so the reader only hears from it if
+// it hangs up.
+void ResultChannel::pollFor(int fd) {
+  struct pollfd pollFds[2];
+  pollFds[0].fd = fd;
+  pollFds[0].events = POLLIN;
+  pollFds[0].revents = 0;
+  pollFds[1].fd = launcherFd_;
+  pollFds[1].events = 0;
+  pollFds[1].revents = 0;
+  int numFds = (getpid() == readerPid_ && launcherFd_ >= 0) ? 2 : 1;
+  poll(pollFds, numFds, RESULT_CHANNEL_POLL);
+  drain(fd);
+  if (numFds == 2 && (pollFds[1].revents & (POLLHUP | POLLERR))) {
+    launcherGone_ = true;
+  }
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef RESULT_CHANNEL_H
+#define RESULT_CHANNEL_H
+
+#include <sys/types.h>
+
+#define RESULT_CHANNEL_CAPACITY  (1024 * 1024) // must be a power of 2
+#define RESULT_CHANNEL_POLL      50            // ms between liveness checks
+#define RESULT_CHANNEL_BATCHES   8   // publish progress every 1/8 of the ring
+#define RESULT_CHANNEL_STALL     60000  // ms without progress before giving up
+
+// Read and write positions, as running byte counts. Each is only ever
+// advanced by one side, so the ring needs no lock. Each side also batches up
+// its progress before publishing it here, so the other side isn't woken up for
+// every few bytes. The writer also counts up its ticks, so the reader can tell
+// a long match from a stuck one. The writer is forked by a launcher process,
+// not the reader, so the launcher reports its pid and when it exits.
+typedef struct {
+  volatile unsigned int readCount;
+  volatile unsigned int writeCount;
+  volatile unsigned int ticks;
+  volatile pid_t writerPid; // -1 if the launcher couldn't fork it
+  volatile int writerExited;
+} ResultChannelHeader;
+
+// A one way ring buffer in shared memory, from a match process (the writer) to
+// a runner thread (the reader). It's created once per runner thread and reset
+// for each match, and carries results of any size: the writer blocks while the
+// ring is full and the reader drains it as the data arrives. A pair of pipes
+// carries the wakeups in each direction.
+//
+// If the match process dies, the launcher dies or the runner quits, reads fail
+// instead of blocking and return zeroes from then on, so callers can read a
+// whole result and check failed() once at the end. They also fail if the
+// writer goes RESULT_CHANNEL_STALL without ticking or writing anything, in
+// case it's deadlocked, and then finishWriter() kills it.
+class ResultChannel {
+  ResultChannelHeader *header_;
+  char *data_;
+  int capacity_;
+  int dataPipe_[2];
+  int spacePipe_[2];
+  unsigned int readCount_;
+  unsigned int writeCount_;
+  pid_t readerPid_;
+  pid_t launcherPid_;
+  int launcherFd_;
+  bool launcherGone_;
+  volatile bool *abort_;
+  bool failed_;
+  bool stalled_;
+  unsigned int lastProgress_;
+  long long lastProgressTime_;
+
+  public:
+    ResultChannel(int capacity);
+    ~ResultChannel();
+    bool isValid();
+    void reset();
+    void setLauncher(int launcherFd, volatile bool *abort);
+    void finishWriter();
+    bool failed();
+    bool stalled();
+    bool launchFailed();
+
+    void launched(pid_t writerPid);
+    void exited();
+
+    void startWriter();
+    void tick();
+
+    void write(const void *data, int length);
+    void writeInt(int i);
+    void writeDouble(double d);
+    void writeString(const char *s);
+    void flush();
+
+    void read(void *data, int length);
+    int readInt();
+    double readDouble();
+    char* readString();
+  private:
+    void publishReads();
+    void publishWrites();
+    bool writerExited();
+    bool writerStalled();
+    void notify(int fd);
+    void drain(int fd);
+    bool waitFor(int fd);
+    void pollFor(int fd);
+};
+
+#endif
@@ -40,6 +40,7 @@ function run(runner, form, files, network)
     while (not runner:empty()) do
       processNextResult(runner, saveReplays)
     end
+    runner:waitForReplays()
 
     print()
     print("---------------------------------------------------------------------")
@@ -109,14 +110,20 @@ function processNextResult(runner, saveReplay)
       end
     end
     if (saveReplay) then
-      local replayName = runner:saveReplay()
+      local replayName = runner:saveReplay(replaySaved)
       if (replayName ~= nil) then
-        print("    Replay saved to: " .. replayName)
+        print("    Saving replay to: " .. replayName)
       end
     end
   end
 end
 
+function replaySaved(filename, saved)
+  if (not saved) then
+    print("Error: couldn't save replay to: " .. filename)
+  end
+end
+
 function printScores()
   print("    Wins: " .. numWins .. " / " .. numSeasons)
   for i, keyEntry in ipairs(scoreKeys) do
@@ -48,6 +48,7 @@ function run(runner, form, files, network)
     while (not runner:empty()) do
       processNextResult(runner, saveReplays)
     end
+    runner:waitForReplays()
 
     if (not saveReplays) then print() end
     print("---------------------------------------------------------------------")
@@ -154,16 +155,22 @@ function processNextResult(runner, saveReplay)
       end
     end
     if (saveReplay) then
-      local replayName = runner:saveReplay()
+      local replayName = runner:saveReplay(replaySaved)
       if (replayName ~= nil) then
         print("--------")
-        print("Replay saved to: " .. replayName)
+        print("Saving replay to: " .. replayName)
         print()
       end
     end
   end
 end
 
+function replaySaved(filename, saved)
+  if (not saved) then
+    print("Error: couldn't save replay to: " .. filename)
+  end
+end
+
 function printScores(scores)
   for i, key in ipairs(scoreKeys) do
     print("    " .. key .. ": "
@@ -223,7 +223,7 @@ function printSavedReplay(result, replayName)
   end
   print("    " .. teamString)
   print("    " .. result.winner .. " wins!")
-  print("    Replay saved to: " .. replayName)
+  print("    Saving replay to: " .. replayName)
   print()
 end
 
@@ -24,108 +24,86 @@ SensorHandler::SensorHandler(Team **teams, int numTeams, bool **teamVision) {
   teams_ = teams;
   numTeams_ = numTeams;
   teamVision_ = teamVision;
-  hitByShips_ = new HitByShip**[numTeams_];
-  numHitByShips_ = new int[numTeams_];
+
+  hitByShips_ = new EventArena*[numTeams_];
   for (int x = 0; x < numTeams_; x++) {
-    hitByShips_[x] = new HitByShip*[MAX_HIT_BY_SHIPS];
-    numHitByShips_[x] = 0;
+    hitByShips_[x] = new EventArena(sizeof(HitByShip));
   }
 
-  hitByLasers_ = new HitByLaser**[numTeams_];
-  numHitByLasers_ = new int[numTeams_];
+  hitByLasers_ = new EventArena*[numTeams_];
   for (int x = 0; x < numTeams_; x++) {
-    hitByLasers_[x] = new HitByLaser*[MAX_HIT_BY_LASERS];
-    numHitByLasers_[x] = 0;
+    hitByLasers_[x] = new EventArena(sizeof(HitByLaser));
   }
 
-  hitByTorpedos_ = new HitByTorpedo**[numTeams_];
-  numHitByTorpedos_ = new int[numTeams_];
+  hitByTorpedos_ = new EventArena*[numTeams_];
   for (int x = 0; x < numTeams_; x++) {
-    hitByTorpedos_[x] = new HitByTorpedo*[MAX_HIT_BY_TORPEDOS];
-    numHitByTorpedos_[x] = 0;
+    hitByTorpedos_[x] = new EventArena(sizeof(HitByTorpedo));
   }
 
-  hitWalls_ = new ShipHitWall**[numTeams_];
-  numHitWalls_ = new int[numTeams_];
+  hitWalls_ = new EventArena*[numTeams_];
   for (int x = 0; x < numTeams_; x++) {
-    hitWalls_[x] = new ShipHitWall*[MAX_HIT_WALLS];
-    numHitWalls_[x] = 0;
+    hitWalls_[x] = new EventArena(sizeof(ShipHitWall));
   }
 
-  shipDestroyeds_ = new ShipDestroyed**[numTeams_];
-  numShipDestroyeds_ = new int[numTeams_];
+  shipDestroyeds_ = new EventArena*[numTeams_];
   for (int x = 0; x < numTeams_; x++) {
-    shipDestroyeds_[x] = new ShipDestroyed*[MAX_SHIP_DESTROYEDS];
-    numShipDestroyeds_[x] = 0;
+    shipDestroyeds_[x] = new EventArena(sizeof(ShipDestroyed));
   }
 
-  shipFiredLasers_ = new ShipFiredLaser**[numTeams_];
-  numShipFiredLasers_ = new int[numTeams_];
+  shipFiredLasers_ = new EventArena*[numTeams_];
   for (int x = 0; x < numTeams_; x++) {
-    shipFiredLasers_[x] = new ShipFiredLaser*[MAX_SHIP_FIRED_LASERS];
-    numShipFiredLasers_[x] = 0;
+    shipFiredLasers_[x] = new EventArena(sizeof(ShipFiredLaser));
   }
 
-  shipFiredTorpedos_ = new ShipFiredTorpedo**[numTeams_];
-  numShipFiredTorpedos_ = new int[numTeams_];
+  shipFiredTorpedos_ = new EventArena*[numTeams_];
   for (int x = 0; x < numTeams_; x++) {
-    shipFiredTorpedos_[x] = new ShipFiredTorpedo*[MAX_SHIP_FIRED_TORPEDOS];
-    numShipFiredTorpedos_[x] = 0;
+    shipFiredTorpedos_[x] = new EventArena(sizeof(ShipFiredTorpedo));
   }
 
-  laserHitShips_ = new LaserHitShip**[numTeams_];
-  numLaserHitShips_ = new int[numTeams_];
+  laserHitShips_ = new EventArena*[numTeams_];
   for (int x = 0; x < numTeams_; x++) {
-    laserHitShips_[x] = new LaserHitShip*[MAX_LASER_HIT_SHIPS];
-    numLaserHitShips_[x] = 0;
+    laserHitShips_[x] = new EventArena(sizeof(LaserHitShip));
   }
 
-  numStageShipHitShips_ = 0;
-  numStageLaserHitShips_ = 0;
-  numStageTorpedoHitShips_ = 0;
-  numStageShipHitWalls_ = 0;
-  numStageShipDestroyeds_ = 0;
-  numStageShipFiredLasers_ = 0;
-  numStageShipFiredTorpedos_ = 0;
+  stageShipHitShips_ = new EventArena(sizeof(ShipHitShip));
+  stageLaserHitShips_ = new EventArena(sizeof(StageLaserHitShip));
+  stageTorpedoHitShips_ = new EventArena(sizeof(StageTorpedoHitShip));
+  stageShipHitWalls_ = new EventArena(sizeof(ShipHitWall));
+  stageShipDestroyeds_ = new EventArena(sizeof(ShipDestroyed));
+  stageShipFiredLasers_ = new EventArena(sizeof(StageShipFiredLaser));
+  stageShipFiredTorpedos_ = new EventArena(sizeof(StageShipFiredTorpedo));
 }
 
 void SensorHandler::handleLaserHitShip(Ship *srcShip, Ship *targetShip,
     Laser *laser, double dx, double dy, int time) {
   int targetShipIndex = targetShip->index;
   int teamIndex = targetShip->teamIndex;
-  if (numHitByLasers_[teamIndex] < MAX_HIT_BY_LASERS) {
-    HitByLaser *hitByLaser = new HitByLaser;
-    hitByLaser->time = time;
-    hitByLaser->targetShipIndex = targetShipIndex;
-    hitByLaser->laserX = laser->x;
-    hitByLaser->laserY = laser->y;
-    hitByLaser->laserHeading = laser->heading;
-    hitByLasers_[teamIndex][numHitByLasers_[teamIndex]++] = hitByLaser;
-  }
+  HitByLaser *hitByLaser = (HitByLaser *) hitByLasers_[teamIndex]->allocate();
+  hitByLaser->time = time;
+  hitByLaser->targetShipIndex = targetShipIndex;
+  hitByLaser->laserX = laser->x;
+  hitByLaser->laserY = laser->y;
+  hitByLaser->laserHeading = laser->heading;
 
   for (int x = 0; x < numTeams_; x++) {
     if (x != teamIndex && teamVision_[x][targetShipIndex]) {
-      if (numLaserHitShips_[x] < MAX_LASER_HIT_SHIPS) {
-        LaserHitShip *laserHitShip = new LaserHitShip;
-        laserHitShip->time = time;
-        laserHitShip->targetShipIndex = targetShipIndex;
-        laserHitShip->shipX = targetShip->x;
-        laserHitShip->shipY = targetShip->y;
-        laserHitShips_[x][numLaserHitShips_[x]++] = laserHitShip;
-      }
+      LaserHitShip *laserHitShip =
+          (LaserHitShip *) laserHitShips_[x]->allocate();
+      laserHitShip->time = time;
+      laserHitShip->targetShipIndex = targetShipIndex;
+      laserHitShip->shipX = targetShip->x;
+      laserHitShip->shipY = targetShip->y;
     }
   }
 
-  if (numStageLaserHitShips_ < MAX_LASER_HIT_SHIPS) {
-    StageLaserHitShip *laserHitShip = new StageLaserHitShip;
-    laserHitShip->time = time;
-    laserHitShip->srcShipIndex = srcShip->index;
-    laserHitShip->targetShipIndex = targetShipIndex;
-    laserHitShip->laserX = laser->x;
-    laserHitShip->laserY = laser->y;
-    laserHitShip->laserHeading = laser->heading;
-    stageLaserHitShips_[numStageLaserHitShips_++] = laserHitShip;
-  }
+  StageLaserHitShip *laserHitShip =
+      (StageLaserHitShip *) stageLaserHitShips_->allocate();
+  laserHitShip->time = time;
+  laserHitShip->srcShipIndex = srcShip->index;
+  laserHitShip->targetShipIndex = targetShipIndex;
+  laserHitShip->laserX = laser->x;
+  laserHitShip->laserY = laser->y;
+  laserHitShip->laserHeading = laser->heading;
 }
 
 void SensorHandler::handleTorpedoExploded(Torpedo *torpedo, int time) {
@@ -137,135 +115,111 @@ void SensorHandler::handleTorpedoHitShip(Ship *srcShip, Ship *targetShip,
     int time) {
   int targetShipIndex = targetShip->index;
   int teamIndex = targetShip->teamIndex;
-  if (numHitByTorpedos_[teamIndex] < MAX_HIT_BY_TORPEDOS) {
-    HitByTorpedo *hitByTorpedo = new HitByTorpedo;
-    hitByTorpedo->time = time;
-    hitByTorpedo->targetShipIndex = targetShipIndex;
-    hitByTorpedo->hitAngle = hitAngle;
-    hitByTorpedo->hitForce = hitForce;
-    hitByTorpedo->hitDamage = hitDamage;
-    hitByTorpedos_[teamIndex][numHitByTorpedos_[teamIndex]++] = hitByTorpedo;
-  }
-
-  if (numStageTorpedoHitShips_ < MAX_HIT_BY_TORPEDOS) {
-    StageTorpedoHitShip *torpedoHitShip = new StageTorpedoHitShip;
-    torpedoHitShip->time = time;
-    torpedoHitShip->srcShipIndex = srcShip->index;
-    torpedoHitShip->targetShipIndex = targetShip->index;
-    torpedoHitShip->hitAngle = hitAngle;
-    torpedoHitShip->hitForce = hitForce;
-    torpedoHitShip->hitDamage = hitDamage;
-    stageTorpedoHitShips_[numStageTorpedoHitShips_++] = torpedoHitShip;
-  }
+  HitByTorpedo *hitByTorpedo =
+      (HitByTorpedo *) hitByTorpedos_[teamIndex]->allocate();
+  hitByTorpedo->time = time;
+  hitByTorpedo->targetShipIndex = targetShipIndex;
+  hitByTorpedo->hitAngle = hitAngle;
+  hitByTorpedo->hitForce = hitForce;
+  hitByTorpedo->hitDamage = hitDamage;
+
+  StageTorpedoHitShip *torpedoHitShip =
+      (StageTorpedoHitShip *) stageTorpedoHitShips_->allocate();
+  torpedoHitShip->time = time;
+  torpedoHitShip->srcShipIndex = srcShip->index;
+  torpedoHitShip->targetShipIndex = targetShip->index;
+  torpedoHitShip->hitAngle = hitAngle;
+  torpedoHitShip->hitForce = hitForce;
+  torpedoHitShip->hitDamage = hitDamage;
 }
 
 void SensorHandler::handleShipHitShip(Ship *hittingShip, Ship *targetShip,
     double inAngle, double inForce, double outAngle, double outForce,
     double damage, int time) {
   int teamIndex = targetShip->teamIndex;
-  if (numHitByShips_[teamIndex] < MAX_HIT_BY_SHIPS) {
-    HitByShip *hitByShip = new HitByShip;
-    hitByShip->time = time;
-    hitByShip->targetShipIndex = targetShip->index;
-    hitByShip->targetX = targetShip->x;
-    hitByShip->targetY = targetShip->y;
-    hitByShip->hittingShipIndex = hittingShip->index;
-    hitByShip->hittingX = hittingShip->x;
-    hitByShip->hittingY = hittingShip->y;
-    hitByShip->inAngle = inAngle;
-    hitByShip->inForce = inForce;
-    hitByShip->outAngle = outAngle;
-    hitByShip->outForce = outForce;
-    hitByShip->damage = damage;
-    hitByShips_[teamIndex][numHitByShips_[teamIndex]++] = hitByShip;
-  }
-
-  if (numStageShipHitShips_ < MAX_SHIP_HIT_SHIPS) {
-    ShipHitShip *shipHitShip = new ShipHitShip;
-    shipHitShip->time = time;
-    shipHitShip->targetShipIndex = targetShip->index;
-    shipHitShip->targetX = targetShip->x;
-    shipHitShip->targetY = targetShip->y;
-    shipHitShip->hittingShipIndex = hittingShip->index;
-    shipHitShip->hittingX = hittingShip->x;
-    shipHitShip->hittingY = hittingShip->y;
-    shipHitShip->inAngle = inAngle;
-    shipHitShip->inForce = inForce;
-    shipHitShip->outAngle = outAngle;
-    shipHitShip->outForce = outForce;
-    stageShipHitShips_[numStageShipHitShips_++] = shipHitShip;
-  }
+  HitByShip *hitByShip = (HitByShip *) hitByShips_[teamIndex]->allocate();
+  hitByShip->time = time;
+  hitByShip->targetShipIndex = targetShip->index;
+  hitByShip->targetX = targetShip->x;
+  hitByShip->targetY = targetShip->y;
+  hitByShip->hittingShipIndex = hittingShip->index;
+  hitByShip->hittingX = hittingShip->x;
+  hitByShip->hittingY = hittingShip->y;
+  hitByShip->inAngle = inAngle;
+  hitByShip->inForce = inForce;
+  hitByShip->outAngle = outAngle;
+  hitByShip->outForce = outForce;
+  hitByShip->damage = damage;
+
+  ShipHitShip *shipHitShip = (ShipHitShip *) stageShipHitShips_->allocate();
+  shipHitShip->time = time;
+  shipHitShip->targetShipIndex = targetShip->index;
+  shipHitShip->targetX = targetShip->x;
+  shipHitShip->targetY = targetShip->y;
+  shipHitShip->hittingShipIndex = hittingShip->index;
+  shipHitShip->hittingX = hittingShip->x;
+  shipHitShip->hittingY = hittingShip->y;
+  shipHitShip->inAngle = inAngle;
+  shipHitShip->inForce = inForce;
+  shipHitShip->outAngle = outAngle;
+  shipHitShip->outForce = outForce;
 }
 
 void SensorHandler::handleShipHitWall(
     Ship *hittingShip, double bounceAngle, double bounceForce, double hitDamage, int time) {
   int teamIndex = hittingShip->teamIndex;
-  if (numHitWalls_[teamIndex] < MAX_HIT_WALLS) {
-    ShipHitWall *hitWall = new ShipHitWall;
-    hitWall->time = time;
-    hitWall->shipIndex = hittingShip->index;
-    hitWall->shipX = hittingShip->x;
-    hitWall->shipY = hittingShip->y;
-    hitWall->bounceAngle = bounceAngle;
-    hitWall->bounceForce = bounceForce;
-    hitWalls_[teamIndex][numHitWalls_[teamIndex]++] = hitWall;
-  }
-
-  if (numStageShipHitWalls_ < MAX_SHIP_HIT_WALLS) {
-    ShipHitWall *hitWall = new ShipHitWall;
-    hitWall->time = time;
-    hitWall->shipIndex = hittingShip->index;
-    hitWall->shipX = hittingShip->x;
-    hitWall->shipY = hittingShip->y;
-    hitWall->bounceAngle = bounceAngle;
-    hitWall->bounceForce = bounceForce;
-    stageShipHitWalls_[numStageShipHitWalls_++] = hitWall;
-  }
+  ShipHitWall *hitWall = (ShipHitWall *) hitWalls_[teamIndex]->allocate();
+  hitWall->time = time;
+  hitWall->shipIndex = hittingShip->index;
+  hitWall->shipX = hittingShip->x;
+  hitWall->shipY = hittingShip->y;
+  hitWall->bounceAngle = bounceAngle;
+  hitWall->bounceForce = bounceForce;
+
+  ShipHitWall *stageHitWall = (ShipHitWall *) stageShipHitWalls_->allocate();
+  stageHitWall->time = time;
+  stageHitWall->shipIndex = hittingShip->index;
+  stageHitWall->shipX = hittingShip->x;
+  stageHitWall->shipY = hittingShip->y;
+  stageHitWall->bounceAngle = bounceAngle;
+  stageHitWall->bounceForce = bounceForce;
 }
 
 void SensorHandler::handleShipDestroyed(Ship *destroyedShip, int time,
     Ship **destroyerShips, int numDestroyers) {
   int destroyedShipIndex = destroyedShip->index;
   for (int x = 0; x < numTeams_; x++) {
-    if (numShipDestroyeds_[x] < MAX_SHIP_DESTROYEDS) {
-      ShipDestroyed *shipDestroyed = new ShipDestroyed;
-      shipDestroyed->time = time;
-      shipDestroyed->shipIndex = destroyedShipIndex;
-      shipDestroyeds_[x][numShipDestroyeds_[x]++] = shipDestroyed;
-    }
-  }
-
-  if (numStageShipDestroyeds_ < MAX_SHIP_DESTROYEDS) {
-    ShipDestroyed *shipDestroyed = new ShipDestroyed;
+    ShipDestroyed *shipDestroyed =
+        (ShipDestroyed *) shipDestroyeds_[x]->allocate();
     shipDestroyed->time = time;
     shipDestroyed->shipIndex = destroyedShipIndex;
-    stageShipDestroyeds_[numStageShipDestroyeds_++] = shipDestroyed;
   }
+
+  ShipDestroyed *shipDestroyed =
+      (ShipDestroyed *) stageShipDestroyeds_->allocate();
+  shipDestroyed->time = time;
+  shipDestroyed->shipIndex = destroyedShipIndex;
 }
 
 void SensorHandler::handleShipFiredLaser(Ship *firingShip, Laser *laser) {
-  if (numStageShipFiredLasers_ < MAX_SHIP_FIRED_LASERS) {
-    StageShipFiredLaser *shipFiredLaser = new StageShipFiredLaser;
-    shipFiredLaser->time = laser->fireTime;
-    shipFiredLaser->shipIndex = firingShip->index;
-    shipFiredLaser->shipX = firingShip->x;
-    shipFiredLaser->shipY = firingShip->y;
-    shipFiredLaser->laserHeading = laser->heading;
-    stageShipFiredLasers_[numStageShipFiredLasers_++] = shipFiredLaser;
-  }
+  StageShipFiredLaser *stageShipFiredLaser =
+      (StageShipFiredLaser *) stageShipFiredLasers_->allocate();
+  stageShipFiredLaser->time = laser->fireTime;
+  stageShipFiredLaser->shipIndex = firingShip->index;
+  stageShipFiredLaser->shipX = firingShip->x;
+  stageShipFiredLaser->shipY = firingShip->y;
+  stageShipFiredLaser->laserHeading = laser->heading;
 
   int targetShipIndex = firingShip->index;
   int teamIndex = firingShip->teamIndex;
   for (int x = 0; x < numTeams_; x++) {
     if (x != teamIndex && teamVision_[x][targetShipIndex]) {
-      if (numShipFiredLasers_[x] < MAX_SHIP_FIRED_LASERS) {
-        ShipFiredLaser *shipFiredLaser = new ShipFiredLaser;
-        shipFiredLaser->time = laser->fireTime;
-        shipFiredLaser->shipIndex = targetShipIndex;
-        shipFiredLaser->shipX = firingShip->x;
-        shipFiredLaser->shipY = firingShip->y;
-        shipFiredLasers_[x][numShipFiredLasers_[x]++] = shipFiredLaser;
-      }
+      ShipFiredLaser *shipFiredLaser =
+          (ShipFiredLaser *) shipFiredLasers_[x]->allocate();
+      shipFiredLaser->time = laser->fireTime;
+      shipFiredLaser->shipIndex = targetShipIndex;
+      shipFiredLaser->shipX = firingShip->x;
+      shipFiredLaser->shipY = firingShip->y;
     }
   }
 }
@@ -275,353 +229,216 @@ void SensorHandler::handleLaserDestroyed(Laser *laser, int time) {
 }
 
 void SensorHandler::handleShipFiredTorpedo(Ship *firingShip, Torpedo *torpedo) {
-  if (numStageShipFiredTorpedos_ < MAX_SHIP_FIRED_TORPEDOS) {
-    StageShipFiredTorpedo *shipFiredTorpedo = new StageShipFiredTorpedo;
-    shipFiredTorpedo->time = torpedo->fireTime;
-    shipFiredTorpedo->shipIndex = firingShip->index;
-    shipFiredTorpedo->shipX = firingShip->x;
-    shipFiredTorpedo->shipY = firingShip->y;
-    shipFiredTorpedo->torpedoHeading = torpedo->heading;
-    shipFiredTorpedo->torpedoDistance = torpedo->distance;
-    stageShipFiredTorpedos_[numStageShipFiredTorpedos_++] = shipFiredTorpedo;
-  }
+  StageShipFiredTorpedo *stageShipFiredTorpedo =
+      (StageShipFiredTorpedo *) stageShipFiredTorpedos_->allocate();
+  stageShipFiredTorpedo->time = torpedo->fireTime;
+  stageShipFiredTorpedo->shipIndex = firingShip->index;
+  stageShipFiredTorpedo->shipX = firingShip->x;
+  stageShipFiredTorpedo->shipY = firingShip->y;
+  stageShipFiredTorpedo->torpedoHeading = torpedo->heading;
+  stageShipFiredTorpedo->torpedoDistance = torpedo->distance;
 
   int firingShipIndex = firingShip->index;
   int teamIndex = firingShip->teamIndex;
   for (int x = 0; x < numTeams_; x++) {
     if (x != teamIndex && teamVision_[x][firingShipIndex]) {
-      if (numShipFiredTorpedos_[x] < MAX_SHIP_FIRED_TORPEDOS) {
-        ShipFiredTorpedo *shipFiredTorpedo = new ShipFiredTorpedo;
-        shipFiredTorpedo->time = torpedo->fireTime;
-        shipFiredTorpedo->shipIndex = firingShipIndex;
-        shipFiredTorpedo->shipX = firingShip->x;
-        shipFiredTorpedo->shipY = firingShip->y;
-        shipFiredTorpedos_[x][numShipFiredTorpedos_[x]++] = shipFiredTorpedo;
-      }
+      ShipFiredTorpedo *shipFiredTorpedo =
+          (ShipFiredTorpedo *) shipFiredTorpedos_[x]->allocate();
+      shipFiredTorpedo->time = torpedo->fireTime;
+      shipFiredTorpedo->shipIndex = firingShipIndex;
+      shipFiredTorpedo->shipX = firingShip->x;
+      shipFiredTorpedo->shipY = firingShip->y;
     }
   }
 }
 
-HitByShip** SensorHandler::getHitByShips(int teamIndex) {
-  return hitByShips_[teamIndex];
+HitByShip* SensorHandler::getHitByShips(int teamIndex) {
+  return (HitByShip *) hitByShips_[teamIndex]->getEvents();
 }
 
 int SensorHandler::numHitByShips(int teamIndex) {
-  return numHitByShips_[teamIndex];
-}
-
-void SensorHandler::clearHitByShips(int teamIndex) {
-  for (int x = 0; x < numHitByShips_[teamIndex]; x++) {
-    delete hitByShips_[teamIndex][x];
-  }
-  numHitByShips_[teamIndex] = 0;
+  return hitByShips_[teamIndex]->getNumEvents();
 }
 
-HitByLaser** SensorHandler::getHitByLasers(int teamIndex) {
-  return hitByLasers_[teamIndex];
+HitByLaser* SensorHandler::getHitByLasers(int teamIndex) {
+  return (HitByLaser *) hitByLasers_[teamIndex]->getEvents();
 }
 
 int SensorHandler::numHitByLasers(int teamIndex) {
-  return numHitByLasers_[teamIndex];
+  return hitByLasers_[teamIndex]->getNumEvents();
 }
 
-void SensorHandler::clearHitByLasers(int teamIndex) {
-  for (int x = 0; x < numHitByLasers_[teamIndex]; x++) {
-    delete hitByLasers_[teamIndex][x];
-  }
-  numHitByLasers_[teamIndex] = 0;
-}
-
-HitByTorpedo** SensorHandler::getHitByTorpedos(int teamIndex) {
-  return hitByTorpedos_[teamIndex];
+HitByTorpedo* SensorHandler::getHitByTorpedos(int teamIndex) {
+  return (HitByTorpedo *) hitByTorpedos_[teamIndex]->getEvents();
 }
 
 int SensorHandler::numHitByTorpedos(int teamIndex) {
-  return numHitByTorpedos_[teamIndex];
-}
-
-void SensorHandler::clearHitByTorpedos(int teamIndex) {
-  for (int x = 0; x < numHitByTorpedos_[teamIndex]; x++) {
-    delete hitByTorpedos_[teamIndex][x];
-  }
-  numHitByTorpedos_[teamIndex] = 0;
+  return hitByTorpedos_[teamIndex]->getNumEvents();
 }
 
-ShipHitWall** SensorHandler::getHitWalls(int teamIndex) {
-  return hitWalls_[teamIndex];
+ShipHitWall* SensorHandler::getHitWalls(int teamIndex) {
+  return (ShipHitWall *) hitWalls_[teamIndex]->getEvents();
 }
 
 int SensorHandler::numHitWalls(int teamIndex) {
-  return numHitWalls_[teamIndex];
-}
-
-void SensorHandler::clearHitWalls(int teamIndex) {
-  for (int x = 0; x < numHitWalls_[teamIndex]; x++) {
-    delete hitWalls_[teamIndex][x];
-  }
-  numHitWalls_[teamIndex] = 0;
+  return hitWalls_[teamIndex]->getNumEvents();
 }
 
-ShipDestroyed** SensorHandler::getShipDestroyeds(int teamIndex) {
-  return shipDestroyeds_[teamIndex];
+ShipDestroyed* SensorHandler::getShipDestroyeds(int teamIndex) {
+  return (ShipDestroyed *) shipDestroyeds_[teamIndex]->getEvents();
 }
 
 int SensorHandler::numShipDestroyeds(int teamIndex) {
-  return numShipDestroyeds_[teamIndex];
+  return shipDestroyeds_[teamIndex]->getNumEvents();
 }
 
-void SensorHandler::clearShipDestroyeds(int teamIndex) {
-  for (int x = 0; x < numShipDestroyeds_[teamIndex]; x++) {
-    delete shipDestroyeds_[teamIndex][x];
-  }
-  numShipDestroyeds_[teamIndex] = 0;
-}
-
-ShipFiredLaser** SensorHandler::getShipFiredLasers(int teamIndex) {
-  return shipFiredLasers_[teamIndex];
+ShipFiredLaser* SensorHandler::getShipFiredLasers(int teamIndex) {
+  return (ShipFiredLaser *) shipFiredLasers_[teamIndex]->getEvents();
 }
 
 int SensorHandler::numShipFiredLasers(int teamIndex) {
-  return numShipFiredLasers_[teamIndex];
-}
-
-void SensorHandler::clearShipFiredLasers(int teamIndex) {
-  for (int x = 0; x < numShipFiredLasers_[teamIndex]; x++) {
-    delete shipFiredLasers_[teamIndex][x];
-  }
-  numShipFiredLasers_[teamIndex] = 0;
+  return shipFiredLasers_[teamIndex]->getNumEvents();
 }
 
-ShipFiredTorpedo** SensorHandler::getShipFiredTorpedos(int teamIndex) {
-  return shipFiredTorpedos_[teamIndex];
+ShipFiredTorpedo* SensorHandler::getShipFiredTorpedos(int teamIndex) {
+  return (ShipFiredTorpedo *) shipFiredTorpedos_[teamIndex]->getEvents();
 }
 
 int SensorHandler::numShipFiredTorpedos(int teamIndex) {
-  return numShipFiredTorpedos_[teamIndex];
+  return shipFiredTorpedos_[teamIndex]->getNumEvents();
 }
 
-void SensorHandler::clearShipFiredTorpedos(int teamIndex) {
-  for (int x = 0; x < numShipFiredTorpedos_[teamIndex]; x++) {
-    delete shipFiredTorpedos_[teamIndex][x];
-  }
-  numShipFiredTorpedos_[teamIndex] = 0;
-}
-
-LaserHitShip** SensorHandler::getLaserHitShips(int teamIndex) {
-  return laserHitShips_[teamIndex];
+LaserHitShip* SensorHandler::getLaserHitShips(int teamIndex) {
+  return (LaserHitShip *) laserHitShips_[teamIndex]->getEvents();
 }
 
 int SensorHandler::numLaserHitShips(int teamIndex) {
-  return numLaserHitShips_[teamIndex];
+  return laserHitShips_[teamIndex]->getNumEvents();
 }
 
-void SensorHandler::clearLaserHitShips(int teamIndex) {
-  for (int x = 0; x < numLaserHitShips_[teamIndex]; x++) {
-    delete laserHitShips_[teamIndex][x];
-  }
-  numLaserHitShips_[teamIndex] = 0;
+void SensorHandler::clearTeamEvents(int teamIndex) {
+  hitByShips_[teamIndex]->reset();
+  hitByLasers_[teamIndex]->reset();
+  hitByTorpedos_[teamIndex]->reset();
+  hitWalls_[teamIndex]->reset();
+  shipDestroyeds_[teamIndex]->reset();
+  shipFiredLasers_[teamIndex]->reset();
+  shipFiredTorpedos_[teamIndex]->reset();
+  laserHitShips_[teamIndex]->reset();
 }
 
-ShipHitShip** SensorHandler::getStageShipHitShips() {
-  return stageShipHitShips_;
+ShipHitShip* SensorHandler::getStageShipHitShips() {
+  return (ShipHitShip *) stageShipHitShips_->getEvents();
 }
 
 int SensorHandler::numStageShipHitShips() {
-  return numStageShipHitShips_;
+  return stageShipHitShips_->getNumEvents();
 }
 
-void SensorHandler::clearStageShipHitShips() {
-  for (int x = 0; x < numStageShipHitShips_; x++) {
-    delete stageShipHitShips_[x];
-  }
-  numStageShipHitShips_ = 0;
-}
-
-StageLaserHitShip** SensorHandler::getStageLaserHitShips() {
-  return stageLaserHitShips_;
+StageLaserHitShip* SensorHandler::getStageLaserHitShips() {
+  return (StageLaserHitShip *) stageLaserHitShips_->getEvents();
 }
 
 int SensorHandler::numStageLaserHitShips() {
-  return numStageLaserHitShips_;
-}
-
-void SensorHandler::clearStageLaserHitShips() {
-  for (int x = 0; x < numStageLaserHitShips_; x++) {
-    delete stageLaserHitShips_[x];
-  }
-  numStageLaserHitShips_ = 0;
+  return stageLaserHitShips_->getNumEvents();
 }
 
-StageTorpedoHitShip** SensorHandler::getStageTorpedoHitShips() {
-  return stageTorpedoHitShips_;
+StageTorpedoHitShip* SensorHandler::getStageTorpedoHitShips() {
+  return (StageTorpedoHitShip *) stageTorpedoHitShips_->getEvents();
 }
 
 int SensorHandler::numStageTorpedoHitShips() {
-  return numStageTorpedoHitShips_;
+  return stageTorpedoHitShips_->getNumEvents();
 }
 
-void SensorHandler::clearStageTorpedoHitShips() {
-  for (int x = 0; x < numStageTorpedoHitShips_; x++) {
-    delete stageTorpedoHitShips_[x];
-  }
-  numStageTorpedoHitShips_ = 0;
-}
-
-ShipHitWall** SensorHandler::getStageShipHitWalls() {
-  return stageShipHitWalls_;
+ShipHitWall* SensorHandler::getStageShipHitWalls() {
+  return (ShipHitWall *) stageShipHitWalls_->getEvents();
 }
 
 int SensorHandler::numStageShipHitWalls() {
-  return numStageShipHitWalls_;
-}
-
-void SensorHandler::clearStageShipHitWalls() {
-  for (int x = 0; x < numStageShipHitWalls_; x++) {
-    delete stageShipHitWalls_[x];
-  }
-  numStageShipHitWalls_ = 0;
+  return stageShipHitWalls_->getNumEvents();
 }
 
-ShipDestroyed** SensorHandler::getStageShipDestroyeds() {
-  return stageShipDestroyeds_;
+ShipDestroyed* SensorHandler::getStageShipDestroyeds() {
+  return (ShipDestroyed *) stageShipDestroyeds_->getEvents();
 }
 
 int SensorHandler::numStageShipDestroyeds() {
-  return numStageShipDestroyeds_;
-}
-
-void SensorHandler::clearStageShipDestroyeds() {
-  for (int x = 0; x < numStageShipDestroyeds_; x++) {
-    delete stageShipDestroyeds_[x];
-  }
-  numStageShipDestroyeds_ = 0;
+  return stageShipDestroyeds_->getNumEvents();
 }
 
-StageShipFiredLaser** SensorHandler::getStageShipFiredLasers() {
-  return stageShipFiredLasers_;
+StageShipFiredLaser* SensorHandler::getStageShipFiredLasers() {
+  return (StageShipFiredLaser *) stageShipFiredLasers_->getEvents();
 }
 
 int SensorHandler::numStageShipFiredLasers() {
-  return numStageShipFiredLasers_;
+  return stageShipFiredLasers_->getNumEvents();
 }
 
-void SensorHandler::clearStageShipFiredLasers() {
-  for (int x = 0; x < numStageShipFiredLasers_; x++) {
-    delete stageShipFiredLasers_[x];
-  }
-  numStageShipFiredLasers_ = 0;
-}
-
-StageShipFiredTorpedo** SensorHandler::getStageShipFiredTorpedos() {
-  return stageShipFiredTorpedos_;
+StageShipFiredTorpedo* SensorHandler::getStageShipFiredTorpedos() {
+  return (StageShipFiredTorpedo *) stageShipFiredTorpedos_->getEvents();
 }
 
 int SensorHandler::numStageShipFiredTorpedos() {
-  return numStageShipFiredTorpedos_;
+  return stageShipFiredTorpedos_->getNumEvents();
 }
 
-void SensorHandler::clearStageShipFiredTorpedos() {
-  for (int x = 0; x < numStageShipFiredTorpedos_; x++) {
-    delete stageShipFiredTorpedos_[x];
-  }
-  numStageShipFiredTorpedos_ = 0;
+void SensorHandler::clearStageEvents() {
+  stageShipHitShips_->reset();
+  stageLaserHitShips_->reset();
+  stageTorpedoHitShips_->reset();
+  stageShipHitWalls_->reset();
+  stageShipDestroyeds_->reset();
+  stageShipFiredLasers_->reset();
+  stageShipFiredTorpedos_->reset();
 }
 
 SensorHandler::~SensorHandler() {
   for (int x = 0; x < numTeams_; x++) {
-    for (int y = 0; y < numHitByShips_[x]; y++) {
-      delete hitByShips_[x][y];
-    }
     delete hitByShips_[x];
   }
   delete hitByShips_;
 
   for (int x = 0; x < numTeams_; x++) {
-    for (int y = 0; y < numHitByLasers_[x]; y++) {
-      delete hitByLasers_[x][y];
-    }
     delete hitByLasers_[x];
   }
   delete hitByLasers_;
 
   for (int x = 0; x < numTeams_; x++) {
-    for (int y = 0; y < numHitByTorpedos_[x]; y++) {
-      delete hitByTorpedos_[x][y];
-    }
     delete hitByTorpedos_[x];
   }
   delete hitByTorpedos_;
 
   for (int x = 0; x < numTeams_; x++) {
-    for (int y = 0; y < numHitWalls_[x]; y++) {
-      delete hitWalls_[x][y];
-    }
     delete hitWalls_[x];
   }
   delete hitWalls_;
 
   for (int x = 0; x < numTeams_; x++) {
-    for (int y = 0; y < numShipDestroyeds_[x]; y++) {
-      delete shipDestroyeds_[x][y];
-    }
     delete shipDestroyeds_[x];
   }
   delete shipDestroyeds_;
 
   for (int x = 0; x < numTeams_; x++) {
-    for (int y = 0; y < numShipFiredLasers_[x]; y++) {
-      delete shipFiredLasers_[x][y];
-    }
     delete shipFiredLasers_[x];
   }
   delete shipFiredLasers_;
 
   for (int x = 0; x < numTeams_; x++) {
-    for (int y = 0; y < numShipFiredTorpedos_[x]; y++) {
-      delete shipFiredTorpedos_[x][y];
-    }
     delete shipFiredTorpedos_[x];
   }
   delete shipFiredTorpedos_;
 
   for (int x = 0; x < numTeams_; x++) {
-    for (int y = 0; y < numLaserHitShips_[x]; y++) {
-      delete laserHitShips_[x][y];
-    }
     delete laserHitShips_[x];
   }
   delete laserHitShips_;
 
-  for (int x = 0; x < numStageShipHitShips_; x++) {
-    delete stageShipHitShips_[x];
-  }
-
-  for (int x = 0; x < numStageLaserHitShips_; x++) {
-    delete stageLaserHitShips_[x];
-  }
-
-  for (int x = 0; x < numStageTorpedoHitShips_; x++) {
-    delete stageTorpedoHitShips_[x];
-  }
-
-  for (int x = 0; x < numStageShipHitWalls_; x++) {
-    delete stageShipHitWalls_[x];
-  }
-
-  for (int x = 0; x < numStageShipFiredLasers_; x++) {
-    delete stageShipFiredLasers_[x];
-  }
-
-  for (int x = 0; x < numStageShipFiredTorpedos_; x++) {
-    delete stageShipFiredTorpedos_[x];
-  }
-
-  delete numHitByShips_;
-  delete numHitByLasers_;
-  delete numHitByTorpedos_;
-  delete numHitWalls_;
-  delete numShipDestroyeds_;
-  delete numShipFiredLasers_;
-  delete numShipFiredTorpedos_;
-  delete numLaserHitShips_;
+  delete stageShipHitShips_;
+  delete stageLaserHitShips_;
+  delete stageTorpedoHitShips_;
+  delete stageShipHitWalls_;
+  delete stageShipDestroyeds_;
+  delete stageShipFiredLasers_;
+  delete stageShipFiredTorpedos_;
 }
@@ -23,18 +23,7 @@
 
 #include "bbutil.h"
 #include "eventhandler.h"
-
-#define MAX_HIT_BY_SHIPS         32
-#define MAX_HIT_BY_LASERS        1024
-#define MAX_HIT_BY_TORPEDOS      1024
-#define MAX_HIT_WALLS            4
-#define MAX_SHIP_DESTROYEDS      1024
-#define MAX_SHIP_HIT_SHIPS       4096
-#define MAX_LASER_HIT_SHIPS      4096
-#define MAX_TORPEDO_HIT_SHIPS    4096
-#define MAX_SHIP_HIT_WALLS       4096
-#define MAX_SHIP_FIRED_LASERS    2048
-#define MAX_SHIP_FIRED_TORPEDOS  2048
+#include "eventarena.h"
 
 typedef struct {
   int time;
@@ -157,39 +146,24 @@ class SensorHandler : public EventHandler {
   int numTeams_;
   bool** teamVision_;
 
-  // Events for the ships.
-  HitByShip*** hitByShips_;
-  int* numHitByShips_;
-  HitByLaser*** hitByLasers_;
-  int *numHitByLasers_;
-  HitByTorpedo*** hitByTorpedos_;
-  int *numHitByTorpedos_;
-  ShipHitWall*** hitWalls_;
-  int *numHitWalls_;
-  ShipDestroyed*** shipDestroyeds_;
-  int *numShipDestroyeds_;
-  ShipFiredLaser*** shipFiredLasers_;
-  int *numShipFiredLasers_;
-  ShipFiredTorpedo*** shipFiredTorpedos_;
-  int *numShipFiredTorpedos_;
-  LaserHitShip*** laserHitShips_;
-  int *numLaserHitShips_;
+  // Events for the ships, one arena per team for each type of event.
+  EventArena **hitByShips_;
+  EventArena **hitByLasers_;
+  EventArena **hitByTorpedos_;
+  EventArena **hitWalls_;
+  EventArena **shipDestroyeds_;
+  EventArena **shipFiredLasers_;
+  EventArena **shipFiredTorpedos_;
+  EventArena **laserHitShips_;
 
   // Events for the stage.
-  ShipHitShip* stageShipHitShips_[MAX_SHIP_HIT_SHIPS];
-  int numStageShipHitShips_;
-  StageLaserHitShip* stageLaserHitShips_[MAX_LASER_HIT_SHIPS];
-  int numStageLaserHitShips_;
-  StageTorpedoHitShip* stageTorpedoHitShips_[MAX_TORPEDO_HIT_SHIPS];
-  int numStageTorpedoHitShips_;
-  ShipHitWall* stageShipHitWalls_[MAX_SHIP_HIT_WALLS];
-  int numStageShipHitWalls_;
-  ShipDestroyed* stageShipDestroyeds_[MAX_SHIP_DESTROYEDS];
-  int numStageShipDestroyeds_;
-  StageShipFiredLaser* stageShipFiredLasers_[MAX_SHIP_FIRED_LASERS];
-  int numStageShipFiredLasers_;
-  StageShipFiredTorpedo* stageShipFiredTorpedos_[MAX_SHIP_FIRED_TORPEDOS];
-  int numStageShipFiredTorpedos_;
+  EventArena *stageShipHitShips_;
+  EventArena *stageLaserHitShips_;
+  EventArena *stageTorpedoHitShips_;
+  EventArena *stageShipHitWalls_;
+  EventArena *stageShipDestroyeds_;
+  EventArena *stageShipFiredLasers_;
+  EventArena *stageShipFiredTorpedos_;
 
   public:
     SensorHandler(Team **teams, int numTeams, bool **teamVision);
@@ -218,53 +192,40 @@ class SensorHandler : public EventHandler {
     virtual void tooManyUserGfxTexts(Team *team) {};
 
     // Events for the ships.
-    HitByShip** getHitByShips(int teamIndex);
+    HitByShip* getHitByShips(int teamIndex);
     int numHitByShips(int teamIndex);
-    void clearHitByShips(int teamIndex);
-    HitByLaser** getHitByLasers(int teamIndex);
+    HitByLaser* getHitByLasers(int teamIndex);
     int numHitByLasers(int teamIndex);
-    void clearHitByLasers(int teamIndex);
-    HitByTorpedo** getHitByTorpedos(int teamIndex);
+    HitByTorpedo* getHitByTorpedos(int teamIndex);
     int numHitByTorpedos(int teamIndex);
-    void clearHitByTorpedos(int teamIndex);
-    ShipHitWall** getHitWalls(int teamIndex);
+    ShipHitWall* getHitWalls(int teamIndex);
     int numHitWalls(int teamIndex);
-    void clearHitWalls(int teamIndex);
-    ShipDestroyed** getShipDestroyeds(int teamIndex);
+    ShipDestroyed* getShipDestroyeds(int teamIndex);
     int numShipDestroyeds(int teamIndex);
-    void clearShipDestroyeds(int teamIndex);
-    ShipFiredLaser** getShipFiredLasers(int teamIndex);
+    ShipFiredLaser* getShipFiredLasers(int teamIndex);
     int numShipFiredLasers(int teamIndex);
-    void clearShipFiredLasers(int teamIndex);
-    ShipFiredTorpedo** getShipFiredTorpedos(int teamIndex);
+    ShipFiredTorpedo* getShipFiredTorpedos(int teamIndex);
     int numShipFiredTorpedos(int teamIndex);
-    void clearShipFiredTorpedos(int teamIndex);
-    LaserHitShip** getLaserHitShips(int teamIndex);
+    LaserHitShip* getLaserHitShips(int teamIndex);
     int numLaserHitShips(int teamIndex);
-    void clearLaserHitShips(int teamIndex);
+    void clearTeamEvents(int teamIndex);
 
     // Events for the stage.
-    ShipHitShip** getStageShipHitShips();
+    ShipHitShip* getStageShipHitShips();
     int numStageShipHitShips();
-    void clearStageShipHitShips();
-    StageLaserHitShip** getStageLaserHitShips();
+    StageLaserHitShip* getStageLaserHitShips();
     int numStageLaserHitShips();
-    void clearStageLaserHitShips();
-    StageTorpedoHitShip** getStageTorpedoHitShips();
+    StageTorpedoHitShip* getStageTorpedoHitShips();
     int numStageTorpedoHitShips();
-    void clearStageTorpedoHitShips();
-    ShipHitWall** getStageShipHitWalls();
+    ShipHitWall* getStageShipHitWalls();
     int numStageShipHitWalls();
-    void clearStageShipHitWalls();
-    ShipDestroyed** getStageShipDestroyeds();
+    ShipDestroyed* getStageShipDestroyeds();
     int numStageShipDestroyeds();
-    void clearStageShipDestroyeds();
-    StageShipFiredLaser** getStageShipFiredLasers();
+    StageShipFiredLaser* getStageShipFiredLasers();
     int numStageShipFiredLasers();
-    void clearStageShipFiredLasers();
-    StageShipFiredTorpedo** getStageShipFiredTorpedos();
+    StageShipFiredTorpedo* getStageShipFiredTorpedos();
     int numStageShipFiredTorpedos();
-    void clearStageShipFiredTorpedos();
+    void clearStageEvents();
 };
 
 #endif
@@ -0,0 +1,228 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "bbconst.h"
+#include "bbutil.h"
+#include "shipkinematics.h"
+
+ShipKinematics::ShipKinematics() {
+  capacity_ = 0;
+  numShips_ = 0;
+  shipIndex_ = 0;
+  x_ = y_ = vx_ = vy_ = px_ = py_ = fx_ = fy_ = 0;
+  nextVx_ = nextVy_ = nextPx_ = nextPy_ = 0;
+  allocations_ = 0;
+}
+
+void ShipKinematics::reserve(int capacity) {
+  if (capacity <= capacity_) {
+    return;
+  }
+  freeArrays();
+  capacity_ = capacity;
+  shipIndex_ = new int[capacity_];
+  x_ = new double[capacity_];
+  y_ = new double[capacity_];
+  vx_ = new double[capacity_];
+  vy_ = new double[capacity_];
+  px_ = new double[capacity_];
+  py_ = new double[capacity_];
+  fx_ = new double[capacity_];
+  fy_ = new double[capacity_];
+  nextVx_ = new double[capacity_];
+  nextVy_ = new double[capacity_];
+  nextPx_ = new double[capacity_];
+  nextPy_ = new double[capacity_];
+  allocations_ += 13;
+  numShips_ = 0;
+}
+
+// Total number of heap allocations, so callers can check they've stopped.
+int ShipKinematics::getAllocations() {
+  return allocations_;
+}
+
+void ShipKinematics::clear() {
+  numShips_ = 0;
+}
+
+int ShipKinematics::getNumShips() {
+  return numShips_;
+}
+
+int ShipKinematics::getShipIndex(int slot) {
+  return shipIndex_[slot];
+}
+
+void ShipKinematics::load(int shipIndex, double *coords) {
+  int slot = numShips_++;
+  shipIndex_[slot] = shipIndex;
+  x_[slot] = coords[0];
+  y_[slot] = coords[1];
+  vx_[slot] = coords[2];
+  vy_[slot] = coords[3];
+  px_[slot] = coords[4];
+  py_[slot] = coords[5];
+  fx_[slot] = coords[6];
+  fy_[slot] = coords[7];
+}
+
+void ShipKinematics::store(int slot, double *coords) {
+  coords[0] = x_[slot];
+  coords[1] = y_[slot];
+  coords[2] = vx_[slot];
+  coords[3] = vy_[slot];
+  coords[4] = px_[slot];
+  coords[5] = py_[slot];
+}
+
+// Same math as nonRelPushFun, in the same order, so results are bit for bit
+// identical to pushing each ship on its own.
+void ShipKinematics::pushNonRel(double dt) {
+  int slot = 0;
+  double dtSq = square(dt);
+#ifdef __SSE2__
+  __m128d vdt = _mm_set1_pd(dt);
+  __m128d vdtSq = _mm_set1_pd(dtSq);
+  __m128d vhalf = _mm_set1_pd(0.5);
+  for (; slot + 2 <= numShips_; slot += 2) {
+    __m128d fx = _mm_loadu_pd(&fx_[slot]);
+    __m128d fy = _mm_loadu_pd(&fy_[slot]);
+    __m128d px = _mm_loadu_pd(&px_[slot]);
+    __m128d py = _mm_loadu_pd(&py_[slot]);
+    __m128d x = _mm_add_pd(_mm_loadu_pd(&x_[slot]), _mm_mul_pd(px, vdt));
+    __m128d y = _mm_add_pd(_mm_loadu_pd(&y_[slot]), _mm_mul_pd(py, vdt));
+    x = _mm_add_pd(x, _mm_mul_pd(_mm_mul_pd(vhalf, fx), vdtSq));
+    y = _mm_add_pd(y, _mm_mul_pd(_mm_mul_pd(vhalf, fy), vdtSq));
+    __m128d dvx = _mm_mul_pd(fx, vdt);
+    __m128d dvy = _mm_mul_pd(fy, vdt);
+    _mm_storeu_pd(&x_[slot], x);
+    _mm_storeu_pd(&y_[slot], y);
+    _mm_storeu_pd(&vx_[slot], _mm_add_pd(_mm_loadu_pd(&vx_[slot]), dvx));
+    _mm_storeu_pd(&vy_[slot], _mm_add_pd(_mm_loadu_pd(&vy_[slot]), dvy));
+    _mm_storeu_pd(&px_[slot], _mm_add_pd(px, dvx));
+    _mm_storeu_pd(&py_[slot], _mm_add_pd(py, dvy));
+  }
+#endif
+  for (; slot < numShips_; slot++) {
+    x_[slot] = x_[slot] + px_[slot]*dt + 0.5*fx_[slot]*dtSq;
+    y_[slot] = y_[slot] + py_[slot]*dt + 0.5*fy_[slot]*dtSq;
+    vx_[slot] = vx_[slot] + fx_[slot]*dt;
+    vy_[slot] = vy_[slot] + fy_[slot]*dt;
+    px_[slot] = px_[slot] + fx_[slot]*dt;
+    py_[slot] = py_[slot] + fy_[slot]*dt;
+  }
+}
+
+// Same math as relPushFun. The new momentum and velocity only need
+// arithmetic and square roots, so they're done in a vectorized first pass. The
+// positions need log and pow, which have no vector equivalent we can count on
+// to give the same results, so they're done per ship in a second pass.
+void ShipKinematics::pushRel(double dt) {
+  int slot = 0;
+  double cSq = square(SPEED_OF_LIGHT);
+#ifdef __SSE2__
+  __m128d vdt = _mm_set1_pd(dt);
+  __m128d vcSq = _mm_set1_pd(cSq);
+  __m128d vone = _mm_set1_pd(1.);
+  for (; slot + 2 <= numShips_; slot += 2) {
+    __m128d px = _mm_add_pd(_mm_loadu_pd(&px_[slot]),
+                            _mm_mul_pd(_mm_loadu_pd(&fx_[slot]), vdt));
+    __m128d py = _mm_add_pd(_mm_loadu_pd(&py_[slot]),
+                            _mm_mul_pd(_mm_loadu_pd(&fy_[slot]), vdt));
+    __m128d pSq = _mm_add_pd(_mm_mul_pd(px, px), _mm_mul_pd(py, py));
+    __m128d gamma = _mm_sqrt_pd(_mm_add_pd(vone, _mm_div_pd(pSq, vcSq)));
+    _mm_storeu_pd(&nextPx_[slot], px);
+    _mm_storeu_pd(&nextPy_[slot], py);
+    _mm_storeu_pd(&nextVx_[slot], _mm_div_pd(px, gamma));
+    _mm_storeu_pd(&nextVy_[slot], _mm_div_pd(py, gamma));
+  }
+#endif
+  for (; slot < numShips_; slot++) {
+    double px = px_[slot] + fx_[slot]*dt;
+    double py = py_[slot] + fy_[slot]*dt;
+    double gamma = sqrt(1 + (square(px) + square(py))/cSq);
+    nextPx_[slot] = px;
+    nextPy_[slot] = py;
+    nextVx_[slot] = px/gamma;
+    nextVy_[slot] = py/gamma;
+  }
+
+  for (slot = 0; slot < numShips_; slot++) {
+    double fx = fx_[slot];
+    double fy = fy_[slot];
+    double fmag = sqrt(square(fx) + square(fy));
+    if (fmag > DEFAULT_EPS) {
+      double px0 = px_[slot];
+      double py0 = py_[slot];
+      double pxT = nextPx_[slot];
+      double pyT = nextPy_[slot];
+      double p0Sq = square(px0) + square(py0);
+      double pTSq = square(pxT) + square(pyT);
+      double root0 = fmag*sqrt(cSq + p0Sq);
+      double rootT = fmag*sqrt(cSq + pTSq);
+      double fac = SPEED_OF_LIGHT/pow(fmag,3);
+      double p0f = px0*fx + py0*fy;
+      double pTf = pxT*fx + pyT*fy;
+      double p0Cf = px0*fy - py0*fx;
+      double term0 = p0Cf*log(p0f + root0);
+      double termT = p0Cf*log(pTf + rootT);
+      x_[slot] = x_[slot] + fac*(fx*(rootT-root0) + fy*(termT-term0));
+      y_[slot] = y_[slot] + fac*(fy*(rootT-root0) - fx*(termT-term0));
+    } else {
+      x_[slot] = x_[slot] + vx_[slot]*dt;
+      y_[slot] = y_[slot] + vy_[slot]*dt;
+    }
+  }
+
+  double *swap;
+  swap = px_; px_ = nextPx_; nextPx_ = swap;
+  swap = py_; py_ = nextPy_; nextPy_ = swap;
+  swap = vx_; vx_ = nextVx_; nextVx_ = swap;
+  swap = vy_; vy_ = nextVy_; nextVy_ = swap;
+}
+
+void ShipKinematics::freeArrays() {
+  if (capacity_ > 0) {
+    delete[] shipIndex_;
+    delete[] x_;
+    delete[] y_;
+    delete[] vx_;
+    delete[] vy_;
+    delete[] px_;
+    delete[] py_;
+    delete[] fx_;
+    delete[] fy_;
+    delete[] nextVx_;
+    delete[] nextVy_;
+    delete[] nextPx_;
+    delete[] nextPy_;
+    capacity_ = 0;
+  }
+}
+
+ShipKinematics::~ShipKinematics() {
+  freeArrays();
+}
@@ -0,0 +1,58 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef SHIP_KINEMATICS_H
+#define SHIP_KINEMATICS_H
+
+// Structure of arrays copy of the kinematic state of the ships that are moving
+// during a collision sub-step, so pushing them all forward is a tight loop over
+// contiguous doubles instead of a call through a function pointer per ship.
+// Each slot maps back to a ship index, and load/store convert to and from the
+// coords layout used by ShipMoveData (x, y, vx, vy, px, py, fx, fy).
+class ShipKinematics {
+  int capacity_;
+  int numShips_;
+  int *shipIndex_;
+  double *x_, *y_;
+  double *vx_, *vy_;
+  double *px_, *py_;
+  double *fx_, *fy_;
+  double *nextVx_, *nextVy_;
+  double *nextPx_, *nextPy_;
+  int allocations_;
+
+  public:
+    ShipKinematics();
+    ~ShipKinematics();
+    void reserve(int capacity);
+    int getAllocations();
+    void clear();
+    int getNumShips();
+    int getShipIndex(int slot);
+    void load(int shipIndex, double *coords);
+    void store(int slot, double *coords);
+    void pushNonRel(double dt);
+    void pushRel(double dt);
+  private:
+    void freeArrays();
+};
+
+#endif
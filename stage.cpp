@@ -35,10 +35,13 @@
 #include "circle2d.h"
 #include "point2d.h"
 #include "line2d.h"
+#include "linegrid.h"
+#include "sweepprune.h"
 #include "filemanager.h"
 
-Stage::Stage(int width, int height) {
+Stage::Stage(int width, int height, RandomGenerator *random) {
   name_ = 0;
+  random_ = random;
   setSize(width, height);
   numWalls_ = 0;
   numWallLines_ = 0;
@@ -51,6 +54,16 @@ Stage::Stage(int width, int height) {
   for (int x = 0; x < 4; x++) {
     baseWallLines_[x] = 0;
   }
+  wallGrid_ = innerWallGrid_ = 0;
+  shipSweep_ = new SweepAndPrune();
+  shipKinematics_ = new ShipKinematics();
+  wallRootFinder_ = new BatchRootFinder();
+  wallCandidates_ = 0;
+  wallCandidateTimes_ = 0;
+  wallCandidateStatus_ = 0;
+  numWallCandidates_ = wallCandidatesCapacity_ = 0;
+  numScratchShips_ = 0;
+  tickAllocations_ = 0;
   teams_ = 0;
   numTeams_ = 0;
   ships_ = 0;
@@ -65,6 +78,7 @@ Stage::Stage(int width, int height) {
   numGfxCircles_ = 0;
   numGfxTexts_ = 0;
   userGfxDisabled_ = false;
+  deferUserGfxOverflows_ = false;
   nextLaserId_ = nextTorpedoId_ = 0;
 }
 
@@ -108,6 +122,23 @@ int Stage::buildBaseWalls() {
       wallLines_[numWallLines_++] = new Line2D(width_, height_, 0, height_);
   baseWallLines_[3] =
       wallLines_[numWallLines_++] = new Line2D(0, height_, 0, 0);
+
+  // The stage size is final by now, so index all wall lines for collisions
+  // and line of sight.
+  if (wallGrid_ != 0) {
+    delete wallGrid_;
+    delete innerWallGrid_;
+  }
+  wallGrid_ = new LineGrid(-SHIP_SIZE, -SHIP_SIZE, width_ + (2 * SHIP_SIZE),
+                           height_ + (2 * SHIP_SIZE), MAX_WALLS * 4);
+  for (int x = 0; x < numWallLines_; x++) {
+    wallGrid_->addLine(x, wallLines_[x]);
+  }
+  innerWallGrid_ = new LineGrid(-SHIP_SIZE, -SHIP_SIZE,
+      width_ + (2 * SHIP_SIZE), height_ + (2 * SHIP_SIZE), MAX_WALLS * 4);
+  for (int x = 0; x < numInnerWallLines_; x++) {
+    innerWallGrid_->addLine(x, innerWallLines_[x]);
+  }
   return i;
 }
 
@@ -121,8 +152,15 @@ int Stage::addWall(
     if (addWallLines) {
       Line2D** wallLines = wall->getLines();
       for (int x = 0; x < 4; x++) {
+        if (wallGrid_ != 0) {
+          wallGrid_->addLine(numWallLines_, wallLines[x]);
+          innerWallGrid_->addLine(numInnerWallLines_, wallLines[x]);
+        }
         innerWallLines_[numInnerWallLines_++] =
             wallLines_[numWallLines_++] = wallLines[x];
+        // Build the inverse now instead of lazily, so line of sight checks
+        // from parallel team runs never have to modify the wall line.
+        wallLines[x]->getInverse();
       }
     }
     return 1;
@@ -239,8 +277,8 @@ int Stage::addStart(double x, double y) {
 Point2D* Stage::getStart() {
   double x, y;
   if (startIndex_ >= numStarts_) {
-    x = SHIP_RADIUS + (rand() % (width_ - SHIP_SIZE));
-    y = SHIP_RADIUS + (rand() % (height_ - SHIP_SIZE));
+    x = SHIP_RADIUS + (random_->next() % (width_ - SHIP_SIZE));
+    y = SHIP_RADIUS + (random_->next() % (height_ - SHIP_SIZE));
   } else {
     Point2D *p = starts_[startIndex_++];
     x = p->getX();
@@ -248,9 +286,9 @@ Point2D* Stage::getStart() {
   }
 
   while (isShipInWall(x, y)) {
-    x = limit(SHIP_RADIUS, x + (rand() % SHIP_SIZE) - SHIP_RADIUS,
+    x = limit(SHIP_RADIUS, x + (random_->next() % SHIP_SIZE) - SHIP_RADIUS,
         width_ - SHIP_RADIUS);
-    y = limit(SHIP_RADIUS, y + (rand() % SHIP_SIZE) - SHIP_RADIUS,
+    y = limit(SHIP_RADIUS, y + (random_->next() % SHIP_SIZE) - SHIP_RADIUS,
         height_ - SHIP_RADIUS);
   }
   return new Point2D(x, y);
@@ -393,6 +431,55 @@ void Stage::clearStaleUserGfxs(int gameTime) {
   clearStaleUserGfxTexts(gameTime);
 }
 
+// While teams run in parallel, the event handlers aren't safe to call from the
+// workers, so a team's overflows are just noted on the team. The engine
+// reports them with reportUserGfxOverflows once the team is done.
+void Stage::setDeferUserGfxOverflows(bool defer) {
+  deferUserGfxOverflows_ = defer;
+}
+
+void Stage::reportUserGfxOverflows(Team *team) {
+  int overflows = team->userGfxOverflows;
+  team->userGfxOverflows = 0;
+  for (int z = 0; z < numEventHandlers_; z++) {
+    if (overflows & USER_GFX_RECTANGLES) {
+      eventHandlers_[z]->tooManyUserGfxRectangles(team);
+    }
+    if (overflows & USER_GFX_LINES) {
+      eventHandlers_[z]->tooManyUserGfxLines(team);
+    }
+    if (overflows & USER_GFX_CIRCLES) {
+      eventHandlers_[z]->tooManyUserGfxCircles(team);
+    }
+    if (overflows & USER_GFX_TEXTS) {
+      eventHandlers_[z]->tooManyUserGfxTexts(team);
+    }
+  }
+}
+
+void Stage::userGfxOverflow(Team *team, int gfxType) {
+  if (team != 0 && deferUserGfxOverflows_) {
+    team->userGfxOverflows |= gfxType;
+    return;
+  }
+  for (int z = 0; z < numEventHandlers_; z++) {
+    switch (gfxType) {
+      case USER_GFX_RECTANGLES:
+        eventHandlers_[z]->tooManyUserGfxRectangles(team);
+        break;
+      case USER_GFX_LINES:
+        eventHandlers_[z]->tooManyUserGfxLines(team);
+        break;
+      case USER_GFX_CIRCLES:
+        eventHandlers_[z]->tooManyUserGfxCircles(team);
+        break;
+      case USER_GFX_TEXTS:
+        eventHandlers_[z]->tooManyUserGfxTexts(team);
+        break;
+    }
+  }
+}
+
 int Stage::addUserGfxRectangle(Team *team, int gameTime, double left,
     double bottom, double width, double height, double rotation,
     RgbaColor fillColor, double outlineThickness, RgbaColor outlineColor,
@@ -401,9 +488,7 @@ int Stage::addUserGfxRectangle(Team *team, int gameTime, double left,
     return 0;
   } else if ((team == 0 ? numGfxRectangles_ : team->numRectangles)
              >= MAX_USER_RECTANGLES) {
-    for (int z = 0; z < numEventHandlers_; z++) {
-      eventHandlers_[z]->tooManyUserGfxRectangles(team);
-    }
+    userGfxOverflow(team, USER_GFX_RECTANGLES);
     return 0;
   } else {
     UserGfxRectangle *rectangle = new UserGfxRectangle;
@@ -481,9 +566,7 @@ int Stage::addUserGfxLine(Team *team, int gameTime, double x, double y,
   if (userGfxDisabled_) {
     return 0;
   } else if ((team == 0 ? numGfxLines_ : team->numLines) >= MAX_USER_LINES) {
-    for (int z = 0; z < numEventHandlers_; z++) {
-      eventHandlers_[z]->tooManyUserGfxLines(team);
-    }
+    userGfxOverflow(team, USER_GFX_LINES);
     return 0;
   } else {
     UserGfxLine *line = new UserGfxLine;
@@ -560,9 +643,7 @@ int Stage::addUserGfxCircle(Team *team, int gameTime, double x, double y,
     return 0;
   } else if ((team == 0 ? numGfxCircles_ : team->numCircles)
              >= MAX_USER_CIRCLES) {
-    for (int z = 0; z < numEventHandlers_; z++) {
-      eventHandlers_[z]->tooManyUserGfxCircles(team);
-    }
+    userGfxOverflow(team, USER_GFX_CIRCLES);
     return 0;
   } else {
     UserGfxCircle *circle = new UserGfxCircle;
@@ -636,9 +717,7 @@ int Stage::addUserGfxText(Team *team, int gameTime, const char *text,
   if (userGfxDisabled_) {
     return 0;
   } else if ((team == 0 ? numGfxTexts_ : team->numTexts) >= MAX_USER_TEXTS) {
-    for (int z = 0; z < numEventHandlers_; z++) {
-      eventHandlers_[z]->tooManyUserGfxTexts(team);
-    }
+    userGfxOverflow(team, USER_GFX_TEXTS);
     return 0;
   } else {
     UserGfxText *userText = new UserGfxText;
@@ -737,138 +816,273 @@ void Stage::setShipShipCollDamage(bool shipShipCollDamage) {
   shipShipCollDamage_ = shipShipCollDamage;
 }
 
-double Stage::timeToFirstShipWallCollision(
+void Stage::timeToFirstShipWallCollision(
     Ship **ships, ShipMoveData *shipData, int numShips, double *timeToFirstEvent,
     int *indexShipWallFirstCollided, int *indexWallShipFirstCollided, 
     int *wallEndpoint, int *typeFirstEvent) {
-  
-  WallEndpointRootStruct wers;
-  WallRootStruct wrs;
-  wers.pushFun = pushFun_;
-  wrs.pushFun = pushFun_;
 
+  // First find every wall endpoint and wall middle the ships might hit, in the
+  // order we want to break ties in.
+  numWallCandidates_ = 0;
   for (int ii = 0; ii < numShips; ii++) {
     if (ships[ii]->alive) {
       ShipMoveData *smd = &(shipData[ii]);
-      double coordsT[6];
-      pushFun_(*timeToFirstEvent, smd->coords, coordsT);
-      smd->nextCirc->setPosition(coordsT[0], coordsT[1]);
-      for (int jj = 0; jj < numWallLines_; jj++) {
-        Line2D* wall = wallLines_[jj];
-        // Check end points first
-        if (smd->nextCirc->contains(wall->x1(), wall->y1())) { 
-          wers.smd = smd; 
-          wers.xp = wall->x1();
-          wers.yp = wall->y1();
-          double tColl;
-          double tStart[2] = {0., *timeToFirstEvent};
-          int ret = newtonBisect(wallEndpointRootFun, tStart, &wers, &tColl, DEFAULT_EPS, DEFAULT_EPS);
-          if (ret != 1) {
-            std::cout << "wall endpoint 1 debug: " << ret << " " << tColl << "\n";
-          }
-          if (tColl < (*timeToFirstEvent)) {
-            *timeToFirstEvent = tColl;
-            *typeFirstEvent = 3;
-            *indexShipWallFirstCollided = ii;
-            *indexWallShipFirstCollided = jj;
-            *wallEndpoint = 1;
-            pushFun_(*timeToFirstEvent, smd->coords, coordsT);
-            smd->nextCirc->setPosition(coordsT[0], coordsT[1]);
-          }
-        } 
-        if (smd->nextCirc->contains(wall->x2(), wall->y2())) {
-          wers.smd = smd; 
-          wers.xp = wall->x2();
-          wers.yp = wall->y2();
-          double tColl;
-          double tStart[2] = {0., *timeToFirstEvent};
-          int ret = newtonBisect(wallEndpointRootFun, tStart, &wers, &tColl, DEFAULT_EPS, DEFAULT_EPS);
-          if (ret != 1) {
-            std::cout << "wall endpoint 2 debug: " << ret << " " << tColl << "\n";
-          }
-          if (tColl < (*timeToFirstEvent)) {
-            *timeToFirstEvent = tColl;
-            *typeFirstEvent = 3;
-            *indexShipWallFirstCollided = ii;
-            *indexWallShipFirstCollided = jj;
-            *wallEndpoint = 2;
-            pushFun_(*timeToFirstEvent, smd->coords, coordsT);
-            smd->nextCirc->setPosition(coordsT[0], coordsT[1]);
-          }
-        }
-        // Check for middle wall collision
-        // And we use line normal/signed distance to check from valid side, i.e.
-        // not with wrong side of thin walls
-        if (smd->nextCirc->intersects(wall) && 
-            wall->signedDistance(smd->nextCirc->h(), smd->nextCirc->k()) > 0.) {
-          wrs.smd = smd;
-          wrs.wall = wall;
-          double tColl;
-          double tStart[2] = {0., *timeToFirstEvent};          
-          int ret = newtonBisect(wallRootFun, tStart, &wrs, &tColl, DEFAULT_EPS, DEFAULT_EPS);
-          if (ret != 1) {
-            std::cout << "wall middle debug: " << ret << " " << tColl << "\n";
-          }
-          if (tColl < (*timeToFirstEvent)) { 
-            *timeToFirstEvent = tColl;
-            *typeFirstEvent = 0;
-            *indexShipWallFirstCollided = ii;
-            *indexWallShipFirstCollided = jj;
-            pushFun_(*timeToFirstEvent, smd->coords, coordsT);
-            smd->nextCirc->setPosition(coordsT[0], coordsT[1]);
+      setNextCirc(smd, *timeToFirstEvent);
+      if (relativistic_) {
+        relPushStart(smd->coords, &(smd->relStart));
+      }
+
+      // Only walls near the ship's path this sub-step can be hit.
+      double reach =
+          SHIP_RADIUS + maxMoveDistance(smd, *timeToFirstEvent);
+      int numNearWalls = wallGrid_->getLines(smd->coords[0] - reach,
+          smd->coords[1] - reach, smd->coords[0] + reach,
+          smd->coords[1] + reach, wallLineIndices_);
+      for (int kk = 0; kk < numNearWalls; kk++) {
+        int jj = wallLineIndices_[kk];
+        // Check end points first, then the middle of the wall.
+        for (int endpoint = 1; endpoint <= 3; endpoint++) {
+          WallCandidate *candidate =
+              newWallCandidate(smd, ii, jj, endpoint % 3);
+          if (wallCandidateInReach(candidate)) {
+            numWallCandidates_++;
           }
         }
       }
     }
   }
+
+  // Non-relativistic collision times are roots of low order polynomials, so we
+  // solve them directly, and can shrink the interval as we go. Relativistic
+  // ones need Newton's method on the push function, so we batch all of them
+  // into one solve over the whole interval, pushing each ship from its
+  // precomputed RelPushStart. Once an earlier collision shrinks the interval,
+  // the rest are solved again inside it, so each one is bracketed just like it
+  // would be on its own. Either way, a candidate with no sign change over the
+  // interval either can't collide before the current first event, or is
+  // already touching and collides right away.
+  double candidatesTime = *timeToFirstEvent;
+  if (relativistic_) {
+    wallRootFinder_->solve(relWallBatchRootFun, numWallCandidates_, 0.,
+        candidatesTime, wallCandidates_, wallCandidateTimes_,
+        wallCandidateStatus_, DEFAULT_EPS, DEFAULT_EPS);
+  }
+
+  // Once an earlier collision is found, the ship's position at that time has
+  // to be back in reach of the wall for a later candidate to count.
+  int currentShip = -1;
+  for (int x = 0; x < numWallCandidates_; x++) {
+    WallCandidate *candidate = &(wallCandidates_[x]);
+    ShipMoveData *smd = candidate->smd;
+    if (candidate->shipIndex != currentShip) {
+      currentShip = candidate->shipIndex;
+      if (*timeToFirstEvent < candidatesTime) {
+        setNextCirc(smd, *timeToFirstEvent);
+      }
+    }
+    if (!wallCandidateInReach(candidate)) {
+      continue;
+    }
+
+    double tColl;
+    int ret;
+    if (relativistic_ && *timeToFirstEvent < candidatesTime) {
+      wallRootFinder_->solve(relWallBatchRootFun, 1, 0., *timeToFirstEvent,
+          candidate, &tColl, &ret, DEFAULT_EPS, DEFAULT_EPS);
+    } else if (relativistic_) {
+      tColl = wallCandidateTimes_[x];
+      ret = wallCandidateStatus_[x];
+    } else if (candidate->wallEndpoint == 0) {
+      ret = nonRelWallCollisionTime(smd, candidate->wall, *timeToFirstEvent,
+                                    &tColl);
+    } else {
+      ret = nonRelWallEndpointCollisionTime(smd, candidate->xp, candidate->yp,
+                                            *timeToFirstEvent, &tColl);
+    }
+    if (ret == 0) {
+      std::cout << "wall debug: " << candidate->wallEndpoint << " " << ret
+                << " " << tColl << "\n";
+    }
+    if (tColl < (*timeToFirstEvent)) {
+      *timeToFirstEvent = tColl;
+      *typeFirstEvent = (candidate->wallEndpoint == 0 ? 0 : 3);
+      *indexShipWallFirstCollided = candidate->shipIndex;
+      *indexWallShipFirstCollided = candidate->wallIndex;
+      if (candidate->wallEndpoint != 0) {
+        *wallEndpoint = candidate->wallEndpoint;
+      }
+      setNextCirc(smd, *timeToFirstEvent);
+    }
+  }
+}
+
+void Stage::setNextCirc(ShipMoveData *smd, double dt) {
+  double coordsT[6];
+  pushFun_(dt, smd->coords, coordsT);
+  smd->nextCirc->setPosition(coordsT[0], coordsT[1]);
+}
+
+// Whether the ship's circle at the end of the sub-step touches the wall
+// endpoint, or crosses the middle of the wall from the front side (so not
+// from the wrong side of a thin wall).
+bool Stage::wallCandidateInReach(WallCandidate *candidate) {
+  Circle2D *nextCirc = candidate->smd->nextCirc;
+  if (candidate->wallEndpoint == 0) {
+    Line2D *wall = candidate->wall;
+    return nextCirc->intersects(wall)
+        && wall->signedDistance(nextCirc->h(), nextCirc->k()) > 0.;
+  } else {
+    return nextCirc->contains(candidate->xp, candidate->yp);
+  }
+}
+
+// Fills in the next free candidate slot, which only becomes part of the list
+// once the caller increments numWallCandidates_.
+WallCandidate* Stage::newWallCandidate(ShipMoveData *smd, int shipIndex,
+                                       int wallIndex, int wallEndpoint) {
+  if (numWallCandidates_ >= wallCandidatesCapacity_) {
+    int newCapacity = std::max(64, wallCandidatesCapacity_ * 2);
+    WallCandidate *newCandidates = new WallCandidate[newCapacity];
+    for (int x = 0; x < numWallCandidates_; x++) {
+      newCandidates[x] = wallCandidates_[x];
+    }
+    if (wallCandidatesCapacity_ > 0) {
+      delete[] wallCandidates_;
+      delete[] wallCandidateTimes_;
+      delete[] wallCandidateStatus_;
+    }
+    wallCandidates_ = newCandidates;
+    wallCandidateTimes_ = new double[newCapacity];
+    wallCandidateStatus_ = new int[newCapacity];
+    wallCandidatesCapacity_ = newCapacity;
+    tickAllocations_ += 3;
+  }
+  Line2D *wall = wallLines_[wallIndex];
+  WallCandidate *candidate = &(wallCandidates_[numWallCandidates_]);
+  candidate->smd = smd;
+  candidate->wall = wall;
+  candidate->shipIndex = shipIndex;
+  candidate->wallIndex = wallIndex;
+  candidate->wallEndpoint = wallEndpoint;
+  candidate->xp = (wallEndpoint == 2 ? wall->x2() : wall->x1());
+  candidate->yp = (wallEndpoint == 2 ? wall->y2() : wall->y1());
+  return candidate;
 }
       
-double Stage::timeToFirstShipShipCollision(
+void Stage::timeToFirstShipShipCollision(
     Ship **ships, ShipMoveData *shipData, int numShips, double *timeToFirstEvent,
     int *indexShipShipFirstCollided, int *indexShipShipFirstCollided2, int *typeFirstEvent) {
     
   ShipShipRootStruct ssrs;
-  
+
+  // Only ships whose swept circles overlap this sub-step can collide. The
+  // pairs come back in the same order as a nested loop over all ships.
+  shipSweep_->setNumBoxes(numShips);
   for (int ii = 0; ii < numShips; ii++) {
     if (ships[ii]->alive) {
       ShipMoveData *smd = &(shipData[ii]);
-      for (int jj = 0; jj < ii; jj++) {
-        if (ships[jj]->alive) {
-          ShipMoveData *smd2 = &(shipData[jj]);
-          // Predicted rough movement has to be recalculated here because we always
-          // update the actual time step
-          double coordsT[6], coordsT2[6];
-          pushFun_(*timeToFirstEvent, smd->coords, coordsT);
-          pushFun_(*timeToFirstEvent, smd2->coords, coordsT2);
-          smd->nextCirc->setPosition(coordsT[0], coordsT[1]);
-          smd2->nextCirc->setPosition(coordsT2[0], coordsT2[1]);
-          if (smd->nextCirc->overlaps(smd2->nextCirc)) {
-            double tColl;
-            double tStart[2] = {0., *timeToFirstEvent};
-            ssrs.smd = smd;
-            ssrs.smd2 = smd2;
-            ssrs.pushFun = pushFun_;  
-            int ret = newtonBisect(shipShipRootFun, tStart, &ssrs, &tColl, DEFAULT_EPS, DEFAULT_EPS);
-            if (ret != 1) {
-              std::cout << "ship-ship debug: " << ret << " " << tColl << "\n";
-            }
-            if (tColl < (*timeToFirstEvent)) {
-              *timeToFirstEvent = tColl;
-              *typeFirstEvent = 1;
-              *indexShipShipFirstCollided = ii;
-              *indexShipShipFirstCollided2 = jj;
-            }
-          }
-        }
+      double reach = SHIP_RADIUS + maxMoveDistance(smd, *timeToFirstEvent);
+      shipSweep_->setBox(ii, smd->coords[0] - reach, smd->coords[1] - reach,
+                         smd->coords[0] + reach, smd->coords[1] + reach);
+    } else {
+      shipSweep_->disableBox(ii);
+    }
+  }
+  int numPairs = shipSweep_->findPairs();
+  int *pairs = shipSweep_->getPairs();
+
+  for (int kk = 0; kk < numPairs; kk++) {
+    int ii = pairs[kk * 2];
+    int jj = pairs[kk * 2 + 1];
+    ShipMoveData *smd = &(shipData[ii]);
+    ShipMoveData *smd2 = &(shipData[jj]);
+    // Predicted rough movement has to be recalculated here because we always
+    // update the actual time step
+    double coordsT[6], coordsT2[6];
+    pushFun_(*timeToFirstEvent, smd->coords, coordsT);
+    pushFun_(*timeToFirstEvent, smd2->coords, coordsT2);
+    smd->nextCirc->setPosition(coordsT[0], coordsT[1]);
+    smd2->nextCirc->setPosition(coordsT2[0], coordsT2[1]);
+    if (smd->nextCirc->overlaps(smd2->nextCirc)) {
+      double tColl;
+      double tStart[2] = {0., *timeToFirstEvent};
+      ssrs.smd = smd;
+      ssrs.smd2 = smd2;
+      ssrs.pushFun = pushFun_;  
+      int ret = newtonBisect(shipShipRootFun, tStart, &ssrs, &tColl, DEFAULT_EPS, DEFAULT_EPS);
+      if (ret != 1) {
+        std::cout << "ship-ship debug: " << ret << " " << tColl << "\n";
       }
+      if (tColl < (*timeToFirstEvent)) {
+        *timeToFirstEvent = tColl;
+        *typeFirstEvent = 1;
+        *indexShipShipFirstCollided = ii;
+        *indexShipShipFirstCollided2 = jj;
+      }
+    }
+  }
+}
+
+// Upper bound on how far a ship can move in time dt from its current state.
+// Speed never exceeds momentum, relativistic or not, and momentum grows at most
+// linearly with the thruster force. Padded a bit for rounding.
+double Stage::maxMoveDistance(ShipMoveData *smd, double dt) {
+  double momentum = sqrt(square(smd->coords[4]) + square(smd->coords[5]));
+  double force = sqrt(square(smd->coords[6]) + square(smd->coords[7]));
+  return 1. + dt * (momentum + (0.5 * force * dt));
+}
+
+// Makes sure the scratch space for moveAndCheckCollisions can hold numShips
+// ships. It only grows, so after the first tick this never allocates.
+void Stage::reserveCollisionScratch(int numShips) {
+  if (numShips <= numScratchShips_) {
+    return;
+  }
+  freeCollisionScratch();
+  numScratchShips_ = numShips;
+  shipData_ = new ShipMoveData[numShips];
+  for (int x = 0; x < numShips; x++) {
+    shipData_[x].circ = new Circle2D(0, 0, SHIP_RADIUS);
+    shipData_[x].nextCirc = new Circle2D(0, 0, SHIP_RADIUS);
+  }
+  laserHits_ = new bool[numShips * numShips];
+  torpedoHits_ = new bool[numShips * numShips];
+  wasAlive_ = new bool[numShips];
+  destroyers_ = new Ship*[numShips];
+  tickAllocations_ += 5 + (2 * numShips);
+  shipKinematics_->reserve(numShips);
+}
+
+void Stage::freeCollisionScratch() {
+  if (numScratchShips_ > 0) {
+    for (int x = 0; x < numScratchShips_; x++) {
+      delete shipData_[x].circ;
+      delete shipData_[x].nextCirc;
     }
+    delete[] shipData_;
+    delete[] laserHits_;
+    delete[] torpedoHits_;
+    delete[] wasAlive_;
+    delete[] destroyers_;
+    numScratchShips_ = 0;
   }
 }
 
+// Heap allocations made by the last call to moveAndCheckCollisions. Should be
+// zero except when the number of ships or collision candidates goes up. The
+// tickallocs bench checks this against a count of calls to operator new.
+int Stage::getTickAllocations() {
+  return tickAllocations_;
+}
+
 void Stage::moveAndCheckCollisions(
     Ship **oldShips, Ship **ships, int numShips, int gameTime) {
-    
-  ShipMoveData *shipData = new ShipMoveData[numShips];
+  int sweepAllocations = shipSweep_->getAllocations();
+  int rootAllocations = wallRootFinder_->getAllocations();
+  int kinematicsAllocations = shipKinematics_->getAllocations();
+  tickAllocations_ = 0;
+  reserveCollisionScratch(numShips);
+  ShipMoveData *shipData = shipData_;
 
   // Calculate non-collision movement and decide on reasonable sub step.
   int intervals = 1;
@@ -876,16 +1090,14 @@ void Stage::moveAndCheckCollisions(
     Ship *ship = ships[ii];
     ShipMoveData *smd = &shipData[ii];
     smd->initialized = false;
-    smd->circ = 0;
-    smd->nextCirc = 0;
     if (ship->alive) {
       Ship *oldShip = oldShips[ii];
   
       smd->initialized = true;
       ship->hitWall = false;
       ship->hitShip = false;
-      smd->circ = new Circle2D(oldShip->x, oldShip->y, SHIP_RADIUS);
-      smd->nextCirc = new Circle2D(0, 0, SHIP_RADIUS);
+      smd->circ->setPosition(oldShip->x, oldShip->y);
+      smd->nextCirc->setPosition(0, 0);
       
       if (ship->powerEnabled) {
         if (ship->power < ship->thrusterForce*THRUSTER_POWER_USAGE) {
@@ -915,22 +1127,13 @@ void Stage::moveAndCheckCollisions(
 
   double dtSub = 1./intervals;  // Time step of sub steps
   
-  // Logs for laser and torpedo hits and alive ships created outside of sub loop.
-  bool **laserHits = new bool*[numShips];
-  for (int ii = 0; ii < numShips; ii++) {
-    laserHits[ii] = new bool[numShips];
-    for (int jj = 0; jj < numShips; jj++) {
-      laserHits[ii][jj] = false;
-    }
-  }
-  bool **torpedoHits = new bool*[numShips];
-  for (int ii = 0; ii < numShips; ii++) {
-    torpedoHits[ii] = new bool[numShips];
-    for (int jj = 0; jj < numShips; jj++) {
-      torpedoHits[ii][jj] = false;
-    }
-  }
-  bool *wasAlive = new bool[numShips];
+  // Logs for laser and torpedo hits and alive ships kept outside of sub loop.
+  // Hits are flat numShips x numShips matrices, indexed [firing][hit ship].
+  bool *laserHits = laserHits_;
+  bool *torpedoHits = torpedoHits_;
+  bool *wasAlive = wasAlive_;
+  memset(laserHits, 0, numShips * numShips * sizeof(bool));
+  memset(torpedoHits, 0, numShips * numShips * sizeof(bool));
   for (int ii = 0; ii < numShips; ii++) {
     wasAlive[ii] = ships[ii]->alive;
   }
@@ -951,7 +1154,7 @@ void Stage::moveAndCheckCollisions(
       int typeFirstEvent = -1;
 
       // Check for torpedo explosions
-      int indexTorpedoFirstExploded;
+      int indexTorpedoFirstExploded = -1;
       timeToFirstTorpedoExplosion(&timeDo, &indexTorpedoFirstExploded, &typeFirstEvent);
 
       // Check for ship-ship collisions.
@@ -1015,22 +1218,16 @@ void Stage::moveAndCheckCollisions(
   for (int x = 0; x < numShips; x++) {
     Ship *ship = ships[x];
     if (wasAlive[x] && !ship->alive) {
+      Ship **destroyers = destroyers_;
       int numDestroyers = 0;
       for (int y = 0; y < numShips; y++) {
-        if (laserHits[y][x] || torpedoHits[y][x]) {
-          numDestroyers++;
-        }
-      }
-      Ship **destroyers = new Ship*[numDestroyers];
-      int destroyerIndex = 0;
-      for (int y = 0; y < numShips; y++) {
-        if (laserHits[y][x] || torpedoHits[y][x]) {
-          destroyers[destroyerIndex++] = ships[y];
+        if (laserHits[(y * numShips) + x] || torpedoHits[(y * numShips) + x]) {
+          destroyers[numDestroyers++] = ships[y];
         }
       }
       
       for (int y = 0; y < numShips; y++) {
-        if (laserHits[y][x]) {
+        if (laserHits[(y * numShips) + x]) {
           double destroyScore = 1.0 / numDestroyers;
           if (ship->teamIndex == ships[y]->teamIndex) {
             ships[y]->friendlyKills += destroyScore;
@@ -1044,7 +1241,6 @@ void Stage::moveAndCheckCollisions(
         eventHandlers_[z]->handleShipDestroyed(ship, gameTime, destroyers,
                                                numDestroyers);
       }
-      delete destroyers;
     }
   }
   // @ohaas: Kill lasers at walls and clean up dead lasers
@@ -1073,40 +1269,36 @@ void Stage::moveAndCheckCollisions(
     }
   }
 
-  // Delete laser hit logs
-  for (int x = 0; x < numShips; x++) {
-    delete laserHits[x];
-  }
-  delete laserHits;
-  // Delete torpedo hit logs
-  for (int x = 0; x < numShips; x++) {
-    delete torpedoHits[x];
-  }
-  delete torpedoHits;
-  // Delete ship alive logs
-  delete wasAlive;  
-
-  // @ohaas: Clean up temporary ship data
-  for (int x = 0; x < numShips; x++) {
-    ShipMoveData *smd = &(shipData[x]);
-    if (smd->initialized) {
-      delete smd->circ;
-      delete smd->nextCirc;
-    }
-  }
-  delete shipData;
+  tickAllocations_ += shipSweep_->getAllocations() - sweepAllocations;
+  tickAllocations_ += wallRootFinder_->getAllocations() - rootAllocations;
+  tickAllocations_ +=
+      shipKinematics_->getAllocations() - kinematicsAllocations;
 }
 
+// Collisions can change any ship's coords between sub-steps, so we load the
+// live ships into the structure of arrays each time, push them all at once, and
+// copy the results back.
 void Stage::pushShips(Ship **oldShips, Ship **ships, ShipMoveData *shipData,
     int numShips, double dt) {
+  shipKinematics_->clear();
   for (int kk = 0; kk < numShips; kk++) {
     if (ships[kk]->alive) {
-      ShipMoveData *smd = &(shipData[kk]);
-      pushFun_(dt, smd->coords, smd->coords);
-      smd->circ->setPosition(smd->coords[0], smd->coords[1]); 
-      setShipData(oldShips[kk], ships[kk], smd); 
+      shipKinematics_->load(kk, shipData[kk].coords);
     }
   }
+  if (relativistic_) {
+    shipKinematics_->pushRel(dt);
+  } else {
+    shipKinematics_->pushNonRel(dt);
+  }
+  int numMoving = shipKinematics_->getNumShips();
+  for (int x = 0; x < numMoving; x++) {
+    int kk = shipKinematics_->getShipIndex(x);
+    ShipMoveData *smd = &(shipData[kk]);
+    shipKinematics_->store(x, smd->coords);
+    smd->circ->setPosition(smd->coords[0], smd->coords[1]); 
+    setShipData(oldShips[kk], ships[kk], smd); 
+  }
 }
       
 void Stage::pushLasers(double dt) {
@@ -1119,7 +1311,7 @@ void Stage::pushLasers(double dt) {
 }
 
 void Stage::checkLaserShipCollisions(Ship **ships, ShipMoveData *shipData,
-    int numShips, bool **laserHits, int gameTime, bool firstTickLasers) {
+    int numShips, bool *laserHits, int gameTime, bool firstTickLasers) {
     
   for (int ii = 0; ii < numShips; ii++) {
     Ship *ship = ships[ii];
@@ -1134,7 +1326,7 @@ void Stage::checkLaserShipCollisions(Ship **ships, ShipMoveData *shipData,
             && smd->circ->intersects(laserLines_[jj])
             && !laser->dead) {
           int firingShipIndex = laser->shipIndex;
-          laserHits[firingShipIndex][ii] = true;
+          laserHits[(firingShipIndex * numShips) + ii] = true;
           double laserDamage = (ship->energyEnabled ? LASER_DAMAGE : 0);
           double damageScore = (laserDamage / DEFAULT_ENERGY);
           if (ship->teamIndex == ships[firingShipIndex]->teamIndex) {
@@ -1322,6 +1514,7 @@ double Stage::damageShip(Ship *ship, double damage) {
   if (ship->energy <= 0) {
     ship->alive = false;
   }
+  return damage;
 }
                     
 void Stage::timeToFirstTorpedoExplosion(
@@ -1350,7 +1543,7 @@ void Stage::pushTorpedos(double dt) {
 }
 
 void Stage::explodeTorpedo(Ship **oldShips, Ship **ships, ShipMoveData *shipData, int numShips,
-    int torpedoIndex, bool **torpedoHits, int gameTime) {
+    int torpedoIndex, bool *torpedoHits, int gameTime) {
     
   Torpedo *torpedo = torpedos_[torpedoIndex]; // Torpedos index NOT the same as torpedo id
   
@@ -1361,7 +1554,7 @@ void Stage::explodeTorpedo(Ship **oldShips, Ship **ships, ShipMoveData *shipData
       double distSq = square(torpedo->x - smd->coords[0]) + square(torpedo->y - smd->coords[1]);
       if (distSq < square(TORPEDO_BLAST_RADIUS)) {
         int firingShipIndex = torpedo->shipIndex;
-        torpedoHits[firingShipIndex][ii] = true;
+        torpedoHits[(firingShipIndex * numShips) + ii] = true;
         double blastDistance = sqrt(distSq);
         double blastFactor = square(1.0 - (blastDistance / TORPEDO_BLAST_RADIUS));
         double blastForce = blastFactor * TORPEDO_BLAST_FORCE;
@@ -1449,9 +1642,13 @@ void Stage::updateTeamVision(
   }
 }
 
+// Only the walls in grid cells along the line of sight can block it, so in
+// most cases we never look at any walls at all.
 bool Stage::hasVision(Line2D *visionLine) {
-  for (int z = 0; z < numInnerWallLines_; z++) {
-    Line2D* wallLine = innerWallLines_[z];
+  int numNearWalls = innerWallGrid_->getLinesAlong(visionLine->x1(),
+      visionLine->y1(), visionLine->x2(), visionLine->y2(), wallLineIndices_);
+  for (int z = 0; z < numNearWalls; z++) {
+    Line2D* wallLine = innerWallLines_[wallLineIndices_[z]];
     if (wallLine->intersects(visionLine)) {
       return false;
     }
@@ -1459,11 +1656,20 @@ bool Stage::hasVision(Line2D *visionLine) {
   return true;
 }
 
+bool Stage::hasVisionNoGrid(Line2D *visionLine) {
+  for (int z = 0; z < numInnerWallLines_; z++) {
+    if (innerWallLines_[z]->intersects(visionLine)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void Stage::updateShipPosition(Ship *ship, double x, double y) {
   while (isShipInWall(x, y) || isShipInShip(ship->index, x, y)) {
-    x = limit(SHIP_RADIUS, x + (rand() % SHIP_SIZE) - SHIP_RADIUS,
+    x = limit(SHIP_RADIUS, x + (random_->next() % SHIP_SIZE) - SHIP_RADIUS,
               width_ - SHIP_RADIUS);
-    y = limit(SHIP_RADIUS, y + (rand() % SHIP_SIZE) - SHIP_RADIUS,
+    y = limit(SHIP_RADIUS, y + (random_->next() % SHIP_SIZE) - SHIP_RADIUS,
               height_ - SHIP_RADIUS);
   }
   ship->x = x;
@@ -1473,86 +1679,129 @@ void Stage::updateShipPosition(Ship *ship, double x, double y) {
 // @ohaas: Changed laser line such that it's centered around firing origin.
 //         This makes lasers easier or more intuitive to hit for the user in my opinion.
 int Stage::fireLaser(Ship *ship, double heading, int gameTime) {
-  if (ship->laserGunHeat > 0 || numLasers_ >= MAX_LASERS ||
-      (ship->powerEnabled && ship->power < LASER_POWER_USAGE)) {
+  if (!canFireLaser(ship)) {
     return 0;
   } else {
-    double cosHeading = cos(heading);
-    double sinHeading = sin(heading);
-    double dx = cosHeading * LASER_SPEED;
-    double dy = sinHeading * LASER_SPEED;
-    double laserX = ship->x + dx*0.5;
-    double laserY = ship->y + dy*0.5;
-    Line2D laserStartLine(ship->x+dx, ship->y+dy, laserX, laserY);
-    if (hasVision(&laserStartLine)) {
-      if (ship->powerEnabled) {
-        ship->power -= LASER_POWER_USAGE;
-      }
-      Laser *laser = new Laser;
-      laser->id = nextLaserId_++;
-      laser->shipIndex = ship->index;
-      laser->fireTime = gameTime;
-      laser->srcX = ship->x;
-      laser->srcY = ship->y;
-      laser->x = laserX;
-      laser->y = laserY;
-      laser->heading = heading;
-      laser->dx = dx;
-      laser->dy = dy;
-      laser->dead = false;
-      lasers_[numLasers_] = laser;
-      laserLines_[numLasers_++] = new Line2D(
-          laser->x - laser->dx, laser->y - laser->dy, laser->x, laser->y);
+    if (prepareLaser(ship, heading, false)) {
+      addLaser(ship, heading, gameTime);
+    }
+    return 1;
+  }
+}
 
-      for (int z = 0; z < numEventHandlers_; z++) {
-        eventHandlers_[z]->handleShipFiredLaser(ship, laser);
-      }
+bool Stage::canFireLaser(Ship *ship) {
+  return !(ship->laserGunHeat > 0 || numLasers_ >= MAX_LASERS ||
+      (ship->powerEnabled && ship->power < LASER_POWER_USAGE));
+}
+
+// Spends the ship's power for a laser if it would clear the walls, and
+// returns whether it should actually be added to the stage. If other teams
+// may be firing at the same time, we skip the wall grid, since its queries
+// share scratch space.
+bool Stage::prepareLaser(Ship *ship, double heading, bool concurrent) {
+  double dx = cos(heading) * LASER_SPEED;
+  double dy = sin(heading) * LASER_SPEED;
+  double laserX = ship->x + dx*0.5;
+  double laserY = ship->y + dy*0.5;
+  Line2D laserStartLine(ship->x+dx, ship->y+dy, laserX, laserY);
+  if (concurrent ? hasVisionNoGrid(&laserStartLine)
+                 : hasVision(&laserStartLine)) {
+    if (ship->powerEnabled) {
+      ship->power -= LASER_POWER_USAGE;
     }
+    return true;
+  }
+  return false;
+}
 
-    return 1;
+bool Stage::addLaser(Ship *ship, double heading, int gameTime) {
+  if (numLasers_ >= MAX_LASERS) {
+    return false;
+  }
+
+  double cosHeading = cos(heading);
+  double sinHeading = sin(heading);
+  double dx = cosHeading * LASER_SPEED;
+  double dy = sinHeading * LASER_SPEED;
+  Laser *laser = new Laser;
+  laser->id = nextLaserId_++;
+  laser->shipIndex = ship->index;
+  laser->fireTime = gameTime;
+  laser->srcX = ship->x;
+  laser->srcY = ship->y;
+  laser->x = ship->x + dx*0.5;
+  laser->y = ship->y + dy*0.5;
+  laser->heading = heading;
+  laser->dx = dx;
+  laser->dy = dy;
+  laser->dead = false;
+  lasers_[numLasers_] = laser;
+  laserLines_[numLasers_++] = new Line2D(
+      laser->x - laser->dx, laser->y - laser->dy, laser->x, laser->y);
+
+  for (int z = 0; z < numEventHandlers_; z++) {
+    eventHandlers_[z]->handleShipFiredLaser(ship, laser);
   }
+  return true;
 }
 
 int Stage::fireTorpedo(
     Ship *ship, double heading, double distance, int gameTime) {
-  if (ship->torpedoGunHeat > 0 || numTorpedos_ >= MAX_TORPEDOS || 
-      ship->torpedoAmmo <= 0 || 
-      (ship->powerEnabled && ship->power < TORPEDO_POWER_USAGE)) {
+  if (!canFireTorpedo(ship)) {
     return 0;
   } else {
-    ship->torpedoAmmo -= 1;
-    if (ship->powerEnabled) {
-      ship->power -= TORPEDO_POWER_USAGE;
-    }
-    Torpedo *torpedo = new Torpedo;
-    torpedo->id = nextTorpedoId_++;
-    torpedo->shipIndex = ship->index;
-    torpedo->fireTime = gameTime;
-    double cosHeading = cos(heading);
-    double sinHeading = sin(heading);
-    double dx = cosHeading * TORPEDO_SPEED;
-    double dy = sinHeading * TORPEDO_SPEED;
-    torpedo->srcX = ship->x;
-    torpedo->srcY = ship->y;
-    torpedo->x = ship->x;
-    torpedo->y = ship->y;
-    torpedo->heading = heading;
+    prepareTorpedo(ship);
+    addTorpedo(ship, heading, distance, gameTime);
+    return 1;
+  }
+}
+
+bool Stage::canFireTorpedo(Ship *ship) {
+  return !(ship->torpedoGunHeat > 0 || numTorpedos_ >= MAX_TORPEDOS ||
+      ship->torpedoAmmo <= 0 ||
+      (ship->powerEnabled && ship->power < TORPEDO_POWER_USAGE));
+}
+
+void Stage::prepareTorpedo(Ship *ship) {
+  ship->torpedoAmmo -= 1;
+  if (ship->powerEnabled) {
+    ship->power -= TORPEDO_POWER_USAGE;
+  }
+}
+
+bool Stage::addTorpedo(
+    Ship *ship, double heading, double distance, int gameTime) {
+  if (numTorpedos_ >= MAX_TORPEDOS) {
+    return false;
+  }
+
+  Torpedo *torpedo = new Torpedo;
+  torpedo->id = nextTorpedoId_++;
+  torpedo->shipIndex = ship->index;
+  torpedo->fireTime = gameTime;
+  double cosHeading = cos(heading);
+  double sinHeading = sin(heading);
+  double dx = cosHeading * TORPEDO_SPEED;
+  double dy = sinHeading * TORPEDO_SPEED;
+  torpedo->srcX = ship->x;
+  torpedo->srcY = ship->y;
+  torpedo->x = ship->x;
+  torpedo->y = ship->y;
+  torpedo->heading = heading;
 //    // @ohaas: Torpedos explode the latest at outer walls.
 //    double flightTime = getPosMin(-torpedo->x/dx, (width_-torpedo->x)/dx, 
 //                                  -torpedo->y/dy, (height_-torpedo->y)/dy);
 //    torpedo->distance = fmin(TORPEDO_SPEED*flightTime, distance);
-    torpedo->distance = std::min(distance, 2.*std::max(width_, height_));
-    torpedo->dx = dx;
-    torpedo->dy = dy;
-    torpedo->distanceTraveled = 0.;
-    torpedos_[numTorpedos_++] = torpedo;
-
-    for (int z = 0; z < numEventHandlers_; z++) {
-      eventHandlers_[z]->handleShipFiredTorpedo(ship, torpedo);
-    }
+  torpedo->distance = std::min(distance, 2.*std::max(width_, height_));
+  torpedo->dx = dx;
+  torpedo->dy = dy;
+  torpedo->distanceTraveled = 0.;
+  torpedos_[numTorpedos_++] = torpedo;
 
-    return 1;
+  for (int z = 0; z < numEventHandlers_; z++) {
+    eventHandlers_[z]->handleShipFiredTorpedo(ship, torpedo);
   }
+  return true;
 }
 
 Laser** Stage::getLasers() {
@@ -1631,6 +1880,19 @@ Stage::~Stage() {
       delete baseWallLines_[x];
     }
   }
+  if (wallGrid_ != 0) {
+    delete wallGrid_;
+    delete innerWallGrid_;
+  }
+  delete shipSweep_;
+  freeCollisionScratch();
+  delete shipKinematics_;
+  delete wallRootFinder_;
+  if (wallCandidatesCapacity_ > 0) {
+    delete[] wallCandidates_;
+    delete[] wallCandidateTimes_;
+    delete[] wallCandidateStatus_;
+  }
   for (int x = 0; x < numStageTexts_; x++) {
     delete stageTexts_[x]->text;
     delete stageTexts_[x];
@@ -1694,16 +1956,30 @@ void nonRelPushFun(double tt, double* coords0, double* coordsT)  {
 }
 
 void relPushFun(double tt, double* c0, double* cT)  {
-
-  bool inPlace = (c0 == cT);
-  if (inPlace) {
-    c0 = new double[8];
-    for (int ii = 0; ii < 8; ii++) {
-      c0[ii] = cT[ii];
-    }
+  RelPushStart start;
+  relPushStart(c0, &start);
+  relPushFrom(&start, tt, cT);
+}
+
+// Everything relPushFun needs that doesn't depend on the time step, so a ship
+// can be pushed to many different times without redoing it.
+void relPushStart(double* c0, RelPushStart* start) {
+  for (int ii = 0; ii < 8; ii++) {
+    start->coords[ii] = c0[ii];
+  }
+  start->fmag = sqrt(square(c0[6]) + square(c0[7]));
+  if (start->fmag > DEFAULT_EPS) {
+    double p0Sq = square(c0[4]) + square(c0[5]);
+    start->root0 = start->fmag*sqrt(square(SPEED_OF_LIGHT) + p0Sq);
+    start->fac = SPEED_OF_LIGHT/pow(start->fmag,3);
+    double p0f = c0[4]*c0[6] + c0[5]*c0[7];
+    start->p0Cf = c0[4]*c0[7] - c0[5]*c0[6];
+    start->term0 = start->p0Cf*log(p0f + start->root0);
   }
+}
 
-  double p0Sq = square(c0[4]) + square(c0[5]);
+void relPushFrom(RelPushStart* start, double tt, double* cT) {
+  double *c0 = start->coords;
   cT[4] = c0[4] + c0[6]*tt;
   cT[5] = c0[5] + c0[7]*tt;
   
@@ -1712,27 +1988,18 @@ void relPushFun(double tt, double* c0, double* cT)  {
   cT[2] = cT[4]/gamma;
   cT[3] = cT[5]/gamma;
   
-  double fmag = sqrt(square(c0[6]) + square(c0[7]));
-  if (fmag > DEFAULT_EPS) {
-    double root0 = fmag*sqrt(square(SPEED_OF_LIGHT) + p0Sq);
-    double rootT = fmag*sqrt(square(SPEED_OF_LIGHT) + pTSq);
-    double fac = SPEED_OF_LIGHT/pow(fmag,3);
-    double p0f = c0[4]*c0[6] + c0[5]*c0[7];
+  if (start->fmag > DEFAULT_EPS) {
+    double rootT = start->fmag*sqrt(square(SPEED_OF_LIGHT) + pTSq);
     double pTf = cT[4]*c0[6] + cT[5]*c0[7];
-    double p0Cf = c0[4]*c0[7] - c0[5]*c0[6];
-    double term0 = p0Cf*log(p0f + root0);
-    double termT = p0Cf*log(pTf + rootT);
-    cT[0] = c0[0] + fac*(c0[6]*(rootT-root0) + c0[7]*(termT-term0));
-    cT[1] = c0[1] + fac*(c0[7]*(rootT-root0) - c0[6]*(termT-term0));
+    double termT = start->p0Cf*log(pTf + rootT);
+    cT[0] = c0[0] + start->fac*(c0[6]*(rootT-start->root0)
+        + c0[7]*(termT-start->term0));
+    cT[1] = c0[1] + start->fac*(c0[7]*(rootT-start->root0)
+        - c0[6]*(termT-start->term0));
   } else {
     cT[0] = c0[0] + c0[2]*tt;
     cT[1] = c0[1] + c0[3]*tt;
   }
-  
-  if (inPlace) {
-    delete c0;
-  }
-  return;
 }
 
 int shipShipRootFun(double* tt, void* params, double* out) {
@@ -1751,30 +2018,112 @@ int shipShipRootFun(double* tt, void* params, double* out) {
   return 0;
 }
 
-int wallRootFun(double* tt, void* params, double* out) {
+void relWallBatchRootFun(double *xx, int *indices, int numIndices,
+                         void *params, double *ff, double *df) {
 
-  WallRootStruct *wrs = static_cast<WallRootStruct*>(params);
+  WallCandidate *candidates = static_cast<WallCandidate*>(params);
   double coordsT[6];
 
-  wrs->pushFun((*tt), wrs->smd->coords, coordsT);
-    
-  out[0] = wrs->wall->signedDistance(coordsT[0], coordsT[1]) - SHIP_RADIUS;
-  out[1] = wrs->wall->nx()*coordsT[2] + wrs->wall->ny()*coordsT[3];
-  
-  return 0;
+  for (int x = 0; x < numIndices; x++) {
+    int index = indices[x];
+    WallCandidate *candidate = &(candidates[index]);
+    relPushFrom(&(candidate->smd->relStart), xx[index], coordsT);
+    if (candidate->wallEndpoint == 0) {
+      Line2D *wall = candidate->wall;
+      ff[index] = wall->signedDistance(coordsT[0], coordsT[1]) - SHIP_RADIUS;
+      df[index] = wall->nx()*coordsT[2] + wall->ny()*coordsT[3];
+    } else {
+      double dx = coordsT[0] - candidate->xp;
+      double dy = coordsT[1] - candidate->yp;
+      ff[index] = square(dx) + square(dy) - square(SHIP_RADIUS);
+      df[index] = 2.*(dx*coordsT[2] + dy*coordsT[3]);
+    }
+  }
 }
 
-int wallEndpointRootFun(double* tt, void* params, double* out) {
+// Polynomial in t with coefficients from highest to lowest order.
+int polyRootFun(double* tt, void* params, double* out) {
 
-  WallEndpointRootStruct *wers = static_cast<WallEndpointRootStruct*>(params);
-  double coordsT[6];
+  PolyRootStruct *prs = static_cast<PolyRootStruct*>(params);
+  double t = (*tt);
+  double *cc = prs->coeffs;
+
+  out[0] = (((cc[0]*t + cc[1])*t + cc[2])*t + cc[3])*t + cc[4];
+  out[1] = ((4.*cc[0]*t + 3.*cc[1])*t + 2.*cc[2])*t + cc[3];
 
-  wers->pushFun((*tt), wers->smd->coords, coordsT);
-    
-  out[0] = square(coordsT[0]-wers->xp) + square(coordsT[1]-wers->yp) - square(SHIP_RADIUS);
-  out[1] = 2.*((coordsT[0]-wers->xp)*coordsT[2] + (coordsT[1]-wers->yp)*coordsT[3]);
-  
   return 0;
 }
 
+// Without relativity, a ship's distance from a wall is quadratic in time, so we
+// can solve for when it reaches SHIP_RADIUS directly. Returns the same codes as
+// newtonBisect.
+int nonRelWallCollisionTime(
+    ShipMoveData *smd, Line2D *wall, double tMax, double *tColl) {
+
+  double *c0 = smd->coords;
+  PolyRootStruct prs;
+  prs.coeffs[0] = 0.;
+  prs.coeffs[1] = 0.;
+  prs.coeffs[2] = 0.5*(wall->nx()*c0[6] + wall->ny()*c0[7]);
+  prs.coeffs[3] = wall->nx()*c0[4] + wall->ny()*c0[5];
+  prs.coeffs[4] = wall->signedDistance(c0[0], c0[1]) - SHIP_RADIUS;
+
+  double fT[2];
+  polyRootFun(&tMax, &prs, fT);
+  if (prs.coeffs[4]*fT[0] > 0.) {
+    *tColl = (prs.coeffs[4] < 0. ? 0. : tMax);
+    return -1;
+  }
+
+  double t1, t2;
+  solveQuadratic(prs.coeffs[2], prs.coeffs[3], prs.coeffs[4], &t1, &t2);
+  bool found = false;
+  *tColl = tMax;
+  if (t1 >= 0. && t1 <= tMax) {
+    *tColl = t1;
+    found = true;
+  }
+  if (t2 >= 0. && t2 <= *tColl) {
+    *tColl = t2;
+    found = true;
+  }
+  if (found) {
+    return 1;
+  }
+
+  // Rounding put the root just outside the interval.
+  double tStart[2] = {0., tMax};
+  return newtonBisect(polyRootFun, tStart, &prs, tColl, DEFAULT_EPS, DEFAULT_EPS);
+}
+
+// Without relativity, the squared distance from a ship to a point is quartic in
+// time. The general quartic solver iterates on complex roots and is slower than
+// Newton's method, so we just run Newton's method on the polynomial, which is
+// much cheaper to evaluate than pushing the ship.
+int nonRelWallEndpointCollisionTime(
+    ShipMoveData *smd, double xp, double yp, double tMax, double *tColl) {
+
+  // Position relative to the point is a*t^2 + b*t + c.
+  double *c0 = smd->coords;
+  double ax = 0.5*c0[6];
+  double ay = 0.5*c0[7];
+  double bx = c0[4];
+  double by = c0[5];
+  double cx = c0[0] - xp;
+  double cy = c0[1] - yp;
+  PolyRootStruct prs;
+  prs.coeffs[0] = square(ax) + square(ay);
+  prs.coeffs[1] = 2.*(ax*bx + ay*by);
+  prs.coeffs[2] = square(bx) + square(by) + 2.*(ax*cx + ay*cy);
+  prs.coeffs[3] = 2.*(bx*cx + by*cy);
+  prs.coeffs[4] = square(cx) + square(cy) - square(SHIP_RADIUS);
+
+  double tStart[2] = {0., tMax};
+  int ret = newtonBisect(polyRootFun, tStart, &prs, tColl, DEFAULT_EPS, DEFAULT_EPS);
+  if (ret == -1) {
+    *tColl = (prs.coeffs[4] < 0. ? 0. : tMax);
+  }
+  return ret;
+}
+
 
@@ -27,7 +27,12 @@
 #include "bbutil.h"
 #include "circle2d.h"
 #include "line2d.h"
+#include "linegrid.h"
 #include "point2d.h"
+#include "sweepprune.h"
+#include "shipkinematics.h"
+#include "batchroot.h"
+#include "randomgen.h"
 #include "wall.h"
 #include "zone.h"
 #include "eventhandler.h"
@@ -39,22 +44,71 @@
 #define VERTEX_FUDGE        0.0001
 #define MAX_EVENT_HANDLERS  8
 
+// Kinds of user gfx a team can run out of room for, as bits in
+// Team::userGfxOverflows.
+#define USER_GFX_RECTANGLES  1
+#define USER_GFX_LINES       2
+#define USER_GFX_CIRCLES     4
+#define USER_GFX_TEXTS       8
+
+// The parts of a relativistic push that only depend on where the ship starts.
+typedef struct {
+  double coords[8];
+  double fmag;
+  double root0;
+  double fac;
+  double p0Cf;
+  double term0;
+} RelPushStart;
+
 typedef struct {
   bool initialized;
   double coords[8];
   Circle2D *circ;
   Circle2D *nextCirc;
+  RelPushStart relStart; // only set while timing relativistic wall collisions
 } ShipMoveData;
 
+typedef struct {
+  ShipMoveData *smd;
+  Line2D *wall;
+  int shipIndex;
+  int wallIndex;
+  int wallEndpoint; // 0 for the middle of the wall, or 1 or 2 for an endpoint
+  double xp;
+  double yp;
+} WallCandidate;
+
 class Stage {
   char *name_;
   int width_, height_;
   int numWalls_, numWallLines_, numInnerWallLines_;
   int numZones_, numStarts_, numStageShips_, numStageTexts_, startIndex_;
+  RandomGenerator *random_;
   Wall* walls_[MAX_WALLS];
   Line2D* wallLines_[MAX_WALLS * 4];
   Line2D* innerWallLines_[MAX_WALLS * 4];
   Line2D* baseWallLines_[4];
+  LineGrid *wallGrid_; // broadphase for ship-wall collisions
+  LineGrid *innerWallGrid_; // broadphase for line of sight
+  int wallLineIndices_[MAX_WALLS * 4];
+  SweepAndPrune *shipSweep_; // broadphase for ship-ship collisions
+
+  // Scratch space for moveAndCheckCollisions, reused every tick.
+  int numScratchShips_;
+  ShipMoveData *shipData_;
+  bool *laserHits_;
+  bool *torpedoHits_;
+  bool *wasAlive_;
+  Ship **destroyers_;
+  ShipKinematics *shipKinematics_;
+  BatchRootFinder *wallRootFinder_;
+  WallCandidate *wallCandidates_;
+  double *wallCandidateTimes_;
+  int *wallCandidateStatus_;
+  int numWallCandidates_;
+  int wallCandidatesCapacity_;
+  int tickAllocations_;
   Zone* zones_[MAX_ZONES];
   Point2D* starts_[MAX_STARTS];
   char* stageShips_[MAX_STAGE_SHIPS]; // the ships loaded by the stage
@@ -81,6 +135,7 @@ class Stage {
   UserGfxText* gfxTexts_[MAX_USER_TEXTS];
   int numGfxTexts_;
   bool userGfxDisabled_;
+  bool deferUserGfxOverflows_;
   int nextLaserId_;
   int nextTorpedoId_;
 
@@ -94,7 +149,7 @@ class Stage {
   double (*kineticEnergy_)(double, double);
   
   public:
-    Stage(int width, int height);
+    Stage(int width, int height, RandomGenerator *random);
     ~Stage();
     void setName(char *name);
     const char* getName();
@@ -140,6 +195,8 @@ class Stage {
     void setGfxEnabled(bool enabled);
     void disableUserGfx();
     void clearStaleUserGfxs(int gameTime);
+    void setDeferUserGfxOverflows(bool defer);
+    void reportUserGfxOverflows(Team *team);
 
     int addUserGfxRectangle(Team *team, int gameTime, double left,
         double bottom, double width, double height, double rotation,
@@ -177,11 +234,18 @@ class Stage {
         Team **teams, int numTeams, Ship **ships, int numShips);
     void moveAndCheckCollisions(
         Ship **oldShips, Ship **ships, int numShips, int gameTime);
+    int getTickAllocations();
     void updateTeamVision(Team **teams, int numTeams, Ship **ships,
         int numShips, bool **teamVision);
     void updateShipPosition(Ship *ship, double x, double y);
     int fireLaser(Ship *ship, double heading, int gameTime);
+    bool canFireLaser(Ship *ship);
+    bool prepareLaser(Ship *ship, double heading, bool concurrent);
+    bool addLaser(Ship *ship, double heading, int gameTime);
     int fireTorpedo(Ship *ship, double heading, double distance, int gameTime);
+    bool canFireTorpedo(Ship *ship);
+    void prepareTorpedo(Ship *ship);
+    bool addTorpedo(Ship *ship, double heading, double distance, int gameTime);
     Laser** getLasers();
     int getLaserCount();
     Torpedo** getTorpedos();
@@ -191,14 +255,23 @@ class Stage {
     void reset(int time);
   private:
     void checkLaserShipCollisions(Ship **ships, ShipMoveData *shipData,
-        int numShips, bool **laserHits, int gameTime, bool firstTickLasers);
+        int numShips, bool *laserHits, int gameTime, bool firstTickLasers);
     bool isShipInWall(double x, double y);
     bool isShipInShip(int shipIndex, double x, double y);
     void setShipData(Ship *oldShip, Ship *ship, ShipMoveData *shipData);
     bool shipStopped(Ship *ship1, Ship *ship2);
+    double maxMoveDistance(ShipMoveData *shipDatum, double dt);
+    void reserveCollisionScratch(int numShips);
+    WallCandidate* newWallCandidate(ShipMoveData *smd, int shipIndex,
+                                    int wallIndex, int wallEndpoint);
+    void setNextCirc(ShipMoveData *smd, double dt);
+    bool wallCandidateInReach(WallCandidate *candidate);
+    void freeCollisionScratch();
     bool hasVision(Line2D *visionLine);
+    bool hasVisionNoGrid(Line2D *visionLine);
     bool inZone(Ship *ship, Zone *zone);
     bool touchedZone(Ship *oldShip, Ship *ship, Zone *zone);
+    void userGfxOverflow(Team *team, int gfxType);
     void clearStaleUserGfxRectangles(int gameTime);
     void clearStaleUserGfxLines(int gameTime);
     void clearStaleUserGfxCircles(int gameTime);
@@ -212,11 +285,11 @@ class Stage {
     int clearStaleUserGfxTexts(int gameTime, UserGfxText** gfxTexts,
                                int numTexts);
                                
-    double timeToFirstShipWallCollision(
+    void timeToFirstShipWallCollision(
         Ship **ships, ShipMoveData *shipData, int numShips, double *timeToFirstEvent,
         int *indexShipWallFirstCollided, int *indexWallShipFirstCollided,
         int *wallEndpoint, int *typeFirstEvent);
-    double timeToFirstShipShipCollision(
+    void timeToFirstShipShipCollision(
         Ship **ships, ShipMoveData *shipData, int numShips, double *timeToFirstEvent,
         int *indexShipShipFirstCollided, int *indexShipShipFirstCollided2, int *typeFirstEvent);
     void timeToFirstTorpedoExplosion(
@@ -234,7 +307,7 @@ class Stage {
     void pushLasers(double dt);
     void pushTorpedos(double dt);
     void explodeTorpedo(Ship **oldShips, Ship **ships, ShipMoveData *shipData, int numShips,
-                        int torpedoIndex, bool **torpedoHits, int gameTime);
+                        int torpedoIndex, bool *torpedoHits, int gameTime);
     double damageShip(Ship *ship, double damage); // Returns damage actually taken
     
     
@@ -249,6 +322,8 @@ void nonRelVelToMom(double vx, double vy, double *px, double *py);
 double nonRelKinEnergy(double px, double py);
 void nonRelPushFun(double tt, double* coords0, double* coordsT);
 void relPushFun(double tt, double* coords0, double* coordsT);
+void relPushStart(double* coords0, RelPushStart* start);
+void relPushFrom(RelPushStart* start, double tt, double* coordsT);
 
 typedef struct {
   ShipMoveData *smd;
@@ -257,20 +332,17 @@ typedef struct {
 } ShipShipRootStruct;
 int shipShipRootFun(double* tt, void* params, double* out);
 
-typedef struct {
-  ShipMoveData *smd;
-  void (*pushFun)(double, double*, double*);
-  Line2D *wall;
-} WallRootStruct;
-int wallRootFun(double* tt, void* params, double* out);
+void relWallBatchRootFun(double *xx, int *indices, int numIndices,
+                         void *params, double *ff, double *df);
 
 typedef struct {
-  ShipMoveData *smd;
-  void (*pushFun)(double, double*, double*);
-  double xp;
-  double yp;
-} WallEndpointRootStruct;
-int wallEndpointRootFun(double* tt, void* params, double* out);
+  double coeffs[5];
+} PolyRootStruct;
+int polyRootFun(double* tt, void* params, double* out);
+int nonRelWallCollisionTime(
+    ShipMoveData *smd, Line2D *wall, double tMax, double *tColl);
+int nonRelWallEndpointCollisionTime(
+    ShipMoveData *smd, double xp, double yp, double tMax, double *tColl);
 
 
 
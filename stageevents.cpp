@@ -0,0 +1,215 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <string.h>
+#include <algorithm>
+#include "eventarena.h"
+#include "stageevents.h"
+
+extern "C" {
+  #include "lua.h"
+  #include "lauxlib.h"
+}
+
+StageEventEncoder::StageEventEncoder() {
+  capacity_ = STAGE_EVENT_INITIAL_CAPACITY;
+  buffer_ = new char[capacity_];
+  length_ = 0;
+  numTables_ = 0;
+}
+
+StageEventEncoder::~StageEventEncoder() {
+  delete[] buffer_;
+}
+
+// Encodes the value at index in L. Raises a Lua error in L for values that
+// can't be sent, like functions and userdata.
+StageEvent* StageEventEncoder::encode(lua_State *L, int index) {
+  if (index < 0) {
+    index = lua_gettop(L) + index + 1;
+  }
+  length_ = 0;
+  numTables_ = 0;
+  lua_newtable(L);
+  encodeValue(L, index, lua_gettop(L));
+  lua_pop(L, 1);
+
+  StageEvent *stageEvent = new StageEvent;
+  stageEvent->data = new char[length_];
+  memcpy(stageEvent->data, buffer_, length_);
+  stageEvent->length = length_;
+  stageEvent->refCount = 0;
+  return stageEvent;
+}
+
+// The table at seenIndex maps each table we've already encoded to its number.
+void StageEventEncoder::encodeValue(lua_State *L, int index, int seenIndex) {
+  switch (lua_type(L, index)) {
+    case LUA_TNIL:
+      writeTag(STAGE_EVENT_NIL);
+      break;
+    case LUA_TBOOLEAN:
+      writeTag(lua_toboolean(L, index) ? STAGE_EVENT_TRUE : STAGE_EVENT_FALSE);
+      break;
+    case LUA_TNUMBER: {
+      double value = lua_tonumber(L, index);
+      writeTag(STAGE_EVENT_NUMBER);
+      write(&value, sizeof(double));
+      break;
+    }
+    case LUA_TSTRING: {
+      size_t stringLength;
+      const char *value = lua_tolstring(L, index, &stringLength);
+      int length = (int) stringLength;
+      writeTag(STAGE_EVENT_STRING);
+      write(&length, sizeof(int));
+      write(value, length);
+      break;
+    }
+    case LUA_TTABLE: {
+      luaL_checkstack(L, 4, "stage event nested too deeply");
+      lua_pushvalue(L, index);
+      lua_rawget(L, seenIndex);
+      if (!lua_isnil(L, -1)) {
+        int tableNum = (int) lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        writeTag(STAGE_EVENT_TABLE_REF);
+        write(&tableNum, sizeof(int));
+        break;
+      }
+      lua_pop(L, 1);
+      lua_pushvalue(L, index);
+      lua_pushinteger(L, ++numTables_);
+      lua_rawset(L, seenIndex);
+
+      writeTag(STAGE_EVENT_TABLE);
+      lua_pushnil(L);
+      while (lua_next(L, index) != 0) {
+        int top = lua_gettop(L);
+        encodeValue(L, top - 1, seenIndex);
+        encodeValue(L, top, seenIndex);
+        lua_pop(L, 1);
+      }
+      writeTag(STAGE_EVENT_TABLE_END);
+      break;
+    }
+    default:
+      luaL_error(L, "Can't copy type '%s' to send as stage event. %s",
+                 luaL_typename(L, index),
+                 "Valid stage event types: nil, number, string, table, boolean.");
+  }
+}
+
+void StageEventEncoder::write(const void *data, int length) {
+  if (length_ + length > capacity_) {
+    int newCapacity = std::max(capacity_ * 2, length_ + length);
+    char *newBuffer = new char[newCapacity];
+    memcpy(newBuffer, buffer_, length_);
+    delete[] buffer_;
+    buffer_ = newBuffer;
+    capacity_ = newCapacity;
+  }
+  memcpy(&(buffer_[length_]), data, length);
+  length_ += length;
+}
+
+void StageEventEncoder::writeTag(char tag) {
+  write(&tag, 1);
+}
+
+// The table at tablesIndex holds each table we've decoded so far, by number.
+static const char* decodeValue(lua_State *L, const char *data, int tablesIndex,
+                               int *numTables) {
+  char tag = *data++;
+  switch (tag) {
+    case STAGE_EVENT_NIL:
+      lua_pushnil(L);
+      break;
+    case STAGE_EVENT_TRUE:
+    case STAGE_EVENT_FALSE:
+      lua_pushboolean(L, tag == STAGE_EVENT_TRUE);
+      break;
+    case STAGE_EVENT_NUMBER: {
+      double value;
+      memcpy(&value, data, sizeof(double));
+      data += sizeof(double);
+      lua_pushnumber(L, value);
+      break;
+    }
+    case STAGE_EVENT_STRING: {
+      int length;
+      memcpy(&length, data, sizeof(int));
+      data += sizeof(int);
+      lua_pushlstring(L, data, length);
+      data += length;
+      break;
+    }
+    case STAGE_EVENT_TABLE:
+      luaL_checkstack(L, 4, "stage event nested too deeply");
+      lua_newtable(L);
+      lua_pushvalue(L, -1);
+      lua_rawseti(L, tablesIndex, ++(*numTables));
+      while (*data != STAGE_EVENT_TABLE_END) {
+        data = decodeValue(L, data, tablesIndex, numTables);
+        data = decodeValue(L, data, tablesIndex, numTables);
+        lua_rawset(L, -3);
+      }
+      data++;
+      break;
+    case STAGE_EVENT_TABLE_REF: {
+      int tableNum;
+      memcpy(&tableNum, data, sizeof(int));
+      data += sizeof(int);
+      lua_rawgeti(L, tablesIndex, tableNum);
+      break;
+    }
+  }
+  return data;
+}
+
+void pushStageEvent(lua_State *L, StageEvent *stageEvent) {
+  int numTables = 0;
+  lua_newtable(L);
+  int tablesIndex = lua_gettop(L);
+  decodeValue(L, stageEvent->data, tablesIndex, &numTables);
+  lua_remove(L, tablesIndex);
+}
+
+// Queues the event for a team, holding a reference to it until released.
+void addStageEvent(EventArena *stageEvents, StageEvent *stageEvent) {
+  stageEvent->refCount++;
+  *((StageEvent **) stageEvents->allocate()) = stageEvent;
+}
+
+// Drops a team's references to its queued events, deleting any that no other
+// team is still holding. Only call this from the main engine thread.
+void releaseStageEvents(EventArena *stageEvents) {
+  StageEvent **events = (StageEvent **) stageEvents->getEvents();
+  int numEvents = stageEvents->getNumEvents();
+  for (int x = 0; x < numEvents; x++) {
+    StageEvent *stageEvent = events[x];
+    if (--(stageEvent->refCount) == 0) {
+      delete[] stageEvent->data;
+      delete stageEvent;
+    }
+  }
+  stageEvents->reset();
+}
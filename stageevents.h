@@ -0,0 +1,76 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef STAGE_EVENTS_H
+#define STAGE_EVENTS_H
+
+#include "eventarena.h"
+
+extern "C" {
+  #include "lua.h"
+}
+
+#define STAGE_EVENT_NIL          0
+#define STAGE_EVENT_TRUE         1
+#define STAGE_EVENT_FALSE        2
+#define STAGE_EVENT_NUMBER       3
+#define STAGE_EVENT_STRING       4
+#define STAGE_EVENT_TABLE        5
+#define STAGE_EVENT_TABLE_END    6
+#define STAGE_EVENT_TABLE_REF    7
+
+#define STAGE_EVENT_INITIAL_CAPACITY  256
+
+// A value sent by the stage with Admin:sendEvent, encoded once into a flat
+// buffer. Every team it was sent to holds a reference to the same copy, and
+// each one decodes it into its own Lua state only if the ship program asks for
+// its stage events.
+typedef struct {
+  char *data;
+  int length;
+  int refCount;
+} StageEvent;
+
+// Encodes Lua values from the stage's state. Tables that show up more than
+// once in a value are only encoded once, and come out as the same table on
+// the other side. The scratch buffer is reused for every event, so a Lua error
+// partway through encoding doesn't leak anything.
+class StageEventEncoder {
+  char *buffer_;
+  int length_;
+  int capacity_;
+  int numTables_;
+
+  public:
+    StageEventEncoder();
+    ~StageEventEncoder();
+    StageEvent* encode(lua_State *L, int index);
+  private:
+    void encodeValue(lua_State *L, int index, int seenIndex);
+    void write(const void *data, int length);
+    void writeTag(char tag);
+};
+
+extern void pushStageEvent(lua_State *L, StageEvent *stageEvent);
+extern void addStageEvent(EventArena *stageEvents, StageEvent *stageEvent);
+extern void releaseStageEvents(EventArena *stageEvents);
+
+#endif
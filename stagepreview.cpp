@@ -151,7 +151,7 @@ void StagePreview::showPreview(sf::RenderWindow *window, const char *stageName,
   infoSizer_->Clear(true);
   descSizer_->Clear(true);
   
-  BerryBotsEngine *engine = new BerryBotsEngine(0, fileManager_, 0);
+  BerryBotsEngine *engine = new BerryBotsEngine(0, fileManager_, 0, rand());
   Stage *stage = engine->getStage();
   try {
     engine->initStage(getStagesDir().c_str(), stageName, getCacheDir().c_str());
@@ -0,0 +1,163 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <algorithm>
+#include "sweepprune.h"
+
+SweepAndPrune::SweepAndPrune() {
+  numBoxes_ = 0;
+  boxes_ = 0;
+  enabled_ = 0;
+  order_ = 0;
+  active_ = 0;
+  pairKeys_ = 0;
+  pairs_ = 0;
+  numPairs_ = 0;
+  pairsCapacity_ = 0;
+  allocations_ = 0;
+}
+
+void SweepAndPrune::setNumBoxes(int numBoxes) {
+  if (numBoxes == numBoxes_) {
+    return;
+  }
+  if (numBoxes_ > 0) {
+    delete[] boxes_;
+    delete[] enabled_;
+    delete[] order_;
+    delete[] active_;
+  }
+  numBoxes_ = numBoxes;
+  boxes_ = new double[numBoxes_ * 4];
+  enabled_ = new bool[numBoxes_];
+  order_ = new int[numBoxes_];
+  active_ = new int[numBoxes_];
+  allocations_ += 4;
+  for (int x = 0; x < numBoxes_; x++) {
+    enabled_[x] = false;
+    order_[x] = x;
+  }
+}
+
+void SweepAndPrune::setBox(int index, double left, double bottom,
+                           double right, double top) {
+  double *box = &(boxes_[index * 4]);
+  box[0] = left;
+  box[1] = bottom;
+  box[2] = right;
+  box[3] = top;
+  enabled_[index] = true;
+}
+
+void SweepAndPrune::disableBox(int index) {
+  enabled_[index] = false;
+}
+
+// Finds all pairs of enabled boxes that overlap. Each pair is stored as
+// (higher index, lower index) and the pairs are sorted by the higher index,
+// then the lower one, which matches the order of a nested loop over
+// for (i = 0; i < n; i++) { for (j = 0; j < i; j++) { ... } }.
+int SweepAndPrune::findPairs() {
+  for (int x = 1; x < numBoxes_; x++) {
+    int index = order_[x];
+    double left = boxes_[index * 4];
+    int y = x - 1;
+    while (y >= 0 && boxes_[order_[y] * 4] > left) {
+      order_[y + 1] = order_[y];
+      y--;
+    }
+    order_[y + 1] = index;
+  }
+
+  numPairs_ = 0;
+  int numActive = 0;
+  for (int x = 0; x < numBoxes_; x++) {
+    int index = order_[x];
+    if (!enabled_[index]) {
+      continue;
+    }
+    double *box = &(boxes_[index * 4]);
+    int numStillActive = 0;
+    for (int y = 0; y < numActive; y++) {
+      int activeIndex = active_[y];
+      double *activeBox = &(boxes_[activeIndex * 4]);
+      if (activeBox[2] >= box[0]) {
+        active_[numStillActive++] = activeIndex;
+        if (activeBox[1] <= box[3] && activeBox[3] >= box[1]) {
+          addPair(std::max(index, activeIndex), std::min(index, activeIndex));
+        }
+      }
+    }
+    numActive = numStillActive;
+    active_[numActive++] = index;
+  }
+
+  std::sort(pairKeys_, pairKeys_ + numPairs_);
+  for (int x = 0; x < numPairs_; x++) {
+    long long key = pairKeys_[x];
+    pairs_[x * 2] = (int) (key / numBoxes_);
+    pairs_[x * 2 + 1] = (int) (key % numBoxes_);
+  }
+
+  return numPairs_;
+}
+
+int* SweepAndPrune::getPairs() {
+  return pairs_;
+}
+
+// Total number of heap allocations, so callers can check they've stopped.
+int SweepAndPrune::getAllocations() {
+  return allocations_;
+}
+
+// Pairs are kept as a single key while sorting, so that sorting the keys gives
+// the nested loop order.
+void SweepAndPrune::addPair(int index1, int index2) {
+  if (numPairs_ >= pairsCapacity_) {
+    int newCapacity = std::max(64, pairsCapacity_ * 2);
+    long long *newPairKeys = new long long[newCapacity];
+    for (int x = 0; x < numPairs_; x++) {
+      newPairKeys[x] = pairKeys_[x];
+    }
+    if (pairsCapacity_ > 0) {
+      delete[] pairKeys_;
+      delete[] pairs_;
+    }
+    pairKeys_ = newPairKeys;
+    pairs_ = new int[newCapacity * 2];
+    pairsCapacity_ = newCapacity;
+    allocations_ += 2;
+  }
+  pairKeys_[numPairs_++] = (((long long) index1) * numBoxes_) + index2;
+}
+
+SweepAndPrune::~SweepAndPrune() {
+  if (numBoxes_ > 0) {
+    delete[] boxes_;
+    delete[] enabled_;
+    delete[] order_;
+    delete[] active_;
+  }
+  if (pairsCapacity_ > 0) {
+    delete[] pairKeys_;
+    delete[] pairs_;
+  }
+}
@@ -0,0 +1,54 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef SWEEP_PRUNE_H
+#define SWEEP_PRUNE_H
+
+// Sort and sweep broadphase over a fixed number of axis-aligned boxes, used to
+// find which ships might collide during a sub-step. The sort order is kept
+// between calls, and since boxes barely move between collision events, the
+// insertion sort we do each time is close to linear.
+class SweepAndPrune {
+  int numBoxes_;
+  double *boxes_;  // left, bottom, right, top for each box
+  bool *enabled_;
+  int *order_;
+  int *active_;
+  long long *pairKeys_;
+  int *pairs_;
+  int numPairs_;
+  int pairsCapacity_;
+  int allocations_;
+
+  public:
+    SweepAndPrune();
+    ~SweepAndPrune();
+    void setNumBoxes(int numBoxes);
+    void setBox(int index, double left, double bottom, double right,
+                double top);
+    void disableBox(int index);
+    int findPairs();
+    int* getPairs();
+    int getAllocations();
+  private:
+    void addPair(int index1, int index2);
+};
+
+#endif
@@ -0,0 +1,189 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <pthread.h>
+#include <errno.h>
+#include <sys/time.h>
+#include "bblua.h"
+#include "watchdog.h"
+
+#define WATCHDOG_INTERVAL  (PCALL_TIME_LIMIT / WATCHDOG_TICKS) // microseconds
+
+Watchdog *watchdogInstance = 0;
+pthread_once_t watchdogOnce = PTHREAD_ONCE_INIT;
+
+Watchdog::Watchdog() {
+  pthread_mutex_init(&lock_, 0);
+  pthread_cond_init(&timerArmed_, 0);
+  for (int x = 0; x < WATCHDOG_WHEEL_SIZE; x++) {
+    wheel_[x] = 0;
+  }
+  currentTick_ = 0;
+  numArmed_ = 0;
+  running_ = false;
+}
+
+void Watchdog::createInstance() {
+  watchdogInstance = new Watchdog();
+  watchdogInstance->startThread();
+}
+
+// Caller must hold the lock, or be createInstance. If we can't start the
+// thread, arm tries again, and until then Lua calls run without a time limit.
+void Watchdog::startThread() {
+  pthread_t watchdogThread;
+  if (pthread_create(&watchdogThread, 0, Watchdog::run, (void*) this) == 0) {
+    pthread_detach(watchdogThread);
+    running_ = true;
+  }
+}
+
+Watchdog* Watchdog::getInstance() {
+  pthread_once(&watchdogOnce, Watchdog::createInstance);
+  return watchdogInstance;
+}
+
+// A forked child only gets the thread that forked it, so it needs a watchdog
+// of its own. The parent's copy, and whatever state its lock was in, are left
+// behind untouched.
+void Watchdog::resetAfterFork() {
+  pthread_once_t freshOnce = PTHREAD_ONCE_INIT;
+  watchdogOnce = freshOnce;
+  watchdogInstance = 0;
+}
+
+WatchdogTimer* Watchdog::newTimer() {
+  WatchdogTimer *timer = new WatchdogTimer;
+  timer->L = 0;
+  timer->expiration = 0;
+  timer->armed = false;
+  timer->prev = timer->next = 0;
+  return timer;
+}
+
+void Watchdog::deleteTimer(WatchdogTimer *timer) {
+  disarm(timer);
+  delete timer;
+}
+
+// Kills the Lua call running on L if the timer isn't disarmed within
+// PCALL_TIME_LIMIT. Re-arming an armed timer restarts it.
+void Watchdog::arm(WatchdogTimer *timer, lua_State *L) {
+  pthread_mutex_lock(&lock_);
+  if (!running_) {
+    startThread();
+  }
+  if (timer->armed) {
+    unlink(timer);
+    numArmed_--;
+  }
+  timer->L = L;
+  timer->expiration = currentTick_ + WATCHDOG_TICKS + 1;
+  int slot = (int) (timer->expiration & (WATCHDOG_WHEEL_SIZE - 1));
+  timer->prev = 0;
+  timer->next = wheel_[slot];
+  if (wheel_[slot] != 0) {
+    wheel_[slot]->prev = timer;
+  }
+  wheel_[slot] = timer;
+  timer->armed = true;
+  if (numArmed_++ == 0) {
+    pthread_cond_signal(&timerArmed_);
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+// Once this returns, the watchdog won't touch the timer's lua_State.
+void Watchdog::disarm(WatchdogTimer *timer) {
+  pthread_mutex_lock(&lock_);
+  if (timer->armed) {
+    unlink(timer);
+    numArmed_--;
+  }
+  timer->L = 0;
+  pthread_mutex_unlock(&lock_);
+}
+
+// Caller must hold the lock.
+void Watchdog::unlink(WatchdogTimer *timer) {
+  if (timer->prev == 0) {
+    wheel_[timer->expiration & (WATCHDOG_WHEEL_SIZE - 1)] = timer->next;
+  } else {
+    timer->prev->next = timer->next;
+  }
+  if (timer->next != 0) {
+    timer->next->prev = timer->prev;
+  }
+  timer->prev = timer->next = 0;
+  timer->armed = false;
+}
+
+// Caller must hold the lock.
+void Watchdog::expireTimers() {
+  WatchdogTimer *timer = wheel_[currentTick_ & (WATCHDOG_WHEEL_SIZE - 1)];
+  while (timer != 0) {
+    WatchdogTimer *nextTimer = timer->next;
+    if (timer->expiration <= currentTick_) {
+      lua_sethook(timer->L, killHook, LUA_MASKCOUNT, 1);
+      unlink(timer);
+      timer->L = 0;
+      numArmed_--;
+    }
+    timer = nextTimer;
+  }
+}
+
+void addMicroseconds(struct timespec *time, long usecs) {
+  long nsecs = time->tv_nsec + (usecs * 1000);
+  time->tv_sec += nsecs / 1000000000;
+  time->tv_nsec = nsecs % 1000000000;
+}
+
+// Advances the wheel every WATCHDOG_INTERVAL while any timers are armed, and
+// sleeps until one is armed otherwise.
+void *Watchdog::run(void *vargs) {
+  Watchdog *watchdog = (Watchdog *) vargs;
+  struct timespec nextTick;
+  bool ticking = false;
+  pthread_mutex_lock(&watchdog->lock_);
+  while (true) {
+    if (watchdog->numArmed_ == 0) {
+      ticking = false;
+      pthread_cond_wait(&watchdog->timerArmed_, &watchdog->lock_);
+    } else {
+      if (!ticking) {
+        struct timeval now;
+        gettimeofday(&now, 0);
+        nextTick.tv_sec = now.tv_sec;
+        nextTick.tv_nsec = now.tv_usec * 1000;
+        addMicroseconds(&nextTick, WATCHDOG_INTERVAL);
+        ticking = true;
+      }
+      if (pthread_cond_timedwait(&watchdog->timerArmed_, &watchdog->lock_,
+                                 &nextTick) == ETIMEDOUT) {
+        watchdog->currentTick_++;
+        watchdog->expireTimers();
+        addMicroseconds(&nextTick, WATCHDOG_INTERVAL);
+      }
+    }
+  }
+  return 0;
+}
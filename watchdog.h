@@ -0,0 +1,73 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <pthread.h>
+
+extern "C" {
+  #include "lua.h"
+}
+
+// The watchdog checks its timers this many times per PCALL_TIME_LIMIT, so a
+// runaway Lua call is killed after at most 1 + 1 / WATCHDOG_TICKS times the
+// limit.
+#define WATCHDOG_TICKS       8
+#define WATCHDOG_WHEEL_SIZE  16  // must be a power of 2 > WATCHDOG_TICKS
+
+typedef struct WatchdogTimer {
+  lua_State *L;
+  unsigned long expiration;
+  bool armed;
+  struct WatchdogTimer *prev;
+  struct WatchdogTimer *next;
+} WatchdogTimer;
+
+// One watchdog thread, shared by every engine in the process, that kills Lua
+// calls that run longer than PCALL_TIME_LIMIT. Armed timers are kept in a
+// timer wheel, bucketed by the tick they expire on. The thread only wakes up
+// while at least one timer is armed.
+class Watchdog {
+  pthread_mutex_t lock_;
+  pthread_cond_t timerArmed_;
+  WatchdogTimer *wheel_[WATCHDOG_WHEEL_SIZE];
+  unsigned long currentTick_;
+  int numArmed_;
+  bool running_;
+
+  public:
+    static Watchdog* getInstance();
+    static void resetAfterFork();
+    WatchdogTimer* newTimer();
+    void deleteTimer(WatchdogTimer *timer);
+    void arm(WatchdogTimer *timer, lua_State *L);
+    void disarm(WatchdogTimer *timer);
+    static void* run(void *vargs);
+  private:
+    Watchdog();
+    static void createInstance();
+    void startThread();
+    void unlink(WatchdogTimer *timer);
+    void expireTimers();
+};
+
+#endif
@@ -0,0 +1,110 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#include <pthread.h>
+#include "workerpool.h"
+
+WorkerPool::WorkerPool(int numThreads) {
+  numThreads_ = (numThreads < 1) ? 1 : numThreads;
+  job_ = 0;
+  context_ = 0;
+  numJobs_ = nextJob_ = numJobsDone_ = 0;
+  batch_ = 0;
+  quitting_ = false;
+  pthread_mutex_init(&lock_, 0);
+  pthread_cond_init(&jobsQueued_, 0);
+  pthread_cond_init(&jobsDone_, 0);
+
+  threads_ = new pthread_t[numThreads_];
+  workerSettings_ = new WorkerSettings[numThreads_];
+  for (int x = 1; x < numThreads_; x++) {
+    workerSettings_[x].pool = this;
+    workerSettings_[x].workerIndex = x;
+    pthread_create(&(threads_[x]), 0, WorkerPool::worker,
+                   (void*) &(workerSettings_[x]));
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  pthread_mutex_lock(&lock_);
+  quitting_ = true;
+  pthread_cond_broadcast(&jobsQueued_);
+  pthread_mutex_unlock(&lock_);
+  for (int x = 1; x < numThreads_; x++) {
+    pthread_join(threads_[x], 0);
+  }
+  pthread_cond_destroy(&jobsDone_);
+  pthread_cond_destroy(&jobsQueued_);
+  pthread_mutex_destroy(&lock_);
+  delete[] threads_;
+  delete[] workerSettings_;
+}
+
+int WorkerPool::getNumThreads() {
+  return numThreads_;
+}
+
+void WorkerPool::run(WorkerJob job, void *context, int numJobs) {
+  pthread_mutex_lock(&lock_);
+  job_ = job;
+  context_ = context;
+  numJobs_ = numJobs;
+  nextJob_ = numJobsDone_ = 0;
+  batch_++;
+  pthread_cond_broadcast(&jobsQueued_);
+  runJobs(0);
+  while (numJobsDone_ < numJobs_) {
+    pthread_cond_wait(&jobsDone_, &lock_);
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+// Called with lock_ held. Takes jobs until there are none left in this batch.
+void WorkerPool::runJobs(int workerIndex) {
+  while (nextJob_ < numJobs_) {
+    int jobIndex = nextJob_++;
+    pthread_mutex_unlock(&lock_);
+    job_(context_, jobIndex, workerIndex);
+    pthread_mutex_lock(&lock_);
+    if (++numJobsDone_ == numJobs_) {
+      pthread_cond_signal(&jobsDone_);
+    }
+  }
+}
+
+void* WorkerPool::worker(void *vargs) {
+  WorkerSettings *settings = (WorkerSettings *) vargs;
+  WorkerPool *pool = settings->pool;
+  pthread_mutex_lock(&(pool->lock_));
+  unsigned int lastBatch = pool->batch_;
+  while (true) {
+    while (!pool->quitting_ && pool->batch_ == lastBatch) {
+      pthread_cond_wait(&(pool->jobsQueued_), &(pool->lock_));
+    }
+    if (pool->quitting_) {
+      break;
+    }
+    lastBatch = pool->batch_;
+    pool->runJobs(settings->workerIndex);
+  }
+  pthread_mutex_unlock(&(pool->lock_));
+  return 0;
+}
@@ -0,0 +1,64 @@
+/*
+  Copyright (C) 2013 - Voidious
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <pthread.h>
+
+typedef void (*WorkerJob)(void *context, int jobIndex, int workerIndex);
+
+class WorkerPool;
+
+typedef struct {
+  WorkerPool *pool;
+  int workerIndex;
+} WorkerSettings;
+
+// A fixed set of threads for running a batch of independent jobs, like one
+// tick's worth of team run() calls. The calling thread works on the batch
+// too, as worker 0, and run() returns once every job has finished.
+class WorkerPool {
+  pthread_t *threads_;
+  WorkerSettings *workerSettings_;
+  int numThreads_;
+  pthread_mutex_t lock_;
+  pthread_cond_t jobsQueued_;
+  pthread_cond_t jobsDone_;
+  WorkerJob job_;
+  void *context_;
+  int numJobs_;
+  int nextJob_;
+  int numJobsDone_;
+  unsigned int batch_;
+  bool quitting_;
+
+  public:
+    WorkerPool(int numThreads);
+    ~WorkerPool();
+    int getNumThreads();
+    void run(WorkerJob job, void *context, int numJobs);
+    static void* worker(void *vargs);
+  private:
+    void runJobs(int workerIndex);
+};
+
+#endif